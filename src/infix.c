@@ -0,0 +1,232 @@
+#include "rpncalc.h"		/* DS, RPN_PROG, rpn_prog_add */
+#include "infix.h"		/* our decls */
+
+/*
+  Infix to postfix conversion by the shunting-yard algorithm,
+  appending each operand and operator to the program as it comes out
+  rather than building up an RPN string to be parsed again:
+
+  Operands go straight to the program. Operators wait on a stack
+  until one of lower precedence comes along (or equal, for
+  left-associative ones), or a closing parenthesis, and are then
+  popped off to the program. Function names wait under their opening
+  parenthesis, and go out after their last argument.
+*/
+
+enum {
+  INFIX_BINARY,			/* infix operator */
+  INFIX_UNARY,			/* prefix operator */
+  INFIX_PAREN,			/* grouping parenthesis */
+  INFIX_CALL,			/* parenthesis opening a function's args */
+  INFIX_FUNC			/* function waiting for its args */
+};
+
+enum {INFIX_DEPTH = 256};	/* deepest nesting of operators */
+
+/* precedences, low to high */
+enum {
+  PREC_OR = 1,
+  PREC_AND,
+  PREC_SHIFT,
+  PREC_ADD,
+  PREC_MUL,
+  PREC_UNARY,
+  PREC_POW
+};
+
+typedef struct {
+  const char *text;		/* rpncalc operator to emit */
+  int len;
+  int kind;
+  int prec;
+} infix_op;
+
+#define isspace(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+#define islower(c) ((c) >= 'a' && (c) <= 'z')
+#define isupper(c) ((c) >= 'A' && (c) <= 'Z')
+#define isdigit(c) ((c) >= '0' && (c) <= '9')
+
+/*
+  Returns the precedence of the binary operator at 'ptr', or 0 if
+  there isn't one, setting the rpncalc operator it maps to and the
+  number of chars it takes up.
+*/
+static int binary_op(const char *ptr, const char **text, int *len, int *used)
+{
+  *text = ptr, *len = 1, *used = 1;
+
+  switch (*ptr) {
+  case '|':
+    return PREC_OR;
+  case '&':
+    return PREC_AND;
+  case '<':
+  case '>':
+    if (ptr[1] != ptr[0]) return 0;
+    *len = 2, *used = 2;
+    return PREC_SHIFT;
+  case '+':
+  case '-':
+    return PREC_ADD;
+  case '*':
+  case '/':
+    return PREC_MUL;
+  case '%':
+    *text = "mod", *len = 3;
+    return PREC_MUL;
+  case '^':
+    return PREC_POW;
+  }
+
+  return 0;
+}
+
+static int emit(RPN_PROG *prog, const infix_op *op, int base)
+{
+  return rpn_prog_add(prog, op->text, op->len, base);
+}
+
+int rpncalc_infix(DS *ds, const char *ptr, RPN_PROG *prog)
+{
+  infix_op stack[INFIX_DEPTH];
+  infix_op op;
+  const char *start;
+  int next = 0;			/* index of next to push */
+  int operand = 1;		/* expecting an operand, not an operator */
+  int opened = 0;		/* last was a function's opening parenthesis */
+  int called = 0;
+  int base;
+  int prec;
+  int used;
+
+  base = ds_base(ds);
+
+  for (;;) {
+    while (isspace(*ptr)) ptr++;
+    if (0 == *ptr) break;
+    start = ptr;
+    opened = called, called = 0;
+
+    if (isdigit(*ptr) || isupper(*ptr) || '.' == *ptr || '$' == *ptr) {
+      /* a number, with uppercase digits for bases > 10, or an argument */
+      if (! operand) return RPN_ERROR;
+      if ('$' == *ptr) ptr++;
+      while (isdigit(*ptr) || isupper(*ptr) || '.' == *ptr) ptr++;
+      if (0 != rpn_prog_add(prog, start, ptr - start, base)) return RPN_ERROR;
+      operand = 0;
+      continue;
+    }
+
+    if (islower(*ptr) || '?' == *ptr || '=' == *ptr) {
+      /* an rpncalc operator, used as a function or constant */
+      if (! operand) return RPN_ERROR;
+      ptr++;
+      while (islower(*ptr) || isdigit(*ptr)) ptr++;
+      op.text = start, op.len = ptr - start;
+      while (isspace(*ptr)) ptr++;
+      if ('(' == *ptr) {
+	if (next + 2 > INFIX_DEPTH) return RPN_ERROR;
+	op.kind = INFIX_FUNC, op.prec = 0;
+	stack[next++] = op;
+	op.text = ptr, op.len = 1;
+	op.kind = INFIX_CALL;
+	stack[next++] = op;
+	ptr++;
+	called = 1;
+	/* operand stays set for the first arg */
+      } else {
+	if (0 != emit(prog, &op, base)) return RPN_ERROR;
+	operand = 0;
+      }
+      continue;
+    }
+
+    ptr++;
+
+    if ('(' == *start) {
+      if (! operand) return RPN_ERROR;
+      if (next == INFIX_DEPTH) return RPN_ERROR;
+      op.text = start, op.len = 1;
+      op.kind = INFIX_PAREN, op.prec = 0;
+      stack[next++] = op;
+      continue;
+    }
+
+    if (')' == *start || ',' == *start) {
+      if (operand) {
+	/* only a function call with no args can close here */
+	if (')' != *start || ! opened) return RPN_ERROR;
+      }
+      while (next > 0 &&
+	     INFIX_PAREN != stack[next - 1].kind &&
+	     INFIX_CALL != stack[next - 1].kind) {
+	if (0 != emit(prog, &stack[--next], base)) return RPN_ERROR;
+      }
+      if (next == 0) return RPN_ERROR; /* unbalanced parenthesis */
+      if (',' == *start) {
+	/* separates function args, not grouped expressions */
+	if (INFIX_CALL != stack[next - 1].kind) return RPN_ERROR;
+	operand = 1;
+	continue;
+      }
+      if (INFIX_CALL == stack[--next].kind) {
+	/* the function follows its args */
+	if (0 != emit(prog, &stack[--next], base)) return RPN_ERROR;
+      }
+      operand = 0;
+      continue;
+    }
+
+    if (operand) {
+      /* prefix operators */
+      if ('+' == *start) continue;
+      if ('-' == *start) {
+	op.text = "-+", op.len = 2;
+      } else if ('~' == *start) {
+	op.text = start, op.len = 1;
+      } else {
+	return RPN_ERROR;
+      }
+      if (next == INFIX_DEPTH) return RPN_ERROR;
+      op.kind = INFIX_UNARY, op.prec = PREC_UNARY;
+      stack[next++] = op;
+      continue;
+    }
+
+    if ('!' == *start) {
+      /* postfix factorial binds tightest, so goes right out */
+      op.text = start, op.len = 1;
+      if (0 != emit(prog, &op, base)) return RPN_ERROR;
+      continue;
+    }
+
+    prec = binary_op(start, &op.text, &op.len, &used);
+    if (0 == prec) return RPN_ERROR;
+    ptr = start + used;
+    op.kind = INFIX_BINARY, op.prec = prec;
+    /* pop higher precedence, and equal if we're left-associative */
+    while (next > 0 &&
+	   (INFIX_BINARY == stack[next - 1].kind ||
+	    INFIX_UNARY == stack[next - 1].kind) &&
+	   (stack[next - 1].prec > prec ||
+	    (stack[next - 1].prec == prec && PREC_POW != prec))) {
+      if (0 != emit(prog, &stack[--next], base)) return RPN_ERROR;
+    }
+    if (next == INFIX_DEPTH) return RPN_ERROR;
+    stack[next++] = op;
+    operand = 1;
+  }
+
+  if (operand && next > 0) return RPN_ERROR; /* dangling operator */
+
+  while (next > 0) {
+    next--;
+    if (INFIX_BINARY != stack[next].kind &&
+	INFIX_UNARY != stack[next].kind) {
+      return RPN_ERROR;		/* unbalanced parenthesis */
+    }
+    if (0 != emit(prog, &stack[next], base)) return RPN_ERROR;
+  }
+
+  return RPN_OK;
+}
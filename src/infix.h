@@ -0,0 +1,17 @@
+#ifndef INFIX_H
+#define INFIX_H
+
+#include "rpncalc.h"		/* DS, RPN_PROG */
+
+/*
+  Compile an infix expression, e.g., "2 * sin(pi / 4) ^ 2", straight
+  into an RPN program for rpncalc_run(), appending to what's in
+  'prog'. Operators, low to high precedence, are | & << >> + - * / %
+  unary - + ~, and ^, which is right-associative, and postfix !.
+  Anything else with a name is an rpncalc operator, with its arguments
+  given in parentheses in the order they'd be pushed, e.g., atan2(y,
+  x), or with none for constants like pi or rcl.
+ */
+extern int rpncalc_infix(DS *ds, const char *ptr, RPN_PROG *prog);
+
+#endif /* INFIX_H */
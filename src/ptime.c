@@ -1,5 +1,13 @@
 #include "ptime.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_TSC 1
+#include <x86intrin.h>		/* __rdtsc */
+#include <cpuid.h>		/* __get_cpuid */
+#endif
+
+enum {CALIBRATE_NS = 5000000};	/* to measure ticks against */
+
 #ifdef WIN32
 
 #include <windows.h>
@@ -15,6 +23,18 @@ double ptime(void)
   return ((double) t.QuadPart) * 1.0e-7;
 }
 
+long long ptime_ns(void)
+{
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER t;
+
+  if (0 == freq.QuadPart) QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t);
+  /* in two parts, since counts times 1e9 overflow within hours */
+  return (t.QuadPart / freq.QuadPart) * 1000000000LL +
+    (t.QuadPart % freq.QuadPart) * 1000000000LL / freq.QuadPart;
+}
+
 #else
 
 #include <time.h>
@@ -27,5 +47,82 @@ double ptime(void)
   }
   return 0.0;
 }
+
+long long ptime_ns(void)
+{
+  struct timespec tv;
+
+  if (0 == clock_gettime(CLOCK_MONOTONIC, &tv)) {
+    return tv.tv_sec * 1000000000LL + tv.tv_nsec;
+  }
+  return 0;
+}
 #endif
 
+#if HAVE_TSC
+/* 1 if the TSC ticks at the same rate whatever the CPU's clock */
+static int invariant_tsc(void)
+{
+  unsigned int a, b, c, d;
+
+  if (! __get_cpuid(0x80000000, &a, &b, &c, &d) || a < 0x80000007) return 0;
+  __get_cpuid(0x80000007, &a, &b, &c, &d);
+  return (d >> 8) & 1;
+}
+
+/*
+  Found out, and measured, the first time they're wanted, by whichever
+  threads get there first: they all find the same use_tsc, and the
+  first tick_ns measured is the one kept.
+ */
+static int use_tsc = -1;	/* not known yet */
+static double tick_ns;		/* not measured yet */
+
+static int tsc(void)
+{
+  int use = __atomic_load_n(&use_tsc, __ATOMIC_RELAXED);
+
+  if (use < 0) {
+    use = invariant_tsc();
+    __atomic_store_n(&use_tsc, use, __ATOMIC_RELAXED);
+  }
+
+  return use;
+}
+#endif
+
+long long ptime_ticks(void)
+{
+#if HAVE_TSC
+  if (tsc()) return (long long) __rdtsc();
+#endif
+  return ptime_ns();
+}
+
+double ptime_tick_ns(void)
+{
+#if HAVE_TSC
+  long long ns0, ns1, t0, t1;
+  double tick, unset = 0.0;
+
+  __atomic_load(&tick_ns, &tick, __ATOMIC_RELAXED);
+  if (0.0 != tick) return tick;
+  if (! tsc()) return 1.0;
+
+  t0 = ptime_ticks();
+  ns0 = ptime_ns();
+  do {
+    ns1 = ptime_ns();
+  } while (ns1 - ns0 < CALIBRATE_NS);
+  t1 = ptime_ticks();
+  tick = (double) (ns1 - ns0) / (double) (t1 - t0);
+  if (! __atomic_compare_exchange(&tick_ns, &unset, &tick, 0,
+				  __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    tick = unset;		/* another thread's measurement */
+  }
+
+  return tick;
+#else
+  return 1.0;
+#endif
+}
@@ -1,6 +1,34 @@
 #ifndef PTIME_H
 #define PTIME_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  The wall clock, in seconds since the epoch. It's a time of day, and
+  jumps when the clock is set, so time intervals with the ones below.
+ */
 extern double ptime(void);
 
+/*
+  A monotonic clock, in integer nanoseconds from some arbitrary start,
+  unaffected by setting the clock.
+ */
+extern long long ptime_ns(void);
+
+/*
+  The cheapest monotonic counter there is, for timing short intervals:
+  the time stamp counter on x86 processors where it runs at a constant
+  rate, otherwise ptime_ns(). ptime_tick_ns() gives the nanoseconds in
+  a tick, measured against ptime_ns() over a few milliseconds the
+  first time it's called.
+ */
+extern long long ptime_ticks(void);
+extern double ptime_tick_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,576 @@
+/*
+  rpnad.c
+
+  Forward-mode automatic differentiation of compiled programs, see
+  rpnad.h. Each operator is rpncalc_op()'s, computing the same value,
+  along with the chain rule on the derivatives of its operands, which
+  always comes down to the derivatives of the result being a linear
+  combination of theirs, d = a dx + b dy.
+*/
+
+#include <math.h>		/* all math functions */
+#include <float.h>		/* DBL_MIN */
+#include <errno.h>		/* errno */
+#include <limits.h>		/* LLONG_MIN */
+#include <string.h>		/* memset */
+#include "rpncalc.h"		/* RPN_PROG, compute_hash_x, convert_sn_to_d */
+#include "rpnad.h"		/* our decls */
+
+/* as in rpncalc.c */
+static const double CONST_E =  2.7182818284590452354;
+static const double CONST_PI = 3.1415926535897932385;
+static const double CONST_LN10_INV = 0.43429448190325182765;
+static const double CONST_SPEED_OF_LIGHT = 299792458;
+static const double CONV_MI_TO_M = 5280.0 * 12.0 * 0.0254;
+static const double CONV_FT_TO_M = 12.0 * 0.0254;
+static const double CONV_IN_TO_MM = 25.4;
+
+#define DEG_PER_RAD 57.295779513082320875
+#define RAD_PER_DEG 0.017453292519943295770
+#define TODEG(x) ((x) * DEG_PER_RAD)
+#define TORAD(x) ((x) * RAD_PER_DEG)
+#define TOFARENHEIT(c) (9.0/5.0*(c)+32.0)
+#define TOCELSIUS(f) (5.0/9.0*((f)-32.0))
+#define TWO_TO_63 9223372036854775808.0
+
+#define round(x) (x) < 0 ? (int) ((x) - 0.5) : (int) ((x) + 0.5)
+
+int rpn_ad_init(RPN_AD *ad, RPN_DUAL *stack, int size)
+{
+  if (size <= 0) return RPN_ERROR;
+
+  ad->stack = stack;
+  ad->size = size;
+  ad->next = 0;
+  ad->base = 10;
+  ad->angle_unit = 0;		/* radians */
+  memset(&ad->mem, 0, sizeof(ad->mem));
+
+  return RPN_OK;
+}
+
+int rpn_ad_pop(RPN_AD *ad, RPN_DUAL *val)
+{
+  if (ad->next == 0) return RPN_ERROR;
+
+  *val = ad->stack[--ad->next];
+
+  return RPN_OK;
+}
+
+/* r = val, with d = a dx */
+static void lin1(RPN_DUAL *r, double val, double a, const RPN_DUAL *x)
+{
+  int k;
+
+  for (k = 0; k < RPN_AD_WIDTH; k++) r->d[k] = a * x->d[k];
+  r->val = val;
+}
+
+/* r = val, with d = a dx + b dy */
+static void lin2(RPN_DUAL *r, double val, double a, const RPN_DUAL *x, double b, const RPN_DUAL *y)
+{
+  int k;
+
+  for (k = 0; k < RPN_AD_WIDTH; k++) r->d[k] = a * x->d[k] + b * y->d[k];
+  r->val = val;
+}
+
+static int push(RPN_AD *ad, double val)
+{
+  RPN_DUAL *r;
+  int k;
+
+  if (ad->next == ad->size) return RPN_ERROR;
+
+  r = &ad->stack[ad->next++];
+  r->val = val;
+  for (k = 0; k < RPN_AD_WIDTH; k++) r->d[k] = 0.0;
+
+  return RPN_OK;
+}
+
+/* replace the top with 'val', whose derivative w.r.t. it is 'a' */
+static int unary(RPN_AD *ad, double val, double a)
+{
+  RPN_DUAL *x = &ad->stack[ad->next - 1];
+
+  lin1(x, val, a, x);
+
+  return RPN_OK;
+}
+
+/* replace the top two, next and top, with 'val', with derivatives 'a' and 'b' */
+static int binary(RPN_AD *ad, double val, double a, double b)
+{
+  RPN_DUAL *y = &ad->stack[ad->next - 2];
+
+  lin2(y, val, a, y, b, y + 1);
+  ad->next--;
+
+  return RPN_OK;
+}
+
+/* ds_fromtop_int() on a plain double */
+static int toint(double x, long long *val)
+{
+  x = x < 0 ? ceil(x - 0.5) : floor(x + 0.5);
+  if (! (x >= -TWO_TO_63 && x < TWO_TO_63)) return RPN_ERROR;
+  *val = (long long) x;
+
+  return RPN_OK;
+}
+
+/* as in rpncalc.c */
+static int factorial(double x, double *f)
+{
+  double cum = x;
+  int r = round(x);
+
+  if (fabs(x - r) > DBL_MIN) return RPN_ERROR;
+
+  if (r < 0) return RPN_ERROR;
+  if (r < 2) {
+    *f = 1;
+    return RPN_OK;
+  }
+
+  while (r-- > 2) cum *= r;
+  *f = cum;
+  return RPN_OK;
+}
+
+/* sample standard deviation as ds_stddev(), and its derivatives */
+static void stddev(RPN_AD *ad, RPN_DUAL *r)
+{
+  double sumx = 0.0, sumxx = 0.0, mean, s;
+  int n = ad->next;
+  int t, k;
+
+  for (k = 0; k < RPN_AD_WIDTH; k++) r->d[k] = 0.0;
+  r->val = 0.0;
+  if (n < 2) return;
+
+  for (t = 0; t < n; t++) {
+    sumx += ad->stack[t].val;
+    sumxx += ad->stack[t].val * ad->stack[t].val;
+  }
+  mean = sumx / n;
+  s = sqrt((sumxx - 2.0*mean*sumx + n*mean*mean) / (n-1));
+  r->val = s;
+  if (! (s > 0.0)) return;
+
+  /* ds = sum((xi - mean) dxi) / ((n - 1) s) */
+  for (t = 0; t < n; t++) {
+    lin2(r, s, 1.0, r, (ad->stack[t].val - mean) / ((n - 1) * s), &ad->stack[t]);
+  }
+}
+
+static int ad_op(RPN_AD *ad, int hash)
+{
+  RPN_DUAL *x = ad->stack + (ad->next > 0 ? ad->next - 1 : 0); /* top */
+  RPN_DUAL *y = ad->stack + (ad->next > 1 ? ad->next - 2 : 0); /* next */
+  RPN_DUAL *r = ad->stack + ad->next;	/* where a push goes */
+  RPN_DUAL a, b;
+  double ka = ad->angle_unit == 0 ? 1.0 : RAD_PER_DEG; /* d angle/d arg */
+  double kr = ad->angle_unit == 0 ? 1.0 : DEG_PER_RAD; /* d result/d angle */
+  double u, v, w;
+  long long i, j;
+  int n = ad->next;
+  int t;
+
+  switch (hash) {
+    /* no derivatives to worry about */
+  case compute_hash_1('c'):	/* c */
+    ad->next = 0;
+    return RPN_OK;
+  case compute_hash_2('a','c'):	/* ac */
+    memset(&ad->mem, 0, sizeof(ad->mem));
+    ad->next = 0;
+    return RPN_OK;
+  case compute_hash_3('d','e','c'): /* dec */
+    ad->base = 10;
+    return RPN_OK;
+  case compute_hash_3('h','e','x'): /* hex */
+    ad->base = 16;
+    return RPN_OK;
+  case compute_hash_3('b','i','n'): /* bin */
+    ad->base = 2;
+    return RPN_OK;
+  case compute_hash_n('=','b','a',5): /* =base */
+    if (ad->next < 1) return RPN_ERROR;
+    t = x->val;
+    ad->next--;
+    if (t < 2 || t > 36) return RPN_ERROR;
+    ad->base = t;
+    return RPN_OK;
+  case compute_hash_n('?','b','a',5): /* ?base */
+    return push(ad, ad->base);
+  case compute_hash_3('r', 'a', 'd'): /* rad */
+    ad->angle_unit = 0;
+    return RPN_OK;
+  case compute_hash_3('d','e','g'): /* deg */
+    ad->angle_unit = 1;
+    return RPN_OK;
+  case compute_hash_n('f','a','s',4): /* fast */
+  case compute_hash_n('l','i','b',4): /* libm, always here */
+    return RPN_OK;
+
+    /* stack and memory, moving derivatives along with values */
+  case compute_hash_3('d','u','p'): /* dup */
+    if (ad->next == 0 || ad->next == ad->size) return RPN_ERROR;
+    *r = *x;
+    ad->next++;
+    return RPN_OK;
+  case compute_hash_n('s','w','a',4): /* swap */
+    if (ad->next < 2) return RPN_ERROR;
+    a = *x, *x = *y, *y = a;
+    return RPN_OK;
+  case compute_hash_3('r','o','t'): /* rot */
+    if (ad->next < 2) return RPN_OK;
+    a = ad->stack[0];
+    for (t = 0; t < ad->next - 1; t++) ad->stack[t] = ad->stack[t + 1];
+    *x = a;
+    return RPN_OK;
+  case compute_hash_n('d','r','o',4): /* drop */
+  case compute_hash_1('.'):	/* . short for drop */
+    if (ad->next == 0) return RPN_ERROR;
+    ad->next--;
+    return RPN_OK;
+  case compute_hash_n('d','e','p',5): /* depth */
+    return push(ad, ad->next);
+  case compute_hash_3('s','t','o'): /* sto, X->M */
+    if (ad->next < 1) return RPN_ERROR;
+    ad->mem = *x;
+    ad->next--;
+    return RPN_OK;
+  case compute_hash_3('r','c','l'): /* rcl, RCL */
+    if (ad->next == ad->size) return RPN_ERROR;
+    *r = ad->mem;
+    ad->next++;
+    return RPN_OK;
+  case compute_hash_3('s','u','m'): /* sum, M+ */
+    if (ad->next < 1) return RPN_ERROR;
+    lin2(&ad->mem, ad->mem.val + x->val, 1.0, &ad->mem, 1.0, x);
+    ad->next--;
+    return RPN_OK;
+  case compute_hash_3('e','x','c'): /* exc, EXC */
+    if (ad->next < 1) return RPN_ERROR;
+    a = *x, *x = ad->mem, ad->mem = a;
+    return RPN_OK;
+
+    /* the mean and standard deviation of the stack */
+  case compute_hash_3('a','v','g'): /* avg */
+    if (n == 0 || RPN_OK != push(ad, 0.0)) return RPN_ERROR;
+    v = 0.0;
+    for (t = 0; t < n; t++) {
+      v += ad->stack[t].val;
+      lin2(r, 0.0, 1.0, r, 1.0 / n, &ad->stack[t]);
+    }
+    r->val = v / n;
+    return RPN_OK;
+  case compute_hash_3('s','t','d'): /* std */
+    if (n == 0 || n == ad->size) return RPN_ERROR;
+    stddev(ad, r);
+    ad->next++;
+    return RPN_OK;
+  }
+
+  /* the rest take one or two operands */
+  switch (hash) {
+  case compute_hash_2('-','+'):	/* -+ */
+  case compute_hash_2('+','-'):	/* +- */
+  case compute_hash_3('i','n','v'): /* inv */
+  case compute_hash_2('s','q'):	/* sq */
+  case compute_hash_n('s','q','r',4): /* sqrt */
+  case compute_hash_1('!'):	/* ! */
+  case compute_hash_3('s','i','n'): /* sin */
+  case compute_hash_3('c','o','s'): /* cos */
+  case compute_hash_3('t','a','n'): /* tan */
+  case compute_hash_n('s','i','n',4): /* sinh */
+  case compute_hash_n('c','o','s',4): /* cosh */
+  case compute_hash_n('t','a','n',4): /* tanh */
+  case compute_hash_n('a','s','i',4): /* asin */
+  case compute_hash_n('a','c','o',4): /* acos */
+  case compute_hash_n('a','t','a',4): /* atan */
+  case compute_hash_3('e','x','p'): /* exp */
+  case compute_hash_2('l','n'):	/* ln */
+  case compute_hash_3('l','o','g'): /* log */
+  case compute_hash_3('a','b','s'): /* abs */
+  case compute_hash_n('r','o','u',5): /* round */
+  case compute_hash_n('t','o','d',5): /* todeg */
+  case compute_hash_n('t','o','r',5): /* torad */
+  case compute_hash_3('t','o','f'): /* tof */
+  case compute_hash_3('t','o','c'): /* toc */
+  case compute_hash_n('f','l','o',5): /* floor */
+  case compute_hash_n('c','e','i',4): /* ceil */
+  case compute_hash_1('~'):	/* ~ */
+    if (ad->next < 1) return RPN_ERROR;
+    break;
+  case compute_hash_n('a','t','a',5): /* atan2 */
+  case compute_hash_n('l','o','g',4): /* logn */
+  case compute_hash_1('+'):	/* + */
+  case compute_hash_1('-'):	/* - */
+  case compute_hash_1('*'):	/* * */
+  case compute_hash_1('x'):	/* x */
+  case compute_hash_1('/'):	/* / */
+  case compute_hash_3('d','i','v'): /* div */
+  case compute_hash_3('m','o','d'): /* mod */
+  case compute_hash_n('f','m','o',4): /* fmod */
+  case compute_hash_3('p','o','w'): /* pow */
+  case compute_hash_1('^'):	/* ^ short for pow */
+  case compute_hash_2('>','>'):	/* >> */
+  case compute_hash_2('<','<'):	/* << */
+  case compute_hash_1('|'):	/* | */
+  case compute_hash_1('&'):	/* & */
+  case compute_hash_n('t','o','x',4): /* toxy */
+  case compute_hash_n('t','o','r',4): /* tort */
+    if (ad->next < 2) return RPN_ERROR;
+    break;
+  case compute_hash_n('m','i','2',4): /* mi2m */
+    return push(ad, CONV_MI_TO_M);
+  case compute_hash_n('f','t','2',4): /* ft2m */
+    return push(ad, CONV_FT_TO_M);
+  case compute_hash_n('i','n','2',5): /* in2mm */
+    return push(ad, CONV_IN_TO_MM);
+  case compute_hash_2('p','i'):	/* pi */
+    return push(ad, CONST_PI);
+  case compute_hash_1('e'):	/* e */
+    return push(ad, CONST_E);
+  case compute_hash_2('v','c'):	/* vc, speed of light */
+    return push(ad, CONST_SPEED_OF_LIGHT);
+  default:
+    /* statistics, random numbers, time, precision, or not an operator */
+    return RPN_ERROR;
+  }
+
+  switch (hash) {
+  case compute_hash_2('-','+'):	/* -+ */
+  case compute_hash_2('+','-'):	/* +- */
+    return unary(ad, -x->val, -1.0);
+  case compute_hash_3('i','n','v'): /* inv */
+    if (! (fabs(x->val) > DBL_MIN)) return RPN_ERROR;
+    v = 1.0 / x->val;
+    return unary(ad, v, -v * v);
+  case compute_hash_2('s','q'):	/* sq */
+    return unary(ad, x->val * x->val, 2.0 * x->val);
+  case compute_hash_n('s','q','r',4): /* sqrt */
+    v = sqrt(x->val);
+    return unary(ad, v, 0.5 / v);
+  case compute_hash_1('!'):	/* ! */
+    return factorial(x->val, &v) || unary(ad, v, 0.0);
+  case compute_hash_3('s','i','n'): /* sin */
+    u = ad->angle_unit == 0 ? x->val : TORAD(x->val);
+    return unary(ad, sin(u), cos(u) * ka);
+  case compute_hash_3('c','o','s'): /* cos */
+    u = ad->angle_unit == 0 ? x->val : TORAD(x->val);
+    return unary(ad, cos(u), -sin(u) * ka);
+  case compute_hash_3('t','a','n'): /* tan */
+    u = ad->angle_unit == 0 ? x->val : TORAD(x->val);
+    v = tan(u);
+    return unary(ad, v, (1.0 + v * v) * ka);
+  case compute_hash_n('s','i','n',4): /* sinh */
+    errno = 0;
+    v = sinh(x->val);
+    return errno != 0 || unary(ad, v, cosh(x->val));
+  case compute_hash_n('c','o','s',4): /* cosh */
+    errno = 0;
+    v = cosh(x->val);
+    return errno != 0 || unary(ad, v, sinh(x->val));
+  case compute_hash_n('t','a','n',4): /* tanh */
+    errno = 0;
+    v = tanh(x->val);
+    return errno != 0 || unary(ad, v, 1.0 - v * v);
+  case compute_hash_n('a','s','i',4): /* asin */
+    errno = 0;
+    v = asin(x->val);
+    if (errno != 0) return RPN_ERROR;
+    w = 1.0 / sqrt(1.0 - x->val * x->val);
+    return unary(ad, ad->angle_unit == 0 ? v : TODEG(v), w * kr);
+  case compute_hash_n('a','c','o',4): /* acos */
+    errno = 0;
+    v = acos(x->val);
+    if (errno != 0) return RPN_ERROR;
+    w = -1.0 / sqrt(1.0 - x->val * x->val);
+    return unary(ad, ad->angle_unit == 0 ? v : TODEG(v), w * kr);
+  case compute_hash_n('a','t','a',4): /* atan */
+    v = atan(x->val);
+    w = 1.0 / (1.0 + x->val * x->val);
+    return unary(ad, ad->angle_unit == 0 ? v : TODEG(v), w * kr);
+  case compute_hash_3('e','x','p'): /* exp */
+    v = exp(x->val);
+    return unary(ad, v, v);
+  case compute_hash_2('l','n'):	/* ln */
+    errno = 0;
+    v = log(x->val);
+    return errno != 0 || unary(ad, v, 1.0 / x->val);
+  case compute_hash_3('l','o','g'): /* log */
+    errno = 0;
+    v = log(x->val);
+    if (errno) return RPN_ERROR;
+    v *= CONST_LN10_INV;
+    return unary(ad, v, CONST_LN10_INV / x->val);
+  case compute_hash_3('a','b','s'): /* abs */
+    return unary(ad, fabs(x->val), x->val > 0 ? 1.0 : x->val < 0 ? -1.0 : 0.0);
+  case compute_hash_n('r','o','u',5): /* round */
+    return unary(ad, round(x->val), 0.0);
+  case compute_hash_n('t','o','d',5): /* todeg */
+    return unary(ad, TODEG(x->val), DEG_PER_RAD);
+  case compute_hash_n('t','o','r',5): /* torad */
+    return unary(ad, TORAD(x->val), RAD_PER_DEG);
+  case compute_hash_3('t','o','f'): /* tof, to farenheit */
+    return unary(ad, TOFARENHEIT(x->val), 9.0/5.0);
+  case compute_hash_3('t','o','c'): /* toc, to celsius */
+    return unary(ad, TOCELSIUS(x->val), 5.0/9.0);
+  case compute_hash_n('f','l','o',5): /* floor */
+    return unary(ad, floor(x->val), 0.0);
+  case compute_hash_n('c','e','i',4): /* ceil */
+    return unary(ad, ceil(x->val), 0.0);
+  case compute_hash_1('~'):	/* ~ */
+    return toint(x->val, &i) || unary(ad, (double) ~i, 0.0);
+
+  case compute_hash_n('a','t','a',5): /* atan2 */
+    v = atan2(y->val, x->val);
+    w = y->val * y->val + x->val * x->val;
+    return binary(ad, ad->angle_unit == 0 ? v : TODEG(v), x->val / w * kr, -y->val / w * kr);
+  case compute_hash_n('l','o','g',4): /* logn */
+    if (y->val <= 0.0 || x->val <= 0.0) return RPN_ERROR;
+    u = log(y->val), w = log(x->val);
+    return binary(ad, u/w, 1.0 / (y->val * w), -u / (w * w * x->val));
+  case compute_hash_1('+'):	/* + */
+    return binary(ad, y->val + x->val, 1.0, 1.0);
+  case compute_hash_1('-'):	/* - */
+    return binary(ad, y->val - x->val, 1.0, -1.0);
+  case compute_hash_1('*'):	/* * */
+  case compute_hash_1('x'):	/* x */
+    return binary(ad, y->val * x->val, x->val, y->val);
+  case compute_hash_1('/'):	/* / */
+    if (! (fabs(x->val) > DBL_MIN)) return RPN_ERROR;
+    v = y->val / x->val;
+    return binary(ad, v, 1.0 / x->val, -v / x->val);
+  case compute_hash_3('d','i','v'): /* div */
+    if (toint(y->val, &i) || toint(x->val, &j)) return RPN_ERROR;
+    if (j == 0 || (j == -1 && i == LLONG_MIN)) return RPN_ERROR;
+    return binary(ad, (double) (i / j), 0.0, 0.0);
+  case compute_hash_3('m','o','d'): /* mod */
+    if (toint(y->val, &i) || toint(x->val, &j)) return RPN_ERROR;
+    if (j == 0) return RPN_ERROR;
+    return binary(ad, (double) (j == -1 ? 0 : i % j), 0.0, 0.0);
+  case compute_hash_n('f','m','o',4): /* fmod */
+    /* y - n x, for the whole number n = trunc(y / x) */
+    v = fmod(y->val, x->val);
+    u = (y->val - v) / x->val;
+    return binary(ad, v, 1.0, -floor(u + 0.5));
+  case compute_hash_3('p','o','w'): /* pow */
+  case compute_hash_1('^'):	/* ^ short for pow */
+    errno = 0;
+    v = pow(y->val, x->val);
+    if (errno) return RPN_ERROR;
+    u = x->val == 0.0 ? 0.0 : x->val * pow(y->val, x->val - 1.0);
+    w = y->val > 0.0 ? v * log(y->val) : 0.0;
+    return binary(ad, v, u, w);
+  case compute_hash_2('>','>'):	/* >> */
+    if (toint(y->val, &i) || toint(x->val, &j)) return RPN_ERROR;
+    if (j < 0 || j > 63) return RPN_ERROR;
+    return binary(ad, (double) (i >> j), 0.0, 0.0);
+  case compute_hash_2('<','<'):	/* << */
+    if (toint(y->val, &i) || toint(x->val, &j)) return RPN_ERROR;
+    if (j < 0 || j > 63) return RPN_ERROR;
+    return binary(ad, (double) (long long) ((unsigned long long) i << j), 0.0, 0.0);
+  case compute_hash_1('|'):	/* | */
+    if (toint(y->val, &i) || toint(x->val, &j)) return RPN_ERROR;
+    return binary(ad, (double) (i | j), 0.0, 0.0);
+  case compute_hash_1('&'):	/* & */
+    if (toint(y->val, &i) || toint(x->val, &j)) return RPN_ERROR;
+    return binary(ad, (double) (i & j), 0.0, 0.0);
+  case compute_hash_n('t','o','x',4): /* toxy, r-theta to x-y */
+    u = ad->angle_unit == 0 ? x->val : TORAD(x->val);
+    v = cos(u), w = sin(u);
+    lin2(&a, y->val * v, v, y, -y->val * w * ka, x);
+    lin2(&b, y->val * w, w, y, y->val * v * ka, x);
+    *y = a, *x = b;
+    return RPN_OK;
+  case compute_hash_n('t','o','r',4): /* tort, x-y to r-theta */
+    v = atan2(x->val, y->val);
+    u = sqrt(y->val * y->val + x->val * x->val);
+    w = u * u;
+    lin2(&a, u, y->val / u, y, x->val / u, x);
+    lin2(&b, ad->angle_unit == 0 ? v : TODEG(v), -x->val / w * kr, y, y->val / w * kr, x);
+    *y = a, *x = b;
+    return RPN_OK;
+  }
+
+  return RPN_ERROR;
+}
+
+/*
+  A token as rpncalc_token() would do it, with arguments seeding the
+  derivatives.
+ */
+static int ad_token(RPN_AD *ad, const RPN_TOKEN *tok, const double *args, int nargs, int first)
+{
+  RPN_DUAL *r;
+  double x;
+  int k;
+
+  if (tok->arg > 0) {
+    if (tok->arg > nargs || RPN_OK != push(ad, args[tok->arg - 1])) return RPN_ERROR;
+    k = tok->arg - 1 - first;
+    if (k >= 0 && k < RPN_AD_WIDTH) {
+      r = &ad->stack[ad->next - 1];
+      r->d[k] = 1.0;
+    }
+    return RPN_OK;
+  }
+
+  if (tok->hash == compute_hash_1('?') || tok->hash == compute_hash_1('q')) {
+    return RPN_ERROR;
+  }
+  if (tok->op > 0) return RPN_ERROR; /* registered ones have no derivatives */
+
+  if (0 == ad_op(ad, tok->hash)) return RPN_OK;
+
+  if (tok->base == ad->base) {
+    x = tok->val;
+  } else if (0 != convert_sn_to_d(tok->text, tok->len, &x, ad->base)) {
+    return RPN_ERROR;
+  }
+
+  return push(ad, x);
+}
+
+int rpn_ad_run(RPN_AD *ad, const RPN_PROG *prog, const double *args, int nargs, int first)
+{
+  const RPN_TOKEN *tok;
+  const RPN_TOKEN *end;
+
+  for (tok = prog->tok, end = tok + prog->num; tok < end; tok++) {
+    if (RPN_OK != ad_token(ad, tok, args, nargs, first)) return RPN_ERROR;
+  }
+
+  return RPN_OK;
+}
+
+int rpncalc_grad(const RPN_PROG *prog, const double *args, int nargs, double *val, double *grad)
+{
+  RPN_DUAL stack[RPN_AD_STACK];
+  RPN_DUAL top;
+  RPN_AD ad;
+  int first = 0;
+  int k;
+
+  do {
+    rpn_ad_init(&ad, stack, RPN_AD_STACK);
+    if (RPN_OK != rpn_ad_run(&ad, prog, args, nargs, first) ||
+	RPN_OK != rpn_ad_pop(&ad, &top)) {
+      return RPN_ERROR;
+    }
+    for (k = 0; k < RPN_AD_WIDTH && first + k < prog->nargs; k++) {
+      grad[first + k] = top.d[k];
+    }
+    first += RPN_AD_WIDTH;
+  } while (first < prog->nargs);
+  *val = top.val;
+
+  return RPN_OK;
+}
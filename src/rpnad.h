@@ -0,0 +1,72 @@
+#ifndef RPNAD_H
+#define RPNAD_H
+
+#include "rpncalc.h"		/* RPN_PROG */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Forward-mode automatic differentiation of compiled RPN programs.
+  Each stack slot is a dual number, a value and its partial
+  derivatives with respect to the program's $n arguments, and every
+  operator carries the derivatives along with the value, so one run
+  gives a function and its gradient, exactly rather than by finite
+  differences.
+
+  The derivatives of up to RPN_AD_WIDTH arguments are carried at once.
+  It's fixed when the library is built, so the loops over them have a
+  known length and vectorize; a program with more arguments takes a
+  run per RPN_AD_WIDTH of them. To change it, build the library and
+  everything using this header with, e.g., -DRPN_AD_WIDTH=16.
+
+  Values are as rpncalc_run_args() computes them, in doubles. The
+  integer and rounding operators (div, mod, the bitwise ones, floor,
+  ceil, round, !) are piecewise constant and have zero derivatives.
+  Statistics, random numbers, time and precision aren't differentiable
+  and are errors here.
+ */
+
+#ifndef RPN_AD_WIDTH
+#define RPN_AD_WIDTH 8
+#endif
+
+enum {RPN_AD_STACK = 64};	/* stack size for rpncalc_grad() */
+
+typedef struct {
+  double val;
+  double d[RPN_AD_WIDTH];	/* partial derivatives */
+} RPN_DUAL;
+
+typedef struct {
+  RPN_DUAL *stack;
+  int size;
+  int next;			/* index of next to push */
+  int base;			/* for numbers not converted ahead */
+  int angle_unit;		/* 0 = rad, 1 = deg */
+  RPN_DUAL mem;			/* 1-value memory */
+} RPN_AD;
+
+extern int rpn_ad_init(RPN_AD *ad, RPN_DUAL *stack, int size);
+extern int rpn_ad_pop(RPN_AD *ad, RPN_DUAL *val);
+
+/*
+  Run a program on a dual stack. Argument $n is the independent
+  variable for derivative d[n - 1 - first] if that's in 0 to
+  RPN_AD_WIDTH - 1, and a constant otherwise, so a wide gradient is
+  done RPN_AD_WIDTH arguments at a time, 'first' at a time.
+ */
+extern int rpn_ad_run(RPN_AD *ad, const RPN_PROG *prog, const double *args, int nargs, int first);
+
+/*
+  The value of a program, and its gradient with respect to all of its
+  arguments, in 'grad[0]' to 'grad[prog->nargs - 1]'.
+ */
+extern int rpncalc_grad(const RPN_PROG *prog, const double *args, int nargs, double *val, double *grad);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RPNAD_H */
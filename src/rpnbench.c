@@ -0,0 +1,1546 @@
+/*
+  rpnbench.c
+
+  Throughput benchmarks for the rpncalc library.
+
+  Usage: rpnbench <type> <iterations> [params ...]
+
+  <type> is one of:
+
+  infix [<infix expression> <equivalent RPN expression>]
+  parse and evaluate an infix expression each time, compared with
+  evaluating the RPN string and running a precompiled program
+
+  rpnd <socket path> [<connections> <batch> <expression>]
+  load-test an rpnd server, with each connection sending a request of
+  'batch' expressions, waiting for the response and sending another,
+  until 'iterations' requests have been answered
+
+  pipeline [<line>]
+  evaluate and print 'iterations' lines, serially and pipelined
+
+  raw [<columns> <expression>]
+  evaluate an expression on 'iterations' rows of numbers, passed as
+  text and as raw binary doubles
+
+  out [<depth>]
+  print 'iterations' results with a stack 'depth' deep, changing only
+  the top each time, with stdio and with the buffered output stage
+
+  stream
+  evaluate one line of 'iterations' additions, all at once, and fed a
+  buffer at a time as if read from a file
+
+  sheet [<cells> <threads>]
+  change an input of a sheet of interdependent formulas 'iterations'
+  times, recomputing all of it and only what depends on the change
+
+  grad [<variables>]
+  the gradient of a function of that many variables, by central
+  differences and by automatic differentiation
+
+  contexts [<live>]
+  create 'live' calcs, a million by default, and then destroy and
+  create one at random 'iterations' times, with and without their
+  statistics and random generators in use, and the bytes per calc
+
+  fastmath
+  the largest error in ULPs, against long double, and the time of
+  libm's and rpnfast.h's functions on 'iterations' random arguments
+  over each range, then of a kinematics formula run both ways
+
+  ops
+  a program of additions, with the built-in + and with a registered
+  operator doing the same, and a registered operator over 'iterations'
+  rows, a row at a time and with its batch form
+
+  mc [<threads>]
+  a Monte Carlo run of a model of four random inputs on 'iterations'
+  samples, on 1, 2, 4, ... threads up to 'threads', one per processor
+  by default, checking that they all give the same results
+
+  snapshot
+  snapshot a calc with everything in use and restore it to another,
+  'iterations' times, checking that the two then carry on the same
+
+  fit [<order> <parts>]
+  a streaming polynomial fit, of order 3 by default, to 'iterations'
+  points, a point at a time and in arrays, and as fits of 'parts'
+  pieces merged, checking that they agree with each other and with
+  the polynomial the points came from
+
+  xform
+  polar to x-y and back, as toxy and tort do it, a point at a time,
+  and over arrays, then spherical to x, y, z and back, and a rotation
+  and translation of 'iterations' points, with the largest errors
+
+  types
+  a formula over columns of 'iterations' rows, and the statistics
+  registers of as many points around 10^8, with rpncalc.hpp in float,
+  double, long double and double-double, and the standard deviation
+  each gets (built with a C++17 compiler)
+
+  sharedstats [<processes>]
+  stat 'iterations' points into a calc's own registers and into a
+  slot of shared ones, then in that many processes at once, 4 by
+  default, while this one reads the sums of all of them as fast as it
+  can, checking that every read is of whole stats, none half done
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <float.h>
+#if HAVE_SYS_UN_H
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#include "rpncalc.h"
+#include "infix.h"
+#include "ptime.h"
+#include "rpnpipe.h"
+#include "rpnraw.h"
+#include "rpnsheet.h"
+#include "rpnad.h"
+#include "rpnfast.h"
+#include "rpnmc.h"
+#include "rpnop.h"
+#include "rpnfit.h"
+#include "rpnxform.h"
+#include "rpnshm.h"
+#if HAVE_SYS_MMAN_H
+#include <sys/wait.h>
+#endif
+#if HAVE_UNISTD_H
+#include <fcntl.h>
+#include "rpnout.h"
+#endif
+
+enum {STACKSIZE = 10};
+
+#if HAVE_CXX17
+extern int bench_types(int num);	/* rpnbenchtypes.cpp */
+#endif
+
+static void report(const char *what, int num, double start, double end)
+{
+  printf("%-24s %10.1f ns/iteration %12.0f iterations/sec\n", what,
+	 (end - start) * 1.0e9 / num, num / (end - start));
+}
+
+static int bench_infix(int num, const char *infix, const char *rpn)
+{
+  DS ds;
+  double stack[STACKSIZE];
+  char buffer[256];
+  RPN_PROG prog;
+  double start;
+  double x, y;
+  int t;
+
+  ds_init(&ds, stack, STACKSIZE);
+  rpn_prog_init(&prog);
+
+  /* check they agree before timing anything */
+  if (0 != rpncalc_infix(&ds, infix, &prog) ||
+      0 != rpncalc_run(&ds, &prog) ||
+      0 != ds_pop(&ds, &x)) {
+    fprintf(stderr, "bad infix expression: %s\n", infix);
+    return 1;
+  }
+  strncpy(buffer, rpn, sizeof(buffer) - 1);
+  buffer[sizeof(buffer) - 1] = 0;
+  if (0 != rpncalc_eval(&ds, buffer) ||
+      0 != ds_pop(&ds, &y)) {
+    fprintf(stderr, "bad RPN expression: %s\n", rpn);
+    return 1;
+  }
+  if (x != y) {
+    fprintf(stderr, "infix gives %.17g, RPN gives %.17g\n", x, y);
+    return 1;
+  }
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    ds_clear(&ds);
+    rpncalc_eval(&ds, buffer);
+  }
+  report("RPN parse + eval", num, start, ptime());
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    ds_clear(&ds);
+    prog.num = 0;
+    rpncalc_infix(&ds, infix, &prog);
+    rpncalc_run(&ds, &prog);
+  }
+  report("infix parse + eval", num, start, ptime());
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    ds_clear(&ds);
+    rpncalc_run(&ds, &prog);
+  }
+  report("compiled eval", num, start, ptime());
+
+  rpn_prog_free(&prog);
+
+  return 0;
+}
+
+static int bench_pipeline(int num, const char *line)
+{
+  DS ds;
+  double stack[STACKSIZE];
+  char buffer[4096];
+  FILE *in, *out1, *out2;
+  double start;
+  int retval;
+  int c1, c2;
+  int t;
+
+  in = tmpfile();
+  out1 = tmpfile();
+  out2 = tmpfile();
+  if (NULL == in || NULL == out1 || NULL == out2) {
+    perror("tmpfile");
+    return 1;
+  }
+  for (t = 0; t < num; t++) {
+    fprintf(in, "%s\n", line);
+  }
+  fflush(in);
+
+  rewind(in);
+  ds_init(&ds, stack, STACKSIZE);
+  start = ptime();
+  while (NULL != fgets(buffer, sizeof(buffer), in)) {
+    retval = rpncalc_eval(&ds, buffer);
+    rpn_print_result(out1, retval, ds.stack, ds.ival, ds.itag, ds.next, ds_base(&ds), ds_prec(&ds));
+  }
+  fflush(out1);
+  report("serial", num, start, ptime());
+
+  rewind(in);
+  ds_init(&ds, stack, STACKSIZE);
+  start = ptime();
+  rpn_pipeline(&ds, in, out2, NULL);
+  report("pipelined", num, start, ptime());
+
+  /* the output should be just the same */
+  rewind(out1);
+  rewind(out2);
+  do {
+    c1 = getc(out1);
+    c2 = getc(out2);
+  } while (c1 == c2 && c1 != EOF);
+  if (c1 != c2) {
+    fprintf(stderr, "serial and pipelined output differ\n");
+    return 1;
+  }
+
+  fclose(in);
+  fclose(out1);
+  fclose(out2);
+
+  return 0;
+}
+
+static int bench_raw(int num, int cols, const char *expr)
+{
+  DS ds;
+  double stack[STACKSIZE];
+  RPN_PROG prog;
+  double *in, *out;
+  char *text, *ptr;
+  char buffer[256];
+  double start;
+  int len;
+  int t, k;
+
+  if (cols <= 0 || cols >= STACKSIZE) return 1;
+
+  in = (double *) malloc((size_t) num * cols * sizeof(double));
+  out = (double *) malloc((size_t) num * sizeof(double));
+  text = (char *) malloc((size_t) num * (cols * 25 + strlen(expr) + 2));
+  if (NULL == in || NULL == out || NULL == text) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  /* the same rows, as doubles and as lines of text */
+  ptr = text;
+  for (t = 0; t < num; t++) {
+    for (k = 0; k < cols; k++) {
+      in[t * cols + k] = t * 0.001 + k + 0.5;
+      ptr += sprintf(ptr, "%.17g ", in[t * cols + k]);
+    }
+    ptr += sprintf(ptr, "%s\n", expr);
+  }
+
+  ds_init(&ds, stack, STACKSIZE);
+  start = ptime();
+  for (ptr = text, t = 0; t < num; t++) {
+    len = strchr(ptr, '\n') - ptr;
+    ds_clear(&ds);
+    rpncalc_evaln(&ds, ptr, len);
+    if (ds.next > 0) {
+      convert_d_to_s(buffer, ds.stack[ds.next - 1], 10, 15, sizeof(buffer));
+    }
+    ptr += len + 1;
+  }
+  report("text rows", num, start, ptime());
+
+  rpn_prog_init(&prog);
+  if (0 != rpncalc_compile(&ds, expr, &prog)) return 1;
+  start = ptime();
+  rpn_raw_rows(&ds, &prog, cols, (unsigned char *) in, num, (unsigned char *) out);
+  report("raw rows", num, start, ptime());
+
+  rpn_prog_free(&prog);
+  free(in);
+  free(out);
+  free(text);
+
+  return 0;
+}
+
+#if HAVE_UNISTD_H
+
+static int bench_out(int num, int depth)
+{
+  RPN_OUT out;
+  double *stack;
+  FILE *f;
+  double start;
+  int fd;
+  int t;
+
+  stack = (double *) malloc(depth * sizeof(double));
+  f = fopen("/dev/null", "w");
+  fd = open("/dev/null", O_WRONLY);
+  if (NULL == stack || NULL == f || fd < 0) {
+    fprintf(stderr, "can't set up\n");
+    return 1;
+  }
+  for (t = 0; t < depth; t++) {
+    stack[t] = t * 1.25 + 0.1;
+  }
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    stack[depth - 1] = t;
+    rpn_print_result(f, RPN_OK, stack, NULL, 0, depth, 10, 15);
+  }
+  fflush(f);
+  report("stdio, every slot", num, start, ptime());
+
+  rpn_out_init(&out, fd);
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    stack[depth - 1] = t;
+    rpn_out_result(&out, RPN_OK, stack, NULL, 0, depth, 10, 15);
+  }
+  rpn_out_flush(&out);
+  report("buffered, cached slots", num, start, ptime());
+  rpn_out_free(&out);
+
+  rpn_out_init(&out, fd);
+  rpn_out_policy(&out, "top");
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    stack[depth - 1] = t;
+    rpn_out_result(&out, RPN_OK, stack, NULL, 0, depth, 10, 15);
+  }
+  rpn_out_flush(&out);
+  report("buffered, top only", num, start, ptime());
+  rpn_out_free(&out);
+
+  fclose(f);
+  close(fd);
+  free(stack);
+
+  return 0;
+}
+
+#endif
+
+static int bench_stream(int num)
+{
+  enum {PIECE = 4096};
+  DS ds;
+  double stack[STACKSIZE];
+  RPN_STREAM st;
+  char *text, *ptr;
+  size_t len, n;
+  double start;
+  double x, y;
+  int t;
+
+  text = (char *) malloc((size_t) num * 6 + 3);
+  if (NULL == text) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  ptr = text + sprintf(text, "0");
+  for (t = 0; t < num; t++) {
+    ptr += sprintf(ptr, " 1.5 +");
+  }
+  len = ptr - text;
+
+  ds_init(&ds, stack, STACKSIZE);
+  start = ptime();
+  rpncalc_evaln(&ds, text, len);
+  report("whole line", num, start, ptime());
+  ds_pop(&ds, &x);
+
+  rpn_stream_init(&st);
+  start = ptime();
+  for (ptr = text; ptr < text + len; ptr += n) {
+    n = text + len - ptr < PIECE ? text + len - ptr : PIECE;
+    rpncalc_feed(&ds, &st, ptr, n);
+  }
+  rpncalc_feed_end(&ds, &st);
+  report("fed in pieces", num, start, ptime());
+  ds_pop(&ds, &y);
+
+  free(text);
+  if (x != y) {
+    fprintf(stderr, "whole and fed results differ\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+static int bench_sheet(int num, int cells, int threads)
+{
+  enum {INPUTS = 50};
+  RPN_SHEET sheet;
+  char name[32];
+  char formula[128];
+  double start;
+  int t, n;
+
+  if (cells <= INPUTS) return 1;
+  rpn_sheet_init(&sheet, threads);
+
+  /* inputs, then cells each using an earlier one and an input */
+  for (t = 0; t < cells; t++) {
+    sprintf(name, "c%d", t);
+    if (t < INPUTS) {
+      sprintf(formula, "%d", t);
+    } else {
+      sprintf(formula, "@c%d @c%d + 0.5 * sin", t - INPUTS, t % INPUTS);
+    }
+    if (RPN_OK != rpn_sheet_set(&sheet, name, formula)) {
+      fprintf(stderr, "bad formula: %s\n", formula);
+      return 1;
+    }
+  }
+  rpn_sheet_recalc(&sheet);
+
+  start = ptime();
+  for (t = n = 0; t < num; t++) {
+    sprintf(formula, "%d", t);
+    rpn_sheet_set(&sheet, "c1", formula);
+    /* as if everything were dirty */
+    for (n = 0; n < sheet.num; n++) {
+      if (! sheet.cell[n].dirty) {
+	sheet.cell[n].dirty = 1;
+	sheet.dirty[sheet.ndirty++] = n;
+      }
+    }
+    n = rpn_sheet_recalc(&sheet);
+  }
+  report("sheet full recalc", num, start, ptime());
+  printf("%d cells recomputed per change\n", n);
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    sprintf(formula, "%d", t);
+    rpn_sheet_set(&sheet, "c1", formula);
+    n = rpn_sheet_recalc(&sheet);
+  }
+  report("sheet incremental", num, start, ptime());
+  printf("%d cells recomputed per change\n", n);
+
+  rpn_sheet_free(&sheet);
+
+  return 0;
+}
+
+static int bench_grad(int num, int vars)
+{
+  DS ds;
+  double stack[STACKSIZE];
+  RPN_PROG prog;
+  char *text, *ptr;
+  double *x, *fd, *ad;
+  double start;
+  double val, up, down, h, err;
+  int t, k;
+
+  if (vars <= 0) return 1;
+  text = (char *) malloc(vars * 40 + 1);
+  x = (double *) malloc(vars * 3 * sizeof(double));
+  if (NULL == text || NULL == x) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  fd = x + vars, ad = fd + vars;
+
+  /* sum of sin(x[k]) * x[k + 1], and exp of the last */
+  ptr = text + sprintf(text, "0");
+  for (k = 1; k < vars; k++) {
+    ptr += sprintf(ptr, " $%d sin $%d * +", k, k + 1);
+  }
+  sprintf(ptr, " $%d exp +", vars);
+  for (k = 0; k < vars; k++) x[k] = 0.1 * (k + 1);
+
+  ds_init(&ds, stack, STACKSIZE);
+  rpn_prog_init(&prog);
+  if (RPN_OK != rpncalc_compile(&ds, text, &prog)) return 1;
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    for (k = 0; k < vars; k++) {
+      h = 1.0e-6 * (x[k] < 0 ? 1 - x[k] : 1 + x[k]);
+      x[k] += h;
+      ds_clear(&ds);
+      rpncalc_run_args(&ds, &prog, x, vars);
+      ds_pop(&ds, &up);
+      x[k] -= 2 * h;
+      ds_clear(&ds);
+      rpncalc_run_args(&ds, &prog, x, vars);
+      ds_pop(&ds, &down);
+      x[k] += h;
+      fd[k] = (up - down) / (2 * h);
+    }
+    ds_clear(&ds);
+    rpncalc_run_args(&ds, &prog, x, vars);
+    ds_pop(&ds, &val);
+  }
+  report("central differences", num, start, ptime());
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    rpncalc_grad(&prog, x, vars, &val, ad);
+  }
+  report("forward-mode AD", num, start, ptime());
+
+  for (k = 0, err = 0; k < vars; k++) {
+    h = fd[k] - ad[k];
+    if (h < 0) h = -h;
+    if (h > err) err = h;
+  }
+  printf("%d variables, %d derivatives at once, largest difference %g\n",
+	 vars, RPN_AD_WIDTH, err);
+
+  rpn_prog_free(&prog);
+  free(text);
+  free(x);
+
+  return 0;
+}
+
+typedef struct {
+  DS ds;
+  double stack[STACKSIZE];
+} bench_ctx;
+
+/* resident memory, where /proc says, or 0 */
+static double resident(void)
+{
+  FILE *f;
+  long size, rss = 0;
+
+  if (NULL == (f = fopen("/proc/self/statm", "r"))) return 0;
+  if (2 != fscanf(f, "%ld %ld", &size, &rss)) rss = 0;
+  fclose(f);
+
+  return rss * 4096.0;
+}
+
+static void report_bytes(const char *what, int live, double rss)
+{
+  printf("%-24s %10.1f bytes/calc, with %lu of pools", what,
+	 sizeof(bench_ctx) + (double) ds_pool_bytes() / live,
+	 (unsigned long) ds_pool_bytes());
+  if (rss > 0) printf(", %.1f resident", rss / live);
+  printf("\n");
+}
+
+static int bench_contexts(int num, int live)
+{
+  bench_ctx *ctx;
+  double start, rss;
+  unsigned long r = 1;
+  int t, k;
+
+  if (live <= 0) return 1;
+  rss = resident();
+  ctx = (bench_ctx *) malloc(live * sizeof(bench_ctx));
+  if (NULL == ctx) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  printf("%lu bytes of calc, the first %lu of them hot, %lu more if eager\n",
+	 (unsigned long) sizeof(DS), (unsigned long) offsetof(DS, stats),
+	 (unsigned long) (DS_INTSIZE * sizeof(long long) + sizeof(DS_STATS) + sizeof(DS_RAND)));
+
+  start = ptime();
+  for (t = 0; t < live; t++) {
+    ds_init(&ctx[t].ds, ctx[t].stack, STACKSIZE);
+    rpncalc_eval(&ctx[t].ds, "1 2 +");
+  }
+  report("create", live, start, ptime());
+  report_bytes("idle", live, resident() - rss);
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    r = r * 1103515245 + 12345;
+    k = (r >> 8) % live;
+    ds_free(&ctx[k].ds);
+    ds_init(&ctx[k].ds, ctx[k].stack, STACKSIZE);
+    rpncalc_eval(&ctx[k].ds, "1 2 +");
+  }
+  report("destroy and create", num, start, ptime());
+
+  /* every calc with statistics and random numbers going */
+  for (t = 0; t < live; t++) {
+    rpncalc_eval(&ctx[t].ds, "c 1 2 stat urand");
+  }
+  report_bytes("statistics, random", live, resident() - rss);
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    r = r * 1103515245 + 12345;
+    k = (r >> 8) % live;
+    ds_free(&ctx[k].ds);
+    ds_init(&ctx[k].ds, ctx[k].stack, STACKSIZE);
+    rpncalc_eval(&ctx[k].ds, "1 2 stat urand");
+  }
+  report("destroy and create them", num, start, ptime());
+
+  start = ptime();
+  for (t = 0; t < live; t++) {
+    ds_free(&ctx[t].ds);
+  }
+  report("destroy", live, start, ptime());
+
+  free(ctx);
+
+  return 0;
+}
+
+static int op_plus(const double *x, double *y)
+{
+  *y = x[0] + x[1];
+  return RPN_OK;
+}
+
+static int op_hypot(const double *x, double *y)
+{
+  *y = sqrt(x[0] * x[0] + x[1] * x[1]);
+  return RPN_OK;
+}
+
+static void op_hypot_batch(double *y, const double *const *x, int n)
+{
+  const double *a = x[0], *b = x[1];
+  int t;
+
+  for (t = 0; t < n; t++) y[t] = sqrt(a[t] * a[t] + b[t] * b[t]);
+}
+
+static int bench_ops(int num)
+{
+  enum {LENGTH = 64};		/* additions in the program */
+  char builtin[8 * LENGTH], registered[8 * LENGTH];
+  RPN_PROG prog[2];
+  DS ds;
+  double stack[STACKSIZE];
+  double *col[2], *y;
+  const char *what[2] = {"built-in +", "registered plus"};
+  double start;
+  int len[2];
+  int op;
+  int t, k;
+
+  rpncalc_register_op("plus", 2, op_plus);
+  rpncalc_register_op("hyp", 2, op_hypot);
+
+  len[0] = sprintf(builtin, "1");
+  len[1] = sprintf(registered, "1");
+  for (t = 0; t < LENGTH; t++) {
+    len[0] += sprintf(builtin + len[0], " 1 +");
+    len[1] += sprintf(registered + len[1], " 1 plus");
+  }
+  ds_init(&ds, stack, STACKSIZE);
+  rpn_prog_init(&prog[0]);
+  rpn_prog_init(&prog[1]);
+  rpncalc_compile(&ds, builtin, &prog[0]);
+  rpncalc_compile(&ds, registered, &prog[1]);
+  for (k = 0; k < 2; k++) {
+    start = ptime();
+    for (t = 0; t < num; t++) {
+      ds_clear(&ds);
+      rpncalc_run(&ds, &prog[k]);
+    }
+    report(what[k], num * LENGTH, start, ptime());
+    rpn_prog_free(&prog[k]);
+  }
+  ds_free(&ds);
+
+  col[0] = (double *) malloc(num * sizeof(double));
+  col[1] = (double *) malloc(num * sizeof(double));
+  y = (double *) malloc(num * sizeof(double));
+  if (NULL == col[0] || NULL == col[1] || NULL == y) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for (t = 0; t < num; t++) {
+    col[0][t] = t;
+    col[1][t] = 0.5 * t;
+  }
+  op = rpncalc_find_op("hyp", 3);
+  start = ptime();
+  rpncalc_op_batch(op, y, (const double *const *) col, num);
+  report("hyp, a row at a time", num, start, ptime());
+  rpncalc_register_batch("hyp", op_hypot_batch);
+  start = ptime();
+  rpncalc_op_batch(op, y, (const double *const *) col, num);
+  report("hyp, batch", num, start, ptime());
+  free(col[0]);
+  free(col[1]);
+  free(y);
+
+  return 0;
+}
+
+static int bench_mc(int num, int maxthreads)
+{
+  static const char *spec[] = {
+    "normal,10,0.5", "uniform,2,3", "gamma,2,1.5", "weibull,1.5,2"
+  };
+  RPN_MC_INPUT input[4];
+  RPN_PROG prog;
+  RPN_MC mc;
+  DS ds;
+  double stack[STACKSIZE];
+  double mean = 0.0, var = 0.0, start;
+  char what[64];
+  int same = 1;
+  int threads;
+  int t;
+
+  ds_init(&ds, stack, STACKSIZE);
+  rpn_prog_init(&prog);
+  rpncalc_compile(&ds, "$1 $2 * $3 sqrt + $4 ln -", &prog);
+  for (t = 0; t < 4; t++) rpn_mc_input(&input[t], spec[t]);
+#if HAVE_UNISTD_H && defined(_SC_NPROCESSORS_ONLN)
+  if (maxthreads <= 0) maxthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (maxthreads <= 0) maxthreads = 1;
+
+  for (threads = 1; ; threads = 2 * threads < maxthreads ? 2 * threads : maxthreads) {
+    rpn_mc_init(&mc, threads);
+    start = ptime();
+    if (RPN_OK != rpn_mc_run(&mc, &prog, input, 4, num)) {
+      fprintf(stderr, "Monte Carlo run failed\n");
+      return 1;
+    }
+    sprintf(what, "samples, %d threads", threads);
+    report(what, num, start, ptime());
+    if (1 == threads) {
+      mean = mc.mean, var = mc.var;
+      printf("mean %.17g var %.17g\n", mean, var);
+    } else if (mc.mean != mean || mc.var != var) {
+      same = 0;
+    }
+    rpn_mc_free(&mc);
+    if (threads == maxthreads) break;
+  }
+  printf("same results on any number of threads: %s\n", same ? "yes" : "NO");
+  rpn_prog_free(&prog);
+  ds_free(&ds);
+
+  return ! same;
+}
+
+static int bench_fit(int num, int order, int parts)
+{
+  enum {POINTS = 1 << 16};	/* generated, and used over again */
+  RPN_FIT whole, part, merged;
+  double coef[RPN_FIT_MAXTERMS], b[RPN_FIT_MAXTERMS], bm[RPN_FIT_MAXTERMS];
+  double *x, *y;
+  double start, r2, err = 0.0, diff = 0.0;
+  unsigned int seed = 1;
+  double xs[RPN_FIT_MAXTERMS];
+  long done, end, n;
+  int t, j;
+
+  if (order < 0 || order >= RPN_FIT_MAXTERMS || parts < 1) {
+    fprintf(stderr, "order from 0 to %d, and at least 1 part\n", RPN_FIT_MAXTERMS - 1);
+    return 1;
+  }
+  x = (double *) malloc(POINTS * sizeof(double));
+  y = (double *) malloc(POINTS * sizeof(double));
+  if (NULL == x || NULL == y) return 1;
+
+  /* y = 1 - 2 x + 3 x^2 - ..., with a little noise, for x in [-1, 1) */
+  for (j = 0; j <= order; j++) {
+    coef[j] = (j % 2 ? -1.0 : 1.0) * (j + 1);
+  }
+  for (t = 0; t < POINTS; t++) {
+    seed = seed * 1103515245 + 12345;
+    x[t] = (seed >> 1) / 1073741824.0 - 1.0;
+    seed = seed * 1103515245 + 12345;
+    y[t] = 1e-6 * ((seed >> 1) / 1073741824.0 - 1.0);
+    for (j = order; j >= 0; j--) {
+      y[t] = y[t] + coef[j] * pow(x[t], j);
+    }
+  }
+
+  rpn_fit_init(&whole, order + 1);
+  start = ptime();
+  for (done = 0; done < num; done++) {
+    xs[0] = x[done % POINTS];
+    for (j = 1; j < order; j++) {
+      xs[j] = xs[j - 1] * xs[0];
+    }
+    rpn_fit_add(&whole, xs, y[done % POINTS]);
+  }
+  report("points, a point at a time", num, start, ptime());
+
+  rpn_fit_init(&whole, order + 1);
+  start = ptime();
+  for (done = 0; done < num; done += n) {
+    n = num - done < POINTS ? num - done : POINTS;
+    rpn_fit_poly_n(&whole, x, y, n);
+  }
+  report("points, in arrays", num, start, ptime());
+
+  start = ptime();
+  if (RPN_OK != rpn_fit_solve(&whole, b, &r2)) {
+    fprintf(stderr, "fit failed\n");
+    return 1;
+  }
+  printf("solved in %.3g us, r2 %.15f\n", 1e6 * (ptime() - start), r2);
+
+  /* the same points, in parts, merged */
+  rpn_fit_init(&merged, order + 1);
+  for (t = 0; t < parts; t++) {
+    rpn_fit_init(&part, order + 1);
+    end = (long) num * (t + 1) / parts;
+    for (done = (long) num * t / parts; done < end; done += n) {
+      n = POINTS - done % POINTS;
+      if (n > end - done) n = end - done;
+      rpn_fit_poly_n(&part, x + done % POINTS, y + done % POINTS, n);
+    }
+    rpn_fit_merge(&merged, &part);
+  }
+  if (RPN_OK != rpn_fit_solve(&merged, bm, NULL)) {
+    fprintf(stderr, "merged fit failed\n");
+    return 1;
+  }
+
+  for (j = 0; j <= order; j++) {
+    printf("b[%d] = %.12f\n", j, b[j]);
+    if (fabs(b[j] - coef[j]) > err) err = fabs(b[j] - coef[j]);
+    if (fabs(bm[j] - b[j]) > diff) diff = fabs(bm[j] - b[j]);
+  }
+  printf("largest error %.3g, merged of %d parts differs by %.3g\n", err, parts, diff);
+  free(x);
+  free(y);
+
+  return ! (err < 1e-4 && diff < 1e-6);
+}
+
+static int bench_xform(int num)
+{
+  RPN_XFORM3 m, rot, move;
+  double *r, *a, *p, *x, *y, *z;
+  double start, err = 0.0, e;
+  int degrees = 1;
+  unsigned int seed = 1;
+  int t;
+
+  r = (double *) malloc(num * sizeof(double));
+  a = (double *) malloc(num * sizeof(double));
+  p = (double *) malloc(num * sizeof(double));
+  x = (double *) malloc(num * sizeof(double));
+  y = (double *) malloc(num * sizeof(double));
+  z = (double *) malloc(num * sizeof(double));
+  if (NULL == r || NULL == a || NULL == p || NULL == x || NULL == y || NULL == z) return 1;
+  for (t = 0; t < num; t++) {
+    seed = seed * 1103515245 + 12345;
+    r[t] = 1.0 + (seed >> 8) / 16777216.0 * 99.0;
+    seed = seed * 1103515245 + 12345;
+    a[t] = (seed >> 8) / 16777216.0 * 180.0;
+    seed = seed * 1103515245 + 12345;
+    p[t] = (seed >> 8) / 16777216.0 * 360.0 - 180.0;
+  }
+
+  /* as toxy and tort do, deciding the angle unit every time */
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    e = degrees ? a[t] * 0.017453292519943295770 : a[t];
+    x[t] = r[t] * cos(e);
+    y[t] = r[t] * sin(e);
+  }
+  report("polar to x-y, a point at a time", num, start, ptime());
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    e = atan2(y[t], x[t]);
+    z[t] = sqrt(x[t] * x[t] + y[t] * y[t]);
+    y[t] = degrees ? e * 57.295779513082320875 : e;
+    x[t] = z[t];
+  }
+  report("x-y to polar, a point at a time", num, start, ptime());
+
+  start = ptime();
+  rpn_polar_to_xy_n(x, y, r, a, num, degrees);
+  report("polar to x-y, arrays", num, start, ptime());
+  start = ptime();
+  rpn_xy_to_polar_n(x, y, x, y, num, degrees);
+  report("x-y to polar, arrays, in place", num, start, ptime());
+  for (t = 0; t < num; t++) {
+    e = fabs(x[t] - r[t]) / r[t] + fabs(y[t] - a[t]) / 180.0;
+    if (e > err) err = e;
+  }
+  printf("polar round trip, largest relative error %.3g\n", err);
+
+  start = ptime();
+  rpn_spherical_to_xyz_n(x, y, z, r, a, p, num, degrees);
+  report("spherical to x, y, z, arrays", num, start, ptime());
+  start = ptime();
+  rpn_xyz_to_spherical_n(x, y, z, x, y, z, num, degrees);
+  report("x, y, z to spherical, arrays, in place", num, start, ptime());
+  err = 0.0;
+  for (t = 0; t < num; t++) {
+    e = fabs(x[t] - r[t]) / r[t] + fabs(y[t] - a[t]) / 180.0;
+    if (a[t] > 1e-3 && a[t] < 180.0 - 1e-3) e += fabs(z[t] - p[t]) / 180.0;
+    if (e > err) err = e;
+  }
+  printf("spherical round trip, largest relative error %.3g\n", err);
+
+  /* move the points along, turn them, and turn them back */
+  rpn_spherical_to_xyz_n(x, y, z, r, a, p, num, degrees);
+  rpn_xform3_rotation(rot, 1.0, 2.0, 3.0, 0.5);
+  rpn_xform3_translation(move, 10.0, -20.0, 30.0);
+  rpn_xform3_compose(m, rot, move);
+  start = ptime();
+  rpn_xform3_apply_n(m, x, y, z, x, y, z, num);
+  report("rotation and translation, arrays", num, start, ptime());
+  rpn_xform3_rotation(rot, 1.0, 2.0, 3.0, -0.5);
+  rpn_xform3_translation(move, -10.0, 20.0, -30.0);
+  rpn_xform3_compose(m, move, rot);
+  rpn_xform3_apply_n(m, x, y, z, x, y, z, num);
+  rpn_xyz_to_spherical_n(x, y, z, x, y, z, num, degrees);
+  err = 0.0;
+  for (t = 0; t < num; t++) {
+    e = fabs(x[t] - r[t]) / r[t];
+    if (e > err) err = e;
+  }
+  printf("transformed and back, largest relative error in r %.3g\n", err);
+
+  free(r);
+  free(a);
+  free(p);
+  free(x);
+  free(y);
+  free(z);
+
+  return ! (err < 1e-12);
+}
+
+/* 1 if the calcs' stacks are the same, bit for bit */
+static int same_stacks(DS *a, DS *b)
+{
+  return a->next == b->next &&
+    0 == memcmp(a->stack, b->stack, a->next * sizeof(double));
+}
+
+static int bench_snapshot(int num)
+{
+  DS a, b;
+  double astack[STACKSIZE], bstack[STACKSIZE];
+  void *buf;
+  size_t size;
+  double start;
+  int same = 1;
+  int t;
+
+  ds_init(&a, astack, STACKSIZE);
+  ds_init(&b, bstack, STACKSIZE);
+  /* stats, a normal left over, a quote, and integers in hex */
+  rpncalc_eval(&a, "3 4 stat 5 7 stat nrand urand c [ dup * 2 - ] hex FF 7 12 deg");
+
+  size = ds_snapshot(&a, NULL, 0);
+  buf = malloc(size);
+  if (NULL == buf) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  printf("%lu bytes of snapshot\n", (unsigned long) size);
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    ds_snapshot(&a, buf, size);
+    if (RPN_OK != ds_restore(&b, buf, size)) {
+      fprintf(stderr, "restore failed\n");
+      return 1;
+    }
+  }
+  report("snapshot and restore", num, start, ptime());
+
+  for (t = 0; t < 1000 && same; t++) {
+    rpncalc_eval(&a, "c nrand urand erand 1 + / dup dup stat mx");
+    rpncalc_eval(&b, "c nrand urand erand 1 + / dup dup stat mx");
+    same = same_stacks(&a, &b);
+  }
+  rpncalc_eval(&a, "c 0 2 solve FF +");
+  rpncalc_eval(&b, "c 0 2 solve FF +");
+  same = same && same_stacks(&a, &b);
+  printf("restored calc carries on the same: %s\n", same ? "yes" : "NO");
+
+  ds_free(&a);
+  ds_free(&b);
+  free(buf);
+
+  return ! same;
+}
+
+#if HAVE_SYS_MMAN_H
+/* 'num' points of (1, 2), so any whole number of them sums exactly */
+static void stat_points(DS *ds, const RPN_PROG *prog, int num)
+{
+  int t;
+
+  for (t = 0; t < num; t++) {
+    ds->next = 0;
+    ds_push(ds, 1.0);
+    ds_push(ds, 2.0);
+    rpncalc_run(ds, prog);
+  }
+}
+
+static int bench_sharedstats(int num, int procs)
+{
+  DS ds;
+  double stack[STACKSIZE];
+  RPN_PROG prog;
+  DS_STATS st;
+  char name[64];
+  double start, end;
+  long reads = 0, torn = 0;
+  int status;
+  int running;
+  int t;
+
+  ds_init(&ds, stack, STACKSIZE);
+  rpn_prog_init(&prog);
+  rpncalc_compile(&ds, "stat", &prog);
+  sprintf(name, "/rpnbench.%ld", (long) getpid());
+
+  start = ptime();
+  stat_points(&ds, &prog, num);
+  report("stat, own registers", num, start, ptime());
+  ds_allclear(&ds);
+  if (RPN_OK != rpn_shm_stats_bind(&ds, name)) {
+    fprintf(stderr, "can't share statistics in %s\n", name);
+    return 1;
+  }
+  start = ptime();
+  stat_points(&ds, &prog, num);
+  report("stat, shared slot", num, start, ptime());
+  ds_allclear(&ds);
+
+  start = ptime();
+  for (t = 0; t < procs; t++) {
+    if (0 == fork()) {
+      ds_free(&ds);		/* the parent's */
+      ds_init(&ds, stack, STACKSIZE);
+      if (RPN_OK != rpn_shm_stats_bind(&ds, name)) _exit(1);
+      stat_points(&ds, &prog, num);
+      ds_free(&ds);
+      _exit(0);
+    }
+  }
+  /* sums of all the slots while they change */
+  for (running = procs; running > 0; ) {
+    rpn_shm_stats_sum(ds.shared, &st);
+    reads++;
+    if (st.sumx != st.n || st.sumy != 2 * st.n || st.sumxy != 2 * st.n) torn++;
+    while (running > 0 && waitpid(-1, &status, WNOHANG) > 0) running--;
+  }
+  end = ptime();
+  report("stat, all processes", procs * num, start, end);
+  report("reads while they ran", reads, start, end);
+
+  rpn_shm_stats_sum(ds.shared, &st);
+  printf("n %.0f of %.0f, %ld of %ld reads torn\n", st.n, (double) procs * num, torn, reads);
+  ds_free(&ds);
+  rpn_shm_stats_unlink(name);
+  rpn_prog_free(&prog);
+
+  return torn || st.n != (double) procs * num;
+}
+#endif	/* HAVE_SYS_MMAN_H */
+
+/* error of 'y' in units in the last place of the true value, 'ref' */
+static double ulps(double y, long double ref)
+{
+  double r = (double) ref;
+  double ulp = nextafter(fabs(r), HUGE_VAL) - fabs(r);
+
+  if (isinf(r) || ulp == 0) return y == r ? 0 : HUGE_VAL;
+  return (double) (fabsl((long double) y - ref) / ulp);
+}
+
+/* sin(x) cos(x), for toxy's sincos */
+static double fast_sincos_prod(double x)
+{
+  double s, c;
+
+  rpn_fast_sincos(x, &s, &c);
+  return s * c;
+}
+
+static double libm_sincos_prod(double x)
+{
+  return sin(x) * cos(x);
+}
+
+static long double sincos_prod_ref(long double x)
+{
+  return sinl(x) * cosl(x);
+}
+
+static int bench_fastmath(int num)
+{
+  static const struct {
+    const char *name;
+    double (*libm)(double);
+    double (*fast)(double);
+    long double (*ref)(long double);
+    void (*array)(double *, const double *, int);
+    double lo, hi;
+    int logscale;			/* uniform in log(x) */
+  } fn[] = {
+    {"sin", sin, rpn_fast_sin, sinl, rpn_fast_sin_n, -3.14159, 3.14159, 0},
+    {"sin", sin, rpn_fast_sin, sinl, rpn_fast_sin_n, -1000, 1000, 0},
+    {"sin", sin, rpn_fast_sin, sinl, rpn_fast_sin_n, -800000, 800000, 0},
+    {"cos", cos, rpn_fast_cos, cosl, rpn_fast_cos_n, -3.14159, 3.14159, 0},
+    {"cos", cos, rpn_fast_cos, cosl, rpn_fast_cos_n, -1000, 1000, 0},
+    {"cos", cos, rpn_fast_cos, cosl, rpn_fast_cos_n, -800000, 800000, 0},
+    {"tan", tan, rpn_fast_tan, tanl, NULL, -1.5, 1.5, 0},
+    {"tan", tan, rpn_fast_tan, tanl, NULL, -1000, 1000, 0},
+    {"sincos", libm_sincos_prod, fast_sincos_prod, sincos_prod_ref, NULL, -3.14159, 3.14159, 0},
+    {"exp", exp, rpn_fast_exp, expl, rpn_fast_exp_n, -1, 1, 0},
+    {"exp", exp, rpn_fast_exp, expl, rpn_fast_exp_n, -700, 700, 0},
+    {"log", log, rpn_fast_log, logl, rpn_fast_log_n, 0.5, 2, 0},
+    {"log", log, rpn_fast_log, logl, rpn_fast_log_n, 1.0e-300, 1.0e300, 1},
+  };
+  static const struct {
+    double xlo, xhi, ylo, yhi;
+  } pw[] = {
+    {0.5, 2, -20, 20},
+    {0.001, 1000, -50, 50},
+    {1.0e-100, 1.0e100, -3, 3},
+  };
+  uniform_random_struct r;
+  DS ds;
+  double stack[STACKSIZE];
+  RPN_PROG prog;
+  double *x, *y, *out;
+  double start, libm_ns, fast_ns, array_ns, libm_err, fast_err, sum;
+  double args[2];
+  unsigned f;
+  int t;
+
+  x = (double *) malloc(3 * (size_t) num * sizeof(double));
+  if (NULL == x) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  y = x + num, out = y + num;
+  uniform_random_init(&r, 0, 1);
+
+  if (LDBL_MANT_DIG <= DBL_MANT_DIG) {
+    printf("long double is no wider than double, errors are against libm\n");
+  }
+  printf("%-6s %-22s %10s %10s %10s %10s %10s\n", "", "range", "libm ulp",
+	 "fast ulp", "libm ns", "fast ns", "array ns");
+
+  for (f = 0; f < sizeof(fn) / sizeof(fn[0]); f++) {
+    for (t = 0; t < num; t++) {
+      x[t] = uniform_random_real(&r);
+      x[t] = fn[f].logscale ? exp(log(fn[f].lo) + (log(fn[f].hi) - log(fn[f].lo)) * x[t])
+	: fn[f].lo + (fn[f].hi - fn[f].lo) * x[t];
+    }
+
+    start = ptime();
+    for (t = 0, sum = 0; t < num; t++) sum += fn[f].libm(x[t]);
+    libm_ns = (ptime() - start) * 1.0e9 / num;
+    start = ptime();
+    for (t = 0; t < num; t++) sum -= fn[f].fast(x[t]);
+    fast_ns = (ptime() - start) * 1.0e9 / num;
+    array_ns = 0;
+    if (NULL != fn[f].array) {
+      fn[f].array(out, x, num);	/* touching 'out' first */
+      start = ptime();
+      fn[f].array(out, x, num);
+      array_ns = (ptime() - start) * 1.0e9 / num;
+    }
+
+    for (t = 0, libm_err = fast_err = 0; t < num; t++) {
+      long double ref = LDBL_MANT_DIG > DBL_MANT_DIG ? fn[f].ref(x[t]) : fn[f].libm(x[t]);
+      double e;
+
+      if ((e = ulps(fn[f].libm(x[t]), ref)) > libm_err) libm_err = e;
+      if ((e = ulps(fn[f].fast(x[t]), ref)) > fast_err) fast_err = e;
+      if (NULL != fn[f].array && out[t] != fn[f].fast(x[t])) {
+	fprintf(stderr, "%s array differs at %.17g\n", fn[f].name, x[t]);
+	return 1;
+      }
+    }
+    printf("%-6s [%-9.3g, %9.3g] %10.2f %10.2f %10.1f %10.1f %10.1f\n",
+	   fn[f].name, fn[f].lo, fn[f].hi, libm_err, fast_err,
+	   libm_ns, fast_ns, array_ns);
+    if (sum == 1.0e300) printf("\n");	/* keep the loops */
+  }
+
+  for (f = 0; f < sizeof(pw) / sizeof(pw[0]); f++) {
+    for (t = 0; t < num; t++) {
+      x[t] = exp(log(pw[f].xlo) + (log(pw[f].xhi) - log(pw[f].xlo)) * uniform_random_real(&r));
+      y[t] = pw[f].ylo + (pw[f].yhi - pw[f].ylo) * uniform_random_real(&r);
+    }
+
+    start = ptime();
+    for (t = 0, sum = 0; t < num; t++) sum += pow(x[t], y[t]);
+    libm_ns = (ptime() - start) * 1.0e9 / num;
+    start = ptime();
+    for (t = 0; t < num; t++) sum -= rpn_fast_pow(x[t], y[t]);
+    fast_ns = (ptime() - start) * 1.0e9 / num;
+
+    for (t = 0, libm_err = fast_err = 0; t < num; t++) {
+      long double ref = LDBL_MANT_DIG > DBL_MANT_DIG ? powl(x[t], y[t]) : pow(x[t], y[t]);
+      double e;
+
+      if ((e = ulps(pow(x[t], y[t]), ref)) > libm_err) libm_err = e;
+      if ((e = ulps(rpn_fast_pow(x[t], y[t]), ref)) > fast_err) fast_err = e;
+    }
+    printf("%-6s [%-9.3g, %9.3g] %10.2f %10.2f %10.1f %10.1f\n", "pow",
+	   pw[f].xlo, pw[f].xhi, libm_err, fast_err, libm_ns, fast_ns);
+    printf("%-6s  ^ [%-6.3g, %6.3g]\n", "", pw[f].ylo, pw[f].yhi);
+    if (sum == 1.0e300) printf("\n");
+  }
+
+  /* atan2, in the square and over magnitudes, with either sign */
+  for (f = 0; f < 2; f++) {
+    for (t = 0; t < num; t++) {
+      x[t] = 2.0 * uniform_random_real(&r) - 1.0;
+      y[t] = 2.0 * uniform_random_real(&r) - 1.0;
+      if (f) {
+	x[t] = copysign(exp(-23.0 + 46.0 * uniform_random_real(&r)), x[t]);
+	y[t] = copysign(exp(-23.0 + 46.0 * uniform_random_real(&r)), y[t]);
+      }
+    }
+
+    start = ptime();
+    for (t = 0, sum = 0; t < num; t++) sum += atan2(y[t], x[t]);
+    libm_ns = (ptime() - start) * 1.0e9 / num;
+    start = ptime();
+    for (t = 0; t < num; t++) sum -= rpn_fast_atan2(y[t], x[t]);
+    fast_ns = (ptime() - start) * 1.0e9 / num;
+    rpn_fast_atan2_n(out, y, x, num);
+    start = ptime();
+    rpn_fast_atan2_n(out, y, x, num);
+    array_ns = (ptime() - start) * 1.0e9 / num;
+
+    for (t = 0, libm_err = fast_err = 0; t < num; t++) {
+      long double ref = LDBL_MANT_DIG > DBL_MANT_DIG ? atan2l(y[t], x[t]) : atan2(y[t], x[t]);
+      double e;
+
+      if ((e = ulps(atan2(y[t], x[t]), ref)) > libm_err) libm_err = e;
+      if ((e = ulps(rpn_fast_atan2(y[t], x[t]), ref)) > fast_err) fast_err = e;
+      if (out[t] != rpn_fast_atan2(y[t], x[t])) {
+	fprintf(stderr, "atan2 array differs at %.17g, %.17g\n", y[t], x[t]);
+	return 1;
+      }
+    }
+    printf("%-6s [%-9.3g, %9.3g] %10.2f %10.2f %10.1f %10.1f %10.1f\n", "atan2",
+	   f ? -1.0e10 : -1.0, f ? 1.0e10 : 1.0, libm_err, fast_err, libm_ns, fast_ns, array_ns);
+    if (sum == 1.0e300) printf("\n");
+  }
+
+  /* a kinematics formula, with the calc's libm and fast math */
+  ds_init(&ds, stack, STACKSIZE);
+  rpn_prog_init(&prog);
+  if (RPN_OK != rpncalc_compile(&ds, "$1 $2 toxy $2 sin * swap $1 cos * + $1 0.1 * exp ln +", &prog)) return 1;
+  for (f = 0; f < 2; f++) {
+    ds.fastmath = f;
+    start = ptime();
+    for (t = 0; t < num; t++) {
+      args[0] = 1.0 + 0.001 * (t & 1023);
+      args[1] = 0.002 * (t & 2047);
+      ds_clear(&ds);
+      rpncalc_run_args(&ds, &prog, args, 2);
+    }
+    report(f ? "formula, fast" : "formula, libm", num, start, ptime());
+  }
+
+  rpn_prog_free(&prog);
+  free(x);
+
+  return 0;
+}
+
+#if HAVE_SYS_UN_H
+
+static int compare_double(const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static int bench_rpnd(int num, const char *path, int conns, int batch,
+		      const char *expr)
+{
+  struct sockaddr_un addr;
+  struct pollfd *fds;
+  double *sent;
+  double *latency;
+  char *request;
+  char buffer[4096];
+  double start, end, now;
+  int reqlen;
+  int issued = 0, done = 0;
+  int errors = 0;
+  ssize_t n;
+  int t, k;
+
+  if (conns <= 0 || batch <= 0) return 1;
+
+  /* one request, 'batch' copies of the expression */
+  reqlen = batch * (strlen(expr) + 3);
+  request = (char *) malloc(reqlen + 1);
+  fds = (struct pollfd *) malloc(conns * sizeof(*fds));
+  sent = (double *) malloc(conns * sizeof(*sent));
+  latency = (double *) malloc(num * sizeof(*latency));
+  if (NULL == request || NULL == fds || NULL == sent || NULL == latency) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  *request = 0;
+  for (t = 0; t < batch; t++) {
+    strcat(request, expr);
+    strcat(request, t + 1 < batch ? " ; " : "\n");
+  }
+  reqlen = strlen(request);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  for (t = 0; t < conns; t++) {
+    fds[t].fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    fds[t].events = POLLIN;
+    if (fds[t].fd < 0 ||
+	0 != connect(fds[t].fd, (struct sockaddr *) &addr, sizeof(addr))) {
+      perror(path);
+      return 1;
+    }
+  }
+
+  start = ptime();
+  for (t = 0; t < conns && issued < num; t++, issued++) {
+    sent[t] = ptime();
+    if (write(fds[t].fd, request, reqlen) != reqlen) {
+      perror(path);
+      return 1;
+    }
+  }
+
+  while (done < num) {
+    if (poll(fds, conns, -1) < 0) {
+      perror("poll");
+      return 1;
+    }
+    for (t = 0; t < conns; t++) {
+      if (! (fds[t].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+      n = read(fds[t].fd, buffer, sizeof(buffer));
+      if (n <= 0) {
+	fprintf(stderr, "server closed connection\n");
+	return 1;
+      }
+      /* responses are short, so a newline ends the one outstanding */
+      if (NULL == memchr(buffer, '\n', n)) continue;
+      for (k = 0; k < n; k++) {
+	if ('E' == buffer[k]) errors++;
+      }
+      now = ptime();
+      latency[done++] = now - sent[t];
+      if (issued < num) {
+	issued++;
+	sent[t] = now;
+	if (write(fds[t].fd, request, reqlen) != reqlen) {
+	  perror(path);
+	  return 1;
+	}
+      }
+    }
+  }
+  end = ptime();
+
+  qsort(latency, num, sizeof(*latency), compare_double);
+  printf("%d requests of %d expressions on %d connections, %d errors\n",
+	 num, batch, conns, errors);
+  printf("%12.0f requests/sec %12.0f expressions/sec\n",
+	 num / (end - start), (double) num * batch / (end - start));
+  printf("latency p50 %10.1f us p99 %10.1f us max %10.1f us\n",
+	 latency[num / 2] * 1.0e6, latency[(int) (num * 0.99)] * 1.0e6,
+	 latency[num - 1] * 1.0e6);
+
+  for (t = 0; t < conns; t++) close(fds[t].fd);
+  free(request);
+  free(fds);
+  free(sent);
+  free(latency);
+
+  return 0;
+}
+
+#endif	/* HAVE_SYS_UN_H */
+
+int main(int argc, char *argv[])
+{
+  int num;
+
+  if (argc < 3 ||
+      1 != sscanf(argv[2], "%i", &num) ||
+      num <= 0) {
+    fprintf(stderr, "usage: <type> <iterations> <params ...>\n");
+    return 1;
+  }
+
+  if (! strcmp(argv[1], "infix")) {
+    if (argc == 3) {
+      return bench_infix(num,
+			 "(1.5 + 2.25) * 3 - 4 / 2 ^ 2 + sin(0.5) * atan2(1, 2)",
+			 "1.5 2.25 + 3 * 4 2 2 ^ / - 0.5 sin 1 2 atan2 * +");
+    }
+    if (argc != 5) {
+      fprintf(stderr, "usage: infix <iterations> <infix> <rpn>\n");
+      return 1;
+    }
+    return bench_infix(num, argv[3], argv[4]);
+  }
+
+  if (! strcmp(argv[1], "pipeline")) {
+    return bench_pipeline(num, argc > 3 ? argv[3] : "c 1.5 2.25 + 3 * 0.5 sin 1 2 atan2 2 sqrt pi");
+  }
+
+  if (! strcmp(argv[1], "raw")) {
+    if (argc == 3) {
+      return bench_raw(num, 3, "* + sqrt");
+    }
+    if (argc != 5) {
+      fprintf(stderr, "usage: raw <iterations> <columns> <expression>\n");
+      return 1;
+    }
+    return bench_raw(num, atoi(argv[3]), argv[4]);
+  }
+
+#if HAVE_UNISTD_H
+  if (! strcmp(argv[1], "out")) {
+    return bench_out(num, argc > 3 ? atoi(argv[3]) : 50);
+  }
+#endif
+
+  if (! strcmp(argv[1], "stream")) {
+    return bench_stream(num);
+  }
+
+  if (! strcmp(argv[1], "sheet")) {
+    if (argc == 3) {
+      return bench_sheet(num, 5000, 1);
+    }
+    if (argc != 5) {
+      fprintf(stderr, "usage: sheet <iterations> <cells> <threads>\n");
+      return 1;
+    }
+    return bench_sheet(num, atoi(argv[3]), atoi(argv[4]));
+  }
+
+  if (! strcmp(argv[1], "grad")) {
+    return bench_grad(num, argc > 3 ? atoi(argv[3]) : 8);
+  }
+
+  if (! strcmp(argv[1], "contexts")) {
+    return bench_contexts(num, argc > 3 ? atoi(argv[3]) : 1000000);
+  }
+
+  if (! strcmp(argv[1], "fastmath")) {
+    return bench_fastmath(num);
+  }
+
+  if (! strcmp(argv[1], "ops")) {
+    return bench_ops(num);
+  }
+
+  if (! strcmp(argv[1], "mc")) {
+    return bench_mc(num, argc > 3 ? atoi(argv[3]) : 0);
+  }
+
+  if (! strcmp(argv[1], "snapshot")) {
+    return bench_snapshot(num);
+  }
+
+  if (! strcmp(argv[1], "xform")) {
+    return bench_xform(num);
+  }
+
+#if HAVE_CXX17
+  if (! strcmp(argv[1], "types")) {
+    return bench_types(num);
+  }
+#endif
+
+#if HAVE_SYS_MMAN_H
+  if (! strcmp(argv[1], "sharedstats")) {
+    return bench_sharedstats(num, argc > 3 ? atoi(argv[3]) : 4);
+  }
+#endif
+
+  if (! strcmp(argv[1], "fit")) {
+    return bench_fit(num, argc > 3 ? atoi(argv[3]) : 3, argc > 4 ? atoi(argv[4]) : 4);
+  }
+
+#if HAVE_SYS_UN_H
+  if (! strcmp(argv[1], "rpnd")) {
+    if (argc == 4) {
+      return bench_rpnd(num, argv[3], 8, 16, "c 1 2 + 3 *");
+    }
+    if (argc != 7) {
+      fprintf(stderr, "usage: rpnd <iterations> <socket path> <connections> <batch> <expression>\n");
+      return 1;
+    }
+    return bench_rpnd(num, argv[3], atoi(argv[4]), atoi(argv[5]), argv[6]);
+  }
+#endif
+
+  fprintf(stderr, "unknown benchmark: %s\n", argv[1]);
+  return 1;
+}
@@ -0,0 +1,186 @@
+/*
+  rpnbenchtypes.cpp
+
+  rpnbench's types benchmark, in C++ for rpncalc.hpp: the same formula
+  over columns of 'num' rows, and the same statistics registers, in
+  float, double, long double and double-double, for the time of each
+  and the standard deviation each gets of data far from 0.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "rpncalc.hpp"
+#include "ptime.h"
+
+extern "C" int bench_types(int num);
+
+namespace {
+
+using rpncalc::dd;
+
+constexpr auto formula = rpncalc::parse("$1 $2 * $3 + $1 * $4 + $2 $3 - sq +");
+
+void report(const char *what, int num, double start, double end)
+{
+  printf("%-24s %10.1f ns/iteration %12.0f iterations/sec\n", what,
+	 (end - start) * 1.0e9 / num, num / (end - start));
+}
+
+/* the formula down the columns, in T, and its results as doubles */
+template <typename T>
+int columns(const char *name, int num, const double *const *x, double *y)
+{
+  T *c = (T *) malloc(5 * num * sizeof(T));
+  T *c1 = c, *c2 = c + num, *c3 = c + 2 * num, *c4 = c + 3 * num, *r = c + 4 * num;
+  double start;
+  int bad = 0;
+  int t;
+
+  if (NULL == c) return 1;
+  for (t = 0; t < num; t++) {
+    c1[t] = x[0][t], c2[t] = x[1][t], c3[t] = x[2][t], c4[t] = x[3][t];
+  }
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    bad += RPN_OK != rpncalc::run<formula>(&r[t], c1[t], c2[t], c3[t], c4[t]);
+  }
+  report(name, num, start, ptime());
+
+  for (t = 0; t < num; t++) {
+    y[t] = (double) r[t];
+  }
+  free(c);
+
+  return bad;
+}
+
+/* stat of the points, in T, for sdx and r */
+template <typename T>
+void stat(const char *name, int num, const double *x, const double *y, double *sdx, double *r)
+{
+  rpncalc::stats<T> st;
+  double start;
+  int t;
+
+  start = ptime();
+  for (t = 0; t < num; t++) {
+    st.add(T(x[t]), T(y[t]));
+  }
+  report(name, num, start, ptime());
+
+  *sdx = (double) st.sdx();
+  *r = (double) st.r();
+}
+
+/* largest relative difference */
+double differ(const double *y, const double *ref, int num)
+{
+  double err = 0.0, e;
+  int t;
+
+  for (t = 0; t < num; t++) {
+    e = y[t] == ref[t] ? 0.0 : (y[t] - ref[t]) / ref[t];
+    if (e < 0.0) e = -e;
+    if (e > err) err = e;
+  }
+
+  return err;
+}
+
+/* 1 / 3 to each type's significant figures */
+template <typename T>
+void third(const char *name)
+{
+  char buf[64];
+  int prec = rpncalc::sigfig<T>(10);
+
+  rpncalc::convert_to_s(buf, T(1) / T(3), 10, prec, sizeof(buf));
+  printf("1/3 in %-17s %2d figures %s\n", name, prec, buf);
+}
+
+} /* namespace */
+
+int bench_types(int num)
+{
+  double *x[4], *y, *ref, *data;
+  double s[4], r[4], exact, mean;
+  char a[64], b[64];
+  unsigned int seed = 1;
+  int bad = 0;
+  int t, j;
+
+  data = (double *) malloc(6 * num * sizeof(double));
+  if (NULL == data) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for (j = 0; j < 4; j++) {
+    x[j] = data + j * num;
+  }
+  y = data + 4 * num;
+  ref = data + 5 * num;
+  for (t = 0; t < num; t++) {
+    for (j = 0; j < 4; j++) {
+      seed = seed * 1103515245 + 12345;
+      x[j][t] = (seed >> 8) / 16777216.0 * 2.0 - 1.0;
+    }
+  }
+
+  /* each against double-double */
+  bad += columns<dd>("double-double", num, x, ref);
+  bad += columns<long double>("long double", num, x, y);
+  printf("%-24s largest relative difference %.3g\n", "", differ(y, ref, num));
+  bad += columns<double>("double", num, x, y);
+  printf("%-24s largest relative difference %.3g\n", "", differ(y, ref, num));
+  bad += columns<float>("float", num, x, y);
+  printf("%-24s largest relative difference %.3g\n", "", differ(y, ref, num));
+
+  /* a standard deviation of about 0.29, of numbers around 10^8 */
+  for (t = 0; t < num; t++) {
+    x[0][t] = 1.0e8 + x[0][t] / 2.0 + 0.5;
+    x[1][t] = 2.0 * x[0][t] + x[1][t];
+  }
+  mean = 0.0;
+  for (t = 0; t < num; t++) {
+    mean += x[0][t] - 1.0e8;
+  }
+  mean /= num;
+  exact = 0.0;
+  for (t = 0; t < num; t++) {
+    exact += ((x[0][t] - 1.0e8) - mean) * ((x[0][t] - 1.0e8) - mean);
+  }
+  exact = std::sqrt(exact / (num - 1));
+  stat<float>("stat, float", num, x[0], x[1], &s[0], &r[0]);
+  stat<double>("stat, double", num, x[0], x[1], &s[1], &r[1]);
+  stat<long double>("stat, long double", num, x[0], x[1], &s[2], &r[2]);
+  stat<dd>("stat, double-double", num, x[0], x[1], &s[3], &r[3]);
+  printf("sdx %.15g, in float %.6g, double %.6g, long double %.6g, double-double %.15g\n",
+	 exact, s[0], s[1], s[2], s[3]);
+  printf("r in float %.6g, double %.6g, long double %.6g, double-double %.15g\n",
+	 r[0], r[1], r[2], r[3]);
+
+  third<float>("float");
+  third<double>("double");
+  third<long double>("long double");
+  third<dd>("double-double");
+
+  /* and a double is as rpncalc prints it */
+  for (t = 0; t < num; t++) {
+    if (RPN_OK != convert_d_to_s(a, ref[t], 10, 15, sizeof(a)) ||
+	RPN_OK != rpncalc::convert_to_s(b, ref[t], 10, 15, sizeof(b)) ||
+	strcmp(a, b)) {
+      fprintf(stderr, "%.17g printed as %s and %s\n", ref[t], a, b);
+      bad++;
+      break;
+    }
+  }
+  free(data);
+
+  return bad || ! (num < 2 || std::fabs(s[3] - exact) < 1e-9 * exact);
+}
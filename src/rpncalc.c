@@ -1,9 +1,20 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include <math.h>		/* all math functions */
 #include <float.h>		/* DBL_MIN */
 #include <errno.h>		/* errno */
+#include <limits.h>		/* LLONG_MAX, LLONG_MIN */
+#include <stdlib.h>		/* NULL, realloc, free */
+#include <string.h>		/* strlen */
 #include "rpncalc.h"		/* our decls */
-#include "ptime.h"		/* ptime */
+#include "ptime.h"		/* ptime, ptime_ns, ptime_ticks */
 #include "variates.h"		/* uniform_random, ... */
+#include "rpnfast.h"		/* rpn_fast_sin, ... */
+#include "rpnslab.h"		/* RPN_SLAB */
+#include "rpnop.h"		/* rpn_op_table, rpncalc_find_op */
+#include "rpnshm.h"		/* rpn_shm_stats_begin, ... */
 
 /*
   Reverse Polish Notation calculator.
@@ -37,7 +48,14 @@ static const double CONV_IN_TO_MM = 25.4;
 #define TOFARENHEIT(c) (9.0/5.0*(c)+32.0)
 #define TOCELSIUS(f) (5.0/9.0*((f)-32.0))
 
+#define DEFAULT_TOL 1.0e-12	/* of solve and integrate */
+
+/* libm's f, or rpnfast.h's, as the calc is set */
+#define MATH(ds, f) ((ds)->fastmath ? rpn_fast_##f : f)
+
 #define DOUBLE_BITS 53		/* bits in the fraction part of a double */
+#define TWO_TO_53 9007199254740992.0 /* integers beyond lose precision */
+#define TWO_TO_63 9223372036854775808.0 /* just beyond a long long */
 
 static int sigfig(int base)
 {
@@ -50,7 +68,9 @@ int ds_init(DS *ds, double *stack, int size)
 
   ds->stack = stack;
   ds->mem = 0.0;
-  ds->sumx = ds->sumy = ds->sumxx = ds->sumyy = ds->sumxy = ds->n = 0.0;
+  ds->stats = NULL;
+  ds->shared = NULL;
+  ds->rand = NULL;
   ds->size = size;
   ds->next = 0;
   ds->base = 10;
@@ -58,9 +78,11 @@ int ds_init(DS *ds, double *stack, int size)
   ds->askprec = ds->sigfig;
   ds->prec = ds->sigfig;
   ds->angle_unit = 0;		/* radians */
-  uniform_random_init(&ds->urand, 0, 1);
-  normal_random_init(&ds->nrand, 0, 1);
-  exponential_random_init(&ds->erand, 1);
+  ds->itag = 0;
+  ds->ival = NULL;
+  ds->solve = NULL;
+  ds->fastmath = RPN_FASTMATH;
+  ds->stream = 0;
 
   return RPN_OK;
 }
@@ -72,15 +94,463 @@ int ds_clear(DS *ds)
   return RPN_OK;
 }
 
+/* what solve and integrate use */
+struct ds_solve {
+  RPN_QUOTE *quote;		/* the last [ ... ], NULL if none yet */
+  double tol;			/* tolerance of solve and integrate */
+  long nfev;			/* function evaluations by the last one */
+};
+
+/* the lazy parts of calcs, see rpncalc.h */
+static RPN_SLAB ival_slab = RPN_SLAB_INITIALIZER(DS_INTSIZE * sizeof(long long));
+static RPN_SLAB stats_slab = RPN_SLAB_INITIALIZER(sizeof(DS_STATS));
+static RPN_SLAB rand_slab = RPN_SLAB_INITIALIZER(sizeof(DS_RAND));
+static RPN_SLAB solve_slab = RPN_SLAB_INITIALIZER(sizeof(struct ds_solve));
+static const DS_STATS no_stats;	/* what a calc without any reads */
+
+/* the registers to read, summed into 'sum' if they're shared */
+static const DS_STATS *stats_read(const DS *ds, DS_STATS *sum)
+{
+  if (NULL != ds->shared) {
+    rpn_shm_stats_sum(ds->shared, sum);
+    return sum;
+  }
+
+  return ds->stats != NULL ? ds->stats : &no_stats;
+}
+
+/* around changes to the registers, for shared ones' readers */
+static void stats_begin(DS *ds)
+{
+  if (NULL != ds->shared) rpn_shm_stats_begin(ds->shared);
+}
+
+static void stats_end(DS *ds)
+{
+  if (NULL != ds->shared) rpn_shm_stats_end(ds->shared);
+}
+
+/* no points, shared registers left bound */
+static void stats_clear(DS *ds)
+{
+  if (NULL != ds->shared) {
+    stats_begin(ds);
+    memset(ds->stats, 0, sizeof(DS_STATS));
+    stats_end(ds);
+  } else {
+    rpn_slab_free(&stats_slab, ds->stats);
+    ds->stats = NULL;
+  }
+}
+
+static void free_quote(RPN_QUOTE *q)
+{
+  if (NULL != q) {
+    rpn_prog_free(&q->prog);
+    free(q->text);
+    free(q);
+  }
+}
+
+/* the quote and tolerance, to change, NULL if out of memory */
+static struct ds_solve *ds_solve(DS *ds)
+{
+  if (NULL == ds->solve) {
+    ds->solve = (struct ds_solve *) rpn_slab_alloc(&solve_slab);
+    if (NULL != ds->solve) {
+      ds->solve->quote = NULL;
+      ds->solve->tol = DEFAULT_TOL;
+      ds->solve->nfev = 0;
+    }
+  }
+
+  return ds->solve;
+}
+
+/* back to no quote and the default tolerance */
+static void solve_clear(DS *ds)
+{
+  if (NULL != ds->solve) {
+    free_quote(ds->solve->quote);
+    rpn_slab_free(&solve_slab, ds->solve);
+    ds->solve = NULL;
+  }
+}
+
+static RPN_QUOTE *ds_quote(const DS *ds)
+{
+  return NULL != ds->solve ? ds->solve->quote : NULL;
+}
+
+static double ds_tol(const DS *ds)
+{
+  return NULL != ds->solve ? ds->solve->tol : DEFAULT_TOL;
+}
+
+static int ds_settol(DS *ds, double tol)
+{
+  if (NULL == ds->solve && DEFAULT_TOL == tol) return RPN_OK;
+  if (NULL == ds_solve(ds)) return RPN_ERROR;
+  ds->solve->tol = tol;
+
+  return RPN_OK;
+}
+
+/* the integer values, to change, NULL if out of memory */
+static long long *ds_ival(DS *ds)
+{
+  if (NULL == ds->ival) ds->ival = (long long *) rpn_slab_alloc(&ival_slab);
+
+  return ds->ival;
+}
+
 /* clear memory, but leave base, degrees, etc. alone */
 int ds_allclear(DS *ds)
 {
   ds->mem = 0.0;
-  ds->sumx = ds->sumy = ds->sumxx = ds->sumyy = ds->sumxy = ds->n = 0.0;
+  stats_clear(ds);
 
   return ds_clear(ds);
 }
 
+/* clear everything but the random generators, as if just initialized */
+int ds_reset(DS *ds)
+{
+  ds->base = 10;
+  ds->sigfig = sigfig(ds->base);
+  ds->askprec = ds->sigfig;
+  ds->prec = ds->sigfig;
+  ds->angle_unit = 0;		/* radians */
+  solve_clear(ds);
+  ds->fastmath = RPN_FASTMATH;
+
+  return ds_allclear(ds);
+}
+
+/* free what the calc has allocated, the quote and the lazy parts */
+void ds_free(DS *ds)
+{
+  solve_clear(ds);
+  rpn_shm_stats_unbind(ds);
+  rpn_slab_free(&ival_slab, ds->ival);
+  rpn_slab_free(&stats_slab, ds->stats);
+  rpn_slab_free(&rand_slab, ds->rand);
+  ds->itag = 0;
+  ds->ival = NULL;
+  ds->stats = NULL;
+  ds->rand = NULL;
+}
+
+size_t ds_pool_bytes(void)
+{
+  return rpn_slab_bytes(&ival_slab) + rpn_slab_bytes(&stats_slab) +
+    rpn_slab_bytes(&rand_slab) + rpn_slab_bytes(&solve_slab);
+}
+
+void ds_share_stats(DS *ds, DS_STATS *st, struct rpn_shm_stats *shared)
+{
+  if (NULL != st && NULL != ds->stats) {
+    rpn_shm_stats_begin(shared);
+    st->sumx += ds->stats->sumx;
+    st->sumy += ds->stats->sumy;
+    st->sumxx += ds->stats->sumxx;
+    st->sumyy += ds->stats->sumyy;
+    st->sumxy += ds->stats->sumxy;
+    st->n += ds->stats->n;
+    rpn_shm_stats_end(shared);
+  }
+  if (NULL == ds->shared) rpn_slab_free(&stats_slab, ds->stats);
+  ds->stats = st;
+  ds->shared = shared;
+}
+
+/* the statistics registers, to change, NULL if out of memory */
+static DS_STATS *ds_stats(DS *ds)
+{
+  if (NULL == ds->stats) {
+    ds->stats = (DS_STATS *) rpn_slab_alloc(&stats_slab);
+    if (NULL != ds->stats) memset(ds->stats, 0, sizeof(DS_STATS));
+  }
+
+  return ds->stats;
+}
+
+/*
+  The generators are variates.c's Park-Miller ones, x' = A x mod M,
+  so 'j' draws on from x is A^j x mod M, as in rpnmc.c.
+ */
+#define RAND_MODULUS 2147483647ULL
+#define RAND_A 16807ULL
+
+static unsigned long long powmod(unsigned long long a, unsigned long long e)
+{
+  unsigned long long r = 1;
+
+  for (; e > 0; e >>= 1) {
+    if (e & 1) r = r * a % RAND_MODULUS;
+    a = a * a % RAND_MODULUS;
+  }
+
+  return r;
+}
+
+/* the generators as ds_init() leaves them, on the calc's stream */
+static void rand_start(DS *ds)
+{
+  DS_RAND *r = ds->rand;
+  unsigned long long jump;
+
+  uniform_random_init(&r->urand, 0, 1);
+  normal_random_init(&r->nrand, 0, 1);
+  exponential_random_init(&r->erand, 1);
+  if (0 == ds->stream) return;
+
+  jump = powmod(RAND_A, ds->stream % (RAND_MODULUS - 1) * RPN_RAND_STRIDE % (RAND_MODULUS - 1));
+  r->urand.u.seed = (long) (r->urand.u.seed * jump % RAND_MODULUS);
+  r->nrand.u1.seed = (long) (r->nrand.u1.seed * jump % RAND_MODULUS);
+  r->nrand.u2.seed = (long) (r->nrand.u2.seed * jump % RAND_MODULUS);
+  r->erand.u.seed = (long) (r->erand.u.seed * jump % RAND_MODULUS);
+}
+
+/* the random generators, NULL if out of memory */
+static DS_RAND *ds_rand(DS *ds)
+{
+  if (NULL == ds->rand) {
+    ds->rand = (DS_RAND *) rpn_slab_alloc(&rand_slab);
+    if (NULL == ds->rand) return NULL;
+    rand_start(ds);
+  }
+
+  return ds->rand;
+}
+
+void ds_seed_stream(DS *ds, unsigned long stream)
+{
+  ds->stream = stream;
+  if (NULL != ds->rand) rand_start(ds);
+}
+
+/*
+  Snapshots, see rpncalc.h. The header is written field by field,
+  rather than copying the structs it comes from, so the format doesn't
+  change when they do.
+ */
+
+#define SNAPSHOT_ORDER 0x01020304
+#define PAD8(n) (((n) + 7) / 8 * 8)
+
+size_t ds_snapshot(const DS *ds, void *buf, size_t len)
+{
+  RPN_SNAPSHOT *h = (RPN_SNAPSHOT *) buf;
+  const DS_RAND *r = ds->rand;
+  const RPN_QUOTE *q = ds_quote(ds);
+  size_t quote_len = NULL != q ? q->len : 0;
+  size_t size;
+  int t;
+
+  size = sizeof(RPN_SNAPSHOT) + ds->next * sizeof(double) + PAD8(quote_len);
+  if (NULL == buf || len < size) return size;
+
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, "RPNs", 4);
+  h->version = RPN_SNAPSHOT_VERSION;
+  h->order = SNAPSHOT_ORDER;
+  h->size = size;
+  h->next = ds->next;
+  h->base = ds->base;
+  h->askprec = ds->askprec;
+  h->prec = ds->prec;
+  h->sigfig = ds->sigfig;
+  h->angle_unit = ds->angle_unit;
+  h->fastmath = ds->fastmath;
+  h->mem = ds->mem;
+  h->tol = ds_tol(ds);
+  h->nfev = NULL != ds->solve ? ds->solve->nfev : 0;
+  for (t = 0; t < DS_INTSIZE; t++) {
+    if (DS_ISINT(ds->itag, t)) {
+      h->itag[t] = 1;
+      h->ival[t] = ds->ival[t];
+    }
+  }
+
+  if (NULL != ds->stats) {
+    h->flags |= RPN_SNAPSHOT_STATS;
+    h->stats[0] = ds->stats->sumx;
+    h->stats[1] = ds->stats->sumy;
+    h->stats[2] = ds->stats->sumxx;
+    h->stats[3] = ds->stats->sumyy;
+    h->stats[4] = ds->stats->sumxy;
+    h->stats[5] = ds->stats->n;
+  }
+
+  if (NULL != r) {
+    h->flags |= RPN_SNAPSHOT_RAND;
+    h->useed = r->urand.u.seed;
+    h->umin = r->urand.min;
+    h->udiff = r->urand.diff;
+    h->nseed1 = r->nrand.u1.seed;
+    h->nseed2 = r->nrand.u2.seed;
+    h->nx1 = r->nrand.x1;
+    h->nx2 = r->nrand.x2;
+    h->nmean = r->nrand.mean;
+    h->nsd = r->nrand.sd;
+    h->nreturn_x2 = r->nrand.return_x2;
+    h->eseed = r->erand.u.seed;
+    h->esd = r->erand.sd;
+  }
+
+  if (NULL != q) {
+    h->flags |= RPN_SNAPSHOT_QUOTE;
+    h->quote_depth = q->depth;
+    h->quote_len = quote_len;
+  }
+
+  memcpy(h + 1, ds->stack, ds->next * sizeof(double));
+  if (quote_len > 0) {
+    memcpy((double *) (h + 1) + ds->next, q->text, quote_len);
+  }
+
+  return size;
+}
+
+/* a quote as in a snapshot, compiled if it's closed, NULL if no memory */
+static RPN_QUOTE *snapshot_quote(DS *ds, const RPN_SNAPSHOT *h, const char *text)
+{
+  RPN_QUOTE *q;
+  int base = ds->base;
+  int retval;
+
+  q = (RPN_QUOTE *) calloc(1, sizeof(*q));
+  if (NULL == q) return NULL;
+  rpn_prog_init(&q->prog);
+  q->depth = h->quote_depth;
+  q->len = q->size = h->quote_len;
+  if (q->len > 0) {
+    q->text = (char *) malloc(q->len);
+    if (NULL == q->text) goto fail;
+    memcpy(q->text, text, q->len);
+  }
+
+  if (0 == q->depth) {
+    /* numbers in it are converted ahead in the base it'll run in */
+    ds->base = h->base;
+    retval = rpncalc_compilen(ds, q->text, q->len, &q->prog);
+    ds->base = base;
+    if (RPN_OK != retval) goto fail;
+  }
+
+  return q;
+
+ fail:
+  rpn_prog_free(&q->prog);
+  free(q->text);
+  free(q);
+  return NULL;
+}
+
+int ds_restore(DS *ds, const void *buf, size_t len)
+{
+  const RPN_SNAPSHOT *h = (const RPN_SNAPSHOT *) buf;
+  RPN_QUOTE *q = NULL;
+  DS_RAND *r;
+  unsigned long itag = 0;
+  int solve;
+  int t;
+
+  if (len < sizeof(RPN_SNAPSHOT)) return RPN_ERROR;
+  if (0 != memcmp(h->magic, "RPNs", 4) ||
+      RPN_SNAPSHOT_VERSION != h->version ||
+      SNAPSHOT_ORDER != h->order) {
+    return RPN_ERROR;
+  }
+  if (h->next < 0 || h->next > ds->size ||
+      h->quote_len < 0 || h->quote_len > h->size ||
+      h->size != (long long) (sizeof(RPN_SNAPSHOT) + h->next * sizeof(double) +
+			      PAD8(h->quote_len)) ||
+      h->size > (long long) len) {
+    return RPN_ERROR;
+  }
+  if (h->base < 2 || h->base > 36 || h->quote_depth < 0 ||
+      h->prec < 0 || h->prec > h->sigfig) {
+    return RPN_ERROR;
+  }
+  for (t = 0; t < DS_INTSIZE; t++) {
+    if (h->itag[t] > 1) return RPN_ERROR;
+    if (h->itag[t]) itag |= 1UL << t;
+  }
+  if (! (h->tol > 0.0)) return RPN_ERROR;
+  solve = (h->flags & RPN_SNAPSHOT_QUOTE) || DEFAULT_TOL != h->tol || 0 != h->nfev;
+
+  /* everything that can fail first, so an error changes nothing */
+  if (h->flags & RPN_SNAPSHOT_QUOTE) {
+    q = snapshot_quote(ds, h, (const char *) ((const double *) (h + 1) + h->next));
+    if (NULL == q) return RPN_ERROR;
+  }
+  if (((h->flags & RPN_SNAPSHOT_STATS) && NULL == ds_stats(ds)) ||
+      ((h->flags & RPN_SNAPSHOT_RAND) && NULL == ds_rand(ds)) ||
+      (0 != itag && NULL == ds_ival(ds)) ||
+      (solve && NULL == ds_solve(ds))) {
+    free_quote(q);
+    return RPN_ERROR;
+  }
+
+  memcpy(ds->stack, h + 1, h->next * sizeof(double));
+  ds->next = h->next;
+  ds->base = h->base;
+  ds->askprec = h->askprec;
+  ds->prec = h->prec;
+  ds->sigfig = h->sigfig;
+  ds->angle_unit = h->angle_unit;
+  ds->fastmath = h->fastmath;
+  ds->mem = h->mem;
+  ds->itag = itag;
+  for (t = 0; t < DS_INTSIZE; t++) {
+    if (h->itag[t]) ds->ival[t] = h->ival[t];
+  }
+  if (solve) {
+    free_quote(ds->solve->quote);
+    ds->solve->quote = q;
+    ds->solve->tol = h->tol;
+    ds->solve->nfev = (long) h->nfev;
+  } else {
+    solve_clear(ds);
+  }
+
+  if (h->flags & RPN_SNAPSHOT_STATS) {
+    stats_begin(ds);
+    ds->stats->sumx = h->stats[0];
+    ds->stats->sumy = h->stats[1];
+    ds->stats->sumxx = h->stats[2];
+    ds->stats->sumyy = h->stats[3];
+    ds->stats->sumxy = h->stats[4];
+    ds->stats->n = h->stats[5];
+    stats_end(ds);
+  } else {
+    stats_clear(ds);
+  }
+
+  if (h->flags & RPN_SNAPSHOT_RAND) {
+    r = ds->rand;
+    r->urand.u.seed = (long) h->useed;
+    r->urand.min = h->umin;
+    r->urand.diff = h->udiff;
+    r->nrand.u1.seed = (long) h->nseed1;
+    r->nrand.u2.seed = (long) h->nseed2;
+    r->nrand.x1 = h->nx1;
+    r->nrand.x2 = h->nx2;
+    r->nrand.mean = h->nmean;
+    r->nrand.sd = h->nsd;
+    r->nrand.return_x2 = (char) h->nreturn_x2;
+    r->erand.u.seed = (long) h->eseed;
+    r->erand.sd = h->esd;
+  } else {
+    rpn_slab_free(&rand_slab, ds->rand);
+    ds->rand = NULL;
+  }
+
+  return RPN_OK;
+}
+
 int ds_push(DS *ds, double val)
 {
   if (ds->next == ds->size) {
@@ -88,11 +558,42 @@ int ds_push(DS *ds, double val)
     return RPN_ERROR;
   }
 
+  if (ds->next < DS_INTSIZE) ds->itag &= ~(1UL << ds->next);
   ds->stack[ds->next++] = val;
 
   return RPN_OK;
 }
 
+/*
+  push an integer whose double may differ from it, as a bit pattern
+  literal's does
+*/
+static int push_lit(DS *ds, double x, long long val)
+{
+  if (ds->next == ds->size) {
+    /* full */
+    return RPN_ERROR;
+  }
+
+  if (ds->next < DS_INTSIZE) {
+    /* without room for its value, it's just a double */
+    if (NULL != ds_ival(ds)) {
+      ds->itag |= 1UL << ds->next;
+      ds->ival[ds->next] = val;
+    } else {
+      ds->itag &= ~(1UL << ds->next);
+    }
+  }
+  ds->stack[ds->next++] = x;
+
+  return RPN_OK;
+}
+
+int ds_push_int(DS *ds, long long val)
+{
+  return push_lit(ds, (double) val, val);
+}
+
 int ds_pop(DS *ds, double *val)
 {
   if (ds->next == 0) {
@@ -114,6 +615,14 @@ int ds_dup(DS *ds)
   }
 
   ds->stack[ds->next] = ds->stack[ds->next - 1];
+  if (ds->next < DS_INTSIZE) {
+    if (DS_ISINT(ds->itag, ds->next - 1)) {
+      ds->itag |= 1UL << ds->next;
+      ds->ival[ds->next] = ds->ival[ds->next - 1];
+    } else {
+      ds->itag &= ~(1UL << ds->next);
+    }
+  }
   ds->next++;
 
   return RPN_OK;
@@ -122,15 +631,32 @@ int ds_dup(DS *ds)
 int ds_swap(DS *ds)
 {
   double temp;
+  long long itemp;
+  unsigned long tags;
+  int t = ds->next - 1;
 
   if (ds->next < 2) {
     /* don't have 2 to swap */
     return RPN_ERROR;
   }
 
-  temp = ds->stack[ds->next - 1];
-  ds->stack[ds->next - 1] = ds->stack[ds->next - 2];
-  ds->stack[ds->next - 2] = temp;
+  temp = ds->stack[t];
+  ds->stack[t] = ds->stack[t - 1];
+  ds->stack[t - 1] = temp;
+  if (t < DS_INTSIZE) {
+    tags = ds->itag >> (t - 1) & 3;
+    if (3 == tags) {
+      itemp = ds->ival[t], ds->ival[t] = ds->ival[t - 1], ds->ival[t - 1] = itemp;
+    } else if (0 != tags) {
+      /* just one's an integer, and it moves */
+      if (1 == tags) ds->ival[t] = ds->ival[t - 1];
+      else ds->ival[t - 1] = ds->ival[t];
+      ds->itag ^= 3UL << (t - 1);
+    }
+  } else if (t == DS_INTSIZE) {
+    /* the bottom one can't stay an integer */
+    ds->itag &= ~(1UL << (t - 1));
+  }
 
   return RPN_OK;
 }
@@ -138,6 +664,8 @@ int ds_swap(DS *ds)
 int ds_rot(DS *ds)
 {
   double temp;
+  long long itemp = 0;
+  unsigned long tag;
   int t;
 
   if (ds->next < 2) {
@@ -146,10 +674,19 @@ int ds_rot(DS *ds)
   }
 
   temp = ds->stack[0];
+  tag = ds->itag & 1;
+  if (tag) itemp = ds->ival[0];
   for (t = 0; t < ds->next - 1; t++) {
     ds->stack[t] = ds->stack[t + 1];
+    if (t + 1 < DS_INTSIZE && DS_ISINT(ds->itag, t + 1)) ds->ival[t] = ds->ival[t + 1];
   }
   ds->stack[ds->next -1] = temp;
+  /* the tags move down one, the bottom's to the top */
+  ds->itag >>= 1;
+  if (ds->next - 1 < DS_INTSIZE) {
+    ds->itag = (ds->itag & ~(1UL << (ds->next - 1))) | tag << (ds->next - 1);
+    if (tag) ds->ival[ds->next - 1] = itemp;
+  }
 
   return RPN_OK;
 }
@@ -175,6 +712,28 @@ int ds_replace(DS *ds, int howmany, double val)
 
   ds->next -= (howmany - 1);
   ds->stack[ds->next - 1] = val;
+  if (ds->next - 1 < DS_INTSIZE) ds->itag &= ~(1UL << (ds->next - 1));
+
+  return RPN_OK;
+}
+
+static int ds_replace_int(DS *ds, int howmany, long long val)
+{
+  if (ds->next < howmany) {
+    /* too few to replace */
+    return RPN_ERROR;
+  }
+
+  ds->next -= (howmany - 1);
+  ds->stack[ds->next - 1] = (double) val;
+  if (ds->next - 1 < DS_INTSIZE) {
+    if (NULL != ds_ival(ds)) {
+      ds->itag |= 1UL << (ds->next - 1);
+      ds->ival[ds->next - 1] = val;
+    } else {
+      ds->itag &= ~(1UL << (ds->next - 1));
+    }
+  }
 
   return RPN_OK;
 }
@@ -196,6 +755,52 @@ int ds_fromtop(DS *ds, int down, double *val)
   return RPN_OK;
 }
 
+/*
+  Like ds_fromtop(), but as an integer, exactly if the slot is one,
+  otherwise rounded. It's an error if it's out of range.
+ */
+int ds_fromtop_int(DS *ds, int down, long long *val)
+{
+  double x;
+  int t = ds->next - 1 - down;
+
+  if (down < 0 ||
+      down >= ds->next) {
+    /* not enough on stack */
+    return RPN_ERROR;
+  }
+
+  if (DS_ISINT(ds->itag, t)) {
+    *val = ds->ival[t];
+    return RPN_OK;
+  }
+
+  x = ds->stack[t];
+  x = x < 0 ? ceil(x - 0.5) : floor(x + 0.5);
+  if (! (x >= -TWO_TO_63 && x < TWO_TO_63)) return RPN_ERROR;
+  *val = (long long) x;
+
+  return RPN_OK;
+}
+
+/*
+  is slot t an integer that's also its double? A bit pattern literal
+  over LLONG_MAX isn't, it's negative in 'ival' but not on the stack,
+  so arithmetic takes it as a double
+*/
+static int ds_exact(DS *ds, int t)
+{
+  return DS_ISINT(ds->itag, t) && (ds->ival[t] >= 0 || ds->stack[t] < 0);
+}
+
+/* are the top two integers, for arithmetic? */
+static int ds_ints(DS *ds)
+{
+  int t = ds->next - 1;
+
+  return t >= 1 && ds_exact(ds, t) && ds_exact(ds, t - 1);
+}
+
 int ds_setbase(DS *ds, int base)
 {
   if (base < 2) return RPN_ERROR;
@@ -253,24 +858,28 @@ double ds_stddev(DS *ds)
 
 double ds_stddev_x(DS *ds)
 {
+  DS_STATS sum;
+  const DS_STATS *st = stats_read(ds, &sum);
   double mean;
 
-  if (ds->n < 2) return 0.0;
+  if (st->n < 2) return 0.0;
 
-  mean = ds->sumx / ds->n;
+  mean = st->sumx / st->n;
 
-  return sqrt((ds->sumxx - 2.0*mean*ds->sumx + ds->n*mean*mean) / (ds->n-1));
+  return sqrt((st->sumxx - 2.0*mean*st->sumx + st->n*mean*mean) / (st->n-1));
 }
 
 double ds_stddev_y(DS *ds)
 {
+  DS_STATS sum;
+  const DS_STATS *st = stats_read(ds, &sum);
   double mean;
 
-  if (ds->n < 2) return 0.0;
+  if (st->n < 2) return 0.0;
 
-  mean = ds->sumy / ds->n;
+  mean = st->sumy / st->n;
 
-  return sqrt((ds->sumyy - 2.0*mean*ds->sumy + ds->n*mean*mean) / (ds->n-1));
+  return sqrt((st->sumyy - 2.0*mean*st->sumy + st->n*mean*mean) / (st->n-1));
 }
 
 /*
@@ -281,35 +890,41 @@ double ds_stddev_y(DS *ds)
 
 double ds_leastsq_a(DS *ds)
 {
+  DS_STATS sum;
+  const DS_STATS *st = stats_read(ds, &sum);
   double denom;
 
-  denom = ds->n*ds->sumxx - ds->sumx*ds->sumx;
+  denom = st->n*st->sumxx - st->sumx*st->sumx;
 
   if (denom == 0.0) return 0.0;
 
-  return (ds->n*ds->sumxy - ds->sumx*ds->sumy) / denom;
+  return (st->n*st->sumxy - st->sumx*st->sumy) / denom;
 }
 
 double ds_leastsq_b(DS *ds)
 {
+  DS_STATS sum;
+  const DS_STATS *st = stats_read(ds, &sum);
   double denom;
 
-  denom = ds->n*ds->sumxx - ds->sumx*ds->sumx;
+  denom = st->n*st->sumxx - st->sumx*st->sumx;
 
   if (denom == 0.0) return 0.0;
 
-  return (ds->sumxx*ds->sumy - ds->sumx*ds->sumxy) / denom;
+  return (st->sumxx*st->sumy - st->sumx*st->sumxy) / denom;
 }
 
 double ds_leastsq_r(DS *ds)
 {
+  DS_STATS sum;
+  const DS_STATS *st = stats_read(ds, &sum);
   double denom;
 
-  denom = (ds->n*ds->sumxx - ds->sumx*ds->sumx) * (ds->n*ds->sumyy - ds->sumy*ds->sumy);
+  denom = (st->n*st->sumxx - st->sumx*st->sumx) * (st->n*st->sumyy - st->sumy*st->sumy);
 
   if (denom <= 0.0) return 0.0;
 
-  return (ds->n*ds->sumxy - ds->sumx*ds->sumy) / sqrt(denom);
+  return (st->n*st->sumxy - st->sumx*st->sumy) / sqrt(denom);
 }
 
 #define isspace(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
@@ -346,42 +961,42 @@ static int strspcmp(char *s, char *c)
 }
 #endif
 
-int compute_hash(char *buffer)
+/*
+  Hashes the first 'len' chars of 'buffer', the way compute_hash()
+  does for a whitespace-terminated token.
+*/
+static int compute_hash_span(const char *buffer, int len)
 {
   int hash;
-  int len;
 
-  if (isnullspace(buffer[0])) {
+  if (len <= 0) {
     return 0;
   }
   hash = ((int) buffer[0]) << 24;
 
-  if (isnullspace(buffer[1])) {
+  if (len == 1) {
     return hash + 1;
   }
   hash += ((int) buffer[1]) << 16;
 
-  if (isnullspace(buffer[2])) {
+  if (len == 2) {
     return hash + 2;
   }
   hash += ((int) buffer[2]) << 8;
 
-  if (isnullspace(buffer[3])) {
-    return hash + 3;
-  }
+  return hash + len;
+}
 
-  len = 4;
+int compute_hash(char *buffer)
+{
+  int len;
+
+  len = 0;
   while (! isnullspace(buffer[len])) len++;
-  hash += len;
 
-  return hash;
+  return compute_hash_span(buffer, len);
 }
 
-#define compute_hash_1(a) ((((int) (a)) << 24) + 1)
-#define compute_hash_2(a,b) ((((int) (a)) << 24) + (((int) (b)) << 16) + 2)
-#define compute_hash_3(a,b,c) ((((int) (a)) << 24) + (((int) (b)) << 16) + (((int) (c)) << 8) + 3)
-#define compute_hash_n(a,b,c,n) ((n) == 3 ? compute_hash_3(a,b,c) : (((int) (a)) << 24) + (((int) (b)) << 16) +(((int) (c)) << 8) + n)
-
 int decompute_hash(int hash, char *buffer)
 {
   int len;
@@ -421,15 +1036,49 @@ static int factorial(double x, double *f)
   return RPN_OK;
 }
 
-static int rpncalc_op(DS *ds, char *op)
+/*
+  Integer arithmetic, returning 0 if it would overflow, so the caller
+  can fall back to doubles.
+ */
+static int add_ll(long long a, long long b, long long *r)
+{
+  if (b > 0 ? a > LLONG_MAX - b : a < LLONG_MIN - b) return 0;
+  *r = a + b;
+  return 1;
+}
+
+static int sub_ll(long long a, long long b, long long *r)
+{
+  if (b < 0 ? a > LLONG_MAX + b : a < LLONG_MIN + b) return 0;
+  *r = a - b;
+  return 1;
+}
+
+static int mul_ll(long long a, long long b, long long *r)
+{
+  if (a == 0 || b == 0) {
+    *r = 0;
+    return 1;
+  }
+  if (a > 0 ?
+      (b > 0 ? a > LLONG_MAX / b : b < LLONG_MIN / a) :
+      (b > 0 ? a < LLONG_MIN / b : a < LLONG_MAX / b)) return 0;
+  *r = a * b;
+  return 1;
+}
+
+static int quote_solve(DS *ds, double a, double b, double *root);
+static int quote_integrate(DS *ds, double a, double b, double *area);
+static int quote_bench(DS *ds, double n, double *mean, double *least, double *sd);
+
+static int rpncalc_op(DS *ds, int hash)
 {
-  double val;
+  double val, sd;
   double top, next;
-  int hash;
+  DS_STATS *st, sum;
+  const DS_STATS *cst;
   int t;
-  int i, j;
-
-  hash = compute_hash(op);
+  long long i, j, k;
 
   switch (hash) {
   case compute_hash_1('c'):	/* c */
@@ -467,42 +1116,47 @@ static int rpncalc_op(DS *ds, char *op)
     if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
     if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
     if (ds->next % 2) return RPN_ERROR;
+    if (NULL == (st = ds_stats(ds))) return RPN_ERROR;
+    stats_begin(ds);
     for (t = 0; t < ds->next; t += 2) {
-      ds->sumx += ds->stack[t];
-      ds->sumy += ds->stack[t + 1];
-      ds->sumxx += ds->stack[t] * ds->stack[t];
-      ds->sumyy += ds->stack[t + 1] * ds->stack[t + 1];
-      ds->sumxy += ds->stack[t] * ds->stack[t + 1];
-      ds->n++;
+      st->sumx += ds->stack[t];
+      st->sumy += ds->stack[t + 1];
+      st->sumxx += ds->stack[t] * ds->stack[t];
+      st->sumyy += ds->stack[t + 1] * ds->stack[t + 1];
+      st->sumxy += ds->stack[t] * ds->stack[t + 1];
+      st->n++;
     }
+    stats_end(ds);
     ds->next = 0;
     return RPN_OK;
   case compute_hash_1('n'):	/* n, number of stat points */
-    return ds_push(ds, ds->n);
+    return ds_push(ds, stats_read(ds, &sum)->n);
   case compute_hash_2('s','x'): /* sx, sum of x */
-    return ds_push(ds, ds->sumx);
+    return ds_push(ds, stats_read(ds, &sum)->sumx);
   case compute_hash_2('s','y'): /* sy, sum of y */
-    return ds_push(ds, ds->sumy);
+    return ds_push(ds, stats_read(ds, &sum)->sumy);
   case compute_hash_3('s','x','x'): /* sxx, sum of x^2 */
-    return ds_push(ds, ds->sumxx);
+    return ds_push(ds, stats_read(ds, &sum)->sumxx);
   case compute_hash_3('s','y','y'): /* syy, sum of y^2 */
-    return ds_push(ds, ds->sumyy);
+    return ds_push(ds, stats_read(ds, &sum)->sumyy);
   case compute_hash_3('s','x','y'): /* sxy, sum of x*y */
-    return ds_push(ds, ds->sumxy);
+    return ds_push(ds, stats_read(ds, &sum)->sumxy);
   case compute_hash_2('m','x'):	/* mx, mean of x */
-    return ds->n == 0 || ds_push(ds, ds->sumx / ds->n);
+    cst = stats_read(ds, &sum);
+    return cst->n == 0 || ds_push(ds, cst->sumx / cst->n);
   case compute_hash_2('m','y'):	/* my, mean of y */
-    return ds->n == 0 || ds_push(ds, ds->sumy / ds->n);
+    cst = stats_read(ds, &sum);
+    return cst->n == 0 || ds_push(ds, cst->sumy / cst->n);
   case compute_hash_3('s','d','x'): /* sdx, stddev of x */
-    return ds->n < 2 || ds_push(ds, ds_stddev_x(ds));
+    return stats_read(ds, &sum)->n < 2 || ds_push(ds, ds_stddev_x(ds));
   case compute_hash_3('s','d','y'): /* sdy, stddev of y */
-    return ds->n < 2 || ds_push(ds, ds_stddev_y(ds));
+    return stats_read(ds, &sum)->n < 2 || ds_push(ds, ds_stddev_y(ds));
   case compute_hash_1('a'):	/* a in linear regression ax+b */
-    return ds->n < 2 || ds_push(ds, ds_leastsq_a(ds));
+    return stats_read(ds, &sum)->n < 2 || ds_push(ds, ds_leastsq_a(ds));
   case compute_hash_1('b'):	/* b in linear regression ax+b */
-    return ds->n < 2 || ds_push(ds, ds_leastsq_b(ds));
+    return stats_read(ds, &sum)->n < 2 || ds_push(ds, ds_leastsq_b(ds));
   case compute_hash_1('r'):	/* r, correlation coefficient */
-    return ds->n < 2 || ds_push(ds, ds_leastsq_r(ds));
+    return stats_read(ds, &sum)->n < 2 || ds_push(ds, ds_leastsq_r(ds));
   case compute_hash_n('=','b','a',5): /* =base */
     return ds_fromtop(ds, 0, &top) == RPN_OK ? ds_drop(ds), ds_setbase(ds, top) : RPN_ERROR;
   case compute_hash_n('=','p','r',5): /* =prec */
@@ -522,8 +1176,11 @@ static int rpncalc_op(DS *ds, char *op)
   case compute_hash_3('e','x','c'): /* exc, EXC */
     return ds_fromtop(ds, 0, &top) == RPN_OK ? ds_replace(ds, 1, ds->mem), ds->mem = top, 0 : RPN_ERROR;
   case compute_hash_2('-','+'):	/* -+ */
-    return ds_fromtop(ds, 0, &top) || ds_replace(ds, 1, -top);
   case compute_hash_2('+','-'):	/* +- */
+    t = ds->next - 1;
+    if (t >= 0 && ds_exact(ds, t) && ds->ival[t] != LLONG_MIN) {
+      return ds_replace_int(ds, 1, -ds->ival[t]);
+    }
     return ds_fromtop(ds, 0, &top) || ds_replace(ds, 1, -top);
   case compute_hash_3('i','n','v'): /* inv */
     return ds_fromtop(ds, 0, &top) || ! (fabs(top) > DBL_MIN) || ds_replace(ds, 1, 1.0 / top);
@@ -534,11 +1191,11 @@ static int rpncalc_op(DS *ds, char *op)
   case compute_hash_1('!'):	/* ! */
     return ds_fromtop(ds, 0, &top) || factorial(top, &val) || ds_replace(ds, 1, val);
   case compute_hash_3('s','i','n'): /* sin */
-    return ds_fromtop(ds, 0, &top) || ds_replace(ds, 1, sin(ds->angle_unit == 0 ? top : TORAD(top)));
+    return ds_fromtop(ds, 0, &top) || ds_replace(ds, 1, MATH(ds, sin)(ds->angle_unit == 0 ? top : TORAD(top)));
   case compute_hash_3('c','o','s'): /* cos */
-    return ds_fromtop(ds, 0, &top) || ds_replace(ds, 1, cos(ds->angle_unit == 0 ? top : TORAD(top)));
+    return ds_fromtop(ds, 0, &top) || ds_replace(ds, 1, MATH(ds, cos)(ds->angle_unit == 0 ? top : TORAD(top)));
   case compute_hash_3('t','a','n'): /* tan */
-    return ds_fromtop(ds, 0, &top) || ds_replace(ds, 1, tan(ds->angle_unit == 0 ? top : TORAD(top)));
+    return ds_fromtop(ds, 0, &top) || ds_replace(ds, 1, MATH(ds, tan)(ds->angle_unit == 0 ? top : TORAD(top)));
   case compute_hash_n('s','i','n',4): /* sinh */
     if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
     errno = 0;
@@ -571,7 +1228,7 @@ static int rpncalc_op(DS *ds, char *op)
   case compute_hash_n('a','t','a',5): /* atan2 */
     if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
     if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
-    val = atan2(next, top);
+    val = MATH(ds, atan2)(next, top);
     return ds_replace(ds, 2, ds->angle_unit == 0 ? val : TODEG(val));
   case compute_hash_3('e','x','p'): /* exp */
     return ds_fromtop(ds, 0, &top) || ds_replace(ds, 1, exp(top));
@@ -599,6 +1256,12 @@ static int rpncalc_op(DS *ds, char *op)
   case compute_hash_3('d','e','g'): /* deg */
     ds->angle_unit = 1;
     return RPN_OK;
+  case compute_hash_n('f','a','s',4): /* fast, math by rpnfast.h */
+    ds->fastmath = 1;
+    return RPN_OK;
+  case compute_hash_n('l','i','b',4): /* libm */
+    ds->fastmath = 0;
+    return RPN_OK;
   case compute_hash_n('t','o','d',5): /* todeg */
     return ds_fromtop(ds, 0, &top) || ds_replace(ds, 1, TODEG(top));
   case compute_hash_n('t','o','r',5): /* torad */
@@ -609,37 +1272,47 @@ static int rpncalc_op(DS *ds, char *op)
     return ds_fromtop(ds, 0, &top) || ds_replace(ds, 1, TOCELSIUS(top));
   case compute_hash_n('x','s','t',5): /* xstat */
     if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
+    if (NULL == (st = ds_stats(ds))) return RPN_ERROR;
+    stats_begin(ds);
     for (t = 0; t < ds->next; t++) {
-      ds->sumx += ds->n;
-      ds->sumy += ds->stack[t];
-      ds->sumxx += ds->n * ds->n;
-      ds->sumyy += ds->stack[t] * ds->stack[t];
-      ds->sumxy += ds->n * ds->stack[t];
-      ds->n++;
+      st->sumx += st->n;
+      st->sumy += ds->stack[t];
+      st->sumxx += st->n * st->n;
+      st->sumyy += ds->stack[t] * ds->stack[t];
+      st->sumxy += st->n * ds->stack[t];
+      st->n++;
     }
+    stats_end(ds);
     ds->next = 0;
     return RPN_OK;
   case compute_hash_1('+'):	/* + */
+    if (ds_ints(ds) && add_ll(ds->ival[ds->next - 2], ds->ival[ds->next - 1], &k)) {
+      return ds_replace_int(ds, 2, k);
+    }
     return ds_fromtop(ds, 1, &next) || ds_fromtop(ds, 0, &top) || ds_replace(ds, 2, next + top);
   case compute_hash_1('-'):	/* - */
+    if (ds_ints(ds) && sub_ll(ds->ival[ds->next - 2], ds->ival[ds->next - 1], &k)) {
+      return ds_replace_int(ds, 2, k);
+    }
     return ds_fromtop(ds, 1, &next) || ds_fromtop(ds, 0, &top) || ds_replace(ds, 2, next - top);
   case compute_hash_1('*'):	/* * */
   case compute_hash_1('x'):	/* x */
+    if (ds_ints(ds) && mul_ll(ds->ival[ds->next - 2], ds->ival[ds->next - 1], &k)) {
+      return ds_replace_int(ds, 2, k);
+    }
     return ds_fromtop(ds, 1, &next) || ds_fromtop(ds, 0, &top) || ds_replace(ds, 2, next * top);
   case compute_hash_1('/'):	/* / */
     return ds_fromtop(ds, 1, &next) || ds_fromtop(ds, 0, &top) || ! (fabs(top) > DBL_MIN) || ds_replace(ds, 2, next / top);
   case compute_hash_3('d','i','v'): /* div */
-    if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
-    if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
-    i = round(next), j = round(top);
-    if (j == 0) return RPN_ERROR;
-    return ds_replace(ds, 2, i / j);
+    if (ds_fromtop_int(ds, 1, &i)) return RPN_ERROR;
+    if (ds_fromtop_int(ds, 0, &j)) return RPN_ERROR;
+    if (j == 0 || (j == -1 && i == LLONG_MIN)) return RPN_ERROR;
+    return ds_replace_int(ds, 2, i / j);
   case compute_hash_3('m','o','d'): /* mod */
-    if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
-    if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
-    i = round(next), j = round(top);
+    if (ds_fromtop_int(ds, 1, &i)) return RPN_ERROR;
+    if (ds_fromtop_int(ds, 0, &j)) return RPN_ERROR;
     if (j == 0) return RPN_ERROR;
-    return ds_replace(ds, 2, i % j);
+    return ds_replace_int(ds, 2, j == -1 ? 0 : i % j);
   case compute_hash_n('f','m','o',4): /* fmod */
     if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
     if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
@@ -658,39 +1331,42 @@ static int rpncalc_op(DS *ds, char *op)
     val = pow(next, top);
     return errno || ds_replace(ds, 2, val);
   case compute_hash_2('>','>'):	      /* >> */
-    if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
-    if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
-    i = round(next), j = round(top);
-    return ds_replace(ds, 2, i >> j);
-  case compute_hash_2('<','<'):	      /* >> */
-    if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
-    if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
-    i = round(next), j = round(top);
-    return ds_replace(ds, 2, i << j);
+    if (ds_fromtop_int(ds, 1, &i)) return RPN_ERROR;
+    if (ds_fromtop_int(ds, 0, &j)) return RPN_ERROR;
+    if (j < 0 || j > 63) return RPN_ERROR;
+    return ds_replace_int(ds, 2, i >> j);
+  case compute_hash_2('<','<'):	      /* << */
+    if (ds_fromtop_int(ds, 1, &i)) return RPN_ERROR;
+    if (ds_fromtop_int(ds, 0, &j)) return RPN_ERROR;
+    if (j < 0 || j > 63) return RPN_ERROR;
+    return ds_replace_int(ds, 2, (long long) ((unsigned long long) i << j));
   case compute_hash_1('|'):	      /* | */
-    if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
-    if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
-    i = round(next), j = round(top);
-    return ds_replace(ds, 2, i | j);
-  case compute_hash_1('&'):	      /* | */
-    if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
-    if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
-    i = round(next), j = round(top);
-    return ds_replace(ds, 2, i & j);
-  case compute_hash_1('~'):	      /* | */
-    if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
-    i = round(top);
-    return ds_replace(ds, 1, ~i);
+    if (ds_fromtop_int(ds, 1, &i)) return RPN_ERROR;
+    if (ds_fromtop_int(ds, 0, &j)) return RPN_ERROR;
+    return ds_replace_int(ds, 2, i | j);
+  case compute_hash_1('&'):	      /* & */
+    if (ds_fromtop_int(ds, 1, &i)) return RPN_ERROR;
+    if (ds_fromtop_int(ds, 0, &j)) return RPN_ERROR;
+    return ds_replace_int(ds, 2, i & j);
+  case compute_hash_1('~'):	      /* ~ */
+    if (ds_fromtop_int(ds, 0, &i)) return RPN_ERROR;
+    return ds_replace_int(ds, 1, ~i);
   case compute_hash_n('t','o','x',4): /* toxy, r-theta to x-y conversion */
     if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
     if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
     ds->next -= 2;
-    return ds_push(ds, next * cos(ds->angle_unit == 0 ? top : TORAD(top))) || ds_push(ds, next * sin(ds->angle_unit == 0 ? top : TORAD(top)));
+    if (ds->angle_unit != 0) top = TORAD(top);
+    if (ds->fastmath) {
+      rpn_fast_sincos(top, &val, &top);
+    } else {
+      val = sin(top), top = cos(top);
+    }
+    return ds_push(ds, next * top) || ds_push(ds, next * val);
   case compute_hash_n('t','o','r',4): /* tort, x-y to r-theta conversion */
     if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
     if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
     ds->next -= 2;
-    val = atan2(top, next);
+    val = MATH(ds, atan2)(top, next);
     return ds_push(ds, sqrt(next*next + top*top)) || ds_push(ds, ds->angle_unit == 0 ? val : TODEG(val));
 
   case compute_hash_n('m','i','2',4): /* mi2m */
@@ -700,34 +1376,59 @@ static int rpncalc_op(DS *ds, char *op)
   case compute_hash_n('i','n','2',5): /* in2mm */
     return ds_push(ds, CONV_IN_TO_MM);
 
+    /* sub-expressions */
+  case compute_hash_n('s','o','l',5): /* solve, for a root of [ f ] in [next, top] */
+    return ds_fromtop(ds, 1, &next) || ds_fromtop(ds, 0, &top) || quote_solve(ds, next, top, &val) || ds_replace(ds, 2, val);
+  case compute_hash_n('i','n','t',9): /* integrate [ f ] from next to top */
+    return ds_fromtop(ds, 1, &next) || ds_fromtop(ds, 0, &top) || quote_integrate(ds, next, top, &val) || ds_replace(ds, 2, val);
+  case compute_hash_n('=','t','o',4): /* =tol */
+    if (ds_fromtop(ds, 0, &top) || ! (top > 0.0)) return RPN_ERROR;
+    return ds_settol(ds, top) || ds_drop(ds);
+  case compute_hash_n('?','t','o',4): /* ?tol */
+    return ds_push(ds, ds_tol(ds));
+  case compute_hash_n('n','f','e',4): /* nfev, evaluations by the last solve or integrate */
+    return ds_push_int(ds, NULL != ds->solve ? ds->solve->nfev : 0);
+
     /* time */
   case compute_hash_n('t','i','m',4): /* time */
     return ds_push(ds, ptime());
+  case compute_hash_2('n','s'): /* ns, on the monotonic clock */
+    return ds_push_int(ds, ptime_ns());
+  case compute_hash_n('b','e','n',5): /* bench, time [ f ] top times */
+    if (ds_fromtop(ds, 0, &top) || ds->next + 2 > ds->size ||
+	quote_bench(ds, top, &val, &next, &sd)) {
+      return RPN_ERROR;
+    }
+    ds->next--;
+    return ds_push(ds, val) || ds_push(ds, next) || ds_push(ds, sd);
 
     /* random variates */
   case compute_hash_n('=','u','r',6): /* =urand, set a and b */
     if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
     if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
+    if (NULL == ds_rand(ds)) return RPN_ERROR;
     ds->next -= 2;
-    uniform_random_set(&ds->urand, next, top);
+    uniform_random_set(&ds->rand->urand, next, top);
     return RPN_OK;
   case compute_hash_n('=','n','r',6): /* =nrand, set mean and sd */
     if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
     if (ds_fromtop(ds, 1, &next)) return RPN_ERROR;
+    if (NULL == ds_rand(ds)) return RPN_ERROR;
     ds->next -= 2;
-    normal_random_set(&ds->nrand, next, top);
+    normal_random_set(&ds->rand->nrand, next, top);
     return RPN_OK;
   case compute_hash_n('=','e','r',6): /* =erand, set sd */
     if (ds_fromtop(ds, 0, &top)) return RPN_ERROR;
+    if (NULL == ds_rand(ds)) return RPN_ERROR;
     ds->next -= 1;
-    exponential_random_set(&ds->erand, top);
+    exponential_random_set(&ds->rand->erand, top);
     return RPN_OK;
   case compute_hash_n('u','r','a',5): /* urand, uniform random number */
-    return ds_push(ds, uniform_random_real(&ds->urand));
+    return NULL == ds_rand(ds) || ds_push(ds, uniform_random_real(&ds->rand->urand));
   case compute_hash_n('n','r','a',5): /* nrand, normal random number */
-    return ds_push(ds, normal_random_real(&ds->nrand));
+    return NULL == ds_rand(ds) || ds_push(ds, normal_random_real(&ds->rand->nrand));
   case compute_hash_n('e','r','a',5): /* erand, exponential random number */
-    return ds_push(ds, exponential_random_real(&ds->erand));
+    return NULL == ds_rand(ds) || ds_push(ds, exponential_random_real(&ds->rand->erand));
 
     /* useful constants */
   case compute_hash_2('p','i'):	/* pi */
@@ -790,24 +1491,33 @@ char tocharbase(int digit, int base)
   return '0';
 }
 
-static char *skipwhite(char *buffer)
+/*
+  The tokenizer. It only looks at the span it's given, so the text
+  needn't be null-terminated or copied, but a null ends it early.
+ */
+const char *rpn_next_token(const char **ptr, const char *end, size_t *len)
 {
-  while (isspace(*buffer)) buffer++;
-
-  return buffer;
-}
+  const char *p = *ptr;
+  const char *start;
 
-static char *skipnonwhite(char *buffer)
-{
-  while (! isspace(*buffer) && *buffer != 0) buffer++;
+  while (p < end && isspace(*p)) p++;
+  if (p == end || 0 == *p) {
+    *ptr = p;
+    return NULL;
+  }
+  start = p;
+  while (p < end && ! isnullspace(*p)) p++;
+  *len = p - start;
+  *ptr = p;
 
-  return buffer;
+  return start;
 }
 
 /*
-  a replacement for strtod, sort of
+  a replacement for strtod, sort of, converting the 'len' chars
+  of the token at 'ptr'
  */
-static int convert_s_to_d(char *ptr, double *x, int base)
+int convert_sn_to_d(const char *ptr, int len, double *x, int base)
 {
   double num = 0.0, fracnum;
   int started = 0;
@@ -818,9 +1528,10 @@ static int convert_s_to_d(char *ptr, double *x, int base)
   int t;
   char c;
 
-  if (0 == *(ptr = skipwhite(ptr))) return RPN_ERROR;
+  if (len <= 0) return RPN_ERROR;
 
-  while (0 != (c = *ptr++) &&
+  while (len-- > 0 &&
+	 0 != (c = *ptr++) &&
 	 !isspace(c)) {
     if (c == '-') {
       if (started) return RPN_ERROR;	/* already in number */
@@ -882,6 +1593,65 @@ static int convert_s_to_d(char *ptr, double *x, int base)
   return (gotnum == 1 ? RPN_OK : RPN_ERROR);
 }
 
+/*
+  converts the 'len' chars at 'ptr' exactly as an integer, failing if
+  there's anything but an optional sign and digits, or it's too big.
+  In power-of-two bases an unsigned one is a bit pattern, up to 2^64-1,
+  so a mask like FFFF8000DEADBEEF is its 64 bits, negative as a long
+  long, though its double, for arithmetic, is still its unsigned value.
+ */
+static int convert_sn_to_ll(const char *ptr, int len, long long *x, int base)
+{
+  unsigned long long num = 0;
+  unsigned long long limit;
+  int minus = 0;
+  int digit;
+
+  if (len > 0 && ('-' == *ptr || '+' == *ptr)) {
+    minus = ('-' == *ptr);
+    ptr++, len--;
+  }
+  if (len <= 0) return RPN_ERROR;
+  if (minus) {
+    limit = (unsigned long long) LLONG_MAX + 1;
+  } else if (0 == (base & (base - 1))) {
+    limit = ULLONG_MAX;
+  } else {
+    limit = LLONG_MAX;
+  }
+
+  for (; len > 0; ptr++, len--) {
+    if (! isdigitbase(*ptr, base)) return RPN_ERROR;
+    digit = (int) todoublebase(*ptr, base);
+    if (num > (limit - digit) / base) return RPN_ERROR;
+    num = num * base + digit;
+  }
+  *x = minus ? (long long) (0 - num) : (long long) num;
+
+  return RPN_OK;
+}
+
+/*
+  converts a number token, noting whether it's an integer, which is
+  exact even if it's too big for a double to hold exactly
+ */
+static int convert_sn(const char *ptr, int len, int base, double *x, long long *i, int *isint)
+{
+  if (0 != convert_sn_to_d(ptr, len, x, base)) return RPN_ERROR;
+
+  *isint = 0;
+  if (NULL != memchr(ptr, '.', len)) return RPN_OK;
+  if (fabs(*x) < TWO_TO_53) {
+    *i = (long long) *x;
+    *isint = 1;
+  } else if (RPN_OK == convert_sn_to_ll(ptr, len, i, base)) {
+    /* a bit pattern's double stays its unsigned value, *i's negative */
+    *isint = 1;
+  }
+
+  return RPN_OK;
+}
+
 int convert_d_to_s(char *buf, double x, int base, int prec, int n)
 {
   double base_to_prec;
@@ -964,55 +1734,700 @@ int convert_d_to_s(char *buf, double x, int base, int prec, int n)
   return RPN_OK;
 }
 
+/*
+  Integers are formatted straight from their bits in power-of-two
+  bases, unsigned, so hex and binary are exact across all 64 of them
+  and a mask with the top bit set prints as its bits, not negated.
+ */
+int convert_ll_to_s(char *buf, long long x, int base, int len)
+{
+  char digits[64];
+  unsigned long long num;
+  int minus = 0;
+  int shift;
+  int n = 0;
+
+  if (base < 2 || base > 36) return RPN_ERROR;
+
+  if (0 == (base & (base - 1))) {
+    num = (unsigned long long) x;
+    for (shift = 0; (1 << shift) < base; shift++) ;
+    do {
+      digits[n++] = tocharbase((int) (num & (base - 1)), base);
+      num >>= shift;
+    } while (num != 0);
+  } else {
+    minus = x < 0;
+    num = minus ? 0 - (unsigned long long) x : (unsigned long long) x;
+    do {
+      digits[n++] = tocharbase((int) (num % base), base);
+      num /= base;
+    } while (num != 0);
+  }
+
+  if (n + minus >= len) return RPN_ERROR;
+  if (minus) *buf++ = '-';
+  while (n > 0) *buf++ = digits[--n];
+  *buf = 0;
+
+  return RPN_OK;
+}
+
+int ds_format(DS *ds, int t, char *buf, int len)
+{
+  if (t < 0 || t >= ds->next) return RPN_ERROR;
+
+  if (DS_PRINTINT(ds->itag, t, ds->ival[t], ds->stack[t], ds->base)) {
+    return convert_ll_to_s(buf, ds->ival[t], ds->base, len);
+  }
+
+  return convert_d_to_s(buf, ds->stack[t], ds->base, ds->prec, len);
+}
+
+/*
+  Starts a quote, replacing the last one, or adds a token to the one
+  being read, compiling it when its closing bracket comes.
+ */
+static int quote_token(DS *ds, const RPN_TOKEN *tok)
+{
+  RPN_QUOTE *q = ds_quote(ds);
+  char *text;
+  size_t size;
+
+  if (NULL == q || 0 == q->depth) {
+    if (NULL == q) {
+      if (NULL == ds_solve(ds)) return RPN_ERROR;
+      q = (RPN_QUOTE *) calloc(1, sizeof(*q));
+      if (NULL == q) return RPN_ERROR;
+      rpn_prog_init(&q->prog);
+      ds->solve->quote = q;
+    }
+    q->len = 0;
+    q->prog.num = q->prog.nargs = 0;
+    q->depth = 1;
+    return RPN_OK;
+  }
+
+  if (tok->hash == compute_hash_1('[')) {
+    q->depth++;
+  } else if (tok->hash == compute_hash_1(']') && 0 == --q->depth) {
+    if (RPN_OK != rpncalc_compilen(ds, q->text, q->len, &q->prog)) {
+      free_quote(q);
+      ds->solve->quote = NULL;
+      return RPN_ERROR;
+    }
+    return RPN_OK;
+  }
+
+  if (q->len + tok->len + 1 > q->size) {
+    size = 2 * (q->len + tok->len + 1);
+    text = (char *) realloc(q->text, size);
+    if (NULL == text) {
+      free_quote(q);
+      ds->solve->quote = NULL;
+      return RPN_ERROR;
+    }
+    q->text = text;
+    q->size = size;
+  }
+  memcpy(q->text + q->len, tok->text, tok->len);
+  q->len += tok->len;
+  q->text[q->len++] = ' ';
+
+  return RPN_OK;
+}
+
+/* a registered operator, on the stack in place */
+static int run_op(DS *ds, const RPN_OP *op)
+{
+  double y;
+
+  if (ds->next < op->arity || (0 == op->arity && ds->next == ds->size) ||
+      RPN_OK != op->fn(ds->stack + ds->next - op->arity, &y)) {
+    return RPN_ERROR;
+  }
+
+  return 0 == op->arity ? ds_push(ds, y) : ds_replace(ds, op->arity, y);
+}
+
+/*
+  Runs one token. Operators are handled first, registered ones before
+  built-in ones, then numbers. Since the operator names are all lower
+  case and the interpreter is case-sensitive, to input numbers that may
+  be confused with operators (e.g., dec), numbers should be uppercase,
+  e.g., DEC for 0xDEC.
+
+  A token converted ahead of time in the calc's current base is pushed
+  as is, otherwise its text is converted now. An argument reference
+  pushes its argument.
+ */
+static int rpncalc_token(DS *ds, const RPN_TOKEN *tok, const double *args, int nargs)
+{
+  double x;
+  long long i;
+  int isint;
+
+  if ((NULL != ds->solve && NULL != ds->solve->quote && ds->solve->quote->depth > 0) ||
+      tok->hash == compute_hash_1('[')) {
+    return quote_token(ds, tok);
+  }
+
+  if (tok->arg > 0) {
+    return tok->arg <= nargs ? ds_push(ds, args[tok->arg - 1]) : RPN_ERROR;
+  }
+
+  if (tok->hash == compute_hash_1('?')) return RPN_HELP;
+  if (tok->hash == compute_hash_1('q')) return RPN_QUIT;
+
+  if (tok->op > 0) {
+    return run_op(ds, &rpn_op_table[tok->op - 1]);
+  }
+
+  if (0 == rpncalc_op(ds, tok->hash)) {
+    /* it's an operator, we just handled it */
+    return RPN_OK;
+  }
+
+  if (tok->base == ds->base) {
+    x = tok->val, i = tok->ival, isint = tok->isint;
+  } else if (0 != convert_sn(tok->text, tok->len, ds->base, &x, &i, &isint)) {
+    /* it's not an operator or number */
+    return RPN_ERROR;
+  }
+
+  /* it's a number, so push it */
+  if (isint) {
+    push_lit(ds, x, i);
+  } else {
+    ds_push(ds, x);
+  }
+
+  return RPN_OK;
+}
+
 /*
   this is used to evaluate an incremental calc, where the stack
   is preserved between calls. To get the value out, do an
   rpncalc_pop() when you want the final value
  */
-int rpncalc_eval(DS *ds, char *ptr)
+int rpncalc_eval(DS *ds, const char *ptr)
 {
-  double x;
+  return rpncalc_evaln(ds, ptr, strlen(ptr));
+}
+
+/*
+  Like rpncalc_eval(), but of the 'len' chars at 'ptr', which needn't
+  be null-terminated or writable, so lines can be evaluated right
+  where they are in a bigger buffer.
+ */
+int rpncalc_evaln(DS *ds, const char *ptr, size_t len)
+{
+  RPN_TOKEN tok;
+  const char *end;
+  size_t toklen;
+  int retval;
+
+  tok.base = 0;			/* numbers are converted only if needed */
+  tok.val = 0.0;
+  tok.arg = 0;
+  tok.isint = 0;
+  tok.ival = 0;
+  end = ptr + len;
+
+  while (NULL != (tok.text = rpn_next_token(&ptr, end, &toklen))) {
+    tok.len = toklen;
+    tok.hash = compute_hash_span(tok.text, tok.len);
+    tok.op = rpncalc_find_op(tok.text, tok.len);
+    retval = rpncalc_token(ds, &tok, NULL, 0);
+    if (RPN_OK != retval) return retval;
+  }
+
+  return RPN_OK;
+}
+
+void rpn_stream_init(RPN_STREAM *st)
+{
+  st->carrylen = 0;
+  st->retval = RPN_OK;
+}
+
+/*
+  Evaluates the whole tokens in a piece of a line in place, holding
+  back one running into the end of the piece, since it may go on in
+  the next. Only that token is copied, to be finished and evaluated
+  by the next piece or the end of the line. Once there's an error, or
+  help or quit, the rest of the line is skipped, as rpncalc_eval()
+  would.
+ */
+int rpncalc_feed(DS *ds, RPN_STREAM *st, const char *ptr, size_t len)
+{
+  const char *end = ptr + len;
+  const char *start;
+  size_t n;
+
+  if (RPN_OK != st->retval) return st->retval;
+
+  if (st->carrylen > 0) {
+    for (start = ptr; ptr < end && ! isnullspace(*ptr); ptr++) ;
+    n = ptr - start;
+    if (n > sizeof(st->carry) - st->carrylen) return st->retval = RPN_ERROR;
+    memcpy(st->carry + st->carrylen, start, n);
+    st->carrylen += n;
+    if (ptr == end) return RPN_OK; /* it goes on still */
+    st->retval = rpncalc_evaln(ds, st->carry, st->carrylen);
+    st->carrylen = 0;
+    if (RPN_OK != st->retval) return st->retval;
+  }
+
+  for (start = end; start > ptr && ! isnullspace(start[-1]); start--) ;
+  n = end - start;
+  if (n > sizeof(st->carry)) return st->retval = RPN_ERROR;
+  st->retval = rpncalc_evaln(ds, ptr, start - ptr);
+  if (RPN_OK == st->retval) {
+    memcpy(st->carry, start, n);
+    st->carrylen = n;
+  }
+
+  return st->retval;
+}
+
+int rpncalc_feed_end(DS *ds, RPN_STREAM *st)
+{
+  int retval = st->retval;
+
+  if (RPN_OK == retval && st->carrylen > 0) {
+    retval = rpncalc_evaln(ds, st->carry, st->carrylen);
+  }
+  rpn_stream_init(st);
+
+  return retval;
+}
+
+int rpn_prog_init(RPN_PROG *prog)
+{
+  prog->tok = NULL;
+  prog->num = 0;
+  prog->size = 0;
+  prog->nargs = 0;
+
+  return RPN_OK;
+}
+
+void rpn_prog_free(RPN_PROG *prog)
+{
+  free(prog->tok);
+  rpn_prog_init(prog);
+}
+
+/*
+  Appends the 'len' chars at 'text' to the program as one token,
+  converting it to a number in 'base' now so that running it later
+  needn't, or resolving it if it's an argument reference like $3.
+  The text is referenced, not copied.
+ */
+int rpn_prog_add(RPN_PROG *prog, const char *text, int len, int base)
+{
+  RPN_TOKEN *tok;
+  int size;
+  int t;
+
+  if (prog->num == prog->size) {
+    size = prog->size < 16 ? 16 : 2 * prog->size;
+    tok = (RPN_TOKEN *) realloc(prog->tok, size * sizeof(*tok));
+    if (NULL == tok) return RPN_ERROR;
+    prog->tok = tok;
+    prog->size = size;
+  }
+
+  tok = &prog->tok[prog->num++];
+  tok->hash = compute_hash_span(text, len);
+  tok->op = rpncalc_find_op(text, len);
+  tok->text = text;
+  tok->len = len;
+  tok->arg = 0;
+  if (len > 1 && '$' == text[0]) {
+    for (t = 1; t < len && text[t] >= '0' && text[t] <= '9'; t++) {
+      tok->arg = 10 * tok->arg + text[t] - '0';
+    }
+    if (t < len || tok->arg == 0) {
+      prog->num--;
+      return RPN_ERROR;
+    }
+    if (tok->arg > prog->nargs) prog->nargs = tok->arg;
+  }
+  if (0 == convert_sn(text, len, base, &tok->val, &tok->ival, &tok->isint)) {
+    tok->base = base;
+  } else {
+    tok->base = 0;		/* not a number here, convert when run */
+    tok->val = 0.0;
+  }
+
+  return RPN_OK;
+}
+
+/*
+  Tokenizes an RPN string into 'prog', appending to what's there,
+  converting numbers in the base the calc will be in when they are
+  reached. Base changes that depend on the stack (=base) can't be
+  known now, and numbers after them are converted when run.
+ */
+int rpncalc_compile(DS *ds, const char *ptr, RPN_PROG *prog)
+{
+  return rpncalc_compilen(ds, ptr, strlen(ptr), prog);
+}
+
+int rpncalc_compilen(DS *ds, const char *ptr, size_t len, RPN_PROG *prog)
+{
+  const char *end = ptr + len;
+  const char *tok;
+  size_t toklen;
   int base;
+  int hash;
 
-  while (0 != *(ptr = skipwhite(ptr))) {
-    /*
-      Handle operators first, then numbers. Since the operator names
-      are all lower case and the interpreter is case-sensitive, to
-      input numbers that may be confused with operators (e.g., dec),
-      numbers should be uppercase, e.g., DEC for 0xDEC.
-    */
-    if ('?' == ptr[0] && (0 == ptr[1] || isspace(ptr[1]))) return RPN_HELP;
-    if ('q' == ptr[0] && (0 == ptr[1] || isspace(ptr[1]))) return RPN_QUIT;
-    base = ds_base(ds);
-    if (0 != rpncalc_op(ds, ptr)) {
-      if (0 == convert_s_to_d(ptr, &x, base)) {
-	/* it's a number, so push it */
-	ds_push(ds, x);
+  base = ds_base(ds);
+
+  while (NULL != (tok = rpn_next_token(&ptr, end, &toklen))) {
+    if (0 != rpn_prog_add(prog, tok, toklen, base)) return RPN_ERROR;
+    hash = prog->tok[prog->num - 1].hash;
+    if (hash == compute_hash_3('d','e','c')) base = 10;
+    else if (hash == compute_hash_3('h','e','x')) base = 16;
+    else if (hash == compute_hash_3('b','i','n')) base = 2;
+  }
+
+  return RPN_OK;
+}
+
+/*
+  Runs a compiled program on a calc, just like rpncalc_eval() would
+  have done with the string it came from.
+ */
+int rpncalc_run(DS *ds, const RPN_PROG *prog)
+{
+  return rpncalc_run_args(ds, prog, NULL, 0);
+}
+
+/*
+  Runs a compiled program with values for its $n references.
+ */
+int rpncalc_run_args(DS *ds, const RPN_PROG *prog, const double *args, int nargs)
+{
+  const RPN_TOKEN *tok;
+  const RPN_TOKEN *end;
+  int retval;
+
+  for (tok = prog->tok, end = tok + prog->num; tok < end; tok++) {
+    retval = rpncalc_token(ds, tok, args, nargs);
+    if (RPN_OK != retval) return retval;
+  }
+
+  return RPN_OK;
+}
+
+/*
+  Evaluating the quote as f(x), on a scratch calc with the settings
+  and memory of the one it's from, counting evaluations.
+ */
+
+enum {QUOTE_STACKSIZE = 64};
+enum {SOLVE_ITERATIONS = 200};	/* most steps to a root */
+enum {INTEGRATE_INTERVALS = 256}; /* most subintervals */
+enum {INTEGRATE_STALL = 32};	/* most splits without the error falling */
+
+typedef struct {
+  DS ds;
+  double stack[QUOTE_STACKSIZE];
+  const RPN_PROG *prog;
+  long *nfev;
+} quote_fn;
+
+static int quote_fn_init(quote_fn *f, DS *ds)
+{
+  RPN_QUOTE *q = ds_quote(ds);
+
+  if (NULL == q || q->depth > 0) return RPN_ERROR;
+
+  ds_init(&f->ds, f->stack, QUOTE_STACKSIZE);
+  f->ds.base = ds->base;
+  f->ds.sigfig = ds->sigfig;
+  f->ds.askprec = ds->askprec;
+  f->ds.prec = ds->prec;
+  f->ds.angle_unit = ds->angle_unit;
+  f->ds.fastmath = ds->fastmath;
+  f->ds.mem = ds->mem;
+  if (RPN_OK != ds_settol(&f->ds, ds_tol(ds))) return RPN_ERROR;
+  f->prog = &q->prog;
+  f->nfev = &ds->solve->nfev;
+  *f->nfev = 0;
+
+  return RPN_OK;
+}
+
+static int quote_fn_eval(quote_fn *f, double x, double *y)
+{
+  (*f->nfev)++;
+  f->ds.next = 0;
+  if (RPN_OK != ds_push(&f->ds, x) ||
+      RPN_OK != rpncalc_run(&f->ds, f->prog) ||
+      RPN_OK != ds_pop(&f->ds, y)) {
+    return RPN_ERROR;
+  }
+
+  return *y == *y ? RPN_OK : RPN_ERROR; /* NaN */
+}
+
+/*
+  Brent's method: keeping a root bracketed between b, the best guess,
+  and c, step by inverse quadratic interpolation, or the secant if
+  there are only two points, when that lands well inside the bracket
+  and is shrinking it fast enough, and by bisection when not.
+ */
+static int brent(quote_fn *f, double a, double b, double tol, double *root)
+{
+  double c, d, e, fa, fb, fc;
+  double p, q, r, s, tol1, xm;
+  int t;
+
+  if (quote_fn_eval(f, a, &fa) || quote_fn_eval(f, b, &fb)) return RPN_ERROR;
+  if ((fa > 0.0 && fb > 0.0) || (fa < 0.0 && fb < 0.0)) return RPN_ERROR;
+
+  c = b, fc = fb;
+  d = e = b - a;
+  for (t = 0; t < SOLVE_ITERATIONS; t++) {
+    if ((fb > 0.0 && fc > 0.0) || (fb < 0.0 && fc < 0.0)) {
+      c = a, fc = fa;
+      d = e = b - a;
+    }
+    if (fabs(fc) < fabs(fb)) {
+      a = b, b = c, c = a;
+      fa = fb, fb = fc, fc = fa;
+    }
+    tol1 = 2.0 * DBL_EPSILON * fabs(b) + 0.5 * tol;
+    xm = 0.5 * (c - b);
+    if (fabs(xm) <= tol1 || fb == 0.0) {
+      *root = b;
+      return RPN_OK;
+    }
+    if (fabs(e) >= tol1 && fabs(fa) > fabs(fb)) {
+      s = fb / fa;
+      if (a == c) {
+	p = 2.0 * xm * s;
+	q = 1.0 - s;
+      } else {
+	q = fa / fc;
+	r = fb / fc;
+	p = s * (2.0 * xm * q * (q - r) - (b - a) * (r - 1.0));
+	q = (q - 1.0) * (r - 1.0) * (s - 1.0);
+      }
+      if (p > 0.0) q = -q;
+      p = fabs(p);
+      if (2.0 * p < 3.0 * xm * q - fabs(tol1 * q) && 2.0 * p < fabs(e * q)) {
+	e = d;
+	d = p / q;
       } else {
-	/* it's not an operator or number */
-	return RPN_ERROR;
+	d = e = xm;
       }
+    } else {
+      d = e = xm;
     }
-    /* else it's an operator, we just handled it */
+    a = b, fa = fb;
+    b += fabs(d) > tol1 ? d : xm > 0.0 ? tol1 : -tol1;
+    if (quote_fn_eval(f, b, &fb)) return RPN_ERROR;
+  }
 
-    /* go on to the next one */
-    ptr = skipnonwhite(ptr);
+  return RPN_ERROR;
+}
+
+static int quote_solve(DS *ds, double a, double b, double *root)
+{
+  quote_fn f;
+  double scale = fabs(a) > fabs(b) ? fabs(a) : fabs(b);
+  int retval;
+
+  if (RPN_OK != quote_fn_init(&f, ds)) return RPN_ERROR;
+  retval = brent(&f, a, b, ds_tol(ds) * (scale > 1.0 ? scale : 1.0), root);
+  ds_free(&f.ds);
+
+  return retval;
+}
+
+/*
+  The 15-point Gauss-Kronrod rule on [a, b], with the embedded 7-point
+  Gauss rule's difference from it as the error estimate, and the rule
+  on |f| for the scale of the area. Nodes are from 1 in, the odd ones
+  the Gauss rule's, and the center last.
+ */
+static const double gk_x[8] = {
+  0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+  0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+  0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+  0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+};
+static const double gk_wk[8] = {
+  0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+  0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+  0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+  0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+static const double gk_wg[4] = {
+  0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+  0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+
+typedef struct {
+  double a, b;
+  double area;
+  double absarea;		/* of |f| */
+  double err;
+} gk_interval;
+
+static int gauss_kronrod(quote_fn *f, gk_interval *v)
+{
+  double center = 0.5 * (v->a + v->b);
+  double half = 0.5 * (v->b - v->a);
+  double fc, f1, f2, k, g, ka;
+  int t;
+
+  if (quote_fn_eval(f, center, &fc)) return RPN_ERROR;
+  k = fc * gk_wk[7];
+  g = fc * gk_wg[3];
+  ka = fabs(fc) * gk_wk[7];
+  for (t = 0; t < 7; t++) {
+    if (quote_fn_eval(f, center - half * gk_x[t], &f1) ||
+	quote_fn_eval(f, center + half * gk_x[t], &f2)) {
+      return RPN_ERROR;
+    }
+    k += gk_wk[t] * (f1 + f2);
+    ka += gk_wk[t] * (fabs(f1) + fabs(f2));
+    if (t % 2) g += gk_wg[t / 2] * (f1 + f2);
   }
+  v->area = k * half;
+  v->absarea = fabs(ka * half);
+  v->err = fabs((k - g) * half);
 
   return RPN_OK;
-};
+}
+
+/*
+  Adaptive integration: keep splitting the subinterval with the
+  biggest error in two until the total error is within tolerance,
+  relative to the integral of |f|, as QUADPACK does, so an area that
+  cancels out, like sin's over many periods, needn't be found to an
+  absolute tolerance finer than rounding allows. Where the error
+  stops falling, or the subintervals run out, the area is as good as
+  it gets, and that's the answer.
+ */
+static int quote_integrate(DS *ds, double a, double b, double *area)
+{
+  gk_interval v[INTEGRATE_INTERVALS];
+  quote_fn f;
+  double sum, abssum, err;
+  double least = HUGE_VAL;
+  int stall = 0;
+  int num = 1;
+  int worst;
+  int t;
+
+  if (RPN_OK != quote_fn_init(&f, ds)) return RPN_ERROR;
+
+  v[0].a = a, v[0].b = b;
+  if (RPN_OK != gauss_kronrod(&f, &v[0])) goto fail;
+  for (;;) {
+    sum = abssum = err = 0.0;
+    worst = 0;
+    for (t = 0; t < num; t++) {
+      sum += v[t].area;
+      abssum += v[t].absarea;
+      err += v[t].err;
+      if (v[t].err > v[worst].err) worst = t;
+    }
+    if (err <= ds_tol(ds) * abssum) break;
+    if (err < least) {
+      least = err;
+      stall = 0;
+    } else if (++stall == INTEGRATE_STALL) {
+      break;
+    }
+    if (num == INTEGRATE_INTERVALS) break;
+
+    v[num].b = v[worst].b;
+    v[num].a = v[worst].b = 0.5 * (v[worst].a + v[worst].b);
+    if (RPN_OK != gauss_kronrod(&f, &v[worst]) ||
+	RPN_OK != gauss_kronrod(&f, &v[num++])) {
+      goto fail;
+    }
+  }
+  ds_free(&f.ds);
+  *area = sum;
+
+  return RPN_OK;
+
+ fail:
+  ds_free(&f.ds);
+  return RPN_ERROR;
+}
+
+/*
+  Runs the quote 'n' times on an empty stack, timing each run by itself
+  on the cheapest clock, less what reading it takes, for the mean,
+  least and standard deviation of a run, in ns.
+ */
+static int quote_bench(DS *ds, double n, double *mean, double *least, double *sd)
+{
+  quote_fn f;
+  long long t0, t1, overhead;
+  double tick, x, d, m = 0.0, ss = 0.0, lo = HUGE_VAL;
+  long k, num;
+  int retval = RPN_OK;
+
+  if (! (n >= 1.0 && n <= LONG_MAX)) return RPN_ERROR;
+  num = (long) n;
+  if (RPN_OK != quote_fn_init(&f, ds)) return RPN_ERROR;
+
+  tick = ptime_tick_ns();
+  for (k = 0, overhead = LLONG_MAX; k < 16; k++) {
+    t0 = ptime_ticks();
+    t1 = ptime_ticks();
+    if (t1 - t0 < overhead) overhead = t1 - t0;
+  }
+
+  /* Welford's running mean and sum of squared deviations */
+  for (k = 1; k <= num; k++) {
+    f.ds.next = 0;
+    t0 = ptime_ticks();
+    retval = rpncalc_run(&f.ds, f.prog);
+    t1 = ptime_ticks();
+    if (RPN_OK != retval) break;
+    x = (t1 - t0 - overhead) * tick;
+    if (x < 0.0) x = 0.0;
+    if (x < lo) lo = x;
+    d = x - m;
+    m += d / k;
+    ss += d * (x - m);
+  }
+  *f.nfev = k - 1;
+  ds_free(&f.ds);
+
+  *mean = m;
+  *least = lo;
+  *sd = num > 1 ? sqrt(ss / (num - 1)) : 0.0;
+
+  return retval;
+}
 
 /*
   this is useful if you just want the result once, and don't want to
   create and reuse a calculator. No rpncalc_pop() is necessary since
   it's done for you and the result stored in val
 */
-int rpncalc_eval_full(char *ptr, double *val)
+int rpncalc_eval_full(const char *ptr, double *val)
 {
   DS ds;
   double stack[10];
+  int retval;
 
-  ds_init(&ds, stack, sizeof(stack));
+  ds_init(&ds, stack, sizeof(stack) / sizeof(stack[0]));
+  retval = rpncalc_eval(&ds, ptr) || ds_pop(&ds, val);
+  ds_free(&ds);
 
-  return rpncalc_eval(&ds, ptr) || ds_pop(&ds, val);
+  return retval;
 }
@@ -1,44 +1,243 @@
 #ifndef RPNCALC_H
 #define RPNCALC_H
 
+#include <stddef.h>		/* size_t */
 #include "variates.h"		/* xxx_random_struct */
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 enum {RPN_OK, RPN_ERROR, RPN_HELP, RPN_QUIT};
 
 /*
-  User-sized stack of doubles
+  User-sized stack of doubles. The first DS_INTSIZE slots also have an
+  integer lane: a slot tagged as an integer, bit t of 'itag' for slot
+  t, holds its exact 64-bit value in 'ival' as well as the nearest
+  double in 'stack', so code that only reads doubles still works.
+  Integer literals and the integer and bitwise operators push
+  integers; anything else pushes a plain double, clearing the tag.
+  In power-of-two bases, a literal over LLONG_MAX, up to 2^64-1, is a
+  64-bit pattern in 'ival', negative there, for the bitwise operators,
+  div and mod, but its double is its unsigned value, which + - * and
+  the rest use, so FFFFFFFFFFFFFFFF 2 / is still about 1.8e19 / 2.
+
+  What every push and operator touches, the stack, its settings, the
+  tags and the pointer to the integer values, comes first, in 64
+  bytes on 64-bit machines, a cache line if the calc is aligned to
+  one. The rest, which most calcs never use, is allocated the first
+  time it's needed, from pools shared by all calcs: the integer
+  values, the statistics registers, the random generators, and the
+  quote with the tolerance of solve and integrate. So an idle calc is
+  just this struct, and ds_init() doesn't set them up. ds_free() puts
+  them back. The statistics registers can instead be a slot of shared
+  memory, summed with other processes', see rpnshm.h.
  */
 
+enum {DS_INTSIZE = 32};		/* bits in 'itag', at least */
+
+/* is slot 't' an integer, by tags 'itag' */
+#define DS_ISINT(itag, t) ((t) < DS_INTSIZE && ((itag) >> (t) & 1))
+
+/*
+  does slot 't', integer 'i' and double 'x', print as its integer in
+  'base'? A bit pattern only does in power-of-two bases
+*/
+#define DS_PRINTINT(itag, t, i, x, base) (DS_ISINT(itag, t) && \
+  ((i) >= 0 || (x) < 0 || 0 == ((base) & ((base) - 1))))
+
+struct ds_solve;		/* rpncalc.c's quote, tolerance and count */
+struct rpn_shm_stats;		/* rpnshm.h */
+
+typedef struct {
+  double sumx, sumy, sumxx, sumyy, sumxy, n;
+} DS_STATS;
+
+typedef struct {
+  uniform_random_struct urand;
+  normal_random_struct nrand;
+  exponential_random_struct erand;
+} DS_RAND;
+
 typedef struct {
   double *stack;
-  double mem;			/* 1-value memory */
-  double sumx, sumy, sumxx, sumyy, sumxy, n; /* statistics vars */
-  int size;			/* stack[size-1] = last one */
   int next;			/* index of next to push, also num in stack */
+  int size;			/* stack[size-1] = last one */
   int base;			/* base used for numbers */
-  int askprec;			/* asked-for precision */
   int prec;			/* actual precision, <= sig figs */
-  int sigfig;			/* max significant figures, from base */
   int angle_unit;		/* 0 = rad, 1 = deg */
-  uniform_random_struct urand;
-  normal_random_struct nrand;
-  exponential_random_struct erand;
+  int fastmath;			/* 1 = rpnfast.h's sin, cos, ..., 0 = libm's */
+  double mem;			/* 1-value memory */
+  unsigned long itag;		/* bit t set if slot t is an integer */
+  long long *ival;		/* DS_INTSIZE exact values, NULL if none yet */
+  int askprec;			/* asked-for precision */
+  int sigfig;			/* max significant figures, from base */
+  DS_STATS *stats;		/* statistics vars, NULL if none yet */
+  struct rpn_shm_stats *shared;	/* where 'stats' is, if shared, else NULL */
+  DS_RAND *rand;		/* random generators, NULL if unused yet */
+  struct ds_solve *solve;	/* the quote, ..., NULL if none yet */
+  unsigned long stream;		/* the generators' substream, see ds_seed_stream() */
 } DS;
 
 extern int ds_init(DS *ds, double *stack, int size);
+extern void ds_free(DS *ds);
 extern int ds_clear(DS *ds);
 extern int ds_allclear(DS *ds);
+extern int ds_reset(DS *ds);
 extern int ds_push(DS *ds, double val);
+extern int ds_push_int(DS *ds, long long val);
 extern int ds_pop(DS *ds, double *val);
 extern int ds_swap(DS *ds);
 extern int ds_rot(DS *ds);
 extern int ds_replace(DS *ds, int howmany, double val);
 extern int ds_fromtop(DS *ds, int down, double *val);
+extern int ds_fromtop_int(DS *ds, int down, long long *val);
 extern int ds_setbase(DS *ds, int base);
+extern int ds_setprec(DS *ds, int prec);
 extern int ds_base(DS *ds);
 extern int ds_prec(DS *ds);
 
+/*
+  Starts the calc's random generators afresh, as ds_init() leaves
+  them, but on substream 'stream' of theirs, RPN_RAND_STRIDE draws on
+  from the one before, so a run that reseeds every job by its number
+  draws the same numbers for each whichever thread runs it, or when.
+  Streams come round again after about 10^9. Generators not yet in
+  use stay unallocated, and start on the stream when first used.
+ */
+enum {RPN_RAND_STRIDE = 4096};
+
+extern void ds_seed_stream(DS *ds, unsigned long stream);
+
+/*
+  Bytes held by the pools of the calcs' lazy parts, for all calcs, in
+  use or not.
+ */
+extern size_t ds_pool_bytes(void);
+
+/*
+  For rpnshm.c: the calc's statistics registers moved to 'st', a slot
+  of 'shared', with the points it has so far added in, or back to
+  none of its own if 'st' is NULL.
+ */
+extern void ds_share_stats(DS *ds, DS_STATS *st, struct rpn_shm_stats *shared);
+
+/*
+  A calc's whole state, as a flat block of bytes, for moving a session
+  to another process or checkpointing it: the stack, memory, integer
+  lane, settings, statistics registers, the random generators as they
+  stand (so a restored calc draws the same numbers), and the quote.
+  It's this header, then 'next' doubles of stack, then 'quote_len'
+  chars of quote text, padded to a multiple of 8, so a file of one
+  can be mapped and read in place. It's in the writer's byte order and
+  type sizes, which 'order' and 'version' check.
+ */
+
+enum {RPN_SNAPSHOT_VERSION = 1};
+enum {RPN_SNAPSHOT_STATS = 1, RPN_SNAPSHOT_RAND = 2, RPN_SNAPSHOT_QUOTE = 4};
+
+typedef struct {
+  char magic[4];		/* "RPNs" */
+  int version;			/* RPN_SNAPSHOT_VERSION */
+  int order;			/* 0x01020304, as the writer stores it */
+  int flags;			/* which of the optional parts there are */
+  long long size;		/* of the whole snapshot */
+  int next, base, askprec, prec, sigfig, angle_unit, fastmath;
+  int quote_depth;		/* > 0 if the quote is still being read */
+  long long quote_len;
+  double mem;
+  double tol;
+  long long nfev;
+  double stats[6];		/* sumx, sumy, sumxx, sumyy, sumxy, n */
+  long long useed, nseed1, nseed2, eseed;
+  double umin, udiff;		/* urand */
+  double nx1, nx2, nmean, nsd;	/* nrand, with the normal it has ready */
+  int nreturn_x2;
+  int pad;
+  double esd;			/* erand */
+  long long ival[DS_INTSIZE];
+  unsigned char itag[DS_INTSIZE];
+} RPN_SNAPSHOT;
+
+/*
+  Write a snapshot of the calc to 'buf', if it's at least 'len' bytes,
+  returning its size either way, so a first call with a NULL 'buf' and
+  a 0 'len' sizes it.
+ */
+extern size_t ds_snapshot(const DS *ds, void *buf, size_t len);
+
+/*
+  Set an initialized calc to a snapshot of 'len' bytes, which must be
+  aligned for doubles. The calc's stack has to hold the snapshot's,
+  and on an error the calc is left as it was.
+ */
+extern int ds_restore(DS *ds, const void *buf, size_t len);
+
+extern int convert_sn_to_d(const char *ptr, int len, double *x, int base);
 extern int convert_d_to_s(char *buf, double x, int base, int prec, int len);
+extern int convert_ll_to_s(char *buf, long long x, int base, int len);
+
+/*
+  Format stack slot 't', counting from the bottom, in the calc's base
+  and precision, exactly if it's an integer.
+ */
+extern int ds_format(DS *ds, int t, char *buf, int len);
+
+/*
+  A compiled program, a sequence of tokens that can be run repeatedly
+  without reparsing the text. Each token keeps its operator hash and,
+  if it looks like one, its value as a number, along with a reference
+  to its text in case it must be converted in another base. The text
+  a program was compiled from must outlive it.
+ */
+
+typedef struct {
+  int hash;			/* operator hash of the text */
+  int base;			/* base 'val' was converted in, 0 if none */
+  double val;			/* value if it's a number */
+  const char *text;		/* the token, not null-terminated */
+  int len;			/* chars in the token */
+  int arg;			/* n for a $n argument reference, else 0 */
+  int isint;			/* 'val' is an integer, exactly 'ival' */
+  long long ival;
+  int op;			/* registered operator, see rpnop.h, else 0 */
+} RPN_TOKEN;
+
+typedef struct {
+  RPN_TOKEN *tok;
+  int num;			/* tokens in the program */
+  int size;			/* tokens allocated */
+  int nargs;			/* highest $n referenced */
+} RPN_PROG;
+
+/*
+  A quoted sub-expression, [ ... ], read a token at a time as it's
+  evaluated, for operators like solve to run over and over as f(x),
+  with x pushed on a scratch stack. Its text is kept, as the program
+  compiled from it when it's closed refers to it. Quotes may nest.
+ */
+
+typedef struct rpn_quote {
+  char *text;			/* its tokens, space-separated */
+  size_t len;
+  size_t size;
+  int depth;			/* of brackets, while it's being read */
+  RPN_PROG prog;		/* compiled when it's closed */
+} RPN_QUOTE;
+
+extern int rpn_prog_init(RPN_PROG *prog);
+extern void rpn_prog_free(RPN_PROG *prog);
+extern int rpn_prog_add(RPN_PROG *prog, const char *text, int len, int base);
+
+/*
+  Operator hashes, as in RPN_TOKEN, from an operator's first chars and
+  length, e.g., compute_hash_n('s','w','a',4) for swap, for switching
+  on in evaluators other than rpncalc's own.
+ */
+#define compute_hash_1(a) ((((int) (a)) << 24) + 1)
+#define compute_hash_2(a,b) ((((int) (a)) << 24) + (((int) (b)) << 16) + 2)
+#define compute_hash_3(a,b,c) ((((int) (a)) << 24) + (((int) (b)) << 16) + (((int) (c)) << 8) + 3)
+#define compute_hash_n(a,b,c,n) ((n) == 3 ? compute_hash_3(a,b,c) : (((int) (a)) << 24) + (((int) (b)) << 16) +(((int) (c)) << 8) + n)
 
 /*
   Using a calc you've inited and plan to continue using,
@@ -46,14 +245,62 @@ extern int convert_d_to_s(char *buf, double x, int base, int prec, int len);
   so you can call this again and preserve intermediate results.
   You will need to call rpncalc_pop() to get the result.
  */
-extern int rpncalc_eval(DS *ds, char *ptr);
+extern int rpncalc_eval(DS *ds, const char *ptr);
+extern int rpncalc_evaln(DS *ds, const char *ptr, size_t len);
+
+/*
+  The tokenizer, over spans of text rather than strings. Returns the
+  next token in '*ptr' up to 'end', setting its length and moving
+  '*ptr' past it, or NULL at the end. Nothing is copied and no null
+  terminator is needed, though a null ends the span.
+ */
+extern const char *rpn_next_token(const char **ptr, const char *end, size_t *len);
+
+/*
+  Streaming evaluation of a line of any length as it arrives, a piece
+  at a time, with rpncalc_feed() for each piece and rpncalc_feed_end()
+  at the end of the line, which returns what rpncalc_eval() would have
+  for the whole line. Pieces are evaluated where they are; only a
+  token split between two pieces is copied, and one longer than
+  RPN_TOKENMAX is an error.
+ */
+
+enum {RPN_TOKENMAX = 256};
+
+typedef struct {
+  char carry[RPN_TOKENMAX];	/* a token continued from the last piece */
+  size_t carrylen;
+  int retval;			/* of the line so far */
+} RPN_STREAM;
+
+extern void rpn_stream_init(RPN_STREAM *st);
+extern int rpncalc_feed(DS *ds, RPN_STREAM *st, const char *ptr, size_t len);
+extern int rpncalc_feed_end(DS *ds, RPN_STREAM *st);
+
+/*
+  Compile an RPN string into a program, for running as often as you
+  like with rpncalc_run(), which has the same effect on the calc as
+  rpncalc_eval() on the string.
+
+  Programs may refer to arguments as $1, $2, ..., resolved when
+  compiled, that push the values passed to rpncalc_run_args(), e.g.,
+  the columns of a row of data. Running with too few is an error.
+ */
+extern int rpncalc_compile(DS *ds, const char *ptr, RPN_PROG *prog);
+extern int rpncalc_compilen(DS *ds, const char *ptr, size_t len, RPN_PROG *prog);
+extern int rpncalc_run(DS *ds, const RPN_PROG *prog);
+extern int rpncalc_run_args(DS *ds, const RPN_PROG *prog, const double *args, int nargs);
 
 /*
   This is useful if you just want the result once, and don't want to
   create and reuse a calculator. No need to call rpncalc_pop(); this 
   will be done for you and the result stored in val.
 */
-extern int rpncalc_eval_full(char *ptr, double *val);
+extern int rpncalc_eval_full(const char *ptr, double *val);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* RPNCALC_H */
 
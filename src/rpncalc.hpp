@@ -0,0 +1,1373 @@
+#ifndef RPNCALC_HPP
+#define RPNCALC_HPP
+
+/*
+  RPN at compile time, for C++17 and later.
+
+  A string literal is parsed by a constexpr function into a fixed
+  program, so a bad token or a stack underflow is a compile error
+  rather than an RPN_ERROR when it's run:
+
+    static constexpr auto area = rpncalc::parse("$1 $2 * 2 /");
+
+    if (RPN_OK != rpncalc::run<area>(&a, width, height)) ...
+
+  run() unrolls the program into straight-line code, each token's
+  operator chosen at compile time, so there's no interpreter left and
+  the compiler sees just the arithmetic. An expression of constants
+  folds to a constant:
+
+    constexpr double k = rpncalc::fold(rpncalc::parse("2 3 + 4 *"));
+
+  Operators do just what rpncalc_op() does, in the same order,
+  integer lane and all, so results match to the bit those of a fresh
+  calc (base 10, radians). Only operators on the stack are here;
+  memory, statistics, random numbers, time and settings from the
+  stack (=base) need a calc and are compile errors. The stack is as
+  deep as the expression needs. Everything folds but the math library
+  functions (sqrt, sin, exp, pow, fmod, ...), which C++ doesn't make
+  constexpr; run() does those as rpncalc does, checking errno and all.
+
+  With C++20 the text can be the template argument itself:
+
+    rpncalc::eval<"$1 sq $2 sq + sqrt">(&r, x, y)
+
+  The value type is that of the result: float, double, long double,
+  or rpncalc::dd, a double-double of 106 bits. Every operator is
+  instantiated for it, so a float program is float throughout, twice
+  as many to a vector register over a column, and a dd one keeps
+  twice double's bits through the sums and products that cancel in
+  std and in the statistics registers, which rpncalc::stats has in
+  any of the types. Double is rpncalc's to the bit. dd's math library
+  functions but sqrt are double's, of its high part.
+
+    float r;
+    rpncalc::run<area>(&r, width, height);
+    constexpr rpncalc::dd third = rpncalc::fold<rpncalc::dd>(rpncalc::parse("1 3 /"));
+
+  sigfig() and convert_to_s() are rpncalc.c's sigfig() and
+  convert_d_to_s(), for the type's precision, to print all of it.
+ */
+
+#include <cerrno>		/* errno */
+#include <cfloat>		/* DBL_MIN, FLT_MANT_DIG, ... */
+#include <climits>		/* LLONG_MAX, LLONG_MIN */
+#include <cmath>		/* the non-constexpr math functions */
+#include <cstddef>		/* std::size_t */
+#include <stdexcept>		/* std::invalid_argument, std::domain_error */
+#include <type_traits>		/* std::is_same_v */
+#include <utility>		/* std::index_sequence */
+#include "rpncalc.h"		/* RPN_OK, RPN_ERROR, DS_INTSIZE */
+
+namespace rpncalc {
+
+namespace detail {
+
+/* a + b = s + *e exactly, Knuth's two-sum */
+constexpr double two_sum(double a, double b, double *e)
+{
+  double s = a + b, v = s - a;
+
+  *e = (a - (s - v)) + (b - v);
+  return s;
+}
+
+/* the same, given |a| >= |b| */
+constexpr double quick_two_sum(double a, double b, double *e)
+{
+  double s = a + b;
+
+  *e = b - (s - a);
+  return s;
+}
+
+/*
+  a * b = p + *e exactly, Dekker's, from halves of 26 bits. Where
+  there's a fused multiply-add the compiler may contract the halving
+  with, it's done with that instead, when it's not at compile time.
+ */
+constexpr double two_prod(double a, double b, double *e)
+{
+  constexpr double SPLIT = 134217729.0; /* 2^27 + 1 */
+  double p = a * b;
+  double t = 0.0, ah = 0.0, al = 0.0, bh = 0.0, bl = 0.0;
+
+#if defined(FP_FAST_FMA) && defined(__GNUC__)
+  if (! __builtin_is_constant_evaluated()) {
+    *e = std::fma(a, b, -p);
+    return p;
+  }
+#endif
+  t = SPLIT * a, ah = t - (t - a), al = a - ah;
+  t = SPLIT * b, bh = t - (t - b), bl = b - bh;
+  *e = ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+
+  return p;
+}
+
+} /* namespace detail */
+
+/*
+  Double-double: hi + lo, unevaluated, lo no more than half an ULP of
+  hi, so hi is the value rounded to a double. Arithmetic is exact sums
+  and products of the parts, to about 2^-104 relative, and constexpr.
+  An infinity or NaN comes out in hi, with lo 0. It needs IEEE double
+  arithmetic as written, not -ffast-math.
+ */
+struct dd {
+  double hi = 0.0;
+  double lo = 0.0;
+
+  constexpr dd() = default;
+  constexpr dd(double x) : hi(x) {}
+  constexpr dd(double h, double l) : hi(h), lo(l) {}
+
+  explicit constexpr operator double() const { return hi; }
+
+  friend constexpr dd operator-(const dd &a) { return dd(-a.hi, -a.lo); }
+
+  friend constexpr dd operator+(const dd &a, const dd &b)
+  {
+    double e = 0.0, f = 0.0;
+    double s = detail::two_sum(a.hi, b.hi, &e);
+    double t = detail::two_sum(a.lo, b.lo, &f);
+
+    if (! (s - s == 0)) return dd(s);
+    e += t;
+    s = detail::quick_two_sum(s, e, &e);
+    e += f;
+    s = detail::quick_two_sum(s, e, &e);
+
+    return dd(s, e);
+  }
+
+  friend constexpr dd operator-(const dd &a, const dd &b) { return a + -b; }
+
+  friend constexpr dd operator*(const dd &a, const dd &b)
+  {
+    double e = 0.0;
+    double p = detail::two_prod(a.hi, b.hi, &e);
+
+    if (! (p - p == 0)) return dd(p);
+    e += a.hi * b.lo + a.lo * b.hi;
+    p = detail::quick_two_sum(p, e, &e);
+
+    return dd(p, e);
+  }
+
+  /* long division, a double of the quotient at a time */
+  friend constexpr dd operator/(const dd &a, const dd &b)
+  {
+    double q1 = a.hi / b.hi, q2 = 0.0, q3 = 0.0, e = 0.0;
+    dd r;
+
+    if (! (q1 - q1 == 0)) return dd(q1);
+    r = a - b * q1;
+    q2 = r.hi / b.hi;
+    r = r - b * q2;
+    q3 = r.hi / b.hi;
+    q1 = detail::quick_two_sum(q1, q2, &e);
+
+    return dd(q1, e) + q3;
+  }
+
+  constexpr dd &operator+=(const dd &b) { return *this = *this + b; }
+  constexpr dd &operator-=(const dd &b) { return *this = *this - b; }
+  constexpr dd &operator*=(const dd &b) { return *this = *this * b; }
+  constexpr dd &operator/=(const dd &b) { return *this = *this / b; }
+
+  friend constexpr bool operator==(const dd &a, const dd &b) { return a.hi == b.hi && a.lo == b.lo; }
+  friend constexpr bool operator!=(const dd &a, const dd &b) { return ! (a == b); }
+  friend constexpr bool operator<(const dd &a, const dd &b) { return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo); }
+  friend constexpr bool operator>(const dd &a, const dd &b) { return b < a; }
+  friend constexpr bool operator<=(const dd &a, const dd &b) { return a.hi < b.hi || (a.hi == b.hi && a.lo <= b.lo); }
+  friend constexpr bool operator>=(const dd &a, const dd &b) { return b <= a; }
+};
+
+/* sqrt to all of dd's bits, a Newton step from double's */
+inline dd sqrt(const dd &x)
+{
+  double y = std::sqrt(x.hi);
+
+  if (! (x.hi > 0.0) || ! (y - y == 0)) return dd(y);
+
+  return dd(y) + (x - dd(y) * dd(y)).hi / (2.0 * y);
+}
+
+/* the rest, double's, setting errno as they do */
+#define RPNCALC_LIBM(f) inline dd f(const dd &x) { return std::f(x.hi); }
+RPNCALC_LIBM(sin) RPNCALC_LIBM(cos) RPNCALC_LIBM(tan)
+RPNCALC_LIBM(sinh) RPNCALC_LIBM(cosh) RPNCALC_LIBM(tanh)
+RPNCALC_LIBM(asin) RPNCALC_LIBM(acos) RPNCALC_LIBM(atan)
+RPNCALC_LIBM(exp) RPNCALC_LIBM(log)
+#undef RPNCALC_LIBM
+
+inline dd atan2(const dd &y, const dd &x) { return std::atan2(y.hi, x.hi); }
+inline dd fmod(const dd &x, const dd &y) { return std::fmod(x.hi, y.hi); }
+inline dd pow(const dd &x, const dd &y) { return std::pow(x.hi, y.hi); }
+
+/*
+  What the operators need of a value type: the bits of its fraction,
+  and the smallest normal number, below which a divisor is taken to be
+  0. Only these types have it.
+ */
+template <typename T>
+struct numeric;
+
+template <>
+struct numeric<float> {
+  static constexpr int digits = FLT_MANT_DIG;
+  static constexpr float tiny = FLT_MIN;
+};
+
+template <>
+struct numeric<double> {
+  static constexpr int digits = DBL_MANT_DIG;
+  static constexpr double tiny = DBL_MIN;
+};
+
+template <>
+struct numeric<long double> {
+  static constexpr int digits = LDBL_MANT_DIG;
+  static constexpr long double tiny = LDBL_MIN;
+};
+
+template <>
+struct numeric<dd> {
+  static constexpr int digits = 2 * DBL_MANT_DIG;
+  static constexpr dd tiny = DBL_MIN;
+};
+
+enum class op : unsigned char {
+  num, arg, clear, dup, swap, rot, drop, depth, avg, stddev,
+  neg, inv, sq, sqrt, fact, sin, cos, tan, sinh, cosh, tanh,
+  asin, acos, atan, atan2, exp, ln, log, logn, abs, round,
+  todeg, torad, tof, toc, add, sub, mul, div, idiv, mod, fmod,
+  floor, ceil, pow, shr, shl, bitor_, bitand_, compl_, toxy, tort,
+  mi2m, ft2m, in2mm, pi, e, vc
+};
+
+struct token {
+  op code = op::num;
+  bool deg = false;		/* angles in degrees */
+  int arg = 0;			/* n for $n */
+  bool isint = false;		/* a number that's exactly 'ival' */
+  long long ival = 0;
+  double val = 0.0;
+  dd wide;			/* val, for types wider than double */
+};
+
+/* 'N' is the most tokens a literal of its length can have */
+template <std::size_t N>
+struct program {
+  static constexpr std::size_t size = N;
+  token tok[N] = {};
+  int num = 0;			/* tokens in the program */
+  int nargs = 0;		/* highest $n referenced */
+  int depth = 0;		/* left on the stack at the end */
+  int maxdepth = 0;		/* deepest the stack gets */
+};
+
+namespace detail {
+
+/* rpncalc.c's values, so results match */
+constexpr double CONST_E = 2.7182818284590452354;
+constexpr double CONST_PI = 3.1415926535897932385;
+constexpr double CONST_LN10_INV = 0.43429448190325182765;
+constexpr double CONST_SPEED_OF_LIGHT = 299792458;
+constexpr double CONV_MI_TO_M = 5280.0 * 12.0 * 0.0254;
+constexpr double CONV_FT_TO_M = 12.0 * 0.0254;
+constexpr double CONV_IN_TO_MM = 25.4;
+constexpr double TWO_TO_52 = 4503599627370496.0;
+constexpr double TWO_TO_53 = 9007199254740992.0;
+constexpr double TWO_TO_63 = 9223372036854775808.0;
+constexpr double CONV_TODEG = 57.295779513082320875;
+constexpr double CONV_TORAD = 0.017453292519943295770;
+
+/* and to 106 bits, for the wider types */
+constexpr dd WIDE_E{2.718281828459045, 1.4456468917292502e-16};
+constexpr dd WIDE_PI{3.141592653589793, 1.2246467991473532e-16};
+constexpr dd WIDE_LN10_INV{0.4342944819032518, 1.098319650216765e-17};
+constexpr dd WIDE_SPEED_OF_LIGHT{299792458.0, 0.0};
+constexpr dd WIDE_MI_TO_M{1609.344, -5.093170329928398e-14};
+constexpr dd WIDE_FT_TO_M{0.3048, -1.5365486660812166e-17};
+constexpr dd WIDE_IN_TO_MM{25.4, 1.4210854715202005e-15};
+constexpr dd WIDE_TODEG{57.29577951308232, -1.9878495670576283e-15};
+constexpr dd WIDE_TORAD{0.017453292519943295, 2.9486522708701687e-19};
+
+/*
+  A constant or literal in T: 'd', as rpncalc has it, for double and
+  narrower, and 'x' for wider, as near as T has to the real thing
+ */
+template <typename T>
+constexpr T widen(double d, const dd &x)
+{
+  if constexpr (std::is_same_v<T, dd>) {
+    return x;
+  } else if constexpr (numeric<T>::digits > DBL_MANT_DIG) {
+    return (T) x.hi + (T) x.lo;
+  } else {
+    return (T) d;
+  }
+}
+
+template <typename T>
+constexpr T todeg(T x) { return x * widen<T>(CONV_TODEG, WIDE_TODEG); }
+template <typename T>
+constexpr T torad(T x) { return x * widen<T>(CONV_TORAD, WIDE_TORAD); }
+
+constexpr bool isspace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/* compute_hash_span(), for the first 'len' chars */
+constexpr int hash(const char *s, int len)
+{
+  int h = 0;
+
+  if (len <= 0) return 0;
+  h = ((int) s[0]) << 24;
+  if (len == 1) return h + 1;
+  h += ((int) s[1]) << 16;
+  if (len == 2) return h + 2;
+  h += ((int) s[2]) << 8;
+
+  return h + len;
+}
+
+/* an operator's hash, by name */
+template <std::size_t L>
+constexpr int H(const char (&name)[L])
+{
+  return hash(name, L - 1);
+}
+
+/*
+  floor() and ceil() aren't constexpr, so these are, to the bit: zero,
+  and anything too big to have a fraction, is already integral.
+ */
+template <typename T>
+constexpr T fabs_c(T x)
+{
+  return x < T(0) ? -x : x == T(0) ? T(0) : x;
+}
+
+constexpr double fabs_c(double x)
+{
+#if defined(__GNUC__)
+  return __builtin_fabs(x);
+#else
+  return x < 0 ? -x : x == 0 ? 0.0 : x;
+#endif
+}
+
+/* 2^n, exactly */
+constexpr double two_to(int n)
+{
+  double x = 1.0;
+
+  while (n-- > 0) x *= 2.0;
+
+  return x;
+}
+
+template <typename T>
+constexpr T floor_c(T x)
+{
+  T t = 0;
+
+  if (! (fabs_c(x) < T(two_to(numeric<T>::digits - 1))) || x == T(0)) return x;
+  t = (T) (long long) x;
+  if (t > x) t -= T(1);
+
+  return t;
+}
+
+template <typename T>
+constexpr T ceil_c(T x)
+{
+  T t = 0;
+
+  if (! (fabs_c(x) < T(two_to(numeric<T>::digits - 1))) || x == T(0)) return x;
+  t = (T) (long long) x;
+  if (t < x) t += T(1);
+
+  return t == T(0) && x < T(0) ? -T(0) : t;
+}
+
+/* a dd's floor is its high part's, or if that's whole, and its low part's */
+constexpr dd floor_c(const dd &x)
+{
+  double h = floor_c(x.hi), e = 0.0;
+
+  if (h != x.hi) return dd(h);
+  h = quick_two_sum(h, floor_c(x.lo), &e);
+
+  return dd(h, e);
+}
+
+constexpr dd ceil_c(const dd &x)
+{
+  return -floor_c(-x);
+}
+
+/* truncating to a long long, which must hold it */
+template <typename T>
+constexpr long long trunc_ll(T x)
+{
+  return (long long) x;
+}
+
+constexpr long long trunc_ll(const dd &x)
+{
+  long long k = (long long) x.hi;
+  double rest = (x.hi - (double) k) + x.lo;
+
+  return k + (long long) (x.hi < 0 ? ceil_c(rest) : floor_c(rest));
+}
+
+/* a long long in T, exactly where T has the bits */
+template <typename T>
+constexpr T from_ll(long long k)
+{
+  return (T) k;
+}
+
+template <>
+constexpr dd from_ll<dd>(long long k)
+{
+  double hi = (double) k;
+
+  /* k - hi, without converting 2^63 back */
+  if (hi >= TWO_TO_63) return dd(hi, (double) (k - LLONG_MAX) - 1.0);
+
+  return dd(hi, (double) (k - (long long) hi));
+}
+
+/* rpncalc.c's round() macro, truncating to an int */
+template <typename T>
+constexpr int round_i(T x)
+{
+  return x < T(0) ? (int) (x - T(0.5)) : (int) (x + T(0.5));
+}
+
+constexpr int round_i(const dd &x)
+{
+  return (int) trunc_ll(x < 0.0 ? x - 0.5 : x + 0.5);
+}
+
+constexpr bool isdigitbase(char digit, int base)
+{
+  if (base <= 10) return digit >= '0' && digit - '0' < base;
+  if (digit >= '0' && digit <= '9') return true;
+  return digit >= 'A' && digit - 'A' + 10 < base;
+}
+
+constexpr int digitbase(char digit)
+{
+  return digit <= '9' ? digit - '0' : digit - 'A' + 10;
+}
+
+/* tocharbase() */
+constexpr char tocharbase(int digit, int base)
+{
+  if (digit < 0) return '0';
+  if (base <= 10) return digit < base ? digit + '0' : '0';
+  if (base <= 36 && digit < 10) return digit + '0';
+  if (base <= 36 && digit < base) return digit + 'A' - 10;
+
+  return '0';
+}
+
+/* convert_sn_to_d(), in T */
+template <typename T>
+constexpr bool convert_sn_to_d(const char *ptr, int len, T *x, int base)
+{
+  T num = 0, fracnum = 0;
+  bool started = false, gotnum = false, minus = false;
+  int infrac = 0;
+  int t = 0;
+  char c = 0;
+
+  if (len <= 0) return false;
+
+  while (len-- > 0 && 0 != (c = *ptr++) && ! isspace(c)) {
+    if (c == '-' || c == '+') {
+      if (started) return false;
+      minus = c == '-', started = true;
+      continue;
+    }
+    if (c == '.') {
+      if (infrac) return false;
+      infrac = 1, started = true;
+      continue;
+    }
+    if (! isdigitbase(c, base)) return false;
+    started = true;
+    if (infrac) {
+      t = infrac;
+      fracnum = T(digitbase(c));
+      while (t-- > 0) fracnum /= T(base);
+      num += fracnum;
+      infrac++;
+    } else {
+      num *= T(base);
+      num += T(digitbase(c));
+    }
+    gotnum = true;
+  }
+  *x = minus ? -num : num;
+
+  return gotnum;
+}
+
+/* convert_sn_to_ll() */
+constexpr bool convert_sn_to_ll(const char *ptr, int len, long long *x, int base)
+{
+  unsigned long long num = 0;
+  unsigned long long limit = 0;
+  bool minus = false;
+  int digit = 0;
+
+  if (len > 0 && ('-' == *ptr || '+' == *ptr)) {
+    minus = '-' == *ptr;
+    ptr++, len--;
+  }
+  if (len <= 0) return false;
+  if (minus) {
+    limit = (unsigned long long) LLONG_MAX + 1;
+  } else if (0 == (base & (base - 1))) {
+    limit = ULLONG_MAX;		/* a bit pattern, as rpncalc.c */
+  } else {
+    limit = LLONG_MAX;
+  }
+
+  for (; len > 0; ptr++, len--) {
+    if (! isdigitbase(*ptr, base)) return false;
+    digit = digitbase(*ptr);
+    if (num > (limit - digit) / base) return false;
+    num = num * base + digit;
+  }
+  *x = minus ? (long long) (0 - num) : (long long) num;
+
+  return true;
+}
+
+/* convert_sn(), filling in a number token */
+constexpr bool convert_sn(const char *ptr, int len, int base, token *tok)
+{
+  int t = 0;
+
+  if (! convert_sn_to_d(ptr, len, &tok->val, base)) return false;
+  convert_sn_to_d(ptr, len, &tok->wide, base);
+
+  tok->isint = false;
+  for (t = 0; t < len; t++) {
+    if ('.' == ptr[t]) return true;
+  }
+  if (fabs_c(tok->val) < TWO_TO_53) {
+    tok->ival = (long long) tok->val;
+    tok->isint = true;
+  } else if (convert_sn_to_ll(ptr, len, &tok->ival, base)) {
+    /* as rpncalc.c, a bit pattern's val stays unsigned */
+    tok->isint = true;
+  }
+
+  return true;
+}
+
+/* add_ll(), sub_ll() and mul_ll(), false if it would overflow */
+constexpr bool add_ll(long long a, long long b, long long *r)
+{
+  if (b > 0 ? a > LLONG_MAX - b : a < LLONG_MIN - b) return false;
+  *r = a + b;
+  return true;
+}
+
+constexpr bool sub_ll(long long a, long long b, long long *r)
+{
+  if (b < 0 ? a > LLONG_MAX + b : a < LLONG_MIN + b) return false;
+  *r = a - b;
+  return true;
+}
+
+constexpr bool mul_ll(long long a, long long b, long long *r)
+{
+  if (a == 0 || b == 0) {
+    *r = 0;
+    return true;
+  }
+  if (a > 0 ?
+      (b > 0 ? a > LLONG_MAX / b : b < LLONG_MIN / a) :
+      (b > 0 ? a < LLONG_MIN / b : a < LLONG_MAX / b)) return false;
+  *r = a * b;
+  return true;
+}
+
+/* factorial() */
+template <typename T>
+constexpr bool factorial(T x, T *f)
+{
+  T cum = x;
+  int r = round_i(x);
+
+  if (fabs_c(x - T(r)) > numeric<T>::tiny) return false;
+  if (r < 0) return false;
+  if (r < 2) {
+    *f = 1;
+    return true;
+  }
+  while (r-- > 2) cum *= T(r);
+  *f = cum;
+
+  return true;
+}
+
+/*
+  The DS stack and its integer lane, as far as the operators here use
+  them, in T. Only the first DS_INTSIZE slots can be tagged as
+  integers.
+ */
+template <typename T, std::size_t N>
+struct stack {
+  T d[N] = {};
+  long long i[N] = {};
+  bool tag[N] = {};
+  int next = 0;
+
+  constexpr void push(T val)
+  {
+    tag[next] = false;
+    d[next++] = val;
+  }
+
+  constexpr void push_int(long long val)
+  {
+    push_lit(from_ll<T>(val), val);
+  }
+
+  /* an integer whose T may differ from it, as a bit pattern literal's */
+  constexpr void push_lit(T x, long long val)
+  {
+    tag[next] = next < DS_INTSIZE;
+    i[next] = val;
+    d[next++] = x;
+  }
+
+  constexpr void replace(int howmany, T val)
+  {
+    next -= howmany - 1;
+    d[next - 1] = val;
+    tag[next - 1] = false;
+  }
+
+  constexpr void replace_int(int howmany, long long val)
+  {
+    next -= howmany - 1;
+    d[next - 1] = from_ll<T>(val);
+    tag[next - 1] = next - 1 < DS_INTSIZE;
+    i[next - 1] = val;
+  }
+
+  constexpr T fromtop(int down) const
+  {
+    return d[next - 1 - down];
+  }
+
+  /* ds_fromtop_int() */
+  constexpr bool fromtop_int(int down, long long *val) const
+  {
+    int t = next - 1 - down;
+    T x = d[t];
+
+    if (tag[t]) {
+      *val = i[t];
+      return true;
+    }
+    x = x < T(0) ? ceil_c(x - T(0.5)) : floor_c(x + T(0.5));
+    if (! (x >= T(-TWO_TO_63) && x < T(TWO_TO_63))) return false;
+    *val = trunc_ll(x);
+
+    return true;
+  }
+
+  /* ds_exact() */
+  constexpr bool exact(int t) const
+  {
+    return tag[t] && (i[t] >= 0 || d[t] < T(0));
+  }
+
+  /* ds_ints() */
+  constexpr bool ints() const
+  {
+    return exact(next - 1) && exact(next - 2);
+  }
+
+  /* ds_dup(), ds_swap() and ds_rot() */
+  constexpr void dup()
+  {
+    d[next] = d[next - 1];
+    tag[next] = tag[next - 1] && next < DS_INTSIZE;
+    i[next] = i[next - 1];
+    next++;
+  }
+
+  constexpr void swap()
+  {
+    int t = next - 1;
+    T x = d[t];
+    long long k = i[t];
+    bool g = tag[t];
+
+    d[t] = d[t - 1], d[t - 1] = x;
+    i[t] = i[t - 1], i[t - 1] = k;
+    tag[t] = tag[t - 1], tag[t - 1] = g;
+    if (t == DS_INTSIZE) tag[t - 1] = tag[t] = false;
+  }
+
+  constexpr void rot()
+  {
+    T x = d[0];
+    long long k = i[0];
+    bool g = tag[0];
+    int t = 0;
+
+    if (next < 2) return;
+    for (t = 0; t < next - 1; t++) {
+      d[t] = d[t + 1], i[t] = i[t + 1], tag[t] = tag[t + 1];
+    }
+    d[next - 1] = x, i[next - 1] = k;
+    tag[next - 1] = g && next - 1 < DS_INTSIZE;
+  }
+};
+
+/*
+  One token's operator, picked at compile time. The stack's depth was
+  checked when the program was parsed, so only errors that depend on
+  the values are left, returned as false. The math functions are
+  std's, or for a dd, its own, by argument dependent lookup.
+ */
+using std::sqrt; using std::sin; using std::cos; using std::tan;
+using std::sinh; using std::cosh; using std::tanh; using std::asin;
+using std::acos; using std::atan; using std::atan2; using std::exp;
+using std::log; using std::fmod; using std::pow;
+
+template <op Code, typename T, std::size_t N>
+constexpr bool step(stack<T, N> &s, const token &tok, const T *args)
+{
+  T top = 0, next = 0, val = 0;
+  long long i = 0, j = 0, k = 0;
+  int t = 0;
+
+  if constexpr (Code == op::num) {
+    if (tok.isint) {
+      s.push_lit(widen<T>(tok.val, tok.wide), tok.ival);
+    } else {
+      s.push(widen<T>(tok.val, tok.wide));
+    }
+  } else if constexpr (Code == op::arg) {
+    s.push(args[tok.arg - 1]);
+  } else if constexpr (Code == op::clear) {
+    s.next = 0;
+  } else if constexpr (Code == op::dup) {
+    s.dup();
+  } else if constexpr (Code == op::swap) {
+    s.swap();
+  } else if constexpr (Code == op::rot) {
+    s.rot();
+  } else if constexpr (Code == op::drop) {
+    s.next--;
+  } else if constexpr (Code == op::depth) {
+    s.push(T(s.next));
+  } else if constexpr (Code == op::avg) {
+    for (t = 0; t < s.next; t++) val += s.d[t];
+    s.push(val / T(s.next));
+  } else if constexpr (Code == op::stddev) {
+    /* ds_stddev() */
+    if (s.next < 2) {
+      s.push(T(0));
+    } else {
+      for (t = 0; t < s.next; t++) {
+	top += s.d[t];
+	next += s.d[t] * s.d[t];
+      }
+      val = top / s.next;
+      s.push(sqrt((next - T(2)*val*top + T(s.next)*val*val) / T(s.next-1)));
+    }
+  } else if constexpr (Code == op::neg) {
+    t = s.next - 1;
+    if (s.exact(t) && s.i[t] != LLONG_MIN) {
+      s.replace_int(1, -s.i[t]);
+    } else {
+      s.replace(1, -s.fromtop(0));
+    }
+  } else if constexpr (Code == op::inv) {
+    top = s.fromtop(0);
+    if (! (fabs_c(top) > numeric<T>::tiny)) return false;
+    s.replace(1, T(1) / top);
+  } else if constexpr (Code == op::sq) {
+    top = s.fromtop(0);
+    s.replace(1, top * top);
+  } else if constexpr (Code == op::sqrt) {
+    s.replace(1, sqrt(s.fromtop(0)));
+  } else if constexpr (Code == op::fact) {
+    if (! factorial(s.fromtop(0), &val)) return false;
+    s.replace(1, val);
+  } else if constexpr (Code == op::sin) {
+    top = s.fromtop(0);
+    s.replace(1, sin(tok.deg ? torad(top) : top));
+  } else if constexpr (Code == op::cos) {
+    top = s.fromtop(0);
+    s.replace(1, cos(tok.deg ? torad(top) : top));
+  } else if constexpr (Code == op::tan) {
+    top = s.fromtop(0);
+    s.replace(1, tan(tok.deg ? torad(top) : top));
+  } else if constexpr (Code == op::sinh || Code == op::cosh ||
+		       Code == op::tanh || Code == op::ln || Code == op::log) {
+    top = s.fromtop(0);
+    errno = 0;
+    if constexpr (Code == op::sinh) val = sinh(top);
+    if constexpr (Code == op::cosh) val = cosh(top);
+    if constexpr (Code == op::tanh) val = tanh(top);
+    if constexpr (Code == op::ln || Code == op::log) val = log(top);
+    if (errno != 0) return false;
+    if constexpr (Code == op::log) val *= widen<T>(CONST_LN10_INV, WIDE_LN10_INV);
+    s.replace(1, val);
+  } else if constexpr (Code == op::asin || Code == op::acos) {
+    top = s.fromtop(0);
+    errno = 0;
+    val = Code == op::asin ? asin(top) : acos(top);
+    if (errno != 0) return false;
+    s.replace(1, tok.deg ? todeg(val) : val);
+  } else if constexpr (Code == op::atan) {
+    val = atan(s.fromtop(0));
+    s.replace(1, tok.deg ? todeg(val) : val);
+  } else if constexpr (Code == op::atan2) {
+    val = atan2(s.fromtop(1), s.fromtop(0));
+    s.replace(2, tok.deg ? todeg(val) : val);
+  } else if constexpr (Code == op::exp) {
+    s.replace(1, exp(s.fromtop(0)));
+  } else if constexpr (Code == op::logn) {
+    next = s.fromtop(1), top = s.fromtop(0);
+    if (next <= T(0) || top <= T(0)) return false;
+    s.replace(2, log(next) / log(top));
+  } else if constexpr (Code == op::abs) {
+    s.replace(1, fabs_c(s.fromtop(0)));
+  } else if constexpr (Code == op::round) {
+    s.replace(1, T(round_i(s.fromtop(0))));
+  } else if constexpr (Code == op::todeg) {
+    s.replace(1, todeg(s.fromtop(0)));
+  } else if constexpr (Code == op::torad) {
+    s.replace(1, torad(s.fromtop(0)));
+  } else if constexpr (Code == op::tof) {
+    s.replace(1, T(9)/T(5)*s.fromtop(0)+T(32));
+  } else if constexpr (Code == op::toc) {
+    s.replace(1, T(5)/T(9)*(s.fromtop(0)-T(32)));
+  } else if constexpr (Code == op::add) {
+    if (s.ints() && add_ll(s.i[s.next - 2], s.i[s.next - 1], &k)) {
+      s.replace_int(2, k);
+    } else {
+      s.replace(2, s.fromtop(1) + s.fromtop(0));
+    }
+  } else if constexpr (Code == op::sub) {
+    if (s.ints() && sub_ll(s.i[s.next - 2], s.i[s.next - 1], &k)) {
+      s.replace_int(2, k);
+    } else {
+      s.replace(2, s.fromtop(1) - s.fromtop(0));
+    }
+  } else if constexpr (Code == op::mul) {
+    if (s.ints() && mul_ll(s.i[s.next - 2], s.i[s.next - 1], &k)) {
+      s.replace_int(2, k);
+    } else {
+      s.replace(2, s.fromtop(1) * s.fromtop(0));
+    }
+  } else if constexpr (Code == op::div) {
+    top = s.fromtop(0);
+    if (! (fabs_c(top) > numeric<T>::tiny)) return false;
+    s.replace(2, s.fromtop(1) / top);
+  } else if constexpr (Code == op::idiv || Code == op::mod ||
+		       Code == op::shr || Code == op::shl ||
+		       Code == op::bitor_ || Code == op::bitand_) {
+    if (! s.fromtop_int(1, &i) || ! s.fromtop_int(0, &j)) return false;
+    if constexpr (Code == op::idiv) {
+      if (j == 0 || (j == -1 && i == LLONG_MIN)) return false;
+      k = i / j;
+    } else if constexpr (Code == op::mod) {
+      if (j == 0) return false;
+      k = j == -1 ? 0 : i % j;
+    } else if constexpr (Code == op::shr) {
+      if (j < 0 || j > 63) return false;
+      k = i >> j;
+    } else if constexpr (Code == op::shl) {
+      if (j < 0 || j > 63) return false;
+      k = (long long) ((unsigned long long) i << j);
+    } else if constexpr (Code == op::bitor_) {
+      k = i | j;
+    } else {
+      k = i & j;
+    }
+    s.replace_int(2, k);
+  } else if constexpr (Code == op::compl_) {
+    if (! s.fromtop_int(0, &i)) return false;
+    s.replace_int(1, ~i);
+  } else if constexpr (Code == op::fmod) {
+    s.replace(2, fmod(s.fromtop(1), s.fromtop(0)));
+  } else if constexpr (Code == op::floor) {
+    s.replace(1, floor_c(s.fromtop(0)));
+  } else if constexpr (Code == op::ceil) {
+    s.replace(1, ceil_c(s.fromtop(0)));
+  } else if constexpr (Code == op::pow) {
+    top = s.fromtop(0), next = s.fromtop(1);
+    errno = 0;
+    val = pow(next, top);
+    if (errno) return false;
+    s.replace(2, val);
+  } else if constexpr (Code == op::toxy) {
+    top = s.fromtop(0), next = s.fromtop(1);
+    s.next -= 2;
+    s.push(next * cos(tok.deg ? torad(top) : top));
+    s.push(next * sin(tok.deg ? torad(top) : top));
+  } else if constexpr (Code == op::tort) {
+    top = s.fromtop(0), next = s.fromtop(1);
+    s.next -= 2;
+    val = atan2(top, next);
+    s.push(sqrt(next*next + top*top));
+    s.push(tok.deg ? todeg(val) : val);
+  } else if constexpr (Code == op::mi2m) {
+    s.push(widen<T>(CONV_MI_TO_M, WIDE_MI_TO_M));
+  } else if constexpr (Code == op::ft2m) {
+    s.push(widen<T>(CONV_FT_TO_M, WIDE_FT_TO_M));
+  } else if constexpr (Code == op::in2mm) {
+    s.push(widen<T>(CONV_IN_TO_MM, WIDE_IN_TO_MM));
+  } else if constexpr (Code == op::pi) {
+    s.push(widen<T>(CONST_PI, WIDE_PI));
+  } else if constexpr (Code == op::e) {
+    s.push(widen<T>(CONST_E, WIDE_E));
+  } else if constexpr (Code == op::vc) {
+    s.push(widen<T>(CONST_SPEED_OF_LIGHT, WIDE_SPEED_OF_LIGHT));
+  }
+
+  return true;
+}
+
+/* the same, picked at run time, for fold() */
+template <typename T, std::size_t N>
+constexpr bool apply(stack<T, N> &s, const token &tok, const T *args)
+{
+#define RPNCALC_STEP(o) case op::o: return step<op::o>(s, tok, args)
+  switch (tok.code) {
+    RPNCALC_STEP(num); RPNCALC_STEP(arg); RPNCALC_STEP(clear);
+    RPNCALC_STEP(dup); RPNCALC_STEP(swap); RPNCALC_STEP(rot);
+    RPNCALC_STEP(drop); RPNCALC_STEP(depth); RPNCALC_STEP(avg);
+    RPNCALC_STEP(stddev); RPNCALC_STEP(neg); RPNCALC_STEP(inv);
+    RPNCALC_STEP(sq); RPNCALC_STEP(sqrt); RPNCALC_STEP(fact);
+    RPNCALC_STEP(sin); RPNCALC_STEP(cos); RPNCALC_STEP(tan);
+    RPNCALC_STEP(sinh); RPNCALC_STEP(cosh); RPNCALC_STEP(tanh);
+    RPNCALC_STEP(asin); RPNCALC_STEP(acos); RPNCALC_STEP(atan);
+    RPNCALC_STEP(atan2); RPNCALC_STEP(exp); RPNCALC_STEP(ln);
+    RPNCALC_STEP(log); RPNCALC_STEP(logn); RPNCALC_STEP(abs);
+    RPNCALC_STEP(round); RPNCALC_STEP(todeg); RPNCALC_STEP(torad);
+    RPNCALC_STEP(tof); RPNCALC_STEP(toc); RPNCALC_STEP(add);
+    RPNCALC_STEP(sub); RPNCALC_STEP(mul); RPNCALC_STEP(div);
+    RPNCALC_STEP(idiv); RPNCALC_STEP(mod); RPNCALC_STEP(fmod);
+    RPNCALC_STEP(floor); RPNCALC_STEP(ceil); RPNCALC_STEP(pow);
+    RPNCALC_STEP(shr); RPNCALC_STEP(shl); RPNCALC_STEP(bitor_);
+    RPNCALC_STEP(bitand_); RPNCALC_STEP(compl_); RPNCALC_STEP(toxy);
+    RPNCALC_STEP(tort); RPNCALC_STEP(mi2m); RPNCALC_STEP(ft2m);
+    RPNCALC_STEP(in2mm); RPNCALC_STEP(pi); RPNCALC_STEP(e);
+    RPNCALC_STEP(vc);
+  }
+#undef RPNCALC_STEP
+
+  return false;
+}
+
+template <const auto &P, typename T, std::size_t... I>
+inline int run(T *result, const T *args, std::index_sequence<I...>)
+{
+  stack<T, (P.maxdepth > 0 ? P.maxdepth : 1)> s{};
+
+  if (! (step<P.tok[I].code>(s, P.tok[I], args) && ...)) return RPN_ERROR;
+  *result = s.d[s.next - 1];
+
+  return RPN_OK;
+}
+
+} /* namespace detail */
+
+/*
+  Parse RPN text into a program, as rpncalc_compile() would, with the
+  base and angle unit changes (dec, hex, bin, rad, deg) done as it
+  goes. Meant to be evaluated at compile time, where its exceptions
+  are compile errors.
+ */
+template <std::size_t L>
+constexpr program<L / 2 + 1> parse(const char (&text)[L])
+{
+  using detail::H;
+  program<L / 2 + 1> prog{};
+  const char *p = text;
+  const char *end = text + L - 1;
+  const char *start = nullptr;
+  token tok{};
+  int base = 10;
+  bool deg = false;
+  int depth = 0;
+  int need = 0;			/* on the stack for the operator */
+  int delta = 0;		/* change in depth */
+  int len = 0;
+  int t = 0;
+
+  for (;;) {
+    while (p < end && detail::isspace(*p)) p++;
+    if (p == end || 0 == *p) break;
+    start = p;
+    while (p < end && 0 != *p && ! detail::isspace(*p)) p++;
+    len = p - start;
+
+    tok = token{};
+    tok.deg = deg;
+    need = 0, delta = 0;
+
+    if (len > 1 && '$' == start[0]) {
+      for (t = 1; t < len && start[t] >= '0' && start[t] <= '9'; t++) {
+	tok.arg = 10 * tok.arg + start[t] - '0';
+      }
+      if (t < len || tok.arg == 0) throw std::invalid_argument("rpncalc: bad argument reference");
+      if (tok.arg > prog.nargs) prog.nargs = tok.arg;
+      tok.code = op::arg, delta = 1;
+    } else {
+      switch (detail::hash(start, len)) {
+      case H("dec"): base = 10; continue;
+      case H("hex"): base = 16; continue;
+      case H("bin"): base = 2; continue;
+      case H("rad"): deg = false; continue;
+      case H("deg"): deg = true; continue;
+      case H("c"): tok.code = op::clear, delta = -depth; break;
+      case H("dup"): tok.code = op::dup, need = 1, delta = 1; break;
+      case H("swap"): tok.code = op::swap, need = 2; break;
+      case H("rot"): tok.code = op::rot; break;
+      case H("drop"): case H("."): tok.code = op::drop, need = 1, delta = -1; break;
+      case H("depth"): tok.code = op::depth, delta = 1; break;
+      case H("avg"): tok.code = op::avg, need = 1, delta = 1; break;
+      case H("std"): tok.code = op::stddev, need = 1, delta = 1; break;
+      case H("-+"): case H("+-"): tok.code = op::neg, need = 1; break;
+      case H("inv"): tok.code = op::inv, need = 1; break;
+      case H("sq"): tok.code = op::sq, need = 1; break;
+      case H("sqrt"): tok.code = op::sqrt, need = 1; break;
+      case H("!"): tok.code = op::fact, need = 1; break;
+      case H("sin"): tok.code = op::sin, need = 1; break;
+      case H("cos"): tok.code = op::cos, need = 1; break;
+      case H("tan"): tok.code = op::tan, need = 1; break;
+      case H("sinh"): tok.code = op::sinh, need = 1; break;
+      case H("cosh"): tok.code = op::cosh, need = 1; break;
+      case H("tanh"): tok.code = op::tanh, need = 1; break;
+      case H("asin"): tok.code = op::asin, need = 1; break;
+      case H("acos"): tok.code = op::acos, need = 1; break;
+      case H("atan"): tok.code = op::atan, need = 1; break;
+      case H("atan2"): tok.code = op::atan2, need = 2, delta = -1; break;
+      case H("exp"): tok.code = op::exp, need = 1; break;
+      case H("ln"): tok.code = op::ln, need = 1; break;
+      case H("log"): tok.code = op::log, need = 1; break;
+      case H("logn"): tok.code = op::logn, need = 2, delta = -1; break;
+      case H("abs"): tok.code = op::abs, need = 1; break;
+      case H("round"): tok.code = op::round, need = 1; break;
+      case H("todeg"): tok.code = op::todeg, need = 1; break;
+      case H("torad"): tok.code = op::torad, need = 1; break;
+      case H("tof"): tok.code = op::tof, need = 1; break;
+      case H("toc"): tok.code = op::toc, need = 1; break;
+      case H("+"): tok.code = op::add, need = 2, delta = -1; break;
+      case H("-"): tok.code = op::sub, need = 2, delta = -1; break;
+      case H("*"): case H("x"): tok.code = op::mul, need = 2, delta = -1; break;
+      case H("/"): tok.code = op::div, need = 2, delta = -1; break;
+      case H("div"): tok.code = op::idiv, need = 2, delta = -1; break;
+      case H("mod"): tok.code = op::mod, need = 2, delta = -1; break;
+      case H("fmod"): tok.code = op::fmod, need = 2, delta = -1; break;
+      case H("floor"): tok.code = op::floor, need = 1; break;
+      case H("ceil"): tok.code = op::ceil, need = 1; break;
+      case H("pow"): case H("^"): tok.code = op::pow, need = 2, delta = -1; break;
+      case H(">>"): tok.code = op::shr, need = 2, delta = -1; break;
+      case H("<<"): tok.code = op::shl, need = 2, delta = -1; break;
+      case H("|"): tok.code = op::bitor_, need = 2, delta = -1; break;
+      case H("&"): tok.code = op::bitand_, need = 2, delta = -1; break;
+      case H("~"): tok.code = op::compl_, need = 1; break;
+      case H("toxy"): tok.code = op::toxy, need = 2; break;
+      case H("tort"): tok.code = op::tort, need = 2; break;
+      case H("mi2m"): tok.code = op::mi2m, delta = 1; break;
+      case H("ft2m"): tok.code = op::ft2m, delta = 1; break;
+      case H("in2mm"): tok.code = op::in2mm, delta = 1; break;
+      case H("pi"): tok.code = op::pi, delta = 1; break;
+      case H("e"): tok.code = op::e, delta = 1; break;
+      case H("vc"): tok.code = op::vc, delta = 1; break;
+      case H("ac"): case H("stat"): case H("xstat"): case H("n"):
+      case H("sx"): case H("sy"): case H("sxx"): case H("syy"):
+      case H("sxy"): case H("mx"): case H("my"): case H("sdx"):
+      case H("sdy"): case H("a"): case H("b"): case H("r"):
+      case H("=base"): case H("=prec"): case H("?base"):
+      case H("?prec"): case H("?sf"): case H("sto"): case H("rcl"):
+      case H("sum"): case H("exc"): case H("time"): case H("=urand"):
+      case H("=nrand"): case H("=erand"): case H("urand"):
+      case H("nrand"): case H("erand"): case H("?"): case H("q"):
+	throw std::invalid_argument("rpncalc: operator needs a calc");
+      default:
+	if (! detail::convert_sn(start, len, base, &tok)) {
+	  throw std::invalid_argument("rpncalc: not an operator or number");
+	}
+	tok.code = op::num, delta = 1;
+	break;
+      }
+    }
+
+    if (depth < need) throw std::invalid_argument("rpncalc: stack underflow");
+    depth += delta;
+    if (depth > prog.maxdepth) prog.maxdepth = depth;
+    prog.tok[prog.num++] = tok;
+  }
+  prog.depth = depth;
+
+  return prog;
+}
+
+/*
+  The top of the stack after running a program of constants, in T, at
+  compile time if it's constexpr, throwing if it's an error.
+ */
+template <typename T = double, std::size_t N>
+constexpr T fold(const program<N> &prog)
+{
+  detail::stack<T, N> s{};
+  int t = 0;
+
+  if (prog.nargs > 0) throw std::invalid_argument("rpncalc: not a constant expression");
+  if (prog.depth == 0) throw std::invalid_argument("rpncalc: nothing left on the stack");
+  for (t = 0; t < prog.num; t++) {
+    if (! detail::apply<T>(s, prog.tok[t], nullptr)) {
+      throw std::domain_error("rpncalc: error");
+    }
+  }
+
+  return s.d[s.next - 1];
+}
+
+/*
+  Run a program, which must be a constexpr variable with static
+  storage, on its $n arguments, setting 'result' to the top of the
+  stack, all in the type of 'result'. Returns RPN_OK, or RPN_ERROR as
+  rpncalc_run_args() would.
+ */
+template <const auto &P, typename T, typename... Args>
+inline int run(T *result, Args... args)
+{
+  static_assert(sizeof...(Args) >= (std::size_t) P.nargs, "rpncalc: too few arguments");
+  static_assert(P.depth > 0, "rpncalc: nothing left on the stack");
+  const T a[sizeof...(Args) + 1] = {static_cast<T>(args)...};
+
+  return detail::run<P>(result, a, std::make_index_sequence<(std::size_t) P.num>());
+}
+
+/*
+  sigfig(), for T: the most significant figures in 'base' that its
+  fraction holds, 15 of a double in base 10, 7 of a float and 31 of a
+  dd.
+ */
+template <typename T>
+constexpr int sigfig(int base)
+{
+  double limit = detail::two_to(numeric<T>::digits);
+  double power = base;
+  int n = 0;
+
+  if (base < 2) return 0;
+  while (power <= limit) power *= base, n++;
+
+  return n;
+}
+
+/*
+  convert_d_to_s(), for T: 'x' to 'prec' digits after the point in
+  'base', in 'buf' of 'len' chars, RPN_ERROR if it doesn't fit, with
+  trailing zeros dropped. A double comes out just as rpncalc prints it.
+ */
+template <typename T>
+int convert_to_s(char *buf, T x, int base, int prec, int len)
+{
+  using detail::floor_c;
+  using detail::trunc_ll;
+  using detail::tocharbase;
+  T base_to_prec = 1, roundinc = 0, frac = 0, whole = 0;
+  char *ptr = buf, *wholestart = nullptr, *point = nullptr, *lastzero = nullptr;
+  char c = 0, temp = 0;
+  int digit = 0, t = 0;
+
+  if (x < T(0)) {
+    *ptr++ = '-', len--;
+    if (len <= 0) {*ptr = 0; return RPN_ERROR;}
+    x = -x;
+  }
+  wholestart = ptr;
+
+  /* round to the last digit by adding half of it */
+  if (prec < 0) prec = 0;
+  for (t = 0; t < prec; t++) {
+    base_to_prec *= T(base);
+  }
+  roundinc = T(0.5) / base_to_prec;
+  x += roundinc;
+
+  whole = floor_c(x);
+  if (whole <= T(0)) {
+    *ptr++ = '0', len--;
+    if (len <= 0) {*ptr = 0; return RPN_ERROR;}
+  }
+  frac = x - whole;
+  while (whole >= T(1)) {
+    digit = (int) trunc_ll(whole - floor_c(whole / T(base)) * T(base));
+    *ptr++ = tocharbase(digit, base), len--;
+    if (len <= 0) {*ptr = 0; return RPN_ERROR;}
+    whole /= T(base);
+    prec--;
+  }
+
+  /* the integer part came out backwards */
+  point = ptr;
+  ptr--;
+  while (wholestart < ptr) {
+    temp = *wholestart;
+    *wholestart = *ptr;
+    *ptr = temp;
+    wholestart++, ptr--;
+  }
+  ptr = point;
+
+  if (prec <= 0) {
+    *ptr = 0;
+    return RPN_OK;
+  }
+  lastzero = ptr;
+  *ptr++ = '.', len--;
+  if (len <= 0) {*ptr = 0; return RPN_ERROR;}
+
+  while (prec-- > 0) {
+    frac *= T(base);
+    digit = (int) trunc_ll(frac);
+    frac = frac - T(digit);
+    c = tocharbase(digit, base);
+    *ptr++ = c, len--;
+    if (c != '0') lastzero = ptr;
+    if (len <= 0) {*lastzero = 0; return RPN_ERROR;}
+  }
+  *lastzero = 0;
+
+  return RPN_OK;
+}
+
+/*
+  The statistics registers, summed as stat and xstat sum them, and
+  what's worked out from them, as rpncalc.c does it, in T. A double's
+  are a calc's to the bit. The sums of squares cancel in sdx, a and r
+  when the data are far from 0 for their spread, which a dd's stand
+  where a double's don't. mx and my of no points are 0 / 0.
+ */
+template <typename T>
+struct stats {
+  T sumx = 0, sumy = 0, sumxx = 0, sumyy = 0, sumxy = 0, n = 0;
+
+  /* stat, of a point */
+  constexpr void add(T x, T y)
+  {
+    sumx += x;
+    sumy += y;
+    sumxx += x * x;
+    sumyy += y * y;
+    sumxy += x * y;
+    n += T(1);
+  }
+
+  /* xstat, of y, its x being the points so far */
+  constexpr void add(T y)
+  {
+    sumx += n;
+    sumy += y;
+    sumxx += n * n;
+    sumyy += y * y;
+    sumxy += n * y;
+    n += T(1);
+  }
+
+  constexpr T mx() const { return sumx / n; }
+  constexpr T my() const { return sumy / n; }
+  T sdx() const { return stddev(sumx, sumxx); }
+  T sdy() const { return stddev(sumy, sumyy); }
+
+  /* y = a x + b */
+  constexpr T a() const
+  {
+    T denom = n*sumxx - sumx*sumx;
+
+    if (denom == T(0)) return T(0);
+
+    return (n*sumxy - sumx*sumy) / denom;
+  }
+
+  constexpr T b() const
+  {
+    T denom = n*sumxx - sumx*sumx;
+
+    if (denom == T(0)) return T(0);
+
+    return (sumxx*sumy - sumx*sumxy) / denom;
+  }
+
+  /* the correlation coefficient */
+  T r() const
+  {
+    using std::sqrt;
+    T denom = (n*sumxx - sumx*sumx) * (n*sumyy - sumy*sumy);
+
+    if (denom <= T(0)) return T(0);
+
+    return (n*sumxy - sumx*sumy) / sqrt(denom);
+  }
+
+private:
+  /* ds_stddev_x() */
+  T stddev(T sum, T sumsq) const
+  {
+    using std::sqrt;
+    T mean = 0;
+
+    if (n < T(2)) return T(0);
+    mean = sum / n;
+
+    return sqrt((sumsq - T(2)*mean*sum + n*mean*mean) / (n - T(1)));
+  }
+};
+
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+
+/* a string literal as a template argument */
+template <std::size_t L>
+struct text {
+  char s[L] = {};
+
+  constexpr text(const char (&str)[L])
+  {
+    for (std::size_t t = 0; t < L; t++) s[t] = str[t];
+  }
+};
+
+template <text T>
+inline constexpr auto compiled = parse(T.s);
+
+template <text S, typename T, typename... Args>
+inline int eval(T *result, Args... args)
+{
+  return run<compiled<S>>(result, args...);
+}
+
+#endif
+
+} /* namespace rpncalc */
+
+#endif /* RPNCALC_HPP */
@@ -0,0 +1,178 @@
+/*
+  rpncsv.c
+
+  Per-row formulas over delimited text, see rpncsv.h. Fields are
+  found with memchr() and only those the program refers to are
+  converted, by a decimal scanner that's exact whenever the digits
+  and power of ten are both exactly representable, which covers
+  nearly all measured data, and leaves the rest to strtod().
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpncalc.h"
+#include "rpncsv.h"
+
+enum {NUMSIZE = 256};		/* longest formatted number */
+
+#define isdigit(c) ((c) >= '0' && (c) <= '9')
+#define isblank(c) ((c) == ' ' || (c) == '\t' || (c) == '\r')
+
+static const double powers10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+  Converts the decimal number between 'ptr' and 'end'. Up to 15
+  significant digits times a power of ten up to 22 are both exact in
+  a double, and so then is their product or quotient.
+*/
+static int scan_double(const char *ptr, const char *end, double *x)
+{
+  char buffer[NUMSIZE];
+  const char *start;
+  char *stop;
+  unsigned long long mant = 0;
+  int digits = 0;		/* significant digits in 'mant' */
+  int exp10 = 0;
+  int exp = 0;
+  int expminus = 0;
+  int minus = 0;
+  int seen = 0;
+
+  while (ptr < end && isblank(*ptr)) ptr++;
+  while (end > ptr && isblank(end[-1])) end--;
+  start = ptr;
+
+  if (ptr < end && ('-' == *ptr || '+' == *ptr)) minus = ('-' == *ptr++);
+  for (; ptr < end && isdigit(*ptr); ptr++, seen = 1) {
+    if (digits < 19) {
+      mant = 10 * mant + (*ptr - '0');
+      if (mant != 0) digits++;
+    } else {
+      exp10++;
+    }
+  }
+  if (ptr < end && '.' == *ptr) {
+    for (ptr++; ptr < end && isdigit(*ptr); ptr++, seen = 1) {
+      if (digits < 19) {
+	mant = 10 * mant + (*ptr - '0');
+	if (mant != 0) digits++;
+	exp10--;
+      }
+    }
+  }
+  if (! seen) return RPN_ERROR;
+  if (ptr < end && ('e' == *ptr || 'E' == *ptr)) {
+    ptr++;
+    if (ptr < end && ('-' == *ptr || '+' == *ptr)) expminus = ('-' == *ptr++);
+    if (ptr == end || ! isdigit(*ptr)) return RPN_ERROR;
+    for (; ptr < end && isdigit(*ptr); ptr++) {
+      if (exp < 10000) exp = 10 * exp + (*ptr - '0');
+    }
+  }
+  if (ptr != end) return RPN_ERROR;
+  exp10 += expminus ? -exp : exp;
+
+  if (digits <= 15 && exp10 >= -22 && exp10 <= 22) {
+    *x = (double) mant;
+    *x = exp10 < 0 ? *x / powers10[-exp10] : *x * powers10[exp10];
+    if (minus) *x = -*x;
+    return RPN_OK;
+  }
+
+  /* the slow way, for too many digits or too big an exponent */
+  if (end - start >= NUMSIZE) return RPN_ERROR;
+  memcpy(buffer, start, end - start);
+  buffer[end - start] = 0;
+  *x = strtod(buffer, &stop);
+
+  return stop == buffer + (end - start) ? RPN_OK : RPN_ERROR;
+}
+
+int rpn_csv(DS *ds, const RPN_PROG *prog, int delim, int append, int header, FILE *in, FILE *out)
+{
+  char buffer[NUMSIZE];
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t len;
+  double *args;
+  char *want;
+  const char *ptr, *end, *field;
+  int retval;
+  int col;
+  int t;
+
+  /* which columns are wanted, so the rest can be skipped over */
+  args = (double *) malloc((prog->nargs + 1) * sizeof(double));
+  want = (char *) calloc(prog->nargs + 1, 1);
+  if (NULL == args || NULL == want) {
+    free(args);
+    free(want);
+    return RPN_ERROR;
+  }
+  for (t = 0; t < prog->num; t++) {
+    want[prog->tok[t].arg] = 1;
+  }
+
+  while ((len = getline(&line, &size, in)) > 0) {
+    while (len > 0 && ('\n' == line[len - 1] || '\r' == line[len - 1])) len--;
+
+    if (header) {
+      header = 0;
+      fwrite(line, 1, len, out);
+      if (append) {
+	fputc(delim, out);
+	fputs("result", out);
+      }
+      fputc('\n', out);
+      continue;
+    }
+
+    retval = RPN_OK;
+    ptr = line;
+    end = line + len;
+    for (col = 1; col <= prog->nargs; col++) {
+      if (ptr > end) {
+	retval = RPN_ERROR;	/* ran out of columns */
+	break;
+      }
+      field = memchr(ptr, delim, end - ptr);
+      if (NULL == field) field = end;
+      if (want[col] && RPN_OK != scan_double(ptr, field, &args[col - 1])) {
+	retval = RPN_ERROR;
+	break;
+      }
+      ptr = field + 1;
+    }
+
+    ds_clear(ds);
+    if (RPN_OK == retval) {
+      retval = rpncalc_run_args(ds, prog, args, prog->nargs);
+    }
+    if (RPN_OK != retval ||
+	ds->next == 0 ||
+	RPN_OK != ds_format(ds, ds->next - 1, buffer, NUMSIZE)) {
+      strcpy(buffer, "error");
+    }
+
+    if (append) {
+      fwrite(line, 1, len, out);
+      fputc(delim, out);
+    }
+    fputs(buffer, out);
+    fputc('\n', out);
+  }
+
+  free(line);
+  free(args);
+  free(want);
+
+  return RPN_OK;
+}
@@ -0,0 +1,23 @@
+#ifndef RPNCSV_H
+#define RPNCSV_H
+
+#include <stdio.h>		/* FILE */
+#include "rpncalc.h"		/* DS, RPN_PROG */
+
+/*
+  Evaluate a program on each row of delimited text, e.g., CSV or TSV,
+  with its $n references getting the numbers in the row's columns,
+  counting from 1. For each row the stack is cleared, the program is
+  run, and the top of the stack is printed, or "error". With
+  'append', the row is printed first, followed by the delimiter, so
+  the result becomes a new last column. With 'header', the first line
+  is passed through, with a "result" column if appending.
+
+  Only columns the program refers to are converted. Fields are
+  numbers in decimal, optionally with exponents, and can't be quoted.
+  Rows are read one at a time, so memory use doesn't grow with input.
+  Returns RPN_OK, or RPN_ERROR if the program can't be run.
+ */
+extern int rpn_csv(DS *ds, const RPN_PROG *prog, int delim, int append, int header, FILE *in, FILE *out);
+
+#endif /* RPNCSV_H */
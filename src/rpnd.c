@@ -0,0 +1,400 @@
+/*
+  rpnd.c
+
+  Calculator server on a Unix domain socket, so that clients that
+  would otherwise run rpn once per expression pay for process startup
+  and calculator initialization just once.
+
+  Syntax: rpnd [-s <socket path>] [-n <warm contexts>]
+
+  Each connection gets its own calculator, taken from a pool of
+  contexts initialized at startup, which persists between requests
+  until the connection closes and is then cleared and put back.
+
+  Requests are lines, each a batch of one or more RPN expressions
+  separated by ';', evaluated in order. The response to each request
+  is a line with one result per expression, separated by spaces: the
+  top of the stack in the current base and precision, _ if the stack
+  is empty, or E if the expression was in error. Clients may send
+  many requests without waiting, and responses come back in order.
+  A q quits, closing the connection once its response is sent, and so
+  does the client shutting down its side, once all the responses to
+  what it sent are.
+
+  For example,
+
+  1 2 + ; 3 * ; hex FF ; c ; 1 0 /
+
+  gets back
+
+  3 9 FF _ E
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include "rpncalc.h"
+
+enum {STACKSIZE = 10};
+enum {INSIZE = 65536};		/* longest request line */
+enum {OUTMAX = 1 << 20};	/* stop reading with this much unsent */
+enum {MAXEVENTS = 64};
+enum {NUMSIZE = 256};		/* longest formatted number */
+
+typedef struct rpnd_ctx {
+  DS ds;
+  double stack[STACKSIZE];
+  struct rpnd_ctx *next;	/* in the free list */
+} rpnd_ctx;
+
+typedef struct {
+  int fd;
+  rpnd_ctx *ctx;
+  char in[INSIZE];
+  int inlen;
+  char *out;
+  int outlen;			/* bytes in 'out' */
+  int outsent;			/* bytes of those already sent */
+  int outsize;			/* bytes allocated */
+  int quit;			/* close once everything is sent */
+  int events;			/* what we're registered for */
+} rpnd_conn;
+
+static rpnd_ctx *ctx_free = NULL;
+
+static rpnd_ctx *ctx_new(void)
+{
+  rpnd_ctx *ctx;
+
+  ctx = (rpnd_ctx *) malloc(sizeof(*ctx));
+  if (NULL == ctx) return NULL;
+  ds_init(&ctx->ds, ctx->stack, STACKSIZE);
+  ctx->next = NULL;
+
+  return ctx;
+}
+
+static rpnd_ctx *ctx_get(void)
+{
+  rpnd_ctx *ctx;
+
+  if (NULL == ctx_free) return ctx_new();
+
+  ctx = ctx_free;
+  ctx_free = ctx->next;
+
+  return ctx;
+}
+
+/*
+  Put it back warm, cleared as if just initialized, its generators
+  too, which ds_reset() leaves, so no session carries on another's.
+ */
+static void ctx_put(rpnd_ctx *ctx)
+{
+  ds_reset(&ctx->ds);
+  ds_seed_stream(&ctx->ds, 0);
+  ctx->next = ctx_free;
+  ctx_free = ctx;
+}
+
+static int out_reserve(rpnd_conn *conn, int len)
+{
+  char *out;
+  int size;
+
+  if (conn->outlen + len <= conn->outsize) return 0;
+
+  if (conn->outsent > 0) {
+    /* make room by dropping what's already gone */
+    memmove(conn->out, conn->out + conn->outsent, conn->outlen - conn->outsent);
+    conn->outlen -= conn->outsent;
+    conn->outsent = 0;
+    if (conn->outlen + len <= conn->outsize) return 0;
+  }
+
+  size = conn->outsize < 4096 ? 4096 : conn->outsize;
+  while (size < conn->outlen + len) size *= 2;
+  out = (char *) realloc(conn->out, size);
+  if (NULL == out) return -1;
+  conn->out = out;
+  conn->outsize = size;
+
+  return 0;
+}
+
+static int out_append(rpnd_conn *conn, const char *str, int len)
+{
+  if (0 != out_reserve(conn, len)) return -1;
+  memcpy(conn->out + conn->outlen, str, len);
+  conn->outlen += len;
+
+  return 0;
+}
+
+/* evaluate one request line, with ';' between expressions */
+static int handle_line(rpnd_conn *conn, char *line)
+{
+  DS *ds = &conn->ctx->ds;
+  char buffer[NUMSIZE];
+  char *expr;
+  char *semi;
+  int retval;
+  int len;
+
+  for (expr = line; NULL != expr; expr = semi) {
+    semi = strchr(expr, ';');
+    if (NULL != semi) *semi++ = 0;
+
+    retval = rpncalc_eval(ds, expr);
+    if (RPN_QUIT == retval) {
+      conn->quit = 1;
+      break;
+    }
+    if (RPN_OK != retval) {
+      strcpy(buffer, "E");
+    } else if (0 == ds->next) {
+      strcpy(buffer, "_");
+    } else if (RPN_OK != ds_format(ds, ds->next - 1, buffer, sizeof(buffer))) {
+      strcpy(buffer, "E");
+    }
+    len = strlen(buffer);
+    if (expr != line) {
+      if (0 != out_append(conn, " ", 1)) return -1;
+    }
+    if (0 != out_append(conn, buffer, len)) return -1;
+  }
+
+  return out_append(conn, "\n", 1);
+}
+
+static int conn_flush(rpnd_conn *conn)
+{
+  ssize_t n;
+
+  while (conn->outsent < conn->outlen) {
+    n = send(conn->fd, conn->out + conn->outsent,
+	     conn->outlen - conn->outsent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (EINTR == errno) continue;
+      if (EAGAIN == errno || EWOULDBLOCK == errno) return 0;
+      return -1;
+    }
+    conn->outsent += n;
+  }
+  conn->outsent = conn->outlen = 0;
+
+  return 0;
+}
+
+static int conn_read(rpnd_conn *conn)
+{
+  ssize_t n;
+  char *start;
+  char *nl;
+  char *end;
+
+  n = read(conn->fd, conn->in + conn->inlen, INSIZE - conn->inlen);
+  if (n < 0) {
+    if (EINTR == errno || EAGAIN == errno || EWOULDBLOCK == errno) return 0;
+    return -1;
+  }
+  if (n == 0) {
+    /* the client's done sending, but may still be reading replies */
+    conn->quit = 1;
+    return 0;
+  }
+  conn->inlen += n;
+
+  /* handle all the complete lines */
+  start = conn->in;
+  end = conn->in + conn->inlen;
+  while (! conn->quit &&
+	 NULL != (nl = memchr(start, '\n', end - start))) {
+    *nl = 0;
+    if (0 != handle_line(conn, start)) return -1;
+    start = nl + 1;
+  }
+  conn->inlen = end - start;
+  memmove(conn->in, start, conn->inlen);
+
+  if (conn->inlen == INSIZE) {
+    /* the line's too long to ever be handled */
+    out_append(conn, "E\n", 2);
+    conn->quit = 1;
+  }
+
+  return 0;
+}
+
+static void conn_close(int epfd, rpnd_conn *conn)
+{
+  epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+  close(conn->fd);
+  ctx_put(conn->ctx);
+  free(conn->out);
+  free(conn);
+}
+
+/* register for output only when some is waiting */
+static int conn_update(int epfd, rpnd_conn *conn)
+{
+  struct epoll_event ev;
+  int events;
+
+  events = 0;
+  if (conn->outlen - conn->outsent < OUTMAX && ! conn->quit) events |= EPOLLIN;
+  if (conn->outsent < conn->outlen) events |= EPOLLOUT;
+  if (events == conn->events) return 0;
+
+  conn->events = events;
+  ev.events = events;
+  ev.data.ptr = conn;
+
+  return epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+static int do_accept(int epfd, int lfd)
+{
+  struct epoll_event ev;
+  rpnd_conn *conn;
+  int fd;
+
+  fd = accept(lfd, NULL, NULL);
+  if (fd < 0) return -1;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  conn = (rpnd_conn *) malloc(sizeof(*conn));
+  if (NULL == conn) {
+    close(fd);
+    return -1;
+  }
+  conn->fd = fd;
+  conn->ctx = ctx_get();
+  conn->inlen = 0;
+  conn->out = NULL;
+  conn->outlen = conn->outsent = conn->outsize = 0;
+  conn->quit = 0;
+  conn->events = EPOLLIN;
+  if (NULL == conn->ctx) {
+    close(fd);
+    free(conn);
+    return -1;
+  }
+
+  ev.events = EPOLLIN;
+  ev.data.ptr = conn;
+  if (0 != epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev)) {
+    conn_close(epfd, conn);
+    return -1;
+  }
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = "/tmp/rpnd.sock";
+  struct sockaddr_un addr;
+  struct epoll_event ev;
+  struct epoll_event events[MAXEVENTS];
+  rpnd_conn *conn;
+  rpnd_ctx *ctx;
+  int warm = 16;
+  int lfd, epfd;
+  int n, t;
+
+  for (t = 1; t < argc; t++) {
+    if (! strcmp(argv[t], "-s") && t + 1 < argc) {
+      path = argv[++t];
+    } else if (! strcmp(argv[t], "-n") && t + 1 < argc &&
+	       1 == sscanf(argv[t + 1], "%i", &warm)) {
+      t++;
+    } else {
+      fprintf(stderr, "usage: rpnd [-s <socket path>] [-n <warm contexts>]\n");
+      return 1;
+    }
+  }
+
+  /* warm up the contexts now, rather than per connection */
+  for (t = 0; t < warm; t++) {
+    if (NULL == (ctx = ctx_new())) break;
+    ctx_put(ctx);
+  }
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "rpnd: socket path too long: %s\n", path);
+    return 1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+
+  lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (lfd < 0 ||
+      0 != bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) ||
+      0 != listen(lfd, SOMAXCONN)) {
+    perror("rpnd");
+    return 1;
+  }
+  fcntl(lfd, F_SETFL, fcntl(lfd, F_GETFL) | O_NONBLOCK);
+
+  epfd = epoll_create1(0);
+  if (epfd < 0) {
+    perror("rpnd");
+    return 1;
+  }
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;		/* NULL means the listener */
+  epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+
+  signal(SIGPIPE, SIG_IGN);
+
+  for (;;) {
+    n = epoll_wait(epfd, events, MAXEVENTS, -1);
+    if (n < 0) {
+      if (EINTR == errno) continue;
+      perror("rpnd");
+      break;
+    }
+    for (t = 0; t < n; t++) {
+      conn = (rpnd_conn *) events[t].data.ptr;
+      if (NULL == conn) {
+	while (0 == do_accept(epfd, lfd));
+	continue;
+      }
+      if (events[t].events & EPOLLERR) {
+	conn_close(epfd, conn);
+	continue;
+      }
+      if ((events[t].events & (EPOLLIN | EPOLLHUP)) &&
+	  (conn->events & EPOLLIN) &&
+	  0 != conn_read(conn)) {
+	conn_close(epfd, conn);
+	continue;
+      }
+      if (0 != conn_flush(conn) ||
+	  (conn->quit && conn->outsent == conn->outlen) ||
+	  0 != conn_update(epfd, conn)) {
+	conn_close(epfd, conn);
+      }
+    }
+  }
+
+  close(lfd);
+  unlink(path);
+
+  return 1;
+}
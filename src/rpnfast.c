@@ -0,0 +1,487 @@
+/*
+  rpnfast.c
+
+  Fast sin, cos, tan, atan2, exp, log and pow, see rpnfast.h. The
+  kernels and their coefficients are fdlibm's, the ones most libms
+  started from, less the special cases: the arguments of sin and cos
+  are reduced by pi/2 in three pieces, Cody and Waite's way, atan's
+  to under 7/16 by the tangent of a difference, exp's by ln(2), and
+  log's by its exponent, and each kernel is straight-line code, so a
+  loop of them vectorizes. Whatever's out of a kernel's
+  range goes to libm. pow carries log(x) and y log(x) in two doubles
+  so exp of it doesn't magnify log's rounding.
+*/
+
+#include <math.h>		/* sin, ..., for out of range arguments */
+#include <float.h>		/* DBL_MIN */
+#include <string.h>		/* memcpy */
+#include "rpnfast.h"		/* our decls */
+
+#define TRIG_MAX 823549.0	/* 2^19 pi/2, n pi/2 is exact below */
+#define EXP_MAX 708.0		/* 2^k for exp stays a normal double */
+#define POW_Y_MAX 18446744073709551616.0 /* 2^64, y log(x) can't split */
+
+/* adding and subtracting this rounds to an integer */
+static const double ROUNDER = 6755399441055744.0; /* 1.5 * 2^52 */
+
+/* pi/2 = PIO2_1 + PIO2_2 + PIO2_3 + PIO2_3T, the first three 33 bits */
+static const double INVPIO2 = 6.36619772367581382433e-01;
+static const double PIO2_1 = 1.57079632673412561417e+00;
+static const double PIO2_2 = 6.07710050630396597660e-11;
+static const double PIO2_2T = 2.02226624879595063154e-21;
+static const double PIO2_3 = 2.02226624871116645580e-21;
+static const double PIO2_3T = 8.47842766036889956997e-32;
+
+/* sin(x) ~ x + x^3 (S1 + x^2 S2 + ...), |x| <= pi/4 */
+static const double S1 = -1.66666666666666324348e-01;
+static const double S2 = 8.33333333332248946124e-03;
+static const double S3 = -1.98412698298579493134e-04;
+static const double S4 = 2.75573137070700676789e-06;
+static const double S5 = -2.50507602534068634195e-08;
+static const double S6 = 1.58969099521155010221e-10;
+
+/* cos(x) ~ 1 - x^2/2 + x^4 (C1 + x^2 C2 + ...), |x| <= pi/4 */
+static const double C1 = 4.16666666666666019037e-02;
+static const double C2 = -1.38888888888741095749e-03;
+static const double C3 = 2.48015872894767294178e-05;
+static const double C4 = -2.75573143513906633035e-07;
+static const double C5 = 2.08757232129817482790e-09;
+static const double C6 = -1.13596475577881948265e-11;
+
+/* atan(x) ~ x - x^3 (AT0 + x^2 AT1 + ...), |x| <= 7/16 */
+static const double AT0 = 3.33333333333329318027e-01;
+static const double AT1 = -1.99999999998764832476e-01;
+static const double AT2 = 1.42857142725034663711e-01;
+static const double AT3 = -1.11111104054623557880e-01;
+static const double AT4 = 9.09088713343650656196e-02;
+static const double AT5 = -7.69187620504482999495e-02;
+static const double AT6 = 6.66107313738753120669e-02;
+static const double AT7 = -5.83357013379057348645e-02;
+static const double AT8 = 4.97687799461593236017e-02;
+static const double AT9 = -3.65315727442169155270e-02;
+static const double AT10 = 1.62858201153657823623e-02;
+
+/* atan(1/2), pi/4, pi/2 and pi, each as a double and what's left */
+static const double ATAN_HALF_HI = 4.63647609000806093515e-01;
+static const double ATAN_HALF_LO = 2.26987774529616870924e-17;
+static const double PIO4_HI = 7.85398163397448278999e-01;
+static const double PIO4_LO = 3.06161699786838301793e-17;
+static const double PIO2_HI = 1.57079632679489655800e+00;
+static const double PIO2_LO = 6.12323399573676603587e-17;
+static const double PI_HI = 3.14159265358979311600e+00;
+static const double PI_LO = 1.22464679914735317720e-16;
+
+/* ln(2) = LN2_HI + LN2_LO, the first 32 bits, so k LN2_HI is exact */
+static const double INVLN2 = 1.44269504088896338700e+00;
+static const double LN2_HI = 6.93147180369123816490e-01;
+static const double LN2_LO = 1.90821492927058770002e-10;
+
+/* exp(r) ~ 1 + 2r/(2 - R(r)), R(r) = r^2 (P1 + r^2 P2 + ...) */
+static const double P1 = 1.66666666666666019037e-01;
+static const double P2 = -2.77777777770155933842e-03;
+static const double P3 = 6.61375632143793436117e-05;
+static const double P4 = -1.65339022054652515390e-06;
+static const double P5 = 4.13813679705723846039e-08;
+
+/* log(1 + f) = 2s + s R(s^2), s = f/(2 + f), R(z) ~ z (Lg1 + z Lg2 ...) */
+static const double LG1 = 6.666666666666735130e-01;
+static const double LG2 = 3.999999999940941908e-01;
+static const double LG3 = 2.857142874366239149e-01;
+static const double LG4 = 2.222219843214978396e-01;
+static const double LG5 = 1.818357216161805012e-01;
+static const double LG6 = 1.531383769920937332e-01;
+static const double LG7 = 1.479819860511658591e-01;
+
+static inline double from_bits(unsigned long long u)
+{
+  double x;
+
+  memcpy(&x, &u, sizeof(x));
+  return x;
+}
+
+static inline unsigned long long to_bits(double x)
+{
+  unsigned long long u;
+
+  memcpy(&u, &x, sizeof(x));
+  return u;
+}
+
+/*
+  x - n pi/2 = *hi + *lo, |*hi| <= pi/4, returning n mod 4. 'x' has
+  to be under TRIG_MAX, so n pi/2 and its first pieces are exact.
+ */
+static inline unsigned reduce_pio2(double x, double *hi, double *lo)
+{
+  double rn = x * INVPIO2 + ROUNDER;
+  double n = rn - ROUNDER;
+  double r, t, w;
+
+  r = x - n * PIO2_1;
+  t = r, w = n * PIO2_2;
+  r = t - w;
+  w = n * PIO2_2T - ((t - r) - w);
+  t = r, w = n * PIO2_3;
+  r = t - w;
+  w = n * PIO2_3T - ((t - r) - w);
+  *hi = r - w;
+  *lo = (r - *hi) - w;
+
+  /* the low bits of rn's fraction are n's */
+  return (unsigned) to_bits(rn) & 3;
+}
+
+/* sin(x + y), |x| <= pi/4, y a tail under half an ulp of x */
+static inline double kernel_sin(double x, double y)
+{
+  double z = x * x, v = z * x;
+  double r = S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)));
+
+  return x - ((z * (0.5 * y - v * r) - y) - v * S1);
+}
+
+static inline double kernel_cos(double x, double y)
+{
+  double z = x * x, hz = 0.5 * z, w = 1.0 - hz;
+  double r = z * (C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6)))));
+
+  return w + (((1.0 - w) - hz) + (z * r - x * y));
+}
+
+/*
+  sin(x) and cos(x). One that's out of range comes out wrong, but not
+  undefined, and the caller does it over with libm. The quadrant picks
+  and negates with bit masks rather than branches or multiplies,
+  which the compiler won't vectorize unless it can assume they don't
+  trap.
+ */
+static inline void kernel_sincos(double x, double *s, double *c)
+{
+  static const unsigned long long SIGN = 0x8000000000000000ULL;
+  unsigned long long ks, kc, odd, neg;
+  double hi, lo;
+  unsigned q;
+
+  q = reduce_pio2(x, &hi, &lo);
+  ks = to_bits(kernel_sin(hi, lo));
+  kc = to_bits(kernel_cos(hi, lo));
+  odd = 0 - (unsigned long long) (q & 1);
+  neg = (unsigned long long) (q & 2) << 62;
+  *s = from_bits(((kc & odd) | (ks & ~odd)) ^ neg);
+  *c = from_bits(((ks & odd) | (kc & ~odd)) ^ neg ^ (odd & SIGN));
+}
+
+/*
+  exp(x), for |x| < EXP_MAX, where 2^n is a normal double, and again,
+  just wrong otherwise.
+ */
+static inline double kernel_exp(double x)
+{
+  double rn, n, hi, lo, r, t, c;
+
+  rn = x * INVLN2 + ROUNDER;
+  n = rn - ROUNDER;
+  hi = x - n * LN2_HI;
+  lo = n * LN2_LO;
+  r = hi - lo;
+  t = r * r;
+  c = r - t * (P1 + t * (P2 + t * (P3 + t * (P4 + t * P5))));
+  r = 1.0 - ((lo - (r * c) / (2.0 - c)) - hi);
+
+  /* 2^n, made from n in rn's fraction */
+  return r * from_bits((to_bits(rn) + 1023) << 52);
+}
+
+/*
+  x = 2^k (1 + *f), 1 + *f in [sqrt(2)/2, sqrt(2)), returning k, for
+  a normal x > 0, and something harmless for anything else.
+ */
+static inline int reduce_log(double x, double *f)
+{
+  unsigned long long u = to_bits(x);
+  unsigned long long m = u & 0x000fffffffffffffULL;
+  /* 0x95f64 is the top of sqrt(2)'s fraction, less a half in the 21st bit */
+  unsigned long long i = ((m >> 32) + 0x95f64) & 0x100000;
+  int k = (int) (u >> 52) - 1023 + (int) (i >> 20);
+
+  *f = from_bits(m | ((i ^ 0x3ff00000) << 32)) - 1.0;
+  return k;
+}
+
+/* log(x), for a normal x > 0 */
+static inline double kernel_log(double x)
+{
+  double f, s, z, w, r, hfsq, dk;
+
+  dk = reduce_log(x, &f);
+  s = f / (2.0 + f);
+  z = s * s;
+  w = z * z;
+  r = z * (LG1 + w * (LG3 + w * (LG5 + w * LG7))) + w * (LG2 + w * (LG4 + w * LG6));
+  hfsq = 0.5 * f * f;
+
+  return dk * LN2_HI - ((hfsq - (s * (hfsq + r) + dk * LN2_LO)) - f);
+}
+
+/* a where the mask is all ones, b where it's 0 */
+static inline double select_bits(unsigned long long mask, double a, double b)
+{
+  return from_bits((to_bits(a) & mask) | (to_bits(b) & ~mask));
+}
+
+/*
+  atan2(y, x), for finite x and y, not both 0. It's atan of the
+  smaller of |x| and |y| over the larger, z in [0, 1], reduced further
+  as atan(z) = atan(c) + atan((z - c)/(1 + c z)) for c = 0, 1/2 or 1,
+  as fdlibm's atan does, then moved to its octant and quadrant. The
+  choices are masks, as kernel_sincos()'s are, and since the doubles
+  compared are never negative, they're compared as their bits are.
+ */
+static inline double kernel_atan2(double y, double x)
+{
+  static const unsigned long long SIGN = 0x8000000000000000ULL;
+  static const unsigned long long BITS_7_16 = 0x3fdc000000000000ULL; /* 0.4375 */
+  static const unsigned long long BITS_11_16 = 0x3fe6000000000000ULL; /* 0.6875 */
+  unsigned long long bx = to_bits(x) & ~SIGN, by = to_bits(y) & ~SIGN;
+  unsigned long long swap = 0 - (unsigned long long) (by > bx);
+  unsigned long long bz, mid, top;
+  double ax = from_bits(bx), ay = from_bits(by);
+  double z, c, hi, lo, u, s, w, s1, s2, r;
+
+  z = select_bits(swap, ax, ay) / select_bits(swap, ay, ax);
+  bz = to_bits(z);
+  mid = 0 - (unsigned long long) (bz >= BITS_7_16);
+  top = 0 - (unsigned long long) (bz >= BITS_11_16);
+  c = select_bits(top, 1.0, select_bits(mid, 0.5, 0.0));
+  hi = select_bits(top, PIO4_HI, select_bits(mid, ATAN_HALF_HI, 0.0));
+  lo = select_bits(top, PIO4_LO, select_bits(mid, ATAN_HALF_LO, 0.0));
+  u = (z - c) / (1.0 + c * z);	/* z - c is exact */
+  s = u * u;
+  w = s * s;
+  s1 = s * (AT0 + w * (AT2 + w * (AT4 + w * (AT6 + w * (AT8 + w * AT10)))));
+  s2 = w * (AT1 + w * (AT3 + w * (AT5 + w * (AT7 + w * AT9))));
+  r = hi - ((u * (s1 + s2) - lo) - u);
+
+  r = select_bits(swap, (PIO2_HI - r) + PIO2_LO, r);
+  r = select_bits(0 - (to_bits(x) >> 63), (PI_HI - r) + PI_LO, r);
+
+  return from_bits(to_bits(r) | (to_bits(y) & SIGN));
+}
+
+/* where kernel_atan2() is good */
+#define ATAN2_OK(y, x) (fabs(x) <= DBL_MAX && fabs(y) <= DBL_MAX && ((x) != 0.0 || (y) != 0.0))
+
+/*
+  One at a time, there's no loop to vectorize, so sin and cos take
+  the quadrant's branch and evaluate only the kernel it wants, and
+  all of them skip the reduction when there's none to do.
+ */
+double rpn_fast_sin(double x)
+{
+  double hi, lo, r;
+  unsigned q;
+
+  if (fabs(x) <= PIO4_HI) return kernel_sin(x, 0.0);
+  if (! (fabs(x) < TRIG_MAX)) return sin(x);
+  q = reduce_pio2(x, &hi, &lo);
+  r = q & 1 ? kernel_cos(hi, lo) : kernel_sin(hi, lo);
+  return q & 2 ? -r : r;
+}
+
+double rpn_fast_cos(double x)
+{
+  double hi, lo, r;
+  unsigned q;
+
+  if (fabs(x) <= PIO4_HI) return kernel_cos(x, 0.0);
+  if (! (fabs(x) < TRIG_MAX)) return cos(x);
+  q = reduce_pio2(x, &hi, &lo);
+  r = q & 1 ? kernel_sin(hi, lo) : kernel_cos(hi, lo);
+  return (q + 1) & 2 ? -r : r;
+}
+
+double rpn_fast_tan(double x)
+{
+  double s, c;
+
+  if (! (fabs(x) < TRIG_MAX)) return tan(x);
+  kernel_sincos(x, &s, &c);
+  return s / c;
+}
+
+void rpn_fast_sincos(double x, double *s, double *c)
+{
+  if (fabs(x) <= PIO4_HI) {
+    *s = kernel_sin(x, 0.0);
+    *c = kernel_cos(x, 0.0);
+  } else if (! (fabs(x) < TRIG_MAX)) {
+    *s = sin(x);
+    *c = cos(x);
+  } else {
+    kernel_sincos(x, s, c);
+  }
+}
+
+double rpn_fast_exp(double x)
+{
+  return fabs(x) < EXP_MAX ? kernel_exp(x) : exp(x);
+}
+
+double rpn_fast_log(double x)
+{
+  return x >= DBL_MIN && x <= DBL_MAX ? kernel_log(x) : log(x);
+}
+
+double rpn_fast_atan2(double y, double x)
+{
+  return ATAN2_OK(y, x) ? kernel_atan2(y, x) : atan2(y, x);
+}
+
+/*
+  Exact products and sums, as a rounded result and its error, for
+  pow's arithmetic in two doubles.
+ */
+static void two_prod(double a, double b, double *p, double *e)
+{
+#ifdef FP_FAST_FMA
+  *p = a * b;
+  *e = fma(a, b, -*p);
+#else
+  static const double SPLIT = 134217729.0; /* 2^27 + 1 */
+  double t, ah, al, bh, bl;
+
+  *p = a * b;
+  t = SPLIT * a, ah = t - (t - a), al = a - ah;
+  t = SPLIT * b, bh = t - (t - b), bl = b - bh;
+  *e = ((ah * bh - *p) + ah * bl + al * bh) + al * bl;
+#endif
+}
+
+static void two_sum(double a, double b, double *s, double *e)
+{
+  double v;
+
+  *s = a + b;
+  v = *s - a;
+  *e = (a - (*s - v)) + (b - v);
+}
+
+/*
+  log(x) = *hi + *lo, good to 2^-64 or so of it, for a normal x > 0.
+  The kernel_log() formula, but keeping s and the biggest term of
+  R(s^2), Lg1 s^3, to two doubles each.
+ */
+static void log2d(double x, double *hi, double *lo)
+{
+  double f, d, dlo, rd, s, slo, p, plo, z, zlo, c, clo, g, glo, rest;
+  double a, alo, b, blo;
+  int k;
+
+  k = reduce_log(x, &f);
+
+  /* s = f/(2 + f), with 2 + f = d + dlo exactly, and s + slo exact */
+  d = 2.0 + f;
+  dlo = f - (d - 2.0);
+  rd = 1.0 / d;
+  s = f * rd;
+  two_prod(s, d, &p, &plo);
+  slo = (((f - p) - plo) - s * dlo) * rd;
+
+  /* c = s^3 and g = Lg1 s^3 */
+  two_prod(s, s, &z, &zlo);
+  two_prod(z, s, &c, &clo);
+  clo += zlo * s + 3.0 * z * slo;
+  two_prod(c, LG1, &g, &glo);
+  glo += clo * LG1;
+  rest = c * z * (LG2 + z * (LG3 + z * (LG4 + z * (LG5 + z * (LG6 + z * LG7)))));
+
+  /* k ln(2) + 2s + g + the rest */
+  two_sum(k * LN2_HI, 2.0 * s, &a, &alo);
+  two_sum(a, g, &b, &blo);
+  alo += blo + 2.0 * slo + glo + rest + k * LN2_LO;
+  *hi = b + alo;
+  *lo = alo - (*hi - b);
+}
+
+double rpn_fast_pow(double x, double y)
+{
+  double lhi, llo, z, zlo, e;
+
+  if (! (x >= DBL_MIN && x <= DBL_MAX && fabs(y) < POW_Y_MAX)) return pow(x, y);
+
+  log2d(x, &lhi, &llo);
+  two_prod(y, lhi, &z, &zlo);
+  zlo += y * llo;
+  if (! (fabs(z) < EXP_MAX)) return pow(x, y);
+
+  /* exp(z + zlo) = exp(z) (1 + zlo), zlo being under 2^-43 */
+  e = kernel_exp(z);
+  return e + e * zlo;
+}
+
+/*
+  The array forms run the kernel over all of it, in a loop with no
+  calls or branches, then do any that were out of range over.
+ */
+void rpn_fast_sin_n(double *y, const double *x, int n)
+{
+  double c;
+  int t;
+
+  for (t = 0; t < n; t++) kernel_sincos(x[t], &y[t], &c);
+  for (t = 0; t < n; t++) {
+    if (! (fabs(x[t]) < TRIG_MAX)) y[t] = sin(x[t]);
+  }
+}
+
+void rpn_fast_cos_n(double *y, const double *x, int n)
+{
+  double s;
+  int t;
+
+  for (t = 0; t < n; t++) kernel_sincos(x[t], &s, &y[t]);
+  for (t = 0; t < n; t++) {
+    if (! (fabs(x[t]) < TRIG_MAX)) y[t] = cos(x[t]);
+  }
+}
+
+void rpn_fast_sincos_n(double *s, double *c, const double *x, int n)
+{
+  int t;
+
+  for (t = 0; t < n; t++) kernel_sincos(x[t], &s[t], &c[t]);
+  for (t = 0; t < n; t++) {
+    if (! (fabs(x[t]) < TRIG_MAX)) s[t] = sin(x[t]), c[t] = cos(x[t]);
+  }
+}
+
+void rpn_fast_exp_n(double *y, const double *x, int n)
+{
+  int t;
+
+  for (t = 0; t < n; t++) y[t] = kernel_exp(x[t]);
+  for (t = 0; t < n; t++) {
+    if (! (fabs(x[t]) < EXP_MAX)) y[t] = exp(x[t]);
+  }
+}
+
+void rpn_fast_log_n(double *y, const double *x, int n)
+{
+  int t;
+
+  for (t = 0; t < n; t++) y[t] = kernel_log(x[t]);
+  for (t = 0; t < n; t++) {
+    if (! (x[t] >= DBL_MIN && x[t] <= DBL_MAX)) y[t] = log(x[t]);
+  }
+}
+
+void rpn_fast_atan2_n(double *a, const double *y, const double *x, int n)
+{
+  int t;
+
+  for (t = 0; t < n; t++) a[t] = kernel_atan2(y[t], x[t]);
+  for (t = 0; t < n; t++) {
+    if (! ATAN2_OK(y[t], x[t])) a[t] = atan2(y[t], x[t]);
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef RPNFAST_H
+#define RPNFAST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Fast replacements for the libm functions the calculator uses most,
+  for when a formula is dominated by them. They're polynomials after
+  a short argument reduction, with no errno and no table lookups, and
+  the array forms are written so the compiler can vectorize them (at
+  -O3, or -O2 -ftree-vectorize).
+
+  Over their fast ranges, the error is under 1 ULP for exp and log,
+  1.5 ULP for sin, cos, atan2 and pow, and 3 ULP for tan, as measured
+  by "rpnbench fastmath" against long double, which also times them
+  against the C library's; glibc's log and pow, for one, are table
+  driven and quicker than these are. Outside those ranges, for huge
+  angles, non-positive logs, overflow, infinities and NaNs, they call
+  libm, so the results, and errno, are the same as libm's there:
+
+  sin, cos, tan, sincos  |x| < 823549 (2^19 pi/2)
+  atan2                  finite y and x, not both 0
+  exp                    |x| < 708
+  log                    normal x > 0
+  pow                    normal x > 0, y * log(x) within exp's range
+
+  The calculator uses sin, cos, tan, sincos and atan2 after the "fast"
+  operator, until "libm", or from the start if the library is built
+  with -DRPN_FASTMATH=1. Its exp, log and pow are always libm's, which
+  are as quick or quicker, one at a time.
+ */
+
+#ifndef RPN_FASTMATH
+#define RPN_FASTMATH 0		/* the default for new calcs */
+#endif
+
+extern double rpn_fast_sin(double x);
+extern double rpn_fast_cos(double x);
+extern double rpn_fast_tan(double x);
+extern void rpn_fast_sincos(double x, double *s, double *c);
+extern double rpn_fast_exp(double x);
+extern double rpn_fast_log(double x);
+extern double rpn_fast_pow(double x, double y);
+extern double rpn_fast_atan2(double y, double x);
+
+/*
+  The same over arrays, y[t] = f(x[t]) for 't' from 0 to n - 1.
+ */
+extern void rpn_fast_sin_n(double *y, const double *x, int n);
+extern void rpn_fast_cos_n(double *y, const double *x, int n);
+extern void rpn_fast_sincos_n(double *s, double *c, const double *x, int n);
+extern void rpn_fast_exp_n(double *y, const double *x, int n);
+extern void rpn_fast_log_n(double *y, const double *x, int n);
+
+/* a[t] = atan2(y[t], x[t]) */
+extern void rpn_fast_atan2_n(double *a, const double *y, const double *x, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RPNFAST_H */
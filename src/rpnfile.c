@@ -0,0 +1,247 @@
+/*
+  rpnfile.c
+
+  Parallel evaluation of big files of lines. The file is mapped, not
+  read, and split into chunks ending at newlines. Worker threads take
+  chunks in order, each evaluating its lines in place with
+  rpncalc_evaln() on its own calc, and print to a buffer per chunk.
+  The caller's thread writes the buffers out in chunk order as they
+  finish. Workers don't run more than a few chunks ahead of the
+  writer, so memory for output stays bounded however big the file.
+
+  Since chunks are evaluated independently, so are lines: each starts
+  from a reset calc rather than the stack left by the line before,
+  with its random generators on the substream of its line number, so
+  the results don't depend on the threads or which chunk ran when.
+  Numbering the lines is the one pass over the file before they start.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#if HAVE_PTHREAD_H && HAVE_SYS_MMAN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rpncalc.h"
+#include "rpnpipe.h"		/* rpn_print_result */
+#include "rpnfile.h"
+
+enum {STACKSIZE = 10};
+enum {CHUNKSIZE = 1 << 22};	/* bytes of input per chunk, roughly */
+enum {AHEAD = 4};		/* chunks per thread ahead of the writer */
+
+enum {CHUNK_WAITING, CHUNK_TAKEN, CHUNK_DONE};
+
+typedef struct {
+  const char *start;		/* in the mapped file */
+  size_t len;
+  long line;			/* number of its first, from 0 */
+  char *out;			/* printed results */
+  size_t outlen;
+  int retval;			/* of the last line */
+  int quit;			/* a line quit */
+  int state;
+} file_chunk;
+
+typedef struct {
+  file_chunk *chunk;
+  int nchunks;
+  int next;			/* next chunk to take */
+  int written;			/* chunks written out */
+  int window;			/* how far ahead of 'written' to take */
+  void (*help)(FILE *out);
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} file_state;
+
+static void eval_chunk(DS *ds, file_chunk *c, void (*help)(FILE *out))
+{
+  const char *ptr = c->start;
+  const char *end = c->start + c->len;
+  const char *nl;
+  long line = c->line;
+  FILE *f;
+  int retval = RPN_OK;
+
+  f = open_memstream(&c->out, &c->outlen);
+  if (NULL == f) {
+    c->retval = RPN_ERROR;
+    return;
+  }
+
+  while (ptr < end) {
+    nl = memchr(ptr, '\n', end - ptr);
+    if (NULL == nl) nl = end;
+    ds_reset(ds);
+    ds_seed_stream(ds, line++);
+    retval = rpncalc_evaln(ds, ptr, nl - ptr);
+    if (RPN_HELP == retval) {
+      if (NULL != help) help(f);
+    } else if (RPN_QUIT == retval) {
+      c->quit = 1;
+      break;
+    } else {
+      rpn_print_result(f, retval, ds->stack, ds->ival, ds->itag, ds->next, ds_base(ds), ds_prec(ds));
+    }
+    ptr = nl + 1;
+  }
+
+  fclose(f);
+  c->retval = retval;
+}
+
+static void *worker(void *arg)
+{
+  file_state *s = (file_state *) arg;
+  DS ds;
+  double stack[STACKSIZE];
+  file_chunk *c;
+
+  ds_init(&ds, stack, STACKSIZE);
+
+  pthread_mutex_lock(&s->mutex);
+  for (;;) {
+    while (s->next < s->nchunks &&
+	   s->next >= s->written + s->window) {
+      pthread_cond_wait(&s->cond, &s->mutex);
+    }
+    if (s->next >= s->nchunks) break;
+    c = &s->chunk[s->next++];
+    c->state = CHUNK_TAKEN;
+    pthread_mutex_unlock(&s->mutex);
+
+    eval_chunk(&ds, c, s->help);
+
+    pthread_mutex_lock(&s->mutex);
+    c->state = CHUNK_DONE;
+    pthread_cond_broadcast(&s->cond);
+  }
+  pthread_mutex_unlock(&s->mutex);
+  ds_free(&ds);
+
+  return NULL;
+}
+
+int rpn_file(const char *path, int threads, FILE *out, void (*help)(FILE *out))
+{
+  file_state s;
+  file_chunk *c;
+  pthread_t *tid;
+  struct stat st;
+  const char *map;
+  const char *nl;
+  size_t size, pos, end;
+  long line = 0;
+  int retval = RPN_OK;
+  int fd;
+  int t;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return RPN_ERROR;
+  if (0 != fstat(fd, &st)) {
+    close(fd);
+    return RPN_ERROR;
+  }
+  size = st.st_size;
+  if (size == 0) {
+    close(fd);
+    return RPN_OK;
+  }
+  map = (const char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == map) return RPN_ERROR;
+  madvise((void *) map, size, MADV_SEQUENTIAL);
+
+  if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads <= 0) threads = 1;
+
+  /* split at the first newline past each chunk's worth */
+  s.nchunks = size / CHUNKSIZE + 1;
+  s.chunk = (file_chunk *) calloc(s.nchunks, sizeof(file_chunk));
+  tid = (pthread_t *) malloc(threads * sizeof(pthread_t));
+  if (NULL == s.chunk || NULL == tid) {
+    munmap((void *) map, size);
+    return RPN_ERROR;
+  }
+  s.nchunks = 0;
+  for (pos = 0; pos < size; pos = end) {
+    end = pos + CHUNKSIZE;
+    if (end >= size) {
+      end = size;
+    } else {
+      nl = memchr(map + end, '\n', size - end);
+      end = NULL == nl ? size : (size_t) (nl + 1 - map);
+    }
+    c = &s.chunk[s.nchunks++];
+    c->start = map + pos;
+    c->len = end - pos;
+    c->line = line;
+    c->state = CHUNK_WAITING;
+    /* the lines in it, for the next's first */
+    for (nl = c->start; NULL != (nl = memchr(nl, '\n', map + end - nl)); nl++) line++;
+  }
+  s.next = 0;
+  s.written = 0;
+  s.window = AHEAD * threads;
+  s.help = help;
+  pthread_mutex_init(&s.mutex, NULL);
+  pthread_cond_init(&s.cond, NULL);
+
+  for (t = 0; t < threads; t++) {
+    if (0 != pthread_create(&tid[t], NULL, worker, &s)) break;
+  }
+  threads = t;
+  if (threads == 0) {
+    /* do it all ourselves */
+    s.window = s.nchunks;
+    worker(&s);
+  }
+
+  for (t = 0; t < s.nchunks; t++) {
+    c = &s.chunk[t];
+    pthread_mutex_lock(&s.mutex);
+    while (CHUNK_DONE != c->state) {
+      pthread_cond_wait(&s.cond, &s.mutex);
+    }
+    pthread_mutex_unlock(&s.mutex);
+
+    if (NULL != c->out) {
+      fwrite(c->out, 1, c->outlen, out);
+      free(c->out);
+      c->out = NULL;
+    }
+    retval = c->retval;
+
+    pthread_mutex_lock(&s.mutex);
+    s.written++;
+    if (c->quit) s.next = s.nchunks; /* no more to take */
+    pthread_cond_broadcast(&s.cond);
+    pthread_mutex_unlock(&s.mutex);
+    if (c->quit) break;
+  }
+  fflush(out);
+
+  for (t = 0; t < threads; t++) {
+    pthread_join(tid[t], NULL);
+  }
+  for (t = 0; t < s.nchunks; t++) {
+    free(s.chunk[t].out);
+  }
+  pthread_mutex_destroy(&s.mutex);
+  pthread_cond_destroy(&s.cond);
+  free(s.chunk);
+  free(tid);
+  munmap((void *) map, size);
+
+  return retval;
+}
+
+#endif	/* HAVE_PTHREAD_H && HAVE_SYS_MMAN_H */
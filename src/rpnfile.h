@@ -0,0 +1,21 @@
+#ifndef RPNFILE_H
+#define RPNFILE_H
+
+#include <stdio.h>		/* FILE */
+
+/*
+  Evaluate each line of the file at 'path' as a separate calculation,
+  starting from a reset calc, printing the results to 'out' as rpn
+  would. The line's random generators are on the substream of its
+  line number (see ds_seed_stream()), so the results are the same on
+  any number of threads. The file is mapped into memory and split into chunks at line
+  boundaries, and lines are evaluated where they are, on 'threads'
+  threads (0 means one per processor), each with its own calc. Results
+  are printed in the order of the lines. Calls 'help' to print help
+  to its FILE for each line asking for it, and stops at the first line
+  that quits. Returns the result of the last line printed, or
+  RPN_ERROR if the file can't be read.
+ */
+extern int rpn_file(const char *path, int threads, FILE *out, void (*help)(FILE *out));
+
+#endif /* RPNFILE_H */
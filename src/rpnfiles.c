@@ -0,0 +1,779 @@
+/*
+  rpnfiles.c
+
+  Evaluation of many small files. Reading them one after another with
+  stdio, each file is an open, a couple of reads and a close, and the
+  calc is idle while it waits on every one of them. Here the reading
+  is done ahead of the evaluating, and many files at a time.
+
+  With io_uring, this thread keeps up to RPN_FILES_BUFFERS files being
+  opened and read at once, with a single system call to submit a
+  batch of requests and wait for some to complete. Each file reads
+  into a buffer of its own, registered with the kernel up front so it
+  isn't mapped for every read, and a file that's been read is queued
+  for the evaluating threads, which free its buffer for the next file
+  when they're done with it. A file bigger than a buffer is copied to
+  the heap when it fills it, and read on from there.
+
+  The ring is set up with system calls directly, as liburing isn't
+  something we can count on being installed. Where there's no
+  io_uring, or it's too old for openat (5.6), or it's not permitted,
+  the files are read by a pool of threads instead, each opening,
+  reading and evaluating a file at a time, and there being several
+  per processor to keep the disk busy.
+
+  Each file's results are printed to a buffer of its own, and written
+  out in the order of the list as they're done, as in rpnfile.c.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#if HAVE_PTHREAD_H && HAVE_SYS_MMAN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if HAVE_LINUX_IO_URING_H
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+#include "rpncalc.h"
+#include "rpnpipe.h"		/* rpn_print_result */
+#include "rpnfiles.h"
+
+/* openat and close came with 5.6, as did this */
+#if HAVE_LINUX_IO_URING_H && defined(__NR_io_uring_setup) && defined(IORING_FEAT_CUR_PERSONALITY)
+#define USE_URING 1
+#endif
+
+enum {STACKSIZE = 10};
+enum {AHEAD = 4};		/* files per reader ahead of the writer */
+enum {FILE_STREAMS = 1024};	/* random substreams per file */
+
+enum {FILE_WAITING, FILE_OPENING, FILE_READING, FILE_READY, FILE_DONE};
+
+typedef struct {
+  const char *path;
+  char *data;			/* the file, in its buffer or on the heap */
+  size_t len;
+  size_t size;			/* of 'data' */
+  int buf;			/* registered buffer, -1 if none */
+  int fd;
+  int error;			/* errno, if it couldn't be read */
+  char *out;			/* printed results */
+  size_t outlen;
+  int retval;			/* of the last line */
+  int quit;			/* a line quit */
+  int state;
+} files_entry;
+
+typedef struct {
+  files_entry *file;
+  int nfiles;
+  int next;			/* next to take */
+  int written;			/* files written out */
+  int window;			/* how far ahead of 'written' to take */
+  int stop;			/* a line quit */
+
+  /* with io_uring */
+  char *bufs;			/* the registered buffers */
+  int *freebuf;			/* those not in use */
+  int nfree;
+  int *ready;			/* files read, to evaluate in turn */
+  int head, tail;
+  int eof;			/* all that will be read have been */
+
+  void (*help)(FILE *out);
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} files_state;
+
+/*
+  The file's lines, each from a reset calc with its generators on a
+  substream of its own, by the file's place in the list and the line's
+  in the file, so the results are the same whatever order files are
+  read and evaluated in. A file has FILE_STREAMS of them, and lines
+  past those share the next file's.
+ */
+static void eval_file(DS *ds, files_entry *e, long index, void (*help)(FILE *out))
+{
+  const char *ptr = e->data;
+  const char *end = e->data + e->len;
+  const char *nl;
+  unsigned long stream = (unsigned long) index * FILE_STREAMS;
+  FILE *f;
+  int retval = RPN_OK;
+
+  f = open_memstream(&e->out, &e->outlen);
+  if (NULL == f) {
+    e->retval = RPN_ERROR;
+    return;
+  }
+
+  while (ptr < end) {
+    nl = memchr(ptr, '\n', end - ptr);
+    if (NULL == nl) nl = end;
+    ds_reset(ds);
+    ds_seed_stream(ds, stream++);
+    retval = rpncalc_evaln(ds, ptr, nl - ptr);
+    if (RPN_HELP == retval) {
+      if (NULL != help) help(f);
+    } else if (RPN_QUIT == retval) {
+      e->quit = 1;
+      break;
+    } else {
+      rpn_print_result(f, retval, ds->stack, ds->ival, ds->itag, ds->next, ds_base(ds), ds_prec(ds));
+    }
+    ptr = nl + 1;
+  }
+
+  fclose(f);
+  e->retval = retval;
+}
+
+/*
+  Write out the files that are done, in order, stopping at one that
+  isn't, or waiting for it if 'wait'. Returns false once a file
+  couldn't be read.
+ */
+static int write_files(files_state *s, FILE *out, int wait, int *retval)
+{
+  files_entry *e;
+  int ok = 1;
+
+  pthread_mutex_lock(&s->mutex);
+  while (s->written < s->nfiles && ! s->stop) {
+    e = &s->file[s->written];
+    if (FILE_DONE != e->state) {
+      if (! wait) break;
+      pthread_cond_wait(&s->cond, &s->mutex);
+      continue;
+    }
+    pthread_mutex_unlock(&s->mutex);
+
+    if (0 != e->error) {
+      fprintf(stderr, "rpn: can't read %s: %s\n", e->path, strerror(e->error));
+      ok = 0;
+    } else {
+      if (NULL != e->out) fwrite(e->out, 1, e->outlen, out);
+      *retval = e->retval;
+    }
+    free(e->out);
+    e->out = NULL;
+
+    pthread_mutex_lock(&s->mutex);
+    s->written++;
+    if (e->quit) s->stop = 1;	/* no more to take */
+    pthread_cond_broadcast(&s->cond);
+  }
+  pthread_mutex_unlock(&s->mutex);
+
+  return ok;
+}
+
+/* all of a file, on the heap */
+static void read_file(files_entry *e)
+{
+  struct stat st;
+  char *data;
+  ssize_t n;
+  int fd;
+
+  fd = open(e->path, O_RDONLY);
+  if (fd < 0) {
+    e->error = errno;
+    return;
+  }
+  e->size = 0 == fstat(fd, &st) && st.st_size > 0 ? st.st_size + 1 : RPN_FILES_BUFSIZE;
+  e->data = (char *) malloc(e->size);
+  e->len = 0;
+  while (NULL != e->data) {
+    if (e->len == e->size) {
+      data = (char *) realloc(e->data, 2 * e->size);
+      if (NULL == data) break;
+      e->data = data;
+      e->size *= 2;
+    }
+    n = read(fd, e->data + e->len, e->size - e->len);
+    if (n < 0 && EINTR == errno) continue;
+    if (n <= 0) {
+      if (n < 0) e->error = errno;
+      close(fd);
+      return;
+    }
+    e->len += n;
+  }
+  e->error = ENOMEM;
+  close(fd);
+}
+
+/* read and evaluate a file at a time */
+static void *reader(void *arg)
+{
+  files_state *s = (files_state *) arg;
+  DS ds;
+  double stack[STACKSIZE];
+  files_entry *e;
+
+  ds_init(&ds, stack, STACKSIZE);
+
+  pthread_mutex_lock(&s->mutex);
+  for (;;) {
+    while (s->next < s->nfiles && ! s->stop &&
+	   s->next >= s->written + s->window) {
+      pthread_cond_wait(&s->cond, &s->mutex);
+    }
+    if (s->next >= s->nfiles || s->stop) break;
+    e = &s->file[s->next++];
+    pthread_mutex_unlock(&s->mutex);
+
+    read_file(e);
+    if (0 == e->error) eval_file(&ds, e, e - s->file, s->help);
+    free(e->data);
+    e->data = NULL;
+
+    pthread_mutex_lock(&s->mutex);
+    e->state = FILE_DONE;
+    pthread_cond_broadcast(&s->cond);
+  }
+  pthread_mutex_unlock(&s->mutex);
+  ds_free(&ds);
+
+  return NULL;
+}
+
+#ifdef USE_URING
+
+/* evaluate the files read through the ring, in the order they were */
+static void *evaluator(void *arg)
+{
+  files_state *s = (files_state *) arg;
+  DS ds;
+  double stack[STACKSIZE];
+  files_entry *e;
+  int stop;
+
+  ds_init(&ds, stack, STACKSIZE);
+
+  pthread_mutex_lock(&s->mutex);
+  for (;;) {
+    while (s->head == s->tail && ! s->eof) {
+      pthread_cond_wait(&s->cond, &s->mutex);
+    }
+    if (s->head == s->tail) break;
+    e = &s->file[s->ready[s->head++]];
+    stop = s->stop;
+    pthread_mutex_unlock(&s->mutex);
+
+    if (0 == e->error && ! stop) eval_file(&ds, e, e - s->file, s->help);
+    if (e->buf < 0 || e->data != s->bufs + (size_t) e->buf * RPN_FILES_BUFSIZE) {
+      free(e->data);		/* it outgrew its buffer */
+    }
+    e->data = NULL;
+
+    pthread_mutex_lock(&s->mutex);
+    if (e->buf >= 0) s->freebuf[s->nfree++] = e->buf;
+    e->state = FILE_DONE;
+    pthread_cond_broadcast(&s->cond);
+  }
+  pthread_mutex_unlock(&s->mutex);
+  ds_free(&ds);
+
+  return NULL;
+}
+
+typedef struct {
+  int fd;
+  unsigned *sq_head, *sq_tail, sq_mask, sq_entries;
+  unsigned *cq_head, *cq_tail, cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_map, *cq_map;
+  size_t sq_size, cq_size;
+  unsigned tail;			/* of the requests we've queued */
+  unsigned queued;		/* of them, those not yet submitted */
+  int inflight;			/* submitted, not yet completed */
+  int fixed;			/* the buffers are registered */
+} files_ring;
+
+enum {RING_CLOSE = 1};		/* in user_data, with the file's index */
+enum {REFILL = RPN_FILES_BUFFERS / 4}; /* buffers to wait for */
+
+static int ring_init(files_ring *r, unsigned entries)
+{
+  struct io_uring_params p;
+  unsigned *array;
+  unsigned i;
+
+  memset(r, 0, sizeof(files_ring));
+  memset(&p, 0, sizeof(p));
+  r->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0) return RPN_ERROR;
+  if (! (p.features & IORING_FEAT_CUR_PERSONALITY)) {
+    close(r->fd);
+    return RPN_ERROR;
+  }
+
+  r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (r->cq_size > r->sq_size) r->sq_size = r->cq_size;
+    r->cq_size = r->sq_size;
+  }
+  r->sq_map = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  if (MAP_FAILED == r->sq_map) {
+    close(r->fd);
+    return RPN_ERROR;
+  }
+  r->cq_map = r->sq_map;
+  if (! (p.features & IORING_FEAT_SINGLE_MMAP)) {
+    r->cq_map = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+  }
+  r->sqes = (struct io_uring_sqe *)
+    mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+	 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (MAP_FAILED == r->cq_map || MAP_FAILED == (void *) r->sqes) {
+    if (MAP_FAILED != r->cq_map && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_size);
+    munmap(r->sq_map, r->sq_size);
+    close(r->fd);
+    return RPN_ERROR;
+  }
+
+  r->sq_head = (unsigned *) ((char *) r->sq_map + p.sq_off.head);
+  r->sq_tail = (unsigned *) ((char *) r->sq_map + p.sq_off.tail);
+  r->sq_mask = *(unsigned *) ((char *) r->sq_map + p.sq_off.ring_mask);
+  r->sq_entries = p.sq_entries;
+  r->cq_head = (unsigned *) ((char *) r->cq_map + p.cq_off.head);
+  r->cq_tail = (unsigned *) ((char *) r->cq_map + p.cq_off.tail);
+  r->cq_mask = *(unsigned *) ((char *) r->cq_map + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *) ((char *) r->cq_map + p.cq_off.cqes);
+
+  /* request i is always in slot i */
+  array = (unsigned *) ((char *) r->sq_map + p.sq_off.array);
+  for (i = 0; i < p.sq_entries; i++) {
+    array[i] = i;
+  }
+  r->tail = *r->sq_tail;
+
+  return RPN_OK;
+}
+
+static void ring_free(files_ring *r)
+{
+  munmap(r->sqes, r->sq_entries * sizeof(struct io_uring_sqe));
+  if (r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_size);
+  munmap(r->sq_map, r->sq_size);
+  close(r->fd);
+}
+
+/* submit what's queued, waiting for 'wait' completions */
+static int ring_enter(files_ring *r, unsigned wait)
+{
+  int n;
+
+  __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+  do {
+    n = syscall(__NR_io_uring_enter, r->fd, r->queued, wait,
+		wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  } while (n < 0 && EINTR == errno);
+  if (n < 0) return RPN_ERROR;
+  r->queued -= n;
+  r->inflight += n;
+
+  return RPN_OK;
+}
+
+/* a cleared request to fill in */
+static struct io_uring_sqe *ring_sqe(files_ring *r)
+{
+  struct io_uring_sqe *sqe;
+
+  if (r->tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries) {
+    if (RPN_OK != ring_enter(r, 0)) return NULL;
+  }
+  sqe = &r->sqes[r->tail & r->sq_mask];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  r->tail++;
+  r->queued++;
+
+  return sqe;
+}
+
+static int queue_open(files_ring *r, files_entry *e, int j)
+{
+  struct io_uring_sqe *sqe = ring_sqe(r);
+
+  if (NULL == sqe) return RPN_ERROR;
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (unsigned long) e->path;
+  sqe->open_flags = O_RDONLY;
+  sqe->user_data = (unsigned long long) j << 1;
+  e->state = FILE_OPENING;
+
+  return RPN_OK;
+}
+
+/* the rest of the file, into the rest of 'data' */
+static int queue_read(files_ring *r, files_state *s, files_entry *e, int j)
+{
+  struct io_uring_sqe *sqe = ring_sqe(r);
+
+  if (NULL == sqe) return RPN_ERROR;
+  sqe->opcode = IORING_OP_READ;
+  if (r->fixed && e->data == s->bufs + (size_t) e->buf * RPN_FILES_BUFSIZE) {
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->buf_index = e->buf;
+  }
+  sqe->fd = e->fd;
+  sqe->addr = (unsigned long) (e->data + e->len);
+  sqe->len = e->size - e->len;
+  sqe->off = e->len;
+  sqe->user_data = (unsigned long long) j << 1;
+  e->state = FILE_READING;
+
+  return RPN_OK;
+}
+
+static int queue_close(files_ring *r, files_entry *e, int j)
+{
+  struct io_uring_sqe *sqe = ring_sqe(r);
+
+  if (NULL == sqe) return RPN_ERROR;
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->fd = e->fd;
+  sqe->user_data = (unsigned long long) j << 1 | RING_CLOSE;
+
+  return RPN_OK;
+}
+
+/*
+  A request for file 'j' completed with 'res'. Returns true if the
+  file's been read, or failed to be.
+ */
+static int completed(files_ring *r, files_state *s, int j, int res)
+{
+  files_entry *e = &s->file[j];
+  size_t requested = e->size - e->len;
+  char *data;
+
+  if (res < 0) {
+    e->error = -res;
+    if (FILE_READING == e->state) queue_close(r, e, j);
+    return 1;
+  }
+  if (FILE_OPENING == e->state) {
+    e->fd = res;
+    if (RPN_OK != queue_read(r, s, e, j)) {
+      e->error = EAGAIN;
+      close(e->fd);
+      return 1;
+    }
+    return 0;
+  }
+
+  /* a short read is the end of a regular file, without reading 0 */
+  e->len += res;
+  if ((size_t) res < requested) {
+    queue_close(r, e, j);
+    return 1;
+  }
+
+  /* it's filled its buffer; move it to the heap, or grow it there */
+  if (e->data == s->bufs + (size_t) e->buf * RPN_FILES_BUFSIZE) {
+    data = (char *) malloc(2 * e->size);
+    if (NULL != data) memcpy(data, e->data, e->len);
+  } else {
+    data = (char *) realloc(e->data, 2 * e->size);
+  }
+  if (NULL == data) {
+    e->error = ENOMEM;
+    queue_close(r, e, j);
+    return 1;
+  }
+  e->data = data;
+  e->size *= 2;
+  if (RPN_OK != queue_read(r, s, e, j)) {
+    e->error = EAGAIN;
+    close(e->fd);
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+  Read the files through a ring, for 'threads' evaluators. Returns
+  RPN_ERROR, having read nothing, if there's no ring to be had.
+ */
+static int uring_files(files_state *s, int threads, FILE *out, int *retval, int *ok)
+{
+  files_ring r;
+  files_entry *e;
+  struct io_uring_cqe *cqe;
+  struct iovec iov[RPN_FILES_BUFFERS];
+  pthread_t tid[RPN_FILES_BUFFERS];
+  unsigned head, tail;
+  int j, n, t;
+
+  if (threads > RPN_FILES_BUFFERS) threads = RPN_FILES_BUFFERS;
+  if (RPN_OK != ring_init(&r, 2 * RPN_FILES_BUFFERS)) return RPN_ERROR;
+  if (0 != posix_memalign((void **) &s->bufs, 4096, (size_t) RPN_FILES_BUFFERS * RPN_FILES_BUFSIZE)) {
+    ring_free(&r);
+    return RPN_ERROR;
+  }
+  s->freebuf = (int *) malloc(RPN_FILES_BUFFERS * sizeof(int));
+  s->ready = (int *) malloc(s->nfiles * sizeof(int));
+  if (NULL == s->freebuf || NULL == s->ready) {
+    ring_free(&r);
+    return RPN_ERROR;
+  }
+  for (t = 0; t < RPN_FILES_BUFFERS; t++) {
+    iov[t].iov_base = s->bufs + (size_t) t * RPN_FILES_BUFSIZE;
+    iov[t].iov_len = RPN_FILES_BUFSIZE;
+    s->freebuf[t] = RPN_FILES_BUFFERS - 1 - t;
+  }
+  s->nfree = RPN_FILES_BUFFERS;
+  s->head = s->tail = 0;
+  s->eof = 0;
+
+  /* without them registered, it's plain reads into them */
+  r.fixed = 0 == syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_BUFFERS,
+			 iov, RPN_FILES_BUFFERS);
+
+  for (t = 0; t < threads; t++) {
+    if (0 != pthread_create(&tid[t], NULL, evaluator, s)) break;
+  }
+  threads = t;
+  if (threads == 0) {
+    ring_free(&r);
+    return RPN_ERROR;
+  }
+
+  for (;;) {
+    /* start as many files as there are buffers for */
+    pthread_mutex_lock(&s->mutex);
+    while (s->next < s->nfiles && s->nfree > 0 && ! s->stop) {
+      e = &s->file[s->next];
+      e->buf = s->freebuf[--s->nfree];
+      e->data = s->bufs + (size_t) e->buf * RPN_FILES_BUFSIZE;
+      e->size = RPN_FILES_BUFSIZE;
+      if (RPN_OK != queue_open(&r, e, s->next)) {
+	s->freebuf[s->nfree++] = e->buf;
+	break;
+      }
+      s->next++;
+    }
+    if (r.inflight == 0 && r.queued == 0) {
+      if (s->next >= s->nfiles || s->stop) {
+	pthread_mutex_unlock(&s->mutex);
+	break;
+      }
+      /*
+	The buffers are all being evaluated. Wait for a batch of them
+	back, not just one, or when we're quicker than the evaluators,
+	we'd be opening the files one at a time.
+      */
+      while ((s->nfree == 0 || (s->nfree < REFILL && s->head != s->tail)) && ! s->stop) {
+	pthread_cond_wait(&s->cond, &s->mutex);
+      }
+      pthread_mutex_unlock(&s->mutex);
+      if (! write_files(s, out, 0, retval)) *ok = 0;
+      continue;
+    }
+    pthread_mutex_unlock(&s->mutex);
+
+    if (RPN_OK != ring_enter(&r, 1)) break;
+
+    n = s->tail;
+    head = *r.cq_head;
+    tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      cqe = &r.cqes[head & r.cq_mask];
+      j = cqe->user_data >> 1;
+      r.inflight--;
+      if (! (cqe->user_data & RING_CLOSE) && completed(&r, s, j, cqe->res)) {
+	s->file[j].state = FILE_READY;
+	s->ready[n++] = j;
+      }
+    }
+    __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+
+    if (n != s->tail) {
+      pthread_mutex_lock(&s->mutex);
+      s->tail = n;
+      pthread_cond_broadcast(&s->cond);
+      pthread_mutex_unlock(&s->mutex);
+    }
+    if (! write_files(s, out, 0, retval)) *ok = 0;
+  }
+
+  /* any files cut off by the ring failing go to the evaluators as failed */
+  pthread_mutex_lock(&s->mutex);
+  for (j = 0; j < s->next; j++) {
+    e = &s->file[j];
+    if (FILE_OPENING == e->state || FILE_READING == e->state) {
+      if (FILE_READING == e->state) close(e->fd);
+      e->error = EIO;
+      e->state = FILE_READY;
+      s->ready[s->tail++] = j;
+    }
+  }
+  s->eof = 1;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->mutex);
+  if (! write_files(s, out, 1, retval)) *ok = 0;
+
+  for (t = 0; t < threads; t++) {
+    pthread_join(tid[t], NULL);
+  }
+  ring_free(&r);
+
+  return RPN_OK;
+}
+
+#endif	/* USE_URING */
+
+/* the names in the list, one to a line, in 'text' */
+static int read_list(const char *list, char **text, const char ***name, int *n)
+{
+  FILE *f = strcmp(list, "-") ? fopen(list, "r") : stdin;
+  size_t len = 0, size = 4096;
+  char *ptr, *nl, *end;
+  void *p;
+  int max;
+
+  if (NULL == f) return RPN_ERROR;
+  *text = (char *) malloc(size);
+  while (NULL != *text) {
+    len += fread(*text + len, 1, size - len, f);
+    if (len < size) break;
+    p = realloc(*text, 2 * size);
+    if (NULL == p) {
+      free(*text);
+      *text = NULL;
+      break;
+    }
+    *text = (char *) p;
+    size *= 2;
+  }
+  if (f != stdin) fclose(f);
+  if (NULL == *text) return RPN_ERROR;
+
+  for (max = 1, ptr = *text, end = *text + len; ptr < end; ptr++) {
+    if ('\n' == *ptr) max++;
+  }
+  *name = (const char **) malloc(max * sizeof(char *));
+  if (NULL == *name) {
+    free(*text);
+    return RPN_ERROR;
+  }
+  (*text)[len] = '\0';		/* there's room: len < size */
+  for (*n = 0, ptr = *text; ptr < end; ptr = nl + 1) {
+    nl = memchr(ptr, '\n', end - ptr);
+    if (NULL == nl) nl = end;
+    *nl = '\0';
+    if (nl > ptr) (*name)[(*n)++] = ptr;
+  }
+
+  return RPN_OK;
+}
+
+int rpn_files(const char *list, int threads, int how, FILE *out,
+	      void (*help)(FILE *out))
+{
+  files_state s;
+  pthread_t *tid;
+  char *text;
+  const char **name;
+  int nprocs;
+  int retval = RPN_OK;
+  int ok = 1;
+  int done = 0;
+  int t;
+
+  if (RPN_OK != read_list(list, &text, &name, &s.nfiles)) return RPN_ERROR;
+  if (s.nfiles == 0) {
+    free(name);
+    free(text);
+    return RPN_OK;
+  }
+
+  s.file = (files_entry *) calloc(s.nfiles, sizeof(files_entry));
+  if (NULL == s.file) {
+    free(name);
+    free(text);
+    return RPN_ERROR;
+  }
+  for (t = 0; t < s.nfiles; t++) {
+    s.file[t].path = name[t];
+    s.file[t].buf = -1;
+    s.file[t].state = FILE_WAITING;
+  }
+  s.next = 0;
+  s.written = 0;
+  s.stop = 0;
+  s.bufs = NULL;
+  s.freebuf = NULL;
+  s.ready = NULL;
+  s.help = help;
+  pthread_mutex_init(&s.mutex, NULL);
+  pthread_cond_init(&s.cond, NULL);
+
+  nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nprocs <= 0) nprocs = 1;
+
+#ifdef USE_URING
+  if (RPN_FILES_AUTO == how) {
+    done = RPN_OK == uring_files(&s, threads > 0 ? threads : nprocs, out, &retval, &ok);
+  }
+#endif
+
+  if (! done) {
+    if (threads <= 0) threads = RPN_FILES_READERS * nprocs;
+    s.window = AHEAD * threads;
+    tid = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    for (t = 0; NULL != tid && t < threads; t++) {
+      if (0 != pthread_create(&tid[t], NULL, reader, &s)) break;
+    }
+    threads = t;
+    if (threads == 0) {
+      /* do it all ourselves */
+      s.window = s.nfiles;
+      reader(&s);
+    }
+    ok = write_files(&s, out, 1, &retval);
+    for (t = 0; t < threads; t++) {
+      pthread_join(tid[t], NULL);
+    }
+    free(tid);
+  }
+  fflush(out);
+
+  for (t = 0; t < s.nfiles; t++) {
+    free(s.file[t].out);
+  }
+  pthread_mutex_destroy(&s.mutex);
+  pthread_cond_destroy(&s.cond);
+  free(s.bufs);
+  free(s.freebuf);
+  free(s.ready);
+  free(s.file);
+  free(name);
+  free(text);
+
+  return ok ? retval : RPN_ERROR;
+}
+
+#endif	/* HAVE_PTHREAD_H && HAVE_SYS_MMAN_H */
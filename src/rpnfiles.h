@@ -0,0 +1,40 @@
+#ifndef RPNFILES_H
+#define RPNFILES_H
+
+#include <stdio.h>		/* FILE */
+
+/*
+  Evaluate many small files, each named on a line of the file at
+  'list' ("-" for stdin), every line of each being a calculation from
+  a reset calc, as with rpn_file(). Where io_uring is available, this
+  thread opens and reads up to RPN_FILES_BUFFERS files at once through
+  it, into buffers of RPN_FILES_BUFSIZE registered with the kernel, and
+  hands each complete file to one of 'threads' evaluating threads (0
+  means one per processor). A file that doesn't fit in its buffer
+  moves to the heap and is read on from there.
+
+  Otherwise, or with 'how' RPN_FILES_THREADS, 'threads' threads (0
+  means RPN_FILES_READERS per processor, since they're mostly waiting
+  on the disk) each open, read and evaluate a file at a time.
+
+  Either way, each file's results go to a stream of its own, and are
+  printed to 'out' in the order of the list. A line's random
+  generators are on a substream of the file's place in the list and
+  its own in the file (see ds_seed_stream()), so they're the same
+  whichever thread evaluates it, or when. A file that can't be read
+  is reported on stderr and skipped. Calls 'help' for lines asking for
+  it and stops at the first line that quits, returning the result of
+  the last line printed, or RPN_ERROR if the list can't be read, or a
+  file on it couldn't be.
+ */
+
+enum {RPN_FILES_AUTO, RPN_FILES_THREADS};
+
+enum {RPN_FILES_BUFFERS = 64};
+enum {RPN_FILES_BUFSIZE = 1 << 16};
+enum {RPN_FILES_READERS = 4};
+
+extern int rpn_files(const char *list, int threads, int how, FILE *out,
+		     void (*help)(FILE *out));
+
+#endif /* RPNFILES_H */
@@ -0,0 +1,290 @@
+/*
+  rpnfit.c
+
+  Streaming least squares, see rpnfit.h. A point on its own is a row
+  r of X, 1 and its regressors, and adds r'r to X'X and r y to X'y, a
+  rank one update of the upper triangle. Arrays of points are taken a
+  block at a time, by columns, each sum of X'X being a dot product of
+  two columns over the block, which the compiler can vectorize (at
+  -O3, or -O2 -ftree-vectorize).
+
+  Solving scales X'X to a unit diagonal first, so the Cholesky pivots
+  are comparable whatever the scales of the regressors, and a tiny one
+  means a regressor that's nearly a combination of the others.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>		/* sqrt */
+#include <float.h>		/* DBL_EPSILON */
+#include <string.h>		/* memset */
+#include "rpncalc.h"
+#include "rpnfit.h"
+
+enum {M = RPN_FIT_MAXTERMS};
+
+/* the partial sums into the totals */
+static void flush(RPN_FIT *fit)
+{
+  int p = fit->terms;
+  int j, k;
+
+  for (j = 0; j < p; j++) {
+    for (k = j; k < p; k++) {
+      fit->xx[j * M + k] += fit->pxx[j * M + k];
+      fit->pxx[j * M + k] = 0.0;
+    }
+    fit->xy[j] += fit->pxy[j];
+    fit->pxy[j] = 0.0;
+  }
+  fit->yy += fit->pyy;
+  fit->pyy = 0.0;
+  fit->block = 0;
+}
+
+/* the row 'r' of X, and y, into the partial sums */
+static void add_row(RPN_FIT *fit, const double *r, double y)
+{
+  int p = fit->terms;
+  double *a;
+  double rj;
+  int j, k;
+
+  for (j = 0; j < p; j++) {
+    a = fit->pxx + j * M;
+    rj = r[j];
+    for (k = j; k < p; k++) {
+      a[k] += rj * r[k];
+    }
+    fit->pxy[j] += rj * y;
+  }
+  fit->pyy += y * y;
+  if (++fit->block == RPN_FIT_BLOCK) flush(fit);
+}
+
+/*
+  Sums in four parts, which are independent, and so can be done at
+  once in vector registers, where a single sum can't be reordered.
+ */
+static double sum(const double *a, int n)
+{
+  double s[4] = {0.0, 0.0, 0.0, 0.0};
+  int t;
+
+  for (t = 0; t + 4 <= n; t += 4) {
+    s[0] += a[t];
+    s[1] += a[t + 1];
+    s[2] += a[t + 2];
+    s[3] += a[t + 3];
+  }
+  for (; t < n; t++) {
+    s[0] += a[t];
+  }
+
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+static double dot(const double *a, const double *b, int n)
+{
+  double s[4] = {0.0, 0.0, 0.0, 0.0};
+  int t;
+
+  for (t = 0; t + 4 <= n; t += 4) {
+    s[0] += a[t] * b[t];
+    s[1] += a[t + 1] * b[t + 1];
+    s[2] += a[t + 2] * b[t + 2];
+    s[3] += a[t + 3] * b[t + 3];
+  }
+  for (; t < n; t++) {
+    s[0] += a[t] * b[t];
+  }
+
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+int rpn_fit_init(RPN_FIT *fit, int terms)
+{
+  if (terms < 1 || terms > RPN_FIT_MAXTERMS) return RPN_ERROR;
+  memset(fit, 0, sizeof(RPN_FIT));
+  fit->terms = terms;
+
+  return RPN_OK;
+}
+
+void rpn_fit_add(RPN_FIT *fit, const double *x, double y)
+{
+  double r[M];
+  int j;
+
+  r[0] = 1.0;
+  for (j = 1; j < fit->terms; j++) {
+    r[j] = x[j - 1];
+  }
+  add_row(fit, r, y);
+}
+
+void rpn_fit_add_n(RPN_FIT *fit, const double *const *x, const double *y, long n)
+{
+  const double *col[M];
+  int p = fit->terms;
+  long t;
+  int nb, j, k;
+
+  for (t = 0; t < n; t += nb) {
+    nb = RPN_FIT_BLOCK - fit->block;
+    if (nb > n - t) nb = n - t;
+    fit->pxx[0] += nb;
+    for (j = 1; j < p; j++) {
+      col[j] = x[j - 1] + t;
+      fit->pxx[j] += sum(col[j], nb);
+    }
+    fit->pxy[0] += sum(y + t, nb);
+    for (j = 1; j < p; j++) {
+      for (k = j; k < p; k++) {
+	fit->pxx[j * M + k] += dot(col[j], col[k], nb);
+      }
+      fit->pxy[j] += dot(col[j], y + t, nb);
+    }
+    fit->pyy += dot(y + t, y + t, nb);
+    fit->block += nb;
+    if (fit->block == RPN_FIT_BLOCK) flush(fit);
+  }
+}
+
+/*
+  X'X of a polynomial only has the sums of x^0 to x^2k in it, x^(j+k)
+  in row j, column k, so that's all that's summed.
+ */
+void rpn_fit_poly_n(RPN_FIT *fit, const double *x, const double *y, long n)
+{
+  double pw[RPN_FIT_BLOCK];	/* x^m of the block */
+  double sx[2 * M - 1];
+  int p = fit->terms;
+  long t;
+  int nb, i, j, k, m;
+
+  for (t = 0; t < n; t += nb) {
+    nb = RPN_FIT_BLOCK - fit->block;
+    if (nb > n - t) nb = n - t;
+    sx[0] = nb;
+    fit->pxy[0] += sum(y + t, nb);
+    if (p > 1) {
+      memcpy(pw, x + t, nb * sizeof(double));
+      for (m = 1; ; m++) {
+	sx[m] = sum(pw, nb);
+	if (m < p) fit->pxy[m] += dot(pw, y + t, nb);
+	if (m == 2 * p - 2) break;
+	for (i = 0; i < nb; i++) {
+	  pw[i] *= x[t + i];
+	}
+      }
+    }
+    for (j = 0; j < p; j++) {
+      for (k = j; k < p; k++) {
+	fit->pxx[j * M + k] += sx[j + k];
+      }
+    }
+    fit->pyy += dot(y + t, y + t, nb);
+    fit->block += nb;
+    if (fit->block == RPN_FIT_BLOCK) flush(fit);
+  }
+}
+
+int rpn_fit_merge(RPN_FIT *fit, const RPN_FIT *from)
+{
+  int p = fit->terms;
+  int j, k;
+
+  if (from->terms != p) return RPN_ERROR;
+  for (j = 0; j < p; j++) {
+    for (k = j; k < p; k++) {
+      fit->xx[j * M + k] += from->xx[j * M + k] + from->pxx[j * M + k];
+    }
+    fit->xy[j] += from->xy[j] + from->pxy[j];
+  }
+  fit->yy += from->yy + from->pyy;
+
+  return RPN_OK;
+}
+
+double rpn_fit_count(const RPN_FIT *fit)
+{
+  return fit->xx[0] + fit->pxx[0];
+}
+
+int rpn_fit_solve(const RPN_FIT *fit, double *b, double *r2)
+{
+  double u[M * M];		/* the Cholesky factor, upper */
+  double d[M];			/* the scaling */
+  double z[M];
+  double n = rpn_fit_count(fit);
+  double yy = fit->yy + fit->pyy;
+  double s, sse, sst;
+  int p = fit->terms;
+  int i, j, k;
+
+  if (n < p) return RPN_ERROR;
+
+  /* D X'X D, with a unit diagonal */
+  for (j = 0; j < p; j++) {
+    s = fit->xx[j * M + j] + fit->pxx[j * M + j];
+    if (! (s > 0.0)) return RPN_ERROR;
+    d[j] = 1.0 / sqrt(s);
+  }
+  for (j = 0; j < p; j++) {
+    for (k = j; k < p; k++) {
+      u[j * M + k] = (fit->xx[j * M + k] + fit->pxx[j * M + k]) * d[j] * d[k];
+    }
+  }
+
+  /* U'U = D X'X D, in place */
+  for (j = 0; j < p; j++) {
+    s = u[j * M + j];
+    for (i = 0; i < j; i++) {
+      s -= u[i * M + j] * u[i * M + j];
+    }
+    if (! (s > M * DBL_EPSILON)) return RPN_ERROR;
+    u[j * M + j] = sqrt(s);
+    for (k = j + 1; k < p; k++) {
+      s = u[j * M + k];
+      for (i = 0; i < j; i++) {
+	s -= u[i * M + j] * u[i * M + k];
+      }
+      u[j * M + k] = s / u[j * M + j];
+    }
+  }
+
+  /* U'z = D X'y, then U c = z, and b = D c */
+  for (j = 0; j < p; j++) {
+    s = (fit->xy[j] + fit->pxy[j]) * d[j];
+    for (i = 0; i < j; i++) {
+      s -= u[i * M + j] * z[i];
+    }
+    z[j] = s / u[j * M + j];
+  }
+  for (j = p - 1; j >= 0; j--) {
+    s = z[j];
+    for (k = j + 1; k < p; k++) {
+      s -= u[j * M + k] * b[k];
+    }
+    b[j] = s / u[j * M + j];
+  }
+  for (j = 0; j < p; j++) {
+    b[j] *= d[j];
+  }
+
+  if (NULL != r2) {
+    /* b'X'y = z'z, so the residual sum of squares is y'y - z'z */
+    sse = yy;
+    for (j = 0; j < p; j++) {
+      sse -= z[j] * z[j];
+    }
+    s = fit->xy[0] + fit->pxy[0];
+    sst = yy - s * s / n;
+    *r2 = sst > 0.0 ? 1.0 - (sse > 0.0 ? sse : 0.0) / sst : 1.0;
+  }
+
+  return RPN_OK;
+}
@@ -0,0 +1,85 @@
+#ifndef RPNFIT_H
+#define RPNFIT_H
+
+#include "rpncalc.h"		/* RPN_OK, RPN_ERROR */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Streaming least squares, for multiple linear regression
+
+  y = b[0] + b[1] x1 + ... + b[m] xm
+
+  and polynomial regression of order k,
+
+  y = b[0] + b[1] x + ... + b[k] x^k
+
+  which is the same thing, with x^j for the xj. The points aren't
+  kept, just the normal equations, X'X b = X'y, summed as they come,
+  so a fit over any number of points is one pass in constant memory,
+  and O(terms^2) per point, or O(terms) for a polynomial's given in
+  arrays, as all a polynomial's X'X has in it is the sums of x^0 to
+  x^2k. Arrays are summed by columns, vectorized. The sums are done a
+  block of RPN_FIT_BLOCK points at a time, then added to the totals,
+  which keeps the rounding over 10^9 points down to that of about as
+  many additions as blocks.
+
+  Fits of the same model on separate threads, over parts of the data,
+  merge into the fit of all of it with rpn_fit_merge(). Solving is by
+  Cholesky, on demand, and doesn't end the fit.
+
+  Normal equations square the condition number, which for polynomials
+  of high order in x far from 0 is a lot: fit in x - x0 for an x0 in
+  the middle of the data, scaled to around 1, if it may come to that.
+  A model that doesn't determine its coefficients, with fewer points
+  than terms, or a regressor that's a combination of the others, is
+  an error to solve.
+ */
+
+enum {RPN_FIT_MAXTERMS = 16};	/* b[0] to b[15], so order 15 at most */
+enum {RPN_FIT_BLOCK = 256};
+
+typedef struct {
+  int terms;			/* 1 + m, or 1 + k */
+  int block;			/* points in the partial sums */
+  /* the upper triangles of X'X, in rows of RPN_FIT_MAXTERMS */
+  double xx[RPN_FIT_MAXTERMS * RPN_FIT_MAXTERMS];
+  double xy[RPN_FIT_MAXTERMS];
+  double yy;
+  double pxx[RPN_FIT_MAXTERMS * RPN_FIT_MAXTERMS]; /* partial sums */
+  double pxy[RPN_FIT_MAXTERMS];
+  double pyy;
+} RPN_FIT;
+
+/* a fit of 'terms' coefficients, b[0] the constant */
+extern int rpn_fit_init(RPN_FIT *fit, int terms);
+
+/* a point of the 'terms' - 1 regressors x[0], ... and y */
+extern void rpn_fit_add(RPN_FIT *fit, const double *x, double y);
+
+/* 'n' points, with x[j][t] the t'th point's regressor j */
+extern void rpn_fit_add_n(RPN_FIT *fit, const double *const *x, const double *y, long n);
+
+/* 'n' points of a polynomial fit, of order 'terms' - 1 in x */
+extern void rpn_fit_poly_n(RPN_FIT *fit, const double *x, const double *y, long n);
+
+/* 'from', a fit of the same terms, into 'fit' */
+extern int rpn_fit_merge(RPN_FIT *fit, const RPN_FIT *from);
+
+/* points so far */
+extern double rpn_fit_count(const RPN_FIT *fit);
+
+/*
+  The coefficients b[0] to b[terms - 1], and if 'r2' isn't NULL, the
+  coefficient of determination, 1 - (residual sum of squares) / (total
+  sum of squares about the mean of y).
+ */
+extern int rpn_fit_solve(const RPN_FIT *fit, double *b, double *r2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RPNFIT_H */
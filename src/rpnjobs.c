@@ -0,0 +1,325 @@
+/*
+  rpnjobs.c
+
+  Evaluation of files of unrelated lines of very different cost, with
+  work stealing. The file is mapped as for rpn_file(), and taken a
+  round of lines at a time. Each worker's share of a round is a deque,
+  a range of line numbers from 'top' to 'bottom', that it takes from
+  at the bottom while the others steal from the top, as in Chase and
+  Lev's deque, "Dynamic Circular Work-Stealing Deque," SPAA 2005.
+  Since no lines are ever added, the deques only shrink, and a worker
+  that finds them all empty is done.
+
+  Each line starts from a reset calc, with its random generators on the
+  substream of its line number, so its results are the same whichever
+  worker runs it.
+
+  A worker prints its lines' results to its own memory stream and
+  notes where each line's are in the line's slot, and when the round
+  is done they're written out in the order of the lines.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#if HAVE_PTHREAD_H && HAVE_SYS_MMAN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rpncalc.h"
+#include "ptime.h"		/* ptime_ticks */
+#include "rpnpipe.h"		/* rpn_print_result */
+#include "rpnjobs.h"
+
+enum {STACKSIZE = 10};
+enum {CACHELINE = 64};
+
+typedef struct {
+  const char *start;		/* the line, in the mapped file */
+  size_t len;
+  long line;			/* its number, from 0, for its random stream */
+  int worker;			/* whose output has its results */
+  long off;			/* where they are in it */
+  long outlen;
+  int retval;
+} jobs_slot;
+
+typedef struct jobs_worker {
+  long top;			/* next for a thief to take */
+  char pad[CACHELINE - sizeof(long)]; /* so the owner doesn't share it */
+  long bottom;			/* one past the owner's next */
+  FILE *f;			/* the round's results */
+  char *out;
+  size_t outlen;
+  long jobs;			/* lines run */
+  long steals;			/* of them, those taken from others */
+  long long busy;		/* ticks spent running them */
+  unsigned int seed;		/* for picking whom to steal from */
+  int id;
+  struct jobs_state *s;
+  pthread_t tid;
+} jobs_worker;
+
+typedef struct jobs_state {
+  jobs_slot *slot;
+  jobs_worker *worker;
+  int nworkers;
+  void (*help)(FILE *out);
+} jobs_state;
+
+/* the owner's next, from the bottom, or -1 if there's none */
+static long pop(jobs_worker *w)
+{
+  long b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - 1;
+  long t;
+
+  __atomic_store_n(&w->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  t = __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+  if (t > b) {
+    /* empty */
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+  if (t == b) {
+    /* the last one, which a thief may be taking too */
+    if (! __atomic_compare_exchange_n(&w->top, &t, b + 1, 0,
+				      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      t = -1;			/* the thief got it */
+    }
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    return t;
+  }
+
+  return b;
+}
+
+/* a thief's take from the top, -1 if it's empty, -2 if it lost a race */
+static long steal(jobs_worker *v)
+{
+  long t = __atomic_load_n(&v->top, __ATOMIC_ACQUIRE);
+  long b;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  b = __atomic_load_n(&v->bottom, __ATOMIC_ACQUIRE);
+  if (t >= b) return -1;
+  if (! __atomic_compare_exchange_n(&v->top, &t, t + 1, 0,
+				    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return -2;
+  }
+
+  return t;
+}
+
+/* a line from any other worker, starting at a random one, or -1 */
+static long steal_any(jobs_worker *w)
+{
+  jobs_state *s = w->s;
+  long j;
+  int k, v;
+
+  w->seed = w->seed * 1103515245 + 12345;
+  v = (w->seed >> 16) % s->nworkers;
+  for (k = 0; k < s->nworkers; k++, v = (v + 1) % s->nworkers) {
+    if (v == w->id) continue;
+    while (-2 == (j = steal(&s->worker[v]))) ;
+    if (j >= 0) return j;
+  }
+
+  return -1;
+}
+
+static void run_job(jobs_worker *w, DS *ds, long j)
+{
+  jobs_slot *slot = &w->s->slot[j];
+  long long start = ptime_ticks();
+  int retval;
+
+  slot->worker = w->id;
+  slot->off = w->outlen;
+  ds_reset(ds);
+  ds_seed_stream(ds, slot->line);
+  retval = rpncalc_evaln(ds, slot->start, slot->len);
+  if (RPN_HELP == retval) {
+    if (NULL != w->s->help) w->s->help(w->f);
+  } else if (RPN_QUIT != retval) {
+    rpn_print_result(w->f, retval, ds->stack, ds->ival, ds->itag, ds->next, ds_base(ds), ds_prec(ds));
+  }
+  fflush(w->f);
+  slot->outlen = w->outlen - slot->off;
+  slot->retval = retval;
+  w->jobs++;
+  w->busy += ptime_ticks() - start;
+}
+
+static void *worker(void *arg)
+{
+  jobs_worker *w = (jobs_worker *) arg;
+  DS ds;
+  double stack[STACKSIZE];
+  long j;
+
+  ds_init(&ds, stack, STACKSIZE);
+  for (;;) {
+    j = pop(w);
+    if (j < 0) {
+      j = steal_any(w);
+      if (j < 0) break;		/* all empty, and they only shrink */
+      w->steals++;
+    }
+    run_job(w, &ds, j);
+  }
+  ds_free(&ds);
+
+  return NULL;
+}
+
+/* run a round of 'n' lines in the slots, false if out of memory */
+static int run_round(jobs_state *s, long n)
+{
+  jobs_worker *w;
+  int started;
+  int t;
+
+  for (t = 0; t < s->nworkers; t++) {
+    w = &s->worker[t];
+    w->top = n * t / s->nworkers;
+    w->bottom = n * (t + 1) / s->nworkers;
+    w->out = NULL;
+    w->outlen = 0;
+    w->f = open_memstream(&w->out, &w->outlen);
+    if (NULL == w->f) {
+      while (--t >= 0) {
+	fclose(s->worker[t].f);
+	free(s->worker[t].out);
+      }
+      return 0;
+    }
+  }
+
+  /* this thread is worker 0; the others' shares are stolen if they can't start */
+  for (started = 1; started < s->nworkers; started++) {
+    w = &s->worker[started];
+    if (0 != pthread_create(&w->tid, NULL, worker, w)) break;
+  }
+  worker(&s->worker[0]);
+  for (t = 1; t < started; t++) {
+    pthread_join(s->worker[t].tid, NULL);
+  }
+
+  for (t = 0; t < s->nworkers; t++) {
+    fclose(s->worker[t].f);
+  }
+
+  return 1;
+}
+
+int rpn_jobs(const char *path, int threads, FILE *out, FILE *report,
+	     void (*help)(FILE *out))
+{
+  jobs_state s;
+  jobs_slot *slot;
+  jobs_worker *w;
+  struct stat st;
+  const char *map, *ptr, *end, *nl;
+  long long start, wall = 0;
+  size_t size;
+  long n, j;
+  long line = 0;
+  int retval = RPN_OK;
+  int quit = 0;
+  int fd;
+  int t;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return RPN_ERROR;
+  if (0 != fstat(fd, &st)) {
+    close(fd);
+    return RPN_ERROR;
+  }
+  size = st.st_size;
+  if (size == 0) {
+    close(fd);
+    return RPN_OK;
+  }
+  map = (const char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == map) return RPN_ERROR;
+  madvise((void *) map, size, MADV_SEQUENTIAL);
+
+  if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads <= 0) threads = 1;
+
+  s.nworkers = threads;
+  s.help = help;
+  s.slot = (jobs_slot *) malloc(RPN_JOBS_ROUND * sizeof(jobs_slot));
+  s.worker = (jobs_worker *) calloc(threads, sizeof(jobs_worker));
+  if (NULL == s.slot || NULL == s.worker) {
+    free(s.slot);
+    free(s.worker);
+    munmap((void *) map, size);
+    return RPN_ERROR;
+  }
+  for (t = 0; t < threads; t++) {
+    s.worker[t].id = t;
+    s.worker[t].seed = t + 1;
+    s.worker[t].s = &s;
+  }
+
+  ptr = map;
+  end = map + size;
+  while (ptr < end && ! quit) {
+    for (n = 0; n < RPN_JOBS_ROUND && ptr < end; n++) {
+      nl = memchr(ptr, '\n', end - ptr);
+      if (NULL == nl) nl = end;
+      s.slot[n].start = ptr;
+      s.slot[n].len = nl - ptr;
+      s.slot[n].line = line++;
+      ptr = nl + 1;
+    }
+
+    start = ptime_ticks();
+    if (! run_round(&s, n)) {
+      retval = RPN_ERROR;
+      break;
+    }
+    wall += ptime_ticks() - start;
+
+    for (j = 0; j < n; j++) {
+      slot = &s.slot[j];
+      if (RPN_QUIT == slot->retval) {
+	quit = 1;
+	break;
+      }
+      fwrite(s.worker[slot->worker].out + slot->off, 1, slot->outlen, out);
+      retval = slot->retval;
+    }
+    for (t = 0; t < threads; t++) {
+      free(s.worker[t].out);
+    }
+  }
+  fflush(out);
+
+  if (NULL != report) {
+    for (t = 0; t < threads; t++) {
+      w = &s.worker[t];
+      fprintf(report, "worker %d: %ld jobs, %ld stolen, %.1f%% busy\n", t,
+	      w->jobs, w->steals, wall > 0 ? 100.0 * w->busy / wall : 0.0);
+    }
+  }
+
+  free(s.slot);
+  free(s.worker);
+  munmap((void *) map, size);
+
+  return retval;
+}
+
+#endif	/* HAVE_PTHREAD_H && HAVE_SYS_MMAN_H */
@@ -0,0 +1,30 @@
+#ifndef RPNJOBS_H
+#define RPNJOBS_H
+
+#include <stdio.h>		/* FILE */
+
+/*
+  Evaluate each line of the file at 'path' as a separate job, like
+  rpn_file(), but for lines of very different cost: each of 'threads'
+  workers (0 means one per processor) starts with an equal share of
+  the lines, and one that runs out steals lines one at a time from the
+  others, so no worker sits idle while there's work left anywhere. A
+  line starts from a reset calc, with its random generators on the
+  substream of its line number (see ds_seed_stream()), so the output
+  doesn't depend on which worker ran it. Its results go to a slot of
+  its own, and they're printed to 'out' in the order of the lines, in
+  rounds of RPN_JOBS_ROUND lines, so memory stays bounded.
+
+  If 'report' isn't NULL, each worker's jobs, steals and the fraction
+  of the time it was running jobs are printed to it at the end. Calls
+  'help' for lines asking for it and stops at the first line that
+  quits, as rpn_file() does, returning the result of the last line
+  printed, or RPN_ERROR if the file can't be read.
+ */
+
+enum {RPN_JOBS_ROUND = 1 << 18};
+
+extern int rpn_jobs(const char *path, int threads, FILE *out, FILE *report,
+		    void (*help)(FILE *out));
+
+#endif /* RPNJOBS_H */
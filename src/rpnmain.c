@@ -4,9 +4,9 @@
   Front end to rpncalc.c, for Reverse Polish Notation (postfix)
   expression evaluation. 
 
-  To Do: enable infix notation.
-
-  Here's is how to convert from an infix notation to postfix notation:
+  With --infix, expressions are in infix notation and are compiled
+  straight to RPN programs by rpncalc_infix(), in infix.c. Here's is
+  how it converts from an infix notation to postfix notation:
 
   1. Initialize an empty stack (string stack), prepare input infix
   expression and clear RPN string.
@@ -51,6 +51,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #ifdef USE_READLINE
 #include <readline/readline.h>
 #endif
@@ -58,168 +59,643 @@
 #include <readline/history.h>
 #endif
 #include "rpncalc.h"
+#include "infix.h"
+#include "rpnsheet.h"
+#include "rpnmc.h"
+#include "rpnop.h"
+#include "rpnpipe.h"
+#include "rpnshm.h"
+#if HAVE_PTHREAD_H && HAVE_SYS_MMAN_H
+#define USE_RPNFILE 1
+#include "rpnfile.h"
+#include "rpnjobs.h"
+#include "rpnfiles.h"
+#endif
+#if HAVE_UNISTD_H
+#define USE_RPNRAW 1
+#include <unistd.h>
+#include "rpnraw.h"
+#define USE_RPNCSV 1
+#include "rpncsv.h"
+#define USE_RPNOUT 1
+#include "rpnout.h"
+#endif
+
+static void print_help(FILE *out)
+{
+  fprintf(out, "Use Reverse Polish Notation (RPN), 1 2 + instead of 1 + 2.\n");
+  fprintf(out, "Numbers are pushed onto the stack for use by operators.\n");
+  fprintf(out, "Operators are lower case, numbers are uppercase for bases > 10.\n");
+  fprintf(out, "The stack is shown after each line, left-to-right is bottom-to-top\n");
+  fprintf(out, "Operators (X means top of stack, X Y mean next and top, respectively):\n");
+  fprintf(out, "c            clear (except memory)\n");
+  fprintf(out, "ac           all clear (including memory)\n");
+  fprintf(out, "dec          use decimal base 10\n");
+  fprintf(out, "sto          copy X into memory and drop it\n");
+  fprintf(out, "rcl          push contents of memory onto stack\n");
+  fprintf(out, "sum          add X to memory and drop it\n");
+  fprintf(out, "exc          exchange X with memory\n");
+  fprintf(out, "hex          use hexadecimal base 16\n");
+  fprintf(out, "bin          use binary base 2\n");
+  fprintf(out, "dup          duplicate X\n");
+  fprintf(out, "swap         swap X and Y\n");
+  fprintf(out, "drop         drop X\n");
+  fprintf(out, "depth        push the depth of the stack onto stack\n");
+
+  fprintf(out, "statistics functions:\n");
+  fprintf(out, "avg          push average of numbers on stack\n");
+  fprintf(out, "std          push std dev of numbers on stack\n");
+  fprintf(out, "stat         X Y ... points go into cumulative statistics\n");
+  fprintf(out, "xstat        X ... singles go into cumulative statistics\n");
+  fprintf(out, "n            push number of stat points\n");
+  fprintf(out, "sx           push sum of x values of the stat points\n");
+  fprintf(out, "sy           push sum of y values of the stat points\n");
+  fprintf(out, "sxx          push sum of squares of x values of the stat points\n");
+  fprintf(out, "syy          push sum of squares of y values of the stat points\n");
+  fprintf(out, "sxy          push sum of products of x and y values of the stat points\n");
+  fprintf(out, "mx           push mean of x values of the stat points\n");
+  fprintf(out, "my           push mean of y values of the stat points\n");
+  fprintf(out, "sdx          push std dev of x values of the stat points\n");
+  fprintf(out, "sdy          push std dev of y values of the stat points\n");
+  fprintf(out, "a            push linear regression 'a' value of ax+b\n");
+  fprintf(out, "b            push linear regression 'b' value of ax+b\n");
+  fprintf(out, "r            push correlation coefficient of linear regression\n");
+
+  fprintf(out, "sqrt         replace X with its square root\n");
+  fprintf(out, "sq           replace X with its square\n");
+  fprintf(out, "inv          replace X with its inverse, 1/X\n");
+
+  fprintf(out, "=base        set the base to X\n");
+  fprintf(out, "=prec        set the precision to X\n");
+  fprintf(out, "?base        push the base\n");
+  fprintf(out, "?prec        push the precision\n");
+  fprintf(out, "?sf          push the number of significant figures\n");
+
+  fprintf(out, ">>           replace X Y with X shifted right by Y\n");
+  fprintf(out, "<<           replace X Y with X shifted left by Y\n");
+  fprintf(out, "&            replace X Y with X bitwise-and Y\n");
+  fprintf(out, "|            replace X Y with X bitwise-or Y\n");
+  fprintf(out, "~            replace X with its bitwise negation\n");
+
+  fprintf(out, "sin          replace X (in radians) with its sine\n");
+  fprintf(out, "cos          replace X (in radians) with its cosine\n");
+  fprintf(out, "tan          replace X (in radians) with its tangent\n");
+  fprintf(out, "atan2        replace X Y with arctangent(x/y)\n");
+  fprintf(out, "fast         use fast sin, cos, tan, atan2, toxy, tort\n");
+  fprintf(out, "libm         use the C library's, as at first\n");
+
+  fprintf(out, "=urand       set uniform random generator (a,b) to X Y\n");
+  fprintf(out, "=nrand       set normal random generator mean, sd to X Y\n");
+  fprintf(out, "=erand       set exponential random generator sd to X\n");
+  fprintf(out, "urand        generate uniform random number using set (a,b)\n");
+  fprintf(out, "nrand        generate normal randomd number using set mean, sd\n");
+  fprintf(out, "erand        generate exponential random number using set sd\n");
+
+  fprintf(out, "sub-expressions, f(x) of X:\n");
+  fprintf(out, "[ ... ]      quote a sub-expression, e.g., [ sq 2 - ]\n");
+  fprintf(out, "solve        replace X Y with a root of the quote between them\n");
+  fprintf(out, "integrate    replace X Y with the integral of the quote from X to Y\n");
+  fprintf(out, "=tol         set the tolerance of solve and integrate to X\n");
+  fprintf(out, "?tol         push the tolerance\n");
+  fprintf(out, "nfev         push the quote evaluations of the last solve or integrate\n");
+  fprintf(out, "bench        run the quote on an empty stack X times, and push the\n");
+  fprintf(out, "             mean, least and std dev of its time in ns\n");
+
+  fprintf(out, "time         push the time of day, in seconds since 1970\n");
+  fprintf(out, "ns           push a clock in ns that's never set, for timing\n");
+
+  fprintf(out, "pi           push pi\n");
+  fprintf(out, "e            push e, the base of the natural log\n");
+  fprintf(out, "vc           push speed of light\n");
+}
+
+#ifndef USE_READLINE
+/*
+  Reads a line of any length into '*line', growing it as needed, and
+  returns it, or NULL at the end of the input.
+*/
+static char *read_line(FILE *in, char **line, size_t *size)
+{
+  size_t len = 0;
+  char *p;
+
+  for (;;) {
+    if (*size - len < 2) {
+      p = (char *) realloc(*line, *size < 256 ? 256 : 2 * *size);
+      if (NULL == p) return NULL;
+      *line = p;
+      *size = *size < 256 ? 256 : 2 * *size;
+    }
+    if (NULL == fgets(*line + len, *size - len, in)) {
+      return len > 0 ? *line : NULL;
+    }
+    len += strlen(*line + len);
+    if (len > 0 && '\n' == (*line)[len - 1]) return *line;
+  }
+}
+#endif
+
+/*
+  One line of sheet mode: "name = formula" defines a cell and prints
+  the cells that were recomputed, "name" prints a cell, and "?" lists
+  them all. Returns RPN_QUIT for "q".
+*/
+static int sheet_line(DS *ds, RPN_SHEET *sheet, char *line)
+{
+  enum {NUMSIZE = 256};
+  char number[NUMSIZE];
+  RPN_CELL *c;
+  char *name, *end;
+  int retval = RPN_OK;
+  int num, t;
+
+  while (' ' == *line || '\t' == *line) line++;
+  name = line;
+  while (*line && ! strchr(" \t\r\n=", *line)) line++;
+  end = line;
+  while (' ' == *line || '\t' == *line) line++;
+
+  if (end == name) return RPN_OK;
+  if (end - name == 1 && 'q' == *name) return RPN_QUIT;
+  if (end - name == 1 && '?' == *name) {
+    for (t = 0; t < sheet->num; t++) {
+      c = &sheet->cell[t];
+      printf("%s = %s\n", c->name, NULL == c->formula ? "" : c->formula);
+    }
+    return RPN_OK;
+  }
+
+  if ('=' == *line) {
+    *end = 0;
+    line[strcspn(line, "\r\n")] = 0;
+    for (line++; ' ' == *line || '\t' == *line; line++) ;
+    retval = rpn_sheet_set(sheet, name, line);
+    if (RPN_OK != retval) {
+      printf("error\n");
+      return retval;
+    }
+    num = rpn_sheet_recalc(sheet);
+  } else {
+    t = rpn_sheet_find(sheet, name, end - name);
+    if (t < 0) {
+      printf("error\n");
+      return RPN_ERROR;
+    }
+    sheet->order[0] = t;
+    num = 1;
+  }
 
-static void print_help(void)
+  for (t = 0; t < num; t++) {
+    c = &sheet->cell[sheet->order[t]];
+    if (RPN_OK != c->status ||
+	RPN_OK != convert_d_to_s(number, c->value, ds_base(ds), ds_prec(ds), NUMSIZE)) {
+      printf("%s = error\n", c->name);
+    } else {
+      printf("%s = %s\n", c->name, number);
+    }
+  }
+
+  return retval;
+}
+
+/* the calc's statistics registers in shared memory segment 'name' */
+static int share_stats(DS *ds, const char *name)
+{
+  if (RPN_OK != rpn_shm_stats_bind(ds, name)) {
+    fprintf(stderr, "rpn: can't share statistics in %s\n", name);
+    return RPN_ERROR;
+  }
+
+  return RPN_OK;
+}
+
+/* an option a mode doesn't take, an error rather than ignored */
+static int unsupported(const char *mode, const char *option)
 {
-  printf("Use Reverse Polish Notation (RPN), 1 2 + instead of 1 + 2.\n");
-  printf("Numbers are pushed onto the stack for use by operators.\n");
-  printf("Operators are lower case, numbers are uppercase for bases > 10.\n");
-  printf("The stack is shown after each line, left-to-right is bottom-to-top\n");
-  printf("Operators (X means top of stack, X Y mean next and top, respectively):\n");
-  printf("c            clear (except memory)\n");
-  printf("ac           all clear (including memory)\n");
-  printf("dec          use decimal base 10\n");
-  printf("sto          copy X into memory and drop it\n");
-  printf("rcl          push contents of memory onto stack\n");
-  printf("sum          add X to memory and drop it\n");
-  printf("exc          exchange X with memory\n");
-  printf("hex          use hexadecimal base 16\n");
-  printf("bin          use binary base 2\n");
-  printf("dup          duplicate X\n");
-  printf("swap         swap X and Y\n");
-  printf("drop         drop X\n");
-  printf("depth        push the depth of the stack onto stack\n");
-
-  printf("statistics functions:\n");
-  printf("avg          push average of numbers on stack\n");
-  printf("std          push std dev of numbers on stack\n");
-  printf("stat         X Y ... points go into cumulative statistics\n");
-  printf("xstat        X ... singles go into cumulative statistics\n");
-  printf("n            push number of stat points\n");
-  printf("sx           push sum of x values of the stat points\n");
-  printf("sy           push sum of y values of the stat points\n");
-  printf("sxx          push sum of squares of x values of the stat points\n");
-  printf("syy          push sum of squares of y values of the stat points\n");
-  printf("sxy          push sum of products of x and y values of the stat points\n");
-  printf("mx           push mean of x values of the stat points\n");
-  printf("my           push mean of y values of the stat points\n");
-  printf("sdx          push std dev of x values of the stat points\n");
-  printf("sdy          push std dev of y values of the stat points\n");
-  printf("a            push linear regression 'a' value of ax+b\n");
-  printf("b            push linear regression 'b' value of ax+b\n");
-  printf("r            push correlation coefficient of linear regression\n");
-
-  printf("sqrt         replace X with its square root\n");
-  printf("sq           replace X with its square\n");
-  printf("inv          replace X with its inverse, 1/X\n");
-
-  printf("=base        set the base to X\n");
-  printf("=prec        set the precision to X\n");
-  printf("?base        push the base\n");
-  printf("?prec        push the precision\n");
-  printf("?sf          push the number of significant figures\n");
-
-  printf(">>           replace X Y with X shifted right by Y\n");
-  printf("<<           replace X Y with X shifted left by Y\n");
-  printf("&            replace X Y with X bitwise-and Y\n");
-  printf("|            replace X Y with X bitwise-or Y\n");
-  printf("~            replace X with its bitwise negation\n");
-
-  printf("sin          replace X (in radians) with its sine\n");
-  printf("cos          replace X (in radians) with its cosine\n");
-  printf("tan          replace X (in radians) with its tangent\n");
-  printf("atan2        replace X Y with arctangent(x/y)\n");
-
-  printf("=urand       set uniform random generator (a,b) to X Y\n");
-  printf("=nrand       set normal random generator mean, sd to X Y\n");
-  printf("=erand       set exponential random generator sd to X\n");
-  printf("urand        generate uniform random number using set (a,b)\n");
-  printf("nrand        generate normal randomd number using set mean, sd\n");
-  printf("erand        generate exponential random number using set sd\n");
-
-  printf("pi           push pi\n");
-  printf("e            push e, the base of the natural log\n");
-  printf("vc           push speed of light\n");
+  fprintf(stderr, "rpn: %s can't be used with %s\n", mode, option);
+  return 1;
+}
+
+/*
+  Monte Carlo mode: the model's statistics over 'samples' samples of
+  its inputs, and some quantiles, each with its confidence interval.
+*/
+static int mc_model(DS *ds, const RPN_PROG *prog, const RPN_MC_INPUT *input,
+		    int ninputs, long samples, long seed, int threads)
+{
+  static const double p[] = {0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99};
+  enum {NUMSIZE = 256};
+  char number[3][NUMSIZE];
+  RPN_MC mc;
+  double q, lo, hi;
+  int base = ds_base(ds), prec = ds_prec(ds);
+  int t;
+
+  rpn_mc_init(&mc, threads);
+  if (seed > 0) mc.seed = seed;
+  if (RPN_OK != rpn_mc_run(&mc, prog, input, ninputs, samples)) {
+    fprintf(stderr, "rpn: Monte Carlo run failed\n");
+    return RPN_ERROR;
+  }
+
+  printf("samples %ld errors %ld\n", mc.n, mc.errors);
+  convert_d_to_s(number[0], mc.mean, base, prec, NUMSIZE);
+  convert_d_to_s(number[1], mc.lo, base, prec, NUMSIZE);
+  convert_d_to_s(number[2], mc.hi, base, prec, NUMSIZE);
+  printf("mean %s (%s to %s)\n", number[0], number[1], number[2]);
+  convert_d_to_s(number[0], mc.var, base, prec, NUMSIZE);
+  convert_d_to_s(number[1], sqrt(mc.var), base, prec, NUMSIZE);
+  printf("var %s sd %s\n", number[0], number[1]);
+  convert_d_to_s(number[0], mc.min, base, prec, NUMSIZE);
+  convert_d_to_s(number[1], mc.max, base, prec, NUMSIZE);
+  printf("min %s max %s\n", number[0], number[1]);
+  for (t = 0; t < (int) (sizeof(p) / sizeof(p[0])); t++) {
+    rpn_mc_quantile(&mc, p[t], &q, &lo, &hi);
+    convert_d_to_s(number[0], q, base, prec, NUMSIZE);
+    convert_d_to_s(number[1], lo, base, prec, NUMSIZE);
+    convert_d_to_s(number[2], hi, base, prec, NUMSIZE);
+    printf("p%02d %s (%s to %s)\n", (int) (100 * p[t] + 0.5), number[0], number[1], number[2]);
+  }
+  rpn_mc_free(&mc);
+
+  return RPN_OK;
 }
 
 /*
   RPN calculator test example
 
-  Syntax: rpn {<expression>}
+  Syntax: rpn [--infix] [--pipeline] [-f <file> [--threads <n>]]
+  .           [--jobs <file> [--threads <n>]]
+  .           [--files <list> [--threads <n>] [--no-uring]]
+  .           [--raw <k>] [--csv | --tsv | --delim <c> [--append]
+  .           [--header]] [--sheet [--threads <n>]]
+  .           [--mc <samples> {--in <dist>} [--seed <s>] [--threads <n>]]
+  .           [--out top|stack|change|every=<n>] {--plugin <lib>}
+  .           [--shared-stats <name>]
+  .           [-e] {<expression>}
 
   If expression is provided, evaluate this, otherwise read from stdin.
+  With --infix, expressions are infix, e.g., 2 * (3 + 4), instead.
+  With --pipeline, stdin is read, evaluated and printed on separate
+  threads, for big piped inputs of RPN, printed in full, so it's not
+  for use with the other modes or --infix or --out. With -f, each line of the file is
+  evaluated separately, in parallel on 'n' threads, defaulting to one
+  per processor, in RPN, with results printed as the whole stack and
+  statistics of the calc's own, so not with --infix, --out or
+  --shared-stats. With --jobs, it's the same, but for lines of very
+  different cost: workers that run out of lines take them from others,
+  and how busy each was is printed to stderr at the end; see rpnjobs.h.
+  With --files, it's each line of each of the files named in the list,
+  one to a line, or "-" for stdin, which are opened and read many at a
+  time through io_uring where there is it, unless --no-uring, and by a
+  pool of threads where there isn't, and as with -f, it's RPN printed
+  in full; see rpnfiles.h.
+  With --raw, stdin is rows of 'k' binary doubles, each pushed onto a
+  cleared stack before the expression is evaluated, and the top of the
+  stack goes to stdout as a binary double; see rpnraw.h.
+  With --csv, --tsv or --delim, stdin is rows of fields separated by
+  commas, tabs or 'c', and the expression is evaluated on each row
+  with $1, $2, ... being its columns, e.g., rpn --csv '$3 $1 - $2 /'.
+  With --append, rows are printed with the result as a new column,
+  and with --header, the first row is passed through; see rpncsv.h.
+  With --sheet, lines are spreadsheet cells like "c = @a @b +" with
+  references to other cells, only recomputing what depends on a change,
+  on 'n' threads if given; see rpnsheet.h.
+  With --mc, the expression is a model of random inputs, $1, $2, ...,
+  each given by an --in like normal,10,0.5, and it's run on that many
+  samples of them, on 'n' threads, defaulting to one per processor,
+  for its mean, spread and quantiles; see rpnmc.h.
+  With --out, results are printed for every line as the whole stack,
+  the default, or just the top, or only when the stack's changed, or
+  every 'n' lines; see rpnout.h.
+  With --plugin, a shared library's operators are added; see rpnop.h.
+  With --shared-stats, the statistics registers are in shared memory
+  segment 'name', created if need be, and are those of every rpn that
+  names it: each stat and xstat adds its points, and n, mx, sdx, a,
+  r, ... are of all of them, live. The segment stays, with its sums,
+  until it's removed, e.g., rm /dev/shm/<name>; see rpnshm.h.
+  The -e ends the options, for an expression that looks like one.
 */
 
 int main(int argc, char *argv[])
 {
-  enum {BUFFERSIZE = 256};
-  char buffer[BUFFERSIZE];
-  int bufferleft = BUFFERSIZE;
+  char *expr;
   char *line;
+#ifndef USE_READLINE
+  char *linebuf = NULL;
+  size_t linesize = 0;
+#endif
+  size_t len;
   DS ds;
   enum {STACKSIZE = 10};
   double stack[STACKSIZE];
+  RPN_PROG prog;
+  int infix = 0;
+  int pipeline = 0;
+  char *file = NULL;
+  char *jobs = NULL;
+  char *files = NULL;
+  int no_uring = 0;
+  int threads = 0;
+  int raw = 0;
+  double *rawstack;
+  int delim = 0;
+  int append = 0;
+  int header = 0;
+  int sheet = 0;
+  RPN_SHEET cells;
+  char *outspec = NULL;
+  long samples = 0;
+  long seed = 0;
+  RPN_MC_INPUT *input;
+  int ninputs = 0;
+  char *shared = NULL;
+#ifdef USE_RPNOUT
+  RPN_OUT out;
+#endif
+  int argstart;
   int base;
   int prec;
   int t;
   int retval;
 
   ds_init(&ds, stack, STACKSIZE);
+  rpn_prog_init(&prog);
+  input = (RPN_MC_INPUT *) malloc(argc * sizeof(RPN_MC_INPUT));
+  if (NULL == input) return 1;
+
+  for (argstart = 1; argstart < argc; argstart++) {
+    if (! strcmp(argv[argstart], "--infix")) {
+      infix = 1;
+    } else if (! strcmp(argv[argstart], "--pipeline")) {
+      pipeline = 1;
+    } else if (! strcmp(argv[argstart], "-f") && argstart + 1 < argc) {
+      file = argv[++argstart];
+    } else if (! strcmp(argv[argstart], "--jobs") && argstart + 1 < argc) {
+      jobs = argv[++argstart];
+    } else if (! strcmp(argv[argstart], "--files") && argstart + 1 < argc) {
+      files = argv[++argstart];
+    } else if (! strcmp(argv[argstart], "--no-uring")) {
+      no_uring = 1;
+    } else if (! strcmp(argv[argstart], "--threads") && argstart + 1 < argc) {
+      threads = atoi(argv[++argstart]);
+    } else if (! strcmp(argv[argstart], "--raw") && argstart + 1 < argc) {
+      raw = atoi(argv[++argstart]);
+      if (raw <= 0) {
+	fprintf(stderr, "rpn: bad number of columns for --raw\n");
+	return 1;
+      }
+    } else if (! strcmp(argv[argstart], "--csv")) {
+      delim = ',';
+    } else if (! strcmp(argv[argstart], "--tsv")) {
+      delim = '\t';
+    } else if (! strcmp(argv[argstart], "--delim") && argstart + 1 < argc) {
+      delim = *argv[++argstart];
+    } else if (! strcmp(argv[argstart], "--append")) {
+      append = 1;
+    } else if (! strcmp(argv[argstart], "--header")) {
+      header = 1;
+    } else if (! strcmp(argv[argstart], "--out") && argstart + 1 < argc) {
+      outspec = argv[++argstart];
+    } else if (! strcmp(argv[argstart], "--sheet")) {
+      sheet = 1;
+    } else if (! strcmp(argv[argstart], "--mc") && argstart + 1 < argc) {
+      samples = atol(argv[++argstart]);
+      if (samples <= 0) {
+	fprintf(stderr, "rpn: bad number of samples for --mc\n");
+	return 1;
+      }
+    } else if (! strcmp(argv[argstart], "--in") && argstart + 1 < argc) {
+      if (RPN_OK != rpn_mc_input(&input[ninputs++], argv[++argstart])) {
+	fprintf(stderr, "rpn: bad input distribution: %s\n", argv[argstart]);
+	return 1;
+      }
+    } else if (! strcmp(argv[argstart], "--seed") && argstart + 1 < argc) {
+      seed = atol(argv[++argstart]);
+    } else if (! strcmp(argv[argstart], "--plugin") && argstart + 1 < argc) {
+      if (RPN_OK != rpncalc_load_ops(argv[++argstart])) {
+	fprintf(stderr, "rpn: can't load plugin: %s\n", argv[argstart]);
+	return 1;
+      }
+    } else if (! strcmp(argv[argstart], "--shared-stats") && argstart + 1 < argc) {
+      shared = argv[++argstart];
+    } else if (! strcmp(argv[argstart], "-e")) {
+      argstart++;
+      break;
+    } else {
+      break;
+    }
+  }
+
+  if (NULL != file) {
+    if (infix) return unsupported("-f", "--infix");
+    if (NULL != outspec) return unsupported("-f", "--out");
+    if (NULL != shared) return unsupported("-f", "--shared-stats");
+#ifdef USE_RPNFILE
+    retval = rpn_file(file, threads, stdout, print_help);
+#else
+    fprintf(stderr, "rpn: -f not supported\n");
+    retval = RPN_ERROR;
+#endif
+    return RPN_ERROR == retval ? 1 : 0;
+  }
+
+  if (NULL != jobs) {
+    if (infix) return unsupported("--jobs", "--infix");
+    if (NULL != outspec) return unsupported("--jobs", "--out");
+    if (NULL != shared) return unsupported("--jobs", "--shared-stats");
+#ifdef USE_RPNFILE
+    retval = rpn_jobs(jobs, threads, stdout, stderr, print_help);
+#else
+    fprintf(stderr, "rpn: --jobs not supported\n");
+    retval = RPN_ERROR;
+#endif
+    return RPN_ERROR == retval ? 1 : 0;
+  }
+
+  if (NULL != files) {
+    if (infix) return unsupported("--files", "--infix");
+    if (NULL != outspec) return unsupported("--files", "--out");
+    if (NULL != shared) return unsupported("--files", "--shared-stats");
+#ifdef USE_RPNFILE
+    retval = rpn_files(files, threads, no_uring ? RPN_FILES_THREADS : RPN_FILES_AUTO, stdout, print_help);
+#else
+    fprintf(stderr, "rpn: --files not supported\n");
+    retval = RPN_ERROR;
+#endif
+    return RPN_ERROR == retval ? 1 : 0;
+  }
+
+  if (pipeline) {
+    if (infix) return unsupported("--pipeline", "--infix");
+    if (sheet) return unsupported("--pipeline", "--sheet");
+    if (NULL != outspec) return unsupported("--pipeline", "--out");
+    if (raw > 0) return unsupported("--pipeline", "--raw");
+    if (delim) return unsupported("--pipeline", "--csv, --tsv or --delim");
+    if (samples > 0) return unsupported("--pipeline", "--mc");
+    if (argc > argstart) return unsupported("--pipeline", "an expression");
+  }
+
+  if (NULL != shared && RPN_OK != share_stats(&ds, shared)) return 1;
+
+  if (pipeline) {
+    retval = rpn_pipeline(&ds, stdin, stdout, print_help);
+    ds_free(&ds);
+    return RPN_ERROR == retval ? 1 : 0;
+  }
 
 #ifdef USE_HISTORY
   using_history();
 #endif
+  rpn_sheet_init(&cells, threads);
+#ifdef USE_RPNOUT
+  rpn_out_init(&out, fileno(stdout));
+  if (NULL != outspec && RPN_OK != rpn_out_policy(&out, outspec)) {
+    fprintf(stderr, "rpn: bad --out policy: %s\n", outspec);
+    return 1;
+  }
+#else
+  if (NULL != outspec) {
+    fprintf(stderr, "rpn: --out not supported\n");
+    return 1;
+  }
+#endif
 
-  *buffer = 0;
-  if (argc > 1) {
-    for (t = 1; t < argc; t++) {
-      if (strlen(argv[t]) < bufferleft - 1) {
-	strcat(buffer, argv[t]);
-	strcat(buffer, " ");
-	bufferleft -= (strlen(argv[t]) + 1);
-      }
+  /* the expression on the command line, if any, as one string */
+  for (len = 1, t = argstart; t < argc; t++) len += strlen(argv[t]) + 1;
+  expr = (char *) malloc(len);
+  if (NULL == expr) return 1;
+  for (len = 0, t = argstart; t < argc; t++) {
+    strcpy(expr + len, argv[t]);
+    len += strlen(argv[t]);
+    expr[len++] = ' ';
+  }
+  expr[len] = 0;
+
+  if (raw > 0) {
+#ifdef USE_RPNRAW
+    /* room for the row and then some */
+    rawstack = (double *) malloc((raw + STACKSIZE) * sizeof(double));
+    ds_free(&ds);
+    if (NULL == rawstack ||
+	RPN_OK != ds_init(&ds, rawstack, raw + STACKSIZE) ||
+	RPN_OK != (infix ?
+		   rpncalc_infix(&ds, expr, &prog) :
+		   rpncalc_compile(&ds, expr, &prog))) {
+      fprintf(stderr, "rpn: bad expression\n");
+      return 1;
+    }
+    if (NULL != shared && RPN_OK != share_stats(&ds, shared)) return 1;
+    retval = rpn_raw(&ds, &prog, raw, fileno(stdin), fileno(stdout));
+    rpn_prog_free(&prog);
+    ds_free(&ds);
+    free(rawstack);
+#else
+    fprintf(stderr, "rpn: --raw not supported\n");
+    retval = RPN_ERROR;
+#endif
+    return RPN_ERROR == retval ? 1 : 0;
+  }
+
+  if (samples > 0) {
+    if (RPN_OK != (infix ?
+		   rpncalc_infix(&ds, expr, &prog) :
+		   rpncalc_compile(&ds, expr, &prog))) {
+      fprintf(stderr, "rpn: bad expression\n");
+      return 1;
     }
+    retval = mc_model(&ds, &prog, input, ninputs, samples, seed, threads);
+    rpn_prog_free(&prog);
+    return RPN_ERROR == retval ? 1 : 0;
+  }
+
+  if (delim) {
+#ifdef USE_RPNCSV
+    if (RPN_OK != (infix ?
+		   rpncalc_infix(&ds, expr, &prog) :
+		   rpncalc_compile(&ds, expr, &prog))) {
+      fprintf(stderr, "rpn: bad expression\n");
+      return 1;
+    }
+    retval = rpn_csv(&ds, &prog, delim, append, header, stdin, stdout);
+    rpn_prog_free(&prog);
+    ds_free(&ds);
+#else
+    fprintf(stderr, "rpn: --csv not supported\n");
+    retval = RPN_ERROR;
+#endif
+    return RPN_ERROR == retval ? 1 : 0;
   }
 
   do {
-    if (argc > 1) {
-      line = buffer;
+    if (argc > argstart) {
+      line = expr;
     } else {
 #ifdef USE_READLINE
       line = readline("");
       if (NULL == line) {
+	retval = RPN_OK;
 	break;
       }
 #else
-      if (NULL == fgets(buffer, BUFFERSIZE, stdin)) {
-	return 0;		/* end of file */
+      if (infix || sheet) {
+	line = read_line(stdin, &linebuf, &linesize);
+	if (NULL == line) {
+	  retval = RPN_OK;
+	  break;		/* end of file */
+	}
+      } else {
+	/* evaluated as it's read */
+	line = NULL;
+	retval = rpn_eval_line(&ds, stdin);
+	if (retval < 0) {
+	  retval = RPN_OK;
+	  break;		/* end of file */
+	}
       }
-      line = buffer;
 #endif
 #ifdef USE_HISTORY
-      if (*line) {
+      if (NULL != line && *line) {
 	add_history(line);
       }
 #endif
     }
 
-    retval = rpncalc_eval(&ds, line);
-    if (RPN_OK == retval) {
-      if (ds.next == 0) {
-	printf("(empty)\n");
-      } else {
-	prec = ds_prec(&ds);
-	base = ds_base(&ds);
-	for (t = 0; t < ds.next; t++) {
-	  retval = convert_d_to_s(buffer, ds.stack[t], base, prec, BUFFERSIZE);
-	  if (RPN_OK != retval) {
-	    printf("error\n");
-	  } else {
-	    buffer[BUFFERSIZE-1] = 0;
-	    printf("%s ", buffer);
-	  }
-	}
-	printf("\n");
+    if (sheet) {
+      retval = sheet_line(&ds, &cells, line); /* prints for itself */
+    } else if (infix) {
+      prog.num = 0;
+      retval = rpncalc_infix(&ds, line, &prog);
+      if (RPN_OK == retval) {
+	retval = rpncalc_run(&ds, &prog);
       }
-    } else if (RPN_ERROR == retval) {
-      printf("error\n");
+    } else if (NULL != line) {
+      retval = rpncalc_eval(&ds, line);
+    }
+    if (sheet) {
+      if (RPN_QUIT == retval) break;
+    } else if (RPN_OK == retval || RPN_ERROR == retval) {
+      prec = ds_prec(&ds);
+      base = ds_base(&ds);
+#ifdef USE_RPNOUT
+      fflush(stdout);		/* anything readline echoed goes first */
+      rpn_out_result(&out, retval, ds.stack, ds.ival, ds.itag, ds.next, base, prec);
+#else
+      rpn_print_result(stdout, retval, ds.stack, ds.ival, ds.itag, ds.next, base, prec);
+#endif
     } else if (RPN_HELP == retval) {
-      print_help();
+#ifdef USE_RPNOUT
+      rpn_out_flush(&out);
+      print_help(stdout);
+      fflush(stdout);
+#else
+      print_help(stdout);
+#endif
     } else if (RPN_QUIT == retval) {
       break;
     }
 
-    if (argc > 1) {
+    if (argc > argstart) {
       break;
     } else {
 #ifdef USE_READLINE
@@ -228,5 +704,18 @@ int main(int argc, char *argv[])
     }
   } while (! feof(stdin));
 
+#ifdef USE_RPNOUT
+  rpn_out_flush(&out);
+  rpn_out_free(&out);
+#endif
+  rpn_prog_free(&prog);
+  rpn_sheet_free(&cells);
+  ds_free(&ds);
+#ifndef USE_READLINE
+  free(linebuf);
+#endif
+  free(expr);
+  free(input);
+
   return RPN_ERROR == retval ? 1 : 0;
 }
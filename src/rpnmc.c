@@ -0,0 +1,481 @@
+/*
+  rpnmc.c
+
+  Monte Carlo runs of RPN models, see rpnmc.h. The generator is the
+  Park-Miller one of variates.c, x' = A x mod M, so 'j' steps ahead of
+  x is A^j x mod M, and substream s starts at seed A^(s stride) mod M.
+  Each input has two substreams, since the normal, gamma and Pearson V
+  generators use two unit generators.
+
+  Worker threads take chunks in turn, as rpnsheet.c's take cells,
+  putting each chunk's results in place in the samples and its count,
+  mean and sum of squared deviations alongside, and those are merged
+  in chunk order when they're done, so the sums are always done the
+  same way.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>		/* sqrt, erfc, HUGE_VAL */
+#include <stdlib.h>		/* malloc, free */
+#include <string.h>		/* strncmp, strchr */
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#if HAVE_UNISTD_H
+#include <unistd.h>		/* sysconf */
+#endif
+#include "rpncalc.h"
+#include "variates.h"
+#include "rpnmc.h"
+
+#define MODULUS 2147483647	/* as in variates.c */
+#define A 16807
+
+enum {STACKSIZE = 64};		/* for running the model */
+enum {MAX_THREADS = 256};
+enum {CHUNK_DRAWS = 8};		/* least room per sample in a substream */
+
+typedef struct {
+  long n;
+  double mean, m2;		/* m2 is the sum of squared deviations */
+  double min, max;
+} mc_chunk;
+
+typedef union {
+  uniform_random_struct uniform;
+  normal_random_struct normal;
+  exponential_random_struct exponential;
+  weibull_random_struct weibull;
+  gamma_random_struct gamma;
+  pearson_v_random_struct pearson_v;
+} mc_gen;
+
+typedef struct {
+  const RPN_PROG *prog;
+  const RPN_MC_INPUT *input;
+  int ninputs;
+  long samples;
+  long nchunks;
+  long seed;
+  unsigned long long jump;	/* A^stride mod M */
+  double *sample;		/* NaN where there's none */
+  mc_chunk *chunk;
+  long next;			/* next chunk to take */
+} mc_run;
+
+/* a b mod M, for a and b < M, which fits in 62 bits */
+static unsigned long long mulmod(unsigned long long a, unsigned long long b)
+{
+  return a * b % MODULUS;
+}
+
+static unsigned long long powmod(unsigned long long a, unsigned long long e)
+{
+  unsigned long long r = 1;
+
+  for (; e > 0; e >>= 1) {
+    if (e & 1) r = mulmod(r, a);
+    a = mulmod(a, a);
+  }
+
+  return r;
+}
+
+void rpn_mc_init(RPN_MC *mc, int threads)
+{
+  mc->threads = threads;
+  mc->seed = 65521;		/* unit_random_init()'s */
+  mc->conf = 0.95;
+  mc->n = mc->errors = 0;
+  mc->mean = mc->var = 0.0;
+  mc->lo = mc->hi = 0.0;
+  mc->min = mc->max = 0.0;
+  mc->sample = NULL;
+}
+
+void rpn_mc_free(RPN_MC *mc)
+{
+  free(mc->sample);
+  mc->sample = NULL;
+  mc->n = 0;
+}
+
+static const struct {
+  const char *name;
+  int type;
+  int nparams;
+} mc_types[] = {
+  {"uniform", RPN_MC_UNIFORM, 2},
+  {"normal", RPN_MC_NORMAL, 2},
+  {"exponential", RPN_MC_EXPONENTIAL, 1},
+  {"weibull", RPN_MC_WEIBULL, 2},
+  {"gamma", RPN_MC_GAMMA, 2},
+  {"pearson_v", RPN_MC_PEARSON_V, 2}
+};
+
+int rpn_mc_input(RPN_MC_INPUT *input, const char *spec)
+{
+  const char *p = strchr(spec, ',');
+  char *end;
+  size_t len = NULL != p ? (size_t) (p - spec) : strlen(spec);
+  double param[2];
+  int n = 0;
+  int t;
+
+  while (NULL != p && n < 2) {
+    param[n++] = strtod(p + 1, &end);
+    if (end == p + 1 || (',' != *end && 0 != *end)) return RPN_ERROR;
+    p = ',' == *end ? end : NULL;
+  }
+  if (NULL != p) return RPN_ERROR;
+
+  for (t = 0; t < (int) (sizeof(mc_types) / sizeof(mc_types[0])); t++) {
+    if (strlen(mc_types[t].name) == len && ! strncmp(spec, mc_types[t].name, len)) {
+      if (n != mc_types[t].nparams) return RPN_ERROR;
+      input->type = mc_types[t].type;
+      input->a = param[0];
+      input->b = n > 1 ? param[1] : 0.0;
+      return RPN_OK;
+    }
+  }
+
+  return RPN_ERROR;
+}
+
+static void gen_init(mc_gen *g, const RPN_MC_INPUT *in)
+{
+  switch (in->type) {
+  case RPN_MC_UNIFORM:
+    uniform_random_init(&g->uniform, in->a, in->b);
+    break;
+  case RPN_MC_NORMAL:
+    normal_random_init(&g->normal, in->a, in->b);
+    break;
+  case RPN_MC_EXPONENTIAL:
+    exponential_random_init(&g->exponential, in->a);
+    break;
+  case RPN_MC_WEIBULL:
+    weibull_random_init(&g->weibull, in->a, in->b);
+    break;
+  case RPN_MC_GAMMA:
+    gamma_random_init(&g->gamma, in->a, in->b);
+    break;
+  case RPN_MC_PEARSON_V:
+    pearson_v_random_init(&g->pearson_v, in->a, in->b);
+    break;
+  }
+}
+
+static void gen_seed(mc_gen *g, const RPN_MC_INPUT *in, long s1, long s2)
+{
+  switch (in->type) {
+  case RPN_MC_UNIFORM:
+    uniform_random_seed(&g->uniform, s1);
+    break;
+  case RPN_MC_NORMAL:
+    normal_random_seed(&g->normal, s1, s2);
+    g->normal.return_x2 = 0;	/* nothing left from the last chunk */
+    break;
+  case RPN_MC_EXPONENTIAL:
+    exponential_random_seed(&g->exponential, s1);
+    break;
+  case RPN_MC_WEIBULL:
+    weibull_random_seed(&g->weibull, s1);
+    break;
+  case RPN_MC_GAMMA:
+    gamma_random_seed(&g->gamma, s1, s2);
+    break;
+  case RPN_MC_PEARSON_V:
+    pearson_v_random_seed(&g->pearson_v, s1, s2);
+    break;
+  }
+}
+
+static double gen_real(mc_gen *g, const RPN_MC_INPUT *in)
+{
+  switch (in->type) {
+  case RPN_MC_UNIFORM:
+    return uniform_random_real(&g->uniform);
+  case RPN_MC_NORMAL:
+    return normal_random_real(&g->normal);
+  case RPN_MC_EXPONENTIAL:
+    return exponential_random_real(&g->exponential);
+  case RPN_MC_WEIBULL:
+    return weibull_random_real(&g->weibull);
+  case RPN_MC_GAMMA:
+    return gamma_random_real(&g->gamma);
+  case RPN_MC_PEARSON_V:
+    return pearson_v_random_real(&g->pearson_v);
+  }
+
+  return 0.0;
+}
+
+/* the samples of chunk 'c', with its generators and calc */
+static void run_chunk(mc_run *r, long c, mc_gen *gen, double *args, DS *ds)
+{
+  mc_chunk *k = &r->chunk[c];
+  unsigned long long s;
+  long start = c * RPN_MC_CHUNK;
+  long end = start + RPN_MC_CHUNK < r->samples ? start + RPN_MC_CHUNK : r->samples;
+  long j;
+  double x, d;
+  int t;
+
+  /* substreams 2 (c ninputs + t) and the one after */
+  s = mulmod(r->seed, powmod(r->jump, 2ULL * c * r->ninputs));
+  for (t = 0; t < r->ninputs; t++) {
+    gen_seed(&gen[t], &r->input[t], (long) s, (long) mulmod(s, r->jump));
+    s = mulmod(s, mulmod(r->jump, r->jump));
+  }
+
+  k->n = 0;
+  k->mean = k->m2 = 0.0;
+  k->min = HUGE_VAL;
+  k->max = -HUGE_VAL;
+  for (j = start; j < end; j++) {
+    for (t = 0; t < r->ninputs; t++) args[t] = gen_real(&gen[t], &r->input[t]);
+    ds_reset(ds);
+    x = NAN;
+    if (RPN_OK == rpncalc_run_args(ds, r->prog, args, r->ninputs) && ds->next > 0) {
+      x = ds->stack[ds->next - 1];
+    }
+    r->sample[j] = x;
+    if (x != x) continue;
+    /* Welford's running mean and sum of squared deviations */
+    k->n++;
+    d = x - k->mean;
+    k->mean += d / k->n;
+    k->m2 += d * (x - k->mean);
+    if (x < k->min) k->min = x;
+    if (x > k->max) k->max = x;
+  }
+}
+
+static void *mc_worker(void *arg)
+{
+  mc_run *r = (mc_run *) arg;
+  mc_gen *gen;
+  double *args;
+  double stack[STACKSIZE];
+  DS ds;
+  long c;
+  int t;
+
+  /* + 1 so there's something for a model without inputs */
+  gen = (mc_gen *) malloc((r->ninputs + 1) * sizeof(mc_gen));
+  args = (double *) malloc((r->ninputs + 1) * sizeof(double));
+  if (NULL != gen && NULL != args) {
+    ds_init(&ds, stack, STACKSIZE);
+    for (t = 0; t < r->ninputs; t++) gen_init(&gen[t], &r->input[t]);
+#if HAVE_PTHREAD_H
+    while ((c = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED)) < r->nchunks) {
+#else
+    while ((c = r->next++) < r->nchunks) {
+#endif
+      run_chunk(r, c, gen, args, &ds);
+    }
+    ds_free(&ds);
+  }
+  free(gen);
+  free(args);
+
+  return NULL;
+}
+
+/* z such that conf of a standard normal is within +-z */
+static double normal_z(double conf)
+{
+  double lo = 0.0, hi = 40.0, z;
+  int t;
+
+  for (t = 0; t < 100; t++) {
+    z = 0.5 * (lo + hi);
+    if (erfc(z / sqrt(2.0)) > 1.0 - conf) lo = z;
+    else hi = z;
+  }
+
+  return 0.5 * (lo + hi);
+}
+
+int rpn_mc_run(RPN_MC *mc, const RPN_PROG *prog,
+	       const RPN_MC_INPUT *input, int ninputs, long samples)
+{
+  mc_run r;
+  mc_chunk *k;
+  unsigned long long nstreams, stride;
+  double d, n;
+  long c, j;
+  int threads;
+  int t;
+#if HAVE_PTHREAD_H
+  pthread_t tid[MAX_THREADS];
+#endif
+
+  rpn_mc_free(mc);
+  mc->errors = 0;
+  if (samples <= 0 || ninputs < 0 || ! (mc->conf > 0.0 && mc->conf < 1.0) ||
+      mc->seed < 1 || mc->seed >= MODULUS - 1) {
+    return RPN_ERROR;
+  }
+
+  r.prog = prog;
+  r.input = input;
+  r.ninputs = ninputs;
+  r.samples = samples;
+  r.nchunks = (samples + RPN_MC_CHUNK - 1) / RPN_MC_CHUNK;
+  r.seed = mc->seed;
+  r.next = 0;
+  nstreams = 2ULL * r.nchunks * (ninputs > 0 ? ninputs : 1);
+  stride = (MODULUS - 1) / nstreams;
+  if (stride < (unsigned long long) RPN_MC_CHUNK * CHUNK_DRAWS) return RPN_ERROR;
+  r.jump = powmod(A, stride);
+
+  r.sample = (double *) malloc(samples * sizeof(double));
+  r.chunk = (mc_chunk *) malloc(r.nchunks * sizeof(mc_chunk));
+  if (NULL == r.sample || NULL == r.chunk) {
+    free(r.sample);
+    free(r.chunk);
+    return RPN_ERROR;
+  }
+
+  threads = mc->threads;
+#if HAVE_UNISTD_H && defined(_SC_NPROCESSORS_ONLN)
+  if (threads <= 0) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (threads <= 0) threads = 1;
+  if (threads > MAX_THREADS) threads = MAX_THREADS;
+  if (threads > r.nchunks) threads = (int) r.nchunks;
+
+#if HAVE_PTHREAD_H
+  for (t = 0; t < threads - 1; t++) {
+    if (0 != pthread_create(&tid[t], NULL, mc_worker, &r)) break;
+  }
+  threads = t;
+  mc_worker(&r);
+  for (t = 0; t < threads; t++) {
+    pthread_join(tid[t], NULL);
+  }
+#else
+  mc_worker(&r);
+#endif
+  if (r.next < r.nchunks) {
+    /* out of memory in every worker */
+    free(r.sample);
+    free(r.chunk);
+    return RPN_ERROR;
+  }
+
+  /* the chunks merged in order, as Chan et al. merge variances */
+  mc->n = 0;
+  mc->mean = 0.0;
+  d = 0.0;			/* sum of squared deviations */
+  mc->min = HUGE_VAL;
+  mc->max = -HUGE_VAL;
+  for (c = 0; c < r.nchunks; c++) {
+    k = &r.chunk[c];
+    if (0 == k->n) continue;
+    n = (double) mc->n + k->n;
+    d += k->m2 + (k->mean - mc->mean) * (k->mean - mc->mean) * mc->n * k->n / n;
+    mc->mean += (k->mean - mc->mean) * k->n / n;
+    mc->n += k->n;
+    if (k->min < mc->min) mc->min = k->min;
+    if (k->max > mc->max) mc->max = k->max;
+  }
+  free(r.chunk);
+  mc->errors = samples - mc->n;
+
+  /* keep just the numbers */
+  for (c = j = 0; c < samples; c++) {
+    if (r.sample[c] == r.sample[c]) r.sample[j++] = r.sample[c];
+  }
+  mc->sample = r.sample;
+  if (0 == mc->n) {
+    rpn_mc_free(mc);
+    return RPN_ERROR;
+  }
+
+  mc->var = mc->n > 1 ? d / (mc->n - 1) : 0.0;
+  d = normal_z(mc->conf) * sqrt(mc->var / mc->n);
+  mc->lo = mc->mean - d;
+  mc->hi = mc->mean + d;
+
+  return RPN_OK;
+}
+
+/*
+  Reorders a[0] to a[n - 1] so a[k] is the one that would be there if
+  they were sorted, with none larger before it and none smaller after.
+ */
+static void select_kth(double *a, long n, long k)
+{
+  long lo = 0, hi = n - 1;
+  long i, j;
+  double pivot, x;
+
+  while (lo < hi) {
+    pivot = a[lo + (hi - lo) / 2];
+    i = lo, j = hi;
+    while (i <= j) {
+      while (a[i] < pivot) i++;
+      while (a[j] > pivot) j--;
+      if (i <= j) {
+	x = a[i], a[i] = a[j], a[j] = x;
+	i++, j--;
+      }
+    }
+    if (k <= j) hi = j;
+    else if (k >= i) lo = i;
+    else return;
+  }
+}
+
+static double least(const double *a, long n)
+{
+  double x = a[0];
+  long t;
+
+  for (t = 1; t < n; t++) {
+    if (a[t] < x) x = a[t];
+  }
+
+  return x;
+}
+
+int rpn_mc_quantile(RPN_MC *mc, double p, double *q, double *lo, double *hi)
+{
+  double *a = mc->sample;
+  long n = mc->n;
+  double h, w, x, y;
+  long k, klo, khi;
+
+  if (NULL == a || ! (p >= 0.0 && p <= 1.0)) return RPN_ERROR;
+
+  /* between the order statistics either side of p (n - 1) */
+  h = p * (n - 1);
+  k = (long) h;
+  select_kth(a, n, k);
+  x = a[k];
+  y = k + 1 < n ? least(a + k + 1, n - k - 1) : x;
+  *q = x + (h - k) * (y - x);
+
+  /* those n p +- z sqrt(n p (1 - p)) from the start, as a binomial */
+  w = normal_z(mc->conf) * sqrt(n * p * (1.0 - p));
+  klo = (long) floor(n * p - w);
+  khi = (long) ceil(n * p + w);
+  if (klo > k) klo = k;
+  if (klo < 0) klo = 0;
+  if (khi <= k) khi = k + 1;
+  if (khi > n - 1) khi = n - 1;
+
+  /* a[k] is in place, so they're on either side of it */
+  if (klo < k) select_kth(a, k, klo);
+  *lo = a[klo];
+  if (khi > k) select_kth(a + k + 1, n - k - 1, khi - k - 1);
+  *hi = a[khi];
+
+  return RPN_OK;
+}
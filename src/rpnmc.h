@@ -0,0 +1,90 @@
+#ifndef RPNMC_H
+#define RPNMC_H
+
+#include "rpncalc.h"		/* RPN_PROG */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Monte Carlo propagation of uncertainty through an RPN model. The
+  model is a compiled program whose $n arguments are random inputs,
+  each drawn from one of the distributions in variates.h, and a run
+  evaluates it on that many samples, on threads, for the mean and
+  variance of the result, confidence intervals, and quantiles.
+
+  The samples are done in chunks of RPN_MC_CHUNK, and each input of
+  each chunk draws from its own substream of the variates.h generator,
+  started where it should be by jumping ahead, so the samples, and
+  everything from them, are the same whatever the number of threads.
+  The generator's period, 2^31 - 2, is split evenly among the
+  substreams, which limits a run to about 100 million samples of one
+  input, or a tenth as many of ten; more is an error.
+
+  A sample the model gives an error or a NaN for is counted and left
+  out. Random operators in the model itself (urand, ...) draw from the
+  thread's own calc, so they're not reproducible; use inputs instead.
+ */
+
+enum {
+  RPN_MC_UNIFORM,		/* a, b: on [a, b) */
+  RPN_MC_NORMAL,		/* a, b: mean, std dev */
+  RPN_MC_EXPONENTIAL,		/* a: mean */
+  RPN_MC_WEIBULL,		/* a, b: shape alpha, scale beta */
+  RPN_MC_GAMMA,			/* a, b: shape alpha, scale beta */
+  RPN_MC_PEARSON_V		/* a, b: shape alpha, scale beta */
+};
+
+enum {RPN_MC_CHUNK = 1024};	/* samples with the same substreams */
+
+typedef struct {
+  int type;			/* RPN_MC_UNIFORM, ... */
+  double a, b;			/* its parameters */
+} RPN_MC_INPUT;
+
+typedef struct {
+  /* set by rpn_mc_init(), and by you before a run */
+  int threads;			/* to run on, 0 for one per processor */
+  long seed;			/* of the first substream, 1 to 2^31 - 2 */
+  double conf;			/* of the confidence intervals, 0.95 */
+
+  /* the results of the last run */
+  long n;			/* samples the model gave a number for */
+  long errors;			/* and those it didn't */
+  double mean, var;		/* sample mean and variance */
+  double lo, hi;		/* confidence interval of the mean */
+  double min, max;
+  double *sample;		/* the n results, reordered by rpn_mc_quantile() */
+} RPN_MC;
+
+extern void rpn_mc_init(RPN_MC *mc, int threads);
+extern void rpn_mc_free(RPN_MC *mc);
+
+/*
+  Set an input from text like "normal,10,0.5", the name being one of
+  uniform, normal, exponential, weibull, gamma or pearson_v, as with
+  the variate program, followed by its parameters.
+ */
+extern int rpn_mc_input(RPN_MC_INPUT *input, const char *spec);
+
+/*
+  Run the model on 'samples' samples of its 'ninputs' inputs, $1 being
+  input[0], and so on, filling in the results. It's an error if no
+  sample gives a number.
+ */
+extern int rpn_mc_run(RPN_MC *mc, const RPN_PROG *prog,
+		      const RPN_MC_INPUT *input, int ninputs, long samples);
+
+/*
+  The 'p' quantile of the last run's results, 0 <= p <= 1, and its
+  confidence interval, from the order statistics that bracket it. It
+  takes time in proportion to the number of samples.
+ */
+extern int rpn_mc_quantile(RPN_MC *mc, double p, double *q, double *lo, double *hi);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RPNMC_H */
@@ -0,0 +1,153 @@
+/*
+  rpnop.c
+
+  The table of operators added at run time, see rpnop.h, with an
+  open-addressed index of their names, twice the table's size so it's
+  never more than half full.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>		/* NAN */
+#include <stdlib.h>		/* NULL */
+#include <string.h>		/* strlen, memcpy, memcmp */
+#if HAVE_DLFCN_H
+#include <dlfcn.h>		/* dlopen, dlsym */
+#endif
+#include "rpncalc.h"
+#include "rpnop.h"
+
+enum {INDEXSIZE = 2 * RPN_OPMAX};
+
+RPN_OP rpn_op_table[RPN_OPMAX];
+static int nops;
+static unsigned short op_index[INDEXSIZE]; /* op, 0 if empty */
+
+static unsigned int hash_name(const char *name, int len)
+{
+  unsigned int h = 2166136261u;	/* FNV-1a */
+  int t;
+
+  for (t = 0; t < len; t++) {
+    h = (h ^ (unsigned char) name[t]) * 16777619u;
+  }
+
+  return h;
+}
+
+int rpncalc_find_op(const char *name, int len)
+{
+  unsigned int h;
+  int op;
+
+  if (0 == nops || len >= RPN_OPNAMEMAX) return 0;
+  for (h = hash_name(name, len) % INDEXSIZE; 0 != (op = op_index[h]); h = (h + 1) % INDEXSIZE) {
+    if (0 == memcmp(rpn_op_table[op - 1].name, name, len) &&
+	0 == rpn_op_table[op - 1].name[len]) {
+      return op;
+    }
+  }
+
+  return 0;
+}
+
+/* a name has to be a token that isn't a $n, quote or number */
+static int valid_name(const char *name, int len)
+{
+  double x;
+  int t;
+
+  if (len <= 0 || len >= RPN_OPNAMEMAX) return 0;
+  for (t = 0; t < len; t++) {
+    if (' ' == name[t] || '\t' == name[t] || '\r' == name[t] || '\n' == name[t]) return 0;
+  }
+  if ('$' == name[0] || '[' == name[0] || ']' == name[0]) return 0;
+
+  return 0 != convert_sn_to_d(name, len, &x, 10);
+}
+
+int rpncalc_register_op(const char *name, int arity, RPN_OP_FN fn)
+{
+  int len = strlen(name);
+  unsigned int h;
+  int op;
+
+  if (! valid_name(name, len) || arity < 0 || arity > RPN_OPARITYMAX || NULL == fn) {
+    return RPN_ERROR;
+  }
+
+  op = rpncalc_find_op(name, len);
+  if (0 == op) {
+    if (nops == RPN_OPMAX) return RPN_ERROR;
+    op = ++nops;
+    memcpy(rpn_op_table[op - 1].name, name, len + 1);
+    for (h = hash_name(name, len) % INDEXSIZE; 0 != op_index[h]; h = (h + 1) % INDEXSIZE) ;
+    op_index[h] = op;
+  }
+  rpn_op_table[op - 1].arity = arity;
+  rpn_op_table[op - 1].fn = fn;
+  rpn_op_table[op - 1].batch = NULL;
+
+  return RPN_OK;
+}
+
+int rpncalc_register_batch(const char *name, RPN_OP_BATCH batch)
+{
+  int op = rpncalc_find_op(name, strlen(name));
+
+  if (0 == op) return RPN_ERROR;
+  rpn_op_table[op - 1].batch = batch;
+
+  return RPN_OK;
+}
+
+int rpncalc_op_batch(int op, double *y, const double *const *x, int n)
+{
+  const RPN_OP *o;
+  double arg[RPN_OPARITYMAX];
+  int retval = RPN_OK;
+  int k, t;
+
+  if (op <= 0 || op > nops) return RPN_ERROR;
+  o = &rpn_op_table[op - 1];
+  if (NULL != o->batch) {
+    o->batch(y, x, n);
+    return RPN_OK;
+  }
+
+  for (t = 0; t < n; t++) {
+    for (k = 0; k < o->arity; k++) arg[k] = x[k][t];
+    if (RPN_OK != o->fn(arg, &y[t])) {
+      y[t] = NAN;
+      retval = RPN_ERROR;
+    }
+  }
+
+  return retval;
+}
+
+int rpncalc_load_ops(const char *path)
+{
+#if HAVE_DLFCN_H
+  static RPN_PLUGIN_API api = {
+    RPN_PLUGIN_VERSION, rpncalc_register_op, rpncalc_register_batch
+  };
+  int (*init)(RPN_PLUGIN_API *api);
+  void *lib;
+
+  lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (NULL == lib) return RPN_ERROR;
+  *(void **) &init = dlsym(lib, "rpn_plugin_init");
+  if (NULL == init) {
+    dlclose(lib);
+    return RPN_ERROR;
+  }
+
+  /* kept loaded even so, as it may have registered some */
+  return init(&api);
+#else
+  return RPN_ERROR;
+#endif
+}
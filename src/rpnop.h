@@ -0,0 +1,98 @@
+#ifndef RPNOP_H
+#define RPNOP_H
+
+#include "rpncalc.h"		/* RPN_OK, RPN_ERROR */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Operators added at run time, by the program using the library or by
+  plugins it loads. An operator is a native function of the top
+  'arity' numbers on the stack, which it replaces with its result:
+
+  int fn(const double *x, double *y)
+
+  with x[0] the deepest and x[arity - 1] the top, so a binary operator
+  does x[0] op x[1], as "Y X op" reads. x points into the stack
+  itself, nothing is copied, and y is where the result goes. It
+  returns RPN_OK, or RPN_ERROR to leave the stack as it was.
+
+  Names are looked up when a program is compiled, or a token is
+  evaluated, before the built-in operators, so a registered operator
+  can replace one, and a compiled program calls it through the table
+  directly. Registering a name again replaces its function, even in
+  programs already compiled. Register operators before evaluating on
+  other threads; the table isn't locked.
+
+  An operator may also have a batch form, over whole columns,
+
+  void batch(double *y, const double *const *x, int n)
+
+  y[t] = op(x[0][t], ..., x[arity - 1][t]) for 't' from 0 to n - 1,
+  for code that has arrays to do at once, through rpncalc_op_batch(),
+  which loops over the scalar function for an operator without one.
+  Batch forms are plain loops, to compile vectorized, and can't fail.
+ */
+
+enum {RPN_OPMAX = 256};		/* most operators registered */
+enum {RPN_OPNAMEMAX = 32};	/* longest name, with the null */
+enum {RPN_OPARITYMAX = 8};
+
+typedef int (*RPN_OP_FN)(const double *x, double *y);
+typedef void (*RPN_OP_BATCH)(double *y, const double *const *x, int n);
+
+typedef struct {
+  char name[RPN_OPNAMEMAX];
+  int arity;
+  RPN_OP_FN fn;
+  RPN_OP_BATCH batch;		/* NULL if none */
+} RPN_OP;
+
+/*
+  The registered operators, for evaluators to dispatch on; a token's
+  'op' is 1 + its index here, 0 if it's not one.
+ */
+extern RPN_OP rpn_op_table[RPN_OPMAX];
+
+extern int rpncalc_register_op(const char *name, int arity, RPN_OP_FN fn);
+extern int rpncalc_register_batch(const char *name, RPN_OP_BATCH batch);
+
+/*
+  The operator named by the 'len' chars at 'name', 1 + its index, or
+  0 if there's none.
+ */
+extern int rpncalc_find_op(const char *name, int len);
+
+/*
+  Operator 'op' over columns of 'n', with its batch form if it has one.
+ */
+extern int rpncalc_op_batch(int op, double *y, const double *const *x, int n);
+
+/*
+  Load a plugin, a shared library with a function
+
+  int rpn_plugin_init(RPN_PLUGIN_API *api)
+
+  that registers its operators through 'api' and returns RPN_OK. The
+  functions are passed in, rather than linked against, so a plugin
+  works with programs that link the library statically. Plugins stay
+  loaded. It's an error where there's no dlopen().
+ */
+
+typedef struct {
+  int version;			/* RPN_PLUGIN_VERSION */
+  int (*register_op)(const char *name, int arity, RPN_OP_FN fn);
+  int (*register_batch)(const char *name, RPN_OP_BATCH batch);
+} RPN_PLUGIN_API;
+
+enum {RPN_PLUGIN_VERSION = 1};
+
+extern int rpncalc_load_ops(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RPNOP_H */
@@ -0,0 +1,234 @@
+/*
+  rpnout.c
+
+  Policy-driven, buffered output of results, see rpnout.h. Output
+  collects in a fixed set of big segments, reused from flush to flush,
+  so it never has to be moved to grow, and is written out with a
+  single writev() when they fill, or after every line when the output
+  is a terminal.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#if HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+#include "rpncalc.h"
+#include "rpnout.h"
+
+int rpn_out_init(RPN_OUT *out, int fd)
+{
+  memset(out, 0, sizeof(*out));
+  out->fd = fd;
+  out->policy = RPN_OUT_STACK;
+  out->every = 1;
+  out->lastnum = -1;
+  out->interactive = isatty(fd);
+
+  return RPN_OK;
+}
+
+void rpn_out_free(RPN_OUT *out)
+{
+  int t;
+
+  for (t = 0; t < RPN_OUT_SEGMENTS; t++) {
+    free(out->seg[t]);
+  }
+  free(out->slot);
+  memset(out, 0, sizeof(*out));
+}
+
+int rpn_out_policy(RPN_OUT *out, const char *spec)
+{
+  char *end;
+
+  if (! strcmp(spec, "stack")) {
+    out->policy = RPN_OUT_STACK;
+  } else if (! strcmp(spec, "top")) {
+    out->policy = RPN_OUT_TOP;
+  } else if (! strcmp(spec, "change")) {
+    out->policy = RPN_OUT_CHANGE;
+  } else if (! strncmp(spec, "every=", 6)) {
+    out->every = strtol(spec + 6, &end, 10);
+    if (out->every <= 0 || 0 != *end) return RPN_ERROR;
+    out->policy = RPN_OUT_EVERY;
+  } else {
+    return RPN_ERROR;
+  }
+
+  return RPN_OK;
+}
+
+int rpn_out_flush(RPN_OUT *out)
+{
+#if HAVE_SYS_UIO_H
+  struct iovec iov[RPN_OUT_SEGMENTS];
+  int first = 0;
+#else
+  size_t off;
+#endif
+  ssize_t n;
+  int t;
+
+#if HAVE_SYS_UIO_H
+  for (t = 0; t < out->nseg; t++) {
+    iov[t].iov_base = out->seg[t];
+    iov[t].iov_len = out->seglen[t];
+  }
+  while (first < out->nseg) {
+    n = writev(out->fd, iov + first, out->nseg - first);
+    if (n < 0) {
+      if (EINTR == errno) continue;
+      out->nseg = 0;
+      return RPN_ERROR;
+    }
+    /* skip what went, which may end partway through a segment */
+    while (first < out->nseg && (size_t) n >= iov[first].iov_len) {
+      n -= iov[first++].iov_len;
+    }
+    if (first < out->nseg) {
+      iov[first].iov_base = (char *) iov[first].iov_base + n;
+      iov[first].iov_len -= n;
+    }
+  }
+#else
+  for (t = 0; t < out->nseg; t++) {
+    for (off = 0; off < out->seglen[t]; off += n) {
+      n = write(out->fd, out->seg[t] + off, out->seglen[t] - off);
+      if (n < 0) {
+	if (EINTR == errno) {
+	  n = 0;
+	  continue;
+	}
+	out->nseg = 0;
+	return RPN_ERROR;
+      }
+    }
+  }
+#endif
+  out->nseg = 0;
+
+  return RPN_OK;
+}
+
+int rpn_out_write(RPN_OUT *out, const char *text, size_t len)
+{
+  size_t n;
+  int s;
+
+  while (len > 0) {
+    if (out->nseg == 0 || out->seglen[out->nseg - 1] == RPN_OUT_SEGSIZE) {
+      if (out->nseg == RPN_OUT_SEGMENTS && RPN_OK != rpn_out_flush(out)) {
+	return RPN_ERROR;
+      }
+      if (NULL == out->seg[out->nseg]) {
+	out->seg[out->nseg] = (char *) malloc(RPN_OUT_SEGSIZE);
+	if (NULL == out->seg[out->nseg]) return RPN_ERROR;
+      }
+      out->seglen[out->nseg++] = 0;
+    }
+    s = out->nseg - 1;
+    n = RPN_OUT_SEGSIZE - out->seglen[s];
+    if (n > len) n = len;
+    memcpy(out->seg[s] + out->seglen[s], text, n);
+    out->seglen[s] += n;
+    text += n, len -= n;
+  }
+
+  return RPN_OK;
+}
+
+/* is slot 't' formatted already, from just this? */
+static int cached(const RPN_OUT_SLOT *s, double val, int isint, long long ival, int base, int prec)
+{
+  if (0 == s->len || s->isint != isint || s->base != base) return 0;
+  if (isint) return s->ival == ival;
+
+  return s->prec == prec && 0 == memcmp(&s->val, &val, sizeof(double));
+}
+
+static RPN_OUT_SLOT *format_slot(RPN_OUT_SLOT *s, double val, int isint, long long ival, int base, int prec)
+{
+  int err;
+
+  if (cached(s, val, isint, ival, base, prec)) return s;
+
+  if (isint) {
+    err = convert_ll_to_s(s->text, ival, base, RPN_OUT_NUMSIZE - 1);
+  } else {
+    err = convert_d_to_s(s->text, val, base, prec, RPN_OUT_NUMSIZE - 1);
+  }
+  if (RPN_OK != err) {
+    s->len = 0;
+    return NULL;
+  }
+  s->len = strlen(s->text);
+  s->text[s->len++] = ' ';
+  s->val = val;
+  s->isint = isint;
+  s->ival = ival;
+  s->base = base;
+  s->prec = prec;
+
+  return s;
+}
+
+int rpn_out_result(RPN_OUT *out, int retval, const double *stack, const long long *ival, unsigned long itag, int num, int base, int prec)
+{
+  RPN_OUT_SLOT *s;
+  int changed;
+  int isint;
+  int t;
+
+  out->lines++;
+  if (RPN_ERROR == retval) {
+    if (RPN_OK != rpn_out_write(out, "error\n", 6)) return RPN_ERROR;
+    return out->interactive ? rpn_out_flush(out) : RPN_OK;
+  }
+  if (RPN_OK != retval) return RPN_OK;
+
+  if (num > out->slotsize) {
+    s = (RPN_OUT_SLOT *) realloc(out->slot, num * sizeof(*s));
+    if (NULL == s) return RPN_ERROR;
+    for (t = out->slotsize; t < num; t++) s[t].len = 0;
+    out->slot = s;
+    out->slotsize = num;
+  }
+
+  if (RPN_OUT_EVERY == out->policy && 0 != out->lines % out->every) {
+    return RPN_OK;
+  }
+  if (RPN_OUT_CHANGE == out->policy) {
+    changed = num != out->lastnum;
+    for (t = 0; t < num && ! changed; t++) {
+      isint = DS_PRINTINT(itag, t, ival[t], stack[t], base);
+      changed = ! cached(&out->slot[t], stack[t], isint, isint ? ival[t] : 0, base, prec);
+    }
+    if (! changed) return RPN_OK;
+  }
+  out->lastnum = num;
+
+  if (num == 0) {
+    rpn_out_write(out, "(empty)\n", 8);
+  } else {
+    for (t = RPN_OUT_TOP == out->policy ? num - 1 : 0; t < num; t++) {
+      isint = DS_PRINTINT(itag, t, ival[t], stack[t], base);
+      s = format_slot(&out->slot[t], stack[t], isint, isint ? ival[t] : 0, base, prec);
+      if (NULL == s) {
+	rpn_out_write(out, "error\n", 6);
+      } else {
+	rpn_out_write(out, s->text, s->len);
+      }
+    }
+    rpn_out_write(out, "\n", 1);
+  }
+
+  return out->interactive ? rpn_out_flush(out) : RPN_OK;
+}
@@ -0,0 +1,74 @@
+#ifndef RPNOUT_H
+#define RPNOUT_H
+
+#include <stddef.h>		/* size_t */
+#include "rpncalc.h"		/* DS_INTSIZE */
+
+/*
+  Buffered output of results, the way rpn prints them, but written to
+  a file descriptor in big gathered writes rather than a stdio call per
+  number, and with a policy for which results to print at all:
+
+  RPN_OUT_STACK   the whole stack after every line, as rpn always has
+  RPN_OUT_TOP     just the top of the stack
+  RPN_OUT_CHANGE  the whole stack, but only when it's changed
+  RPN_OUT_EVERY   the whole stack after every Nth line
+
+  Errors are always printed. Each stack slot's formatted text is kept
+  along with the value it came from, so a slot that hasn't changed
+  since the last line, like the bottom of a deep stack, is copied
+  rather than formatted again.
+ */
+
+enum {RPN_OUT_STACK, RPN_OUT_TOP, RPN_OUT_CHANGE, RPN_OUT_EVERY};
+
+enum {RPN_OUT_NUMSIZE = 256};	/* longest formatted number */
+enum {RPN_OUT_SEGSIZE = 65536};	/* bytes per buffer segment */
+enum {RPN_OUT_SEGMENTS = 16};	/* segments, flushed in one writev */
+
+typedef struct {
+  double val;			/* what 'text' was formatted from */
+  long long ival;
+  int isint;
+  int base;
+  int prec;
+  int len;			/* of 'text', 0 if nothing cached */
+  char text[RPN_OUT_NUMSIZE];	/* with a trailing space */
+} RPN_OUT_SLOT;
+
+typedef struct {
+  int fd;
+  int policy;
+  long every;			/* N for RPN_OUT_EVERY */
+  long lines;			/* results seen */
+  int interactive;		/* flush after every line */
+  char *seg[RPN_OUT_SEGMENTS];	/* pending output */
+  size_t seglen[RPN_OUT_SEGMENTS];
+  int nseg;			/* segments in use */
+  RPN_OUT_SLOT *slot;		/* formatted stack, bottom-to-top */
+  int slotsize;
+  int lastnum;			/* depth of the stack printed last */
+} RPN_OUT;
+
+extern int rpn_out_init(RPN_OUT *out, int fd);
+extern void rpn_out_free(RPN_OUT *out);
+
+/*
+  Set the policy from text: "stack", "top", "change" or "every=N".
+ */
+extern int rpn_out_policy(RPN_OUT *out, const char *spec);
+
+/*
+  Print the result of a line, as rpn_print_result() would, if the
+  policy says to. Help and quit are up to the caller.
+ */
+extern int rpn_out_result(RPN_OUT *out, int retval, const double *stack, const long long *ival, unsigned long itag, int num, int base, int prec);
+
+extern int rpn_out_write(RPN_OUT *out, const char *text, size_t len);
+
+/*
+  Write out everything pending, e.g., before printing some other way.
+ */
+extern int rpn_out_flush(RPN_OUT *out);
+
+#endif /* RPNOUT_H */
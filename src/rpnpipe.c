@@ -0,0 +1,506 @@
+/*
+  rpnpipe.c
+
+  Pipelined evaluation of lines of input, with a reader, an evaluator
+  and a writer on separate threads so that I/O, evaluation and
+  formatting overlap on big piped inputs.
+
+  Lines go through in batches, a fixed number of which circulate
+  through three single-producer, single-consumer rings: free batches
+  from the writer to the reader, full ones from the reader to the
+  evaluator, and evaluated ones from the evaluator to the writer.
+  Each ring has one writer of its tail and one of its head, so they
+  need no locks, just ordered loads and stores of the indices. Since
+  there's only one evaluator, and batches stay in order through each
+  ring, output comes out in the order of the input.
+
+  A thread that finds its ring empty, or full, polls it for a while,
+  then sleeps on the ring's condition variable, so an idle pipeline
+  takes no CPU. The other side only takes the lock to wake it when
+  there's a sleeper. A quit stops the reader, which waits on a pipe
+  of ours as well as the input, so it's never left reading the
+  caller's input after rpn_pipeline() returns.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_PTHREAD_H
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+#include "rpncalc.h"
+#include "rpnpipe.h"
+
+enum {NUMSIZE = 256};		/* longest formatted number */
+
+void rpn_print_result(FILE *out, int retval, const double *stack, const long long *ival, unsigned long itag, int num, int base, int prec)
+{
+  char buffer[NUMSIZE];
+  int t;
+  int err;
+
+  if (RPN_OK == retval) {
+    if (num == 0) {
+      fputs("(empty)\n", out);
+    } else {
+      for (t = 0; t < num; t++) {
+	if (DS_PRINTINT(itag, t, ival[t], stack[t], base)) {
+	  err = convert_ll_to_s(buffer, ival[t], base, NUMSIZE);
+	} else {
+	  err = convert_d_to_s(buffer, stack[t], base, prec, NUMSIZE);
+	}
+	if (RPN_OK != err) {
+	  fputs("error\n", out);
+	} else {
+	  buffer[NUMSIZE-1] = 0;
+	  fputs(buffer, out);
+	  fputc(' ', out);
+	}
+      }
+      fputc('\n', out);
+    }
+  } else if (RPN_ERROR == retval) {
+    fputs("error\n", out);
+  }
+}
+
+int rpn_eval_line(DS *ds, FILE *in)
+{
+  enum {BUFFERSIZE = 4096};
+  char buffer[BUFFERSIZE];
+  RPN_STREAM st;
+  size_t len;
+  int got = 0;
+
+  rpn_stream_init(&st);
+  while (NULL != fgets(buffer, BUFFERSIZE, in)) {
+    got = 1;
+    len = strlen(buffer);
+    rpncalc_feed(ds, &st, buffer, len);
+    if (len > 0 && '\n' == buffer[len - 1]) break;
+  }
+
+  return got ? rpncalc_feed_end(ds, &st) : -1;
+}
+
+#if HAVE_PTHREAD_H
+
+enum {NBATCH = 8};		/* batches in flight, a power of 2 */
+enum {BATCHTEXT = 65536};	/* bytes read into a batch */
+enum {SPINS = 1000};		/* polls before sleeping */
+
+typedef struct {
+  int retval;
+  int base;
+  int prec;
+  int num;			/* values on the stack */
+  int val;			/* index of the first in 'vals' */
+  unsigned long itag;		/* which are integers, in 'ivals' */
+} pipe_result;
+
+typedef struct {
+  char *text;			/* lines, null-terminated */
+  int len;
+  int size;
+  int *line;			/* offsets of each line in 'text' */
+  int nlines;
+  int linesize;
+  pipe_result *res;		/* one per line */
+  int ressize;
+  double *vals;			/* all the stacks */
+  long long *ivals;		/* and their integer lanes */
+  int nvals;
+  int valsize;
+  int ivalsize;
+  int last;			/* no batches follow this one */
+} pipe_batch;
+
+typedef struct {
+  pipe_batch *slot[NBATCH];
+  unsigned long head;		/* next to pop, stored by the consumer */
+  char pad[64];			/* keep head and tail in separate lines */
+  unsigned long tail;		/* next to push, stored by the producer */
+  char pad2[64];
+  int sleepers;			/* threads waiting on 'wake' */
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+} pipe_ring;
+
+typedef struct {
+  DS *ds;
+  FILE *in;
+  int stop;			/* the threads' to give up */
+  int stopfd[2];		/* and a pipe to tell it while it's reading */
+  pipe_ring free;		/* writer to reader */
+  pipe_ring full;		/* reader to evaluator */
+  pipe_ring done;		/* evaluator to writer */
+  pipe_batch batch[NBATCH];
+} pipe_state;
+
+/* sleeps until '*index' isn't 'was', returning true if stopped instead */
+static int ring_wait(pipe_state *p, pipe_ring *ring, unsigned long *index, unsigned long was)
+{
+  int stop;
+
+  pthread_mutex_lock(&ring->lock);
+  __atomic_add_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+  for (;;) {
+    stop = __atomic_load_n(&p->stop, __ATOMIC_ACQUIRE);
+    if (stop || __atomic_load_n(index, __ATOMIC_SEQ_CST) != was) break;
+    pthread_cond_wait(&ring->wake, &ring->lock);
+  }
+  __atomic_sub_fetch(&ring->sleepers, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&ring->lock);
+
+  return stop;
+}
+
+/* after moving an index, wake the other side if it's asleep */
+static void ring_wake(pipe_ring *ring)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (0 != __atomic_load_n(&ring->sleepers, __ATOMIC_RELAXED)) {
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->wake);
+    pthread_mutex_unlock(&ring->lock);
+  }
+}
+
+/* false if the pipeline stopped while the ring was full */
+static int ring_push(pipe_state *p, pipe_ring *ring, pipe_batch *b)
+{
+  unsigned long tail = ring->tail;
+  unsigned long head;
+  int spins = 0;
+
+  while (tail - (head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) == NBATCH) {
+    if (++spins > SPINS && ring_wait(p, ring, &ring->head, head)) return 0;
+  }
+  ring->slot[tail & (NBATCH - 1)] = b;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  ring_wake(ring);
+
+  return 1;
+}
+
+/* NULL if the pipeline stopped while the ring was empty */
+static pipe_batch *ring_pop(pipe_state *p, pipe_ring *ring)
+{
+  unsigned long head = ring->head;
+  pipe_batch *b;
+  int spins = 0;
+
+  while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+    if (++spins > SPINS && ring_wait(p, ring, &ring->tail, head)) return NULL;
+  }
+  b = ring->slot[head & (NBATCH - 1)];
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  ring_wake(ring);
+
+  return b;
+}
+
+static void ring_init(pipe_ring *ring)
+{
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->wake, NULL);
+}
+
+static void ring_destroy(pipe_ring *ring)
+{
+  pthread_mutex_destroy(&ring->lock);
+  pthread_cond_destroy(&ring->wake);
+}
+
+/* tell the threads to give up, whether reading or waiting on a ring */
+static void stop_pipeline(pipe_state *p)
+{
+  __atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+  ring_wake(&p->free);
+  ring_wake(&p->full);
+  ring_wake(&p->done);
+  while (write(p->stopfd[1], "", 1) < 0 && EINTR == errno) ;
+}
+
+/* a read of the input, or 0 as if at its end once we're stopped */
+static ssize_t read_input(pipe_state *p, char *buf, size_t len)
+{
+  struct pollfd fds[2];
+
+  fds[0].fd = fileno(p->in);
+  fds[0].events = POLLIN;
+  fds[1].fd = p->stopfd[0];
+  fds[1].events = POLLIN;
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (EINTR == errno) continue;
+      return -1;
+    }
+    if (0 != fds[1].revents) return 0;
+    if (0 != fds[0].revents) return read(fds[0].fd, buf, len);
+  }
+}
+
+static int grow(void **ptr, int *size, int need, int elsize)
+{
+  void *p;
+  int n;
+
+  if (need <= *size) return 0;
+  n = *size < 16 ? 16 : *size;
+  while (n < need) n *= 2;
+  p = realloc(*ptr, (size_t) n * elsize);
+  if (NULL == p) return -1;
+  *ptr = p;
+  *size = n;
+
+  return 0;
+}
+
+/*
+  Reads big blocks straight into batches, splitting them into
+  null-terminated lines. The partial line at the end of a block is
+  carried over to the start of the next batch.
+*/
+static void *reader(void *arg)
+{
+  pipe_state *p = (pipe_state *) arg;
+  pipe_batch *b;
+  char *carry = NULL;
+  int carrylen = 0, carrysize = 0;
+  char *ptr, *end, *nl;
+  ssize_t n;
+  int eof = 0;
+
+  while (! eof) {
+    b = ring_pop(p, &p->free);
+    if (NULL == b) break;	/* stopped */
+    b->len = 0;
+    b->nlines = 0;
+    b->last = 0;
+    if (0 != grow((void **) &b->text, &b->size, carrylen + BATCHTEXT, 1)) {
+      /* out of memory, so that's the end of it */
+      b->last = 1;
+      ring_push(p, &p->full, b);
+      break;
+    }
+    memcpy(b->text, carry, carrylen);
+    b->len = carrylen;
+    carrylen = 0;
+
+    /* read until we have at least one complete line */
+    for (;;) {
+      n = read_input(p, b->text + b->len, b->size - b->len - 1);
+      if (n <= 0) {
+	eof = 1;
+	break;
+      }
+      nl = memchr(b->text + b->len, '\n', n);
+      b->len += n;
+      if (NULL != nl) break;
+      if (b->len == b->size - 1 &&
+	  0 != grow((void **) &b->text, &b->size, 2 * b->size, 1)) {
+	eof = 1;
+	break;
+      }
+    }
+
+    /* the partial last line waits for the next batch, unless that's it */
+    end = b->text + b->len;
+    if (! eof) {
+      for (nl = end - 1; *nl != '\n'; nl--);
+      carrylen = end - (nl + 1);
+      if (0 != grow((void **) &carry, &carrysize, carrylen, 1)) {
+	carrylen = 0;
+	eof = 1;
+      } else {
+	memcpy(carry, nl + 1, carrylen);
+	end = nl + 1;
+      }
+    }
+    *end = 0;
+
+    for (ptr = b->text; ptr < end; ptr = nl + 1) {
+      if (0 != grow((void **) &b->line, &b->linesize, b->nlines + 1, sizeof(int))) {
+	eof = 1;
+	break;
+      }
+      b->line[b->nlines++] = ptr - b->text;
+      nl = memchr(ptr, '\n', end - ptr);
+      if (NULL == nl) break;	/* last line, with no newline */
+      *nl = 0;
+    }
+
+    b->last = eof;
+    if (! ring_push(p, &p->full, b)) break;
+  }
+
+  free(carry);
+
+  return NULL;
+}
+
+/*
+  Evaluates each line, saving the resulting stack for the writer.
+  A quit makes its batch the last, and the rest of the input is
+  ignored.
+*/
+static void *evaluator(void *arg)
+{
+  pipe_state *p = (pipe_state *) arg;
+  DS *ds = p->ds;
+  pipe_batch *b;
+  pipe_result *r;
+  int last;
+  int t, n;
+
+  do {
+    b = ring_pop(p, &p->full);
+    if (NULL == b) break;
+    last = b->last;
+    if (0 != grow((void **) &b->res, &b->ressize, b->nlines, sizeof(*r))) {
+      b->nlines = 0;
+    }
+    b->nvals = 0;
+    for (t = 0; t < b->nlines; t++) {
+      r = &b->res[t];
+      r->retval = rpncalc_eval(ds, b->text + b->line[t]);
+      r->base = ds_base(ds);
+      r->prec = ds_prec(ds);
+      r->num = ds->next;
+      r->val = b->nvals;
+      if (0 != grow((void **) &b->vals, &b->valsize, b->nvals + ds->next, sizeof(double)) ||
+	  0 != grow((void **) &b->ivals, &b->ivalsize, b->nvals + ds->next, sizeof(long long))) {
+	r->retval = RPN_ERROR;
+	continue;
+      }
+      memcpy(b->vals + b->nvals, ds->stack, ds->next * sizeof(double));
+      r->itag = ds->itag;
+      n = ds->next < DS_INTSIZE ? ds->next : DS_INTSIZE;
+      if (0 != r->itag) memcpy(b->ivals + b->nvals, ds->ival, n * sizeof(long long));
+      b->nvals += ds->next;
+      if (RPN_QUIT == r->retval) {
+	b->nlines = t + 1;
+	b->last = last = 1;
+	break;
+      }
+    }
+    ring_push(p, &p->done, b);
+  } while (! last);
+
+  return NULL;
+}
+
+static void free_state(pipe_state *p)
+{
+  int t;
+
+  for (t = 0; t < NBATCH; t++) {
+    free(p->batch[t].text);
+    free(p->batch[t].line);
+    free(p->batch[t].res);
+    free(p->batch[t].vals);
+    free(p->batch[t].ivals);
+  }
+  ring_destroy(&p->free);
+  ring_destroy(&p->full);
+  ring_destroy(&p->done);
+  close(p->stopfd[0]);
+  close(p->stopfd[1]);
+  free(p);
+}
+
+int rpn_pipeline(DS *ds, FILE *in, FILE *out, void (*help)(FILE *out))
+{
+  pipe_state *p;
+  pthread_t rthread, ethread;
+  pipe_batch *b;
+  pipe_result *r;
+  int retval = RPN_OK;
+  int quit = 0;
+  int last;
+  int t;
+
+  p = (pipe_state *) calloc(1, sizeof(*p));
+  if (NULL == p) return RPN_ERROR;
+  if (0 != pipe(p->stopfd)) {
+    free(p);
+    return RPN_ERROR;
+  }
+  p->ds = ds;
+  p->in = in;
+  ring_init(&p->free);
+  ring_init(&p->full);
+  ring_init(&p->done);
+  for (t = 0; t < NBATCH; t++) {
+    ring_push(p, &p->free, &p->batch[t]);
+  }
+
+  if (0 != pthread_create(&rthread, NULL, reader, p)) {
+    free_state(p);
+    return RPN_ERROR;
+  }
+  if (0 != pthread_create(&ethread, NULL, evaluator, p)) {
+    stop_pipeline(p);
+    pthread_join(rthread, NULL);
+    free_state(p);
+    return RPN_ERROR;
+  }
+
+  do {
+    b = ring_pop(p, &p->done);
+    last = b->last;
+    for (t = 0; t < b->nlines && ! quit; t++) {
+      r = &b->res[t];
+      retval = r->retval;
+      if (RPN_HELP == retval) {
+	if (NULL != help) help(out);
+      } else if (RPN_QUIT == retval) {
+	quit = 1;
+      } else {
+	rpn_print_result(out, retval, b->vals + r->val, b->ivals + r->val,
+			 r->itag, r->num, r->base, r->prec);
+      }
+    }
+    if (! last) ring_push(p, &p->free, b);
+  } while (! last && ! quit);
+  fflush(out);
+
+  /* the reader may be waiting on input that will never come */
+  if (quit) stop_pipeline(p);
+  pthread_join(ethread, NULL);
+  pthread_join(rthread, NULL);
+  free_state(p);
+
+  return retval;
+}
+
+#else  /* no threads, so no pipeline, just the serial loop */
+
+int rpn_pipeline(DS *ds, FILE *in, FILE *out, void (*help)(FILE *out))
+{
+  int retval = RPN_OK;
+  int line;
+
+  while ((line = rpn_eval_line(ds, in)) >= 0) {
+    retval = line;
+    if (RPN_HELP == retval) {
+      if (NULL != help) help(out);
+    } else if (RPN_QUIT == retval) {
+      break;
+    } else {
+      rpn_print_result(out, retval, ds->stack, ds->ival, ds->itag, ds->next, ds_base(ds), ds_prec(ds));
+    }
+  }
+
+  return retval;
+}
+
+#endif	/* HAVE_PTHREAD_H */
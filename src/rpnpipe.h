@@ -0,0 +1,32 @@
+#ifndef RPNPIPE_H
+#define RPNPIPE_H
+
+#include <stdio.h>		/* FILE */
+#include "rpncalc.h"		/* DS */
+
+/*
+  Print the result of evaluating a line the way rpn does, the stack
+  bottom-to-top, or (empty), or error. Slots tagged in 'itag', bit t for
+  slot t, are printed exactly from 'ival', as in the calc's integer
+  lane, which may be NULL if none are. Help and quit are up to the caller.
+ */
+extern void rpn_print_result(FILE *out, int retval, const double *stack, const long long *ival, unsigned long itag, int num, int base, int prec);
+
+/*
+  Read a line of 'in' and evaluate it on the calc a buffer at a time
+  as it's read, so it's never held whole, however long it is. Returns
+  the result of the line, or -1 at the end of the input.
+ */
+extern int rpn_eval_line(DS *ds, FILE *in);
+
+/*
+  Evaluate each line of 'in' on the calc, printing the results to
+  'out' just as the serial loop in rpn would, but with reading,
+  evaluating and printing overlapped on separate threads. Calls 'help'
+  to print help to 'out' for each line asking for it, and stops at the
+  first line that quits. Returns the result of the last line
+  evaluated.
+ */
+extern int rpn_pipeline(DS *ds, FILE *in, FILE *out, void (*help)(FILE *out));
+
+#endif /* RPNPIPE_H */
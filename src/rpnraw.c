@@ -0,0 +1,187 @@
+/*
+  rpnraw.c
+
+  Raw binary float64 input and output, see rpnraw.h. Input is mapped
+  when it's a file, otherwise read in big blocks, and output goes out
+  in big blocks, so there's no per-number conversion or per-row system
+  call, and a program upstream can feed rows at memory bandwidth.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>		/* NAN */
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include "rpncalc.h"
+#include "rpnraw.h"
+
+#ifndef NAN
+#define NAN (0.0/0.0)
+#endif
+
+enum {BLOCKSIZE = 1 << 20};	/* bytes per read and write, roughly */
+
+static int little_endian(void)
+{
+  union {
+    double d;
+    unsigned char c[sizeof(double)];
+  } u;
+
+  u.d = 1.0;			/* 0x3FF0000000000000 */
+
+  return u.c[sizeof(double) - 1] == 0x3F;
+}
+
+static double get_double(const unsigned char *ptr, int swap)
+{
+  unsigned char c[sizeof(double)];
+  double d;
+  size_t t;
+
+  if (swap) {
+    for (t = 0; t < sizeof(double); t++) c[t] = ptr[sizeof(double) - 1 - t];
+    ptr = c;
+  }
+  memcpy(&d, ptr, sizeof(double));
+
+  return d;
+}
+
+static void put_double(unsigned char *ptr, double d, int swap)
+{
+  unsigned char c[sizeof(double)];
+  size_t t;
+
+  memcpy(c, &d, sizeof(double));
+  if (swap) {
+    for (t = 0; t < sizeof(double); t++) ptr[t] = c[sizeof(double) - 1 - t];
+  } else {
+    memcpy(ptr, c, sizeof(double));
+  }
+}
+
+long rpn_raw_rows(DS *ds, const RPN_PROG *prog, int cols, const unsigned char *in, long rows, unsigned char *out)
+{
+  int swap = ! little_endian();
+  long errors = 0;
+  long r;
+  int t;
+
+  for (r = 0; r < rows; r++) {
+    ds_clear(ds);
+    for (t = 0; t < cols; t++, in += sizeof(double)) {
+      ds_push(ds, get_double(in, swap));
+    }
+    if (RPN_OK != rpncalc_run(ds, prog) || ds->next == 0) {
+      put_double(out, NAN, swap);
+      errors++;
+    } else {
+      put_double(out, ds->stack[ds->next - 1], swap);
+    }
+    out += sizeof(double);
+  }
+
+  return errors;
+}
+
+static int write_all(int fd, const unsigned char *ptr, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fd, ptr, len);
+    if (n < 0) {
+      if (EINTR == errno) continue;
+      return RPN_ERROR;
+    }
+    ptr += n, len -= n;
+  }
+
+  return RPN_OK;
+}
+
+/* evaluate a big run of rows a block at a time */
+static int raw_rows(DS *ds, const RPN_PROG *prog, int cols, const unsigned char *in, long rows, unsigned char *out, long outrows, int outfd)
+{
+  long n;
+
+  while (rows > 0) {
+    n = rows < outrows ? rows : outrows;
+    rpn_raw_rows(ds, prog, cols, in, n, out);
+    if (RPN_OK != write_all(outfd, out, n * sizeof(double))) return RPN_ERROR;
+    in += n * cols * sizeof(double);
+    rows -= n;
+  }
+
+  return RPN_OK;
+}
+
+int rpn_raw(DS *ds, const RPN_PROG *prog, int cols, int infd, int outfd)
+{
+  size_t rowsize = cols * sizeof(double);
+  long outrows = BLOCKSIZE / sizeof(double);
+  unsigned char *in, *out;
+  struct stat st;
+  size_t len;
+  size_t n;
+  ssize_t got;
+  int retval;
+
+  if (cols <= 0) return RPN_ERROR;
+
+  out = (unsigned char *) malloc(outrows * sizeof(double));
+  if (NULL == out) return RPN_ERROR;
+
+#if HAVE_SYS_MMAN_H
+  if (0 == fstat(infd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+    in = (unsigned char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, infd, 0);
+    if (MAP_FAILED != in) {
+      madvise(in, st.st_size, MADV_SEQUENTIAL);
+      retval = raw_rows(ds, prog, cols, in, st.st_size / rowsize, out, outrows, outfd);
+      munmap(in, st.st_size);
+      free(out);
+      return retval;
+    }
+  }
+#endif
+
+  /* read whole rows a block at a time, keeping any partial row */
+  len = (BLOCKSIZE / rowsize + 1) * rowsize;
+  in = (unsigned char *) malloc(len);
+  if (NULL == in) {
+    free(out);
+    return RPN_ERROR;
+  }
+  retval = RPN_OK;
+  n = 0;
+  for (;;) {
+    got = read(infd, in + n, len - n);
+    if (got < 0) {
+      if (EINTR == errno) continue;
+      retval = RPN_ERROR;
+      break;
+    }
+    if (got == 0) break;
+    n += got;
+    if (RPN_OK != raw_rows(ds, prog, cols, in, n / rowsize, out, outrows, outfd)) {
+      retval = RPN_ERROR;
+      break;
+    }
+    memmove(in, in + n - n % rowsize, n % rowsize);
+    n %= rowsize;
+  }
+
+  free(in);
+  free(out);
+
+  return retval;
+}
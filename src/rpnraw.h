@@ -0,0 +1,30 @@
+#ifndef RPNRAW_H
+#define RPNRAW_H
+
+#include "rpncalc.h"		/* DS, RPN_PROG */
+
+/*
+  Raw binary records, for passing numbers between programs without
+  formatting and parsing text. Input is rows of 'cols' little-endian
+  IEEE 754 doubles. For each row the stack is cleared, the row is
+  pushed left to right, the program is run, and the top of the stack
+  goes out as one little-endian double, or a NaN if there was an
+  error or nothing left on the stack. Memory and statistics carry
+  over from row to row.
+ */
+
+/*
+  Evaluate 'rows' rows at 'in', putting the results at 'out'.
+  Returns the number of rows in error.
+ */
+extern long rpn_raw_rows(DS *ds, const RPN_PROG *prog, int cols, const unsigned char *in, long rows, unsigned char *out);
+
+/*
+  Evaluate all the rows from file descriptor 'infd', writing results
+  to 'outfd'. Input that's a regular file is mapped rather than read.
+  A partial row at the end is ignored. Returns RPN_OK, or RPN_ERROR
+  on a read or write error.
+ */
+extern int rpn_raw(DS *ds, const RPN_PROG *prog, int cols, int infd, int outfd);
+
+#endif /* RPNRAW_H */
@@ -0,0 +1,481 @@
+/*
+  rpnsheet.c
+
+  Spreadsheet-style recomputation of named formulas, see rpnsheet.h.
+  Each formula is compiled once, with its @name references turned into
+  $n arguments of the program, numbered in order of first appearance,
+  so recomputing a cell is gathering its arguments and running it.
+
+  A change marks its cell and everything downstream of it dirty, by
+  following the edges from each cell to those referring to it. Recalc
+  counts, for each dirty cell, the dirty cells it depends on, and then
+  works in waves: the cells with none left make up a wave, and when a
+  wave is done, its cells' users are counted down, and those reaching
+  zero make up the next. Cells in a wave are independent of each other.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>		/* malloc, realloc, free */
+#include <string.h>		/* strlen, memcpy */
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#include "rpncalc.h"
+#include "rpnsheet.h"
+
+enum {STACKSIZE = 64};		/* for running a formula */
+enum {PARALLEL_MIN = 64};	/* fewest cells in a wave worth threads */
+enum {MAX_THREADS = 64};
+
+#define isnamestart(c) (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || (c) == '_')
+#define isnamechar(c) (isnamestart(c) || ((c) >= '0' && (c) <= '9'))
+
+typedef struct {
+  DS ds;
+  double stack[STACKSIZE];
+  double *args;
+  int argssize;
+} sheet_worker;
+
+static int valid_name(const char *name, int len)
+{
+  int t;
+
+  if (len <= 0 || ! isnamestart(name[0])) return 0;
+  for (t = 1; t < len; t++) {
+    if (! isnamechar(name[t])) return 0;
+  }
+
+  return 1;
+}
+
+static unsigned int hash_name(const char *name, int len)
+{
+  unsigned int h = 2166136261u;	/* FNV-1a */
+  int t;
+
+  for (t = 0; t < len; t++) {
+    h = (h ^ (unsigned char) name[t]) * 16777619u;
+  }
+
+  return h;
+}
+
+static void index_insert(RPN_SHEET *sheet, int i)
+{
+  RPN_CELL *c = &sheet->cell[i];
+  unsigned int mask = sheet->indexsize - 1;
+  unsigned int h;
+
+  for (h = hash_name(c->name, strlen(c->name)) & mask;
+       0 != sheet->index[h];
+       h = (h + 1) & mask) ;
+  sheet->index[h] = i + 1;
+}
+
+static int grow_int(int **arr, int *size, int need)
+{
+  int *a;
+  int n;
+
+  if (need <= *size) return RPN_OK;
+  n = *size < 4 ? 4 : 2 * *size;
+  if (n < need) n = need;
+  a = (int *) realloc(*arr, n * sizeof(int));
+  if (NULL == a) return RPN_ERROR;
+  *arr = a;
+  *size = n;
+
+  return RPN_OK;
+}
+
+/* make a new, undefined cell, returning its index, or -1 */
+static int add_cell(RPN_SHEET *sheet, const char *name, int len)
+{
+  RPN_CELL *c;
+  int size, t;
+  int *a;
+
+  if (sheet->num == sheet->size) {
+    size = sheet->size < 16 ? 16 : 2 * sheet->size;
+    c = (RPN_CELL *) realloc(sheet->cell, size * sizeof(RPN_CELL));
+    if (NULL == c) return -1;
+    sheet->cell = c;
+    a = (int *) realloc(sheet->dirty, size * sizeof(int));
+    if (NULL == a) return -1;
+    sheet->dirty = a;
+    a = (int *) realloc(sheet->order, size * sizeof(int));
+    if (NULL == a) return -1;
+    sheet->order = a;
+    sheet->size = size;
+  }
+  if (2 * (sheet->num + 1) > sheet->indexsize) {
+    size = sheet->indexsize < 32 ? 32 : 2 * sheet->indexsize;
+    a = (int *) calloc(size, sizeof(int));
+    if (NULL == a) return -1;
+    free(sheet->index);
+    sheet->index = a;
+    sheet->indexsize = size;
+    for (t = 0; t < sheet->num; t++) index_insert(sheet, t);
+  }
+
+  c = &sheet->cell[sheet->num];
+  memset(c, 0, sizeof(*c));
+  c->name = (char *) malloc(len + 1);
+  if (NULL == c->name) return -1;
+  memcpy(c->name, name, len);
+  c->name[len] = 0;
+  rpn_prog_init(&c->prog);
+  c->status = RPN_ERROR;	/* until it's defined */
+  index_insert(sheet, sheet->num);
+
+  return sheet->num++;
+}
+
+int rpn_sheet_init(RPN_SHEET *sheet, int threads)
+{
+  memset(sheet, 0, sizeof(*sheet));
+  sheet->threads = threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+
+  return RPN_OK;
+}
+
+void rpn_sheet_free(RPN_SHEET *sheet)
+{
+  RPN_CELL *c;
+  int t;
+
+  for (t = 0; t < sheet->num; t++) {
+    c = &sheet->cell[t];
+    free(c->name);
+    free(c->formula);
+    rpn_prog_free(&c->prog);
+    free(c->deps);
+    free(c->users);
+  }
+  free(sheet->cell);
+  free(sheet->index);
+  free(sheet->dirty);
+  free(sheet->order);
+  memset(sheet, 0, sizeof(*sheet));
+}
+
+int rpn_sheet_find(const RPN_SHEET *sheet, const char *name, int len)
+{
+  unsigned int mask;
+  unsigned int h;
+  const RPN_CELL *c;
+
+  if (0 == sheet->indexsize) return -1;
+  mask = sheet->indexsize - 1;
+  for (h = hash_name(name, len) & mask;
+       0 != sheet->index[h];
+       h = (h + 1) & mask) {
+    c = &sheet->cell[sheet->index[h] - 1];
+    if (0 == strncmp(c->name, name, len) && 0 == c->name[len]) {
+      return sheet->index[h] - 1;
+    }
+  }
+
+  return -1;
+}
+
+int rpn_sheet_get(const RPN_SHEET *sheet, const char *name, double *value)
+{
+  int i = rpn_sheet_find(sheet, name, strlen(name));
+
+  if (i < 0) return RPN_ERROR;
+  *value = sheet->cell[i].value;
+
+  return sheet->cell[i].status;
+}
+
+/* does cell 'i' reach any of 'deps' by way of its users? */
+static int makes_cycle(RPN_SHEET *sheet, int i, const int *deps, int ndeps)
+{
+  char *mark;
+  int *todo;
+  int ntodo = 0;
+  int cycle = 0;
+  RPN_CELL *c;
+  int t;
+
+  mark = (char *) calloc(sheet->num, 1);
+  todo = (int *) malloc(sheet->num * sizeof(int));
+  if (NULL == mark || NULL == todo) {
+    free(mark);
+    free(todo);
+    return 1;
+  }
+  for (t = 0; t < ndeps; t++) mark[deps[t]] = 1;
+
+  if (1 == mark[i]) cycle = 1;	/* refers to itself */
+  mark[i] = 2;
+  todo[ntodo++] = i;
+  while (ntodo > 0 && ! cycle) {
+    c = &sheet->cell[todo[--ntodo]];
+    for (t = 0; t < c->nusers; t++) {
+      i = c->users[t];
+      if (1 == mark[i]) cycle = 1;
+      if (2 != mark[i]) {
+	mark[i] = 2;
+	todo[ntodo++] = i;
+      }
+    }
+  }
+
+  free(mark);
+  free(todo);
+
+  return cycle;
+}
+
+static void mark_dirty(RPN_SHEET *sheet, int i)
+{
+  RPN_CELL *c;
+  int from = sheet->ndirty;
+  int t;
+
+  if (sheet->cell[i].dirty) return;
+  sheet->cell[i].dirty = 1;
+  sheet->dirty[sheet->ndirty++] = i;
+
+  /* the dirty list doubles as the queue */
+  while (from < sheet->ndirty) {
+    c = &sheet->cell[sheet->dirty[from++]];
+    for (t = 0; t < c->nusers; t++) {
+      i = c->users[t];
+      if (! sheet->cell[i].dirty) {
+	sheet->cell[i].dirty = 1;
+	sheet->dirty[sheet->ndirty++] = i;
+      }
+    }
+  }
+}
+
+static void remove_user(RPN_CELL *c, int user)
+{
+  int t;
+
+  for (t = 0; t < c->nusers; t++) {
+    if (c->users[t] == user) {
+      c->users[t] = c->users[--c->nusers];
+      return;
+    }
+  }
+}
+
+int rpn_sheet_set(RPN_SHEET *sheet, const char *name, const char *formula)
+{
+  DS ds;
+  double stack[1];
+  RPN_PROG prog;
+  RPN_TOKEN *tok;
+  RPN_CELL *c;
+  char *text;
+  int *deps = NULL;
+  int ndeps = 0;
+  int i, d, k, t;
+
+  if (! valid_name(name, strlen(name))) return RPN_ERROR;
+  i = rpn_sheet_find(sheet, name, strlen(name));
+  if (i < 0 && (i = add_cell(sheet, name, strlen(name))) < 0) return RPN_ERROR;
+
+  /* the text must outlive the program, so it's the cell's copy */
+  text = (char *) malloc(strlen(formula) + 1);
+  if (NULL == text) return RPN_ERROR;
+  strcpy(text, formula);
+  ds_init(&ds, stack, 1);
+  rpn_prog_init(&prog);
+  if (RPN_OK != rpncalc_compile(&ds, text, &prog) ||
+      (prog.num > 0 && NULL == (deps = (int *) malloc(prog.num * sizeof(int))))) {
+    goto fail;
+  }
+
+  /* turn references into arguments, one per cell referred to */
+  for (t = 0; t < prog.num; t++) {
+    tok = &prog.tok[t];
+    if (tok->arg > 0) goto fail; /* $n isn't for sheets */
+    if ('@' != tok->text[0]) continue;
+    if (! valid_name(tok->text + 1, tok->len - 1)) goto fail;
+    d = rpn_sheet_find(sheet, tok->text + 1, tok->len - 1);
+    if (d < 0 && (d = add_cell(sheet, tok->text + 1, tok->len - 1)) < 0) goto fail;
+    for (k = 0; k < ndeps && deps[k] != d; k++) ;
+    if (k == ndeps) deps[ndeps++] = d;
+    tok->arg = k + 1;
+  }
+  prog.nargs = ndeps;
+  if (makes_cycle(sheet, i, deps, ndeps)) goto fail;
+
+  /* make room for the new edges first, so nothing's left half done */
+  for (t = 0; t < ndeps; t++) {
+    c = &sheet->cell[deps[t]];
+    if (RPN_OK != grow_int(&c->users, &c->userssize, c->nusers + 1)) goto fail;
+  }
+
+  /* replace the old definition and its edges with the new */
+  c = &sheet->cell[i];
+  for (t = 0; t < c->ndeps; t++) remove_user(&sheet->cell[c->deps[t]], i);
+  for (t = 0; t < ndeps; t++) {
+    c = &sheet->cell[deps[t]];
+    c->users[c->nusers++] = i;
+  }
+  c = &sheet->cell[i];
+  free(c->formula);
+  rpn_prog_free(&c->prog);
+  free(c->deps);
+  c->formula = text;
+  c->prog = prog;
+  c->deps = deps;
+  c->ndeps = ndeps;
+  mark_dirty(sheet, i);
+
+  return RPN_OK;
+
+ fail:
+  rpn_prog_free(&prog);
+  free(text);
+  free(deps);
+  return RPN_ERROR;
+}
+
+static void compute_cell(RPN_SHEET *sheet, int i, sheet_worker *w)
+{
+  RPN_CELL *c = &sheet->cell[i];
+  RPN_CELL *d;
+  double *args;
+  int t;
+
+  c->status = RPN_ERROR;
+  if (NULL == c->formula) return;
+  if (c->ndeps > w->argssize) {
+    args = (double *) realloc(w->args, c->ndeps * sizeof(double));
+    if (NULL == args) return;
+    w->args = args;
+    w->argssize = c->ndeps;
+  }
+  for (t = 0; t < c->ndeps; t++) {
+    d = &sheet->cell[c->deps[t]];
+    if (RPN_OK != d->status) return;
+    w->args[t] = d->value;
+  }
+
+  ds_reset(&w->ds);
+  if (RPN_OK == rpncalc_run_args(&w->ds, &c->prog, w->args, c->ndeps) &&
+      w->ds.next > 0) {
+    c->value = w->ds.stack[w->ds.next - 1];
+    c->status = RPN_OK;
+  }
+}
+
+static void worker_init(sheet_worker *w)
+{
+  ds_init(&w->ds, w->stack, STACKSIZE);
+  w->args = NULL;
+  w->argssize = 0;
+}
+
+#if HAVE_PTHREAD_H
+
+typedef struct {
+  RPN_SHEET *sheet;
+  const int *wave;
+  int num;
+  int next;			/* next in the wave to take */
+} sheet_wave;
+
+static void *wave_worker(void *arg)
+{
+  sheet_wave *v = (sheet_wave *) arg;
+  sheet_worker w;
+  int t;
+
+  worker_init(&w);
+  while ((t = __atomic_fetch_add(&v->next, 1, __ATOMIC_RELAXED)) < v->num) {
+    compute_cell(v->sheet, v->wave[t], &w);
+  }
+  free(w.args);
+  ds_free(&w.ds);
+
+  return NULL;
+}
+
+/* compute a wave of independent cells on the sheet's threads */
+static void compute_wave(RPN_SHEET *sheet, const int *wave, int num)
+{
+  pthread_t tid[MAX_THREADS];
+  sheet_wave v;
+  int threads;
+  int t;
+
+  v.sheet = sheet;
+  v.wave = wave;
+  v.num = num;
+  v.next = 0;
+  for (threads = 0; threads < sheet->threads - 1; threads++) {
+    if (0 != pthread_create(&tid[threads], NULL, wave_worker, &v)) break;
+  }
+  wave_worker(&v);
+  for (t = 0; t < threads; t++) {
+    pthread_join(tid[t], NULL);
+  }
+}
+
+#endif	/* HAVE_PTHREAD_H */
+
+int rpn_sheet_recalc(RPN_SHEET *sheet)
+{
+  sheet_worker w;
+  RPN_CELL *c;
+  int start, end;
+  int i, t, u;
+
+  sheet->norder = 0;
+  if (0 == sheet->ndirty) return 0;
+
+  /* count what each dirty cell waits on; those with nothing go first */
+  for (t = 0; t < sheet->ndirty; t++) {
+    c = &sheet->cell[sheet->dirty[t]];
+    c->pending = 0;
+    for (u = 0; u < c->ndeps; u++) {
+      if (sheet->cell[c->deps[u]].dirty) c->pending++;
+    }
+    if (0 == c->pending) sheet->order[sheet->norder++] = sheet->dirty[t];
+  }
+
+  worker_init(&w);
+  for (start = 0; start < sheet->norder; start = end) {
+    end = sheet->norder;
+#if HAVE_PTHREAD_H
+    if (sheet->threads > 1 && end - start >= PARALLEL_MIN) {
+      compute_wave(sheet, sheet->order + start, end - start);
+    } else
+#endif
+    {
+      for (t = start; t < end; t++) compute_cell(sheet, sheet->order[t], &w);
+    }
+
+    /* the next wave is the users with nothing left to wait on */
+    for (t = start; t < end; t++) {
+      c = &sheet->cell[sheet->order[t]];
+      for (u = 0; u < c->nusers; u++) {
+	i = c->users[u];
+	if (sheet->cell[i].dirty && 0 == --sheet->cell[i].pending) {
+	  sheet->order[sheet->norder++] = i;
+	}
+      }
+    }
+  }
+  free(w.args);
+  ds_free(&w.ds);
+
+  for (t = 0; t < sheet->ndirty; t++) {
+    sheet->cell[sheet->dirty[t]].dirty = 0;
+  }
+  sheet->ndirty = 0;
+
+  return sheet->norder;
+}
@@ -0,0 +1,76 @@
+#ifndef RPNSHEET_H
+#define RPNSHEET_H
+
+#include "rpncalc.h"		/* RPN_PROG */
+
+/*
+  A sheet of named cells, each holding an RPN formula that may refer
+  to other cells as @name, e.g., "area = @width @height *". References
+  are found when a formula is compiled and make a dependency graph, so
+  that when a cell changes, only the cells downstream of it are marked
+  dirty, and only those are recomputed, in dependency order, by
+  rpn_sheet_recalc(). Cells at the same depth don't depend on each
+  other, so with threads, big sets of them are recomputed in parallel.
+
+  A cell that's referred to before it's defined is an error until it
+  is, as is any cell that depends on a cell in error. A definition that
+  would make a cycle is refused.
+ */
+
+typedef struct {
+  char *name;
+  char *formula;		/* NULL until defined */
+  RPN_PROG prog;
+  double value;
+  int status;			/* RPN_OK or RPN_ERROR */
+  int *deps;			/* cells referred to, in $n order */
+  int ndeps;
+  int *users;			/* cells referring to this one */
+  int nusers;
+  int userssize;
+  int dirty;			/* needs recomputing */
+  int pending;			/* dirty cells it's waiting on */
+} RPN_CELL;
+
+typedef struct {
+  RPN_CELL *cell;
+  int num;			/* cells in the sheet */
+  int size;			/* cells allocated */
+  int *index;			/* hash of names to cell + 1, 0 if empty */
+  int indexsize;		/* a power of 2 */
+  int *dirty;			/* cells to recompute */
+  int ndirty;
+  int *order;			/* cells recomputed last, in order */
+  int norder;
+  int threads;			/* for recomputing, 1 for none */
+} RPN_SHEET;
+
+extern int rpn_sheet_init(RPN_SHEET *sheet, int threads);
+extern void rpn_sheet_free(RPN_SHEET *sheet);
+
+/*
+  Define or redefine a cell, marking it and everything that depends
+  on it dirty. Nothing is computed until rpn_sheet_recalc(). Returns
+  RPN_ERROR for a bad name or formula, or a cycle, leaving the cell
+  as it was.
+ */
+extern int rpn_sheet_set(RPN_SHEET *sheet, const char *name, const char *formula);
+
+/*
+  Recompute the dirty cells, returning how many. Their indices are
+  left in sheet->order, in the order they were finished.
+ */
+extern int rpn_sheet_recalc(RPN_SHEET *sheet);
+
+/*
+  Look up a cell by name, returning its index, or -1 if there's none.
+ */
+extern int rpn_sheet_find(const RPN_SHEET *sheet, const char *name, int len);
+
+/*
+  Get the value of a cell as of the last recalc, returning its status,
+  or RPN_ERROR if there's no such cell.
+ */
+extern int rpn_sheet_get(const RPN_SHEET *sheet, const char *name, double *value);
+
+#endif /* RPNSHEET_H */
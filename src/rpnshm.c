@@ -0,0 +1,340 @@
+/*
+  rpnshm.c
+
+  Statistics registers in POSIX shared memory, see rpnshm.h. Each
+  slot is a seqlock with one writer, its calc: the sequence number is
+  odd while the sums change, and a reader copies the sums between two
+  reads of the same even number. Slot 'gone' holds the sums of calcs
+  that have left, and since moving a slot into it is the one change
+  that touches two slots, a reader of all of them also rereads gone's
+  number, and starts over if a move came in between. Its owner word
+  is the lock that moves take, being the one thing with many writers.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#if HAVE_SYS_MMAN_H
+#include <fcntl.h>		/* O_CREAT, ... */
+#include <sched.h>		/* sched_yield */
+#include <signal.h>		/* kill */
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "rpncalc.h"
+#include "rpnshm.h"
+
+enum {LINE = 64};		/* bytes in a cache line */
+enum {SPINS = 4096};		/* waits on a writer before giving up */
+enum {NAMEMAX = 255};
+enum {SHM_VERSION = 1};
+
+typedef struct {
+  unsigned seq;			/* odd while the sums are changing */
+  int owner;			/* pid of the process it's claimed by, 0 if free */
+  DS_STATS sums;
+  char pad[LINE - 2 * sizeof(int) - sizeof(DS_STATS)];
+} SLOT;
+
+typedef struct {
+  char magic[4];		/* "RPNm" */
+  int version;			/* SHM_VERSION, 0 until the creator has set it up */
+  int slots;			/* RPN_SHM_SLOTS */
+  char pad[LINE - 4 - 2 * sizeof(int)];
+  SLOT gone;			/* departed calcs, its owner the lock on it */
+  SLOT slot[RPN_SHM_SLOTS];
+} SEGMENT;
+
+struct rpn_shm_stats {
+  SEGMENT *seg;
+  SLOT *slot;			/* the calc's own */
+};
+
+static void yield(int tries)
+{
+#if HAVE_SYS_MMAN_H
+  if (tries > 64) sched_yield();
+#endif
+}
+
+static void begin(SLOT *s)
+{
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void end(SLOT *s)
+{
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* the sequence number once even, or odd if its writer seems stuck */
+static unsigned steady(const unsigned *seq)
+{
+  unsigned s;
+  int tries = 0;
+
+  while (((s = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) && tries++ < SPINS) {
+    yield(tries);
+  }
+
+  return s;
+}
+
+static void read_slot(const SLOT *s, DS_STATS *st)
+{
+  unsigned seq;
+  int tries = 0;
+
+  do {
+    seq = steady(&s->seq);
+    memcpy(st, &s->sums, sizeof(DS_STATS));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (seq != __atomic_load_n(&s->seq, __ATOMIC_RELAXED) && tries++ < SPINS);
+}
+
+static void add(DS_STATS *st, const DS_STATS *from)
+{
+  st->sumx += from->sumx;
+  st->sumy += from->sumy;
+  st->sumxx += from->sumxx;
+  st->sumyy += from->sumyy;
+  st->sumxy += from->sumxy;
+  st->n += from->n;
+}
+
+void rpn_shm_stats_begin(RPN_SHM_STATS *shm)
+{
+  begin(shm->slot);
+}
+
+void rpn_shm_stats_end(RPN_SHM_STATS *shm)
+{
+  end(shm->slot);
+}
+
+void rpn_shm_stats_sum(const RPN_SHM_STATS *shm, DS_STATS *sum)
+{
+  const SEGMENT *seg = shm->seg;
+  DS_STATS part;
+  unsigned moves;
+  int tries = 0;
+  int t;
+
+  do {
+    moves = steady(&seg->gone.seq);
+    read_slot(&seg->gone, sum);
+    for (t = 0; t < RPN_SHM_SLOTS; t++) {
+      /* free slots are all 0 */
+      if (0 == __atomic_load_n(&seg->slot[t].owner, __ATOMIC_RELAXED)) continue;
+      read_slot(&seg->slot[t], &part);
+      add(sum, &part);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (moves != __atomic_load_n(&seg->gone.seq, __ATOMIC_RELAXED) && tries++ < SPINS);
+}
+
+#if HAVE_SYS_MMAN_H
+
+static int dead(int pid)
+{
+  return pid > 0 && -1 == kill(pid, 0) && ESRCH == errno;
+}
+
+/* the sums of slot 's' moved into gone, leaving it 0 */
+static void retire(SEGMENT *seg, SLOT *s)
+{
+  int me = getpid();
+  int owner;
+  int tries = 0;
+
+  for (;;) {
+    owner = 0;
+    if (__atomic_compare_exchange_n(&seg->gone.owner, &owner, me, 0,
+				    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) break;
+    /* a process that died holding it */
+    if (dead(owner) &&
+	__atomic_compare_exchange_n(&seg->gone.owner, &owner, me, 0,
+				    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      if (seg->gone.seq & 1) end(&seg->gone);
+      break;
+    }
+    yield(++tries);
+  }
+
+  /* a slot taken over from a process that died changing it */
+  if (s->seq & 1) end(s);
+  begin(&seg->gone);
+  begin(s);
+  add(&seg->gone.sums, &s->sums);
+  memset(&s->sums, 0, sizeof(DS_STATS));
+  end(s);
+  end(&seg->gone);
+
+  __atomic_store_n(&seg->gone.owner, 0, __ATOMIC_RELEASE);
+}
+
+/* a free slot, or failing that one whose process has died */
+static SLOT *claim(SEGMENT *seg)
+{
+  int me = getpid();
+  int owner;
+  int t;
+
+  for (t = 0; t < RPN_SHM_SLOTS; t++) {
+    owner = 0;
+    if (__atomic_compare_exchange_n(&seg->slot[t].owner, &owner, me, 0,
+				    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      return &seg->slot[t];
+    }
+  }
+  for (t = 0; t < RPN_SHM_SLOTS; t++) {
+    owner = __atomic_load_n(&seg->slot[t].owner, __ATOMIC_RELAXED);
+    if (owner != me && dead(owner) &&
+	__atomic_compare_exchange_n(&seg->slot[t].owner, &owner, me, 0,
+				    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      retire(seg, &seg->slot[t]);
+      return &seg->slot[t];
+    }
+  }
+
+  return NULL;
+}
+
+static const char *shm_name(char *path, const char *name)
+{
+  if ('/' == name[0]) return name;
+  if (strlen(name) + 1 > NAMEMAX) return NULL;
+  path[0] = '/';
+  strcpy(path + 1, name);
+
+  return path;
+}
+
+/* the segment, created if it isn't there, NULL on an error */
+static SEGMENT *map(const char *name)
+{
+  char path[NAMEMAX + 1];
+  struct stat st;
+  SEGMENT *seg;
+  int created = 1;
+  int tries;
+  int fd;
+
+  if (NULL == (name = shm_name(path, name))) return NULL;
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && EEXIST == errno) {
+    created = 0;
+    fd = shm_open(name, O_RDWR, 0);
+  }
+  if (fd < 0) return NULL;
+  if (created && 0 != ftruncate(fd, sizeof(SEGMENT))) {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  /* another process may have created it and not yet sized it */
+  for (tries = 0; ; tries++) {
+    if (0 != fstat(fd, &st) || tries > SPINS) {
+      close(fd);
+      return NULL;
+    }
+    if (st.st_size != 0) break;
+    yield(tries);
+  }
+  if (st.st_size != sizeof(SEGMENT)) {
+    close(fd);
+    return NULL;
+  }
+
+  seg = (SEGMENT *) mmap(NULL, sizeof(SEGMENT), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (MAP_FAILED == seg) return NULL;
+
+  if (created) {
+    memcpy(seg->magic, "RPNm", 4);
+    seg->slots = RPN_SHM_SLOTS;
+    __atomic_store_n(&seg->version, SHM_VERSION, __ATOMIC_RELEASE);
+    return seg;
+  }
+
+  for (tries = 0; 0 == __atomic_load_n(&seg->version, __ATOMIC_ACQUIRE) && tries < SPINS; tries++) {
+    yield(tries);
+  }
+  if (memcmp(seg->magic, "RPNm", 4) || SHM_VERSION != seg->version ||
+      RPN_SHM_SLOTS != seg->slots) {
+    munmap(seg, sizeof(SEGMENT));
+    return NULL;
+  }
+
+  return seg;
+}
+
+int rpn_shm_stats_bind(DS *ds, const char *name)
+{
+  RPN_SHM_STATS *shm;
+
+  if (NULL != ds->shared) return RPN_ERROR;
+  shm = (RPN_SHM_STATS *) malloc(sizeof(RPN_SHM_STATS));
+  if (NULL == shm) return RPN_ERROR;
+  if (NULL == (shm->seg = map(name))) {
+    free(shm);
+    return RPN_ERROR;
+  }
+  if (NULL == (shm->slot = claim(shm->seg))) {
+    munmap(shm->seg, sizeof(SEGMENT));
+    free(shm);
+    return RPN_ERROR;
+  }
+  ds_share_stats(ds, &shm->slot->sums, shm);
+
+  return RPN_OK;
+}
+
+void rpn_shm_stats_unbind(DS *ds)
+{
+  RPN_SHM_STATS *shm = ds->shared;
+
+  if (NULL == shm) return;
+  ds_share_stats(ds, NULL, NULL);
+  /* not in a child that inherited it, where the slot is the parent's */
+  if (getpid() == __atomic_load_n(&shm->slot->owner, __ATOMIC_RELAXED)) {
+    retire(shm->seg, shm->slot);
+    __atomic_store_n(&shm->slot->owner, 0, __ATOMIC_RELEASE);
+  }
+  munmap(shm->seg, sizeof(SEGMENT));
+  free(shm);
+}
+
+int rpn_shm_stats_unlink(const char *name)
+{
+  char path[NAMEMAX + 1];
+
+  if (NULL == (name = shm_name(path, name))) return RPN_ERROR;
+
+  return 0 == shm_unlink(name) ? RPN_OK : RPN_ERROR;
+}
+
+#else
+
+int rpn_shm_stats_bind(DS *ds, const char *name)
+{
+  return RPN_ERROR;
+}
+
+void rpn_shm_stats_unbind(DS *ds)
+{
+}
+
+int rpn_shm_stats_unlink(const char *name)
+{
+  return RPN_ERROR;
+}
+
+#endif	/* HAVE_SYS_MMAN_H */
@@ -0,0 +1,67 @@
+#ifndef RPNSHM_H
+#define RPNSHM_H
+
+#include "rpncalc.h"		/* DS, DS_STATS, RPN_OK, RPN_ERROR */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Statistics registers shared by calcs in any number of processes,
+  through a named POSIX shared memory segment, so producers that each
+  stat their slice of the data have n, sx, ..., mx, sdx, a, b and r of
+  all of it, live, rather than printing their sums to be added later.
+
+  The segment is RPN_SHM_SLOTS slots of a cache line each. A calc
+  bound to it claims a slot of its own, and its stat and xstat add to
+  that slot alone, so producers never write the same line and never
+  take a lock: a slot's only writer bumps its sequence number before
+  and after changing it, and readers retry a slot that was changing
+  under them. Reading a register sums all the slots in use, which is
+  O(slots) against stat's O(1), so it's for the occasional query, not
+  a tight loop. ac clears a calc's own points, not the others'.
+
+  A calc that unbinds, or is freed, adds its slot into the segment's
+  total of departed calcs, so its points stay counted, and gives the
+  slot back. The slots of processes that died bound are counted as
+  they stand, and taken over, their sums likewise kept, when no slot
+  is free. A calc bound before a fork() stays the parent's: a child
+  can unbind or free its copy, which leaves the slot alone, but has to
+  bind a calc of its own to add points.
+
+  The segment lasts until rpn_shm_stats_unlink(), or a reboot. Names
+  are as for shm_open(), with the leading '/' optional. Where there's
+  no shm_open(), binding is an error.
+ */
+
+enum {RPN_SHM_SLOTS = 256};
+
+typedef struct rpn_shm_stats RPN_SHM_STATS;
+
+/*
+  Binds the calc's statistics registers to segment 'name', creating
+  it if need be, with the points the calc has so far added in. An
+  error if the calc is already bound, the segment isn't one of ours,
+  or all its slots are held by live processes.
+ */
+extern int rpn_shm_stats_bind(DS *ds, const char *name);
+
+/* back to registers of its own, empty; nothing if it isn't bound */
+extern void rpn_shm_stats_unbind(DS *ds);
+
+/* removes the name; bound calcs keep the segment until they unbind */
+extern int rpn_shm_stats_unlink(const char *name);
+
+/* for rpncalc.c: around changes to the calc's slot */
+extern void rpn_shm_stats_begin(RPN_SHM_STATS *shm);
+extern void rpn_shm_stats_end(RPN_SHM_STATS *shm);
+
+/* for rpncalc.c: the registers of all the calcs, into 'sum' */
+extern void rpn_shm_stats_sum(const RPN_SHM_STATS *shm, DS_STATS *sum);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RPNSHM_H */
@@ -0,0 +1,103 @@
+/*
+  rpnslab.c
+
+  Pools of same-sized objects, see rpnslab.h. A new slab's first
+  object-sized piece links it to the others, and the rest are handed
+  out in order, with freed objects coming back through the free list
+  first.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>		/* malloc, free */
+#include "rpnslab.h"
+
+#if HAVE_PTHREAD_H
+#define LOCK(slab) pthread_mutex_lock(&(slab)->lock)
+#define UNLOCK(slab) pthread_mutex_unlock(&(slab)->lock)
+#else
+#define LOCK(slab)
+#define UNLOCK(slab)
+#endif
+
+void rpn_slab_init(RPN_SLAB *slab, size_t size)
+{
+  slab->size = RPN_SLAB_ROUND(size);
+  slab->free = slab->slabs = NULL;
+  slab->fresh = slab->end = NULL;
+  slab->live = slab->nslabs = 0;
+#if HAVE_PTHREAD_H
+  pthread_mutex_init(&slab->lock, NULL);
+#endif
+}
+
+void rpn_slab_destroy(RPN_SLAB *slab)
+{
+  void *s, *next;
+
+  for (s = slab->slabs; NULL != s; s = next) {
+    next = *(void **) s;
+    free(s);
+  }
+  slab->free = slab->slabs = NULL;
+  slab->fresh = slab->end = NULL;
+  slab->live = slab->nslabs = 0;
+#if HAVE_PTHREAD_H
+  pthread_mutex_destroy(&slab->lock);
+#endif
+}
+
+void *rpn_slab_alloc(RPN_SLAB *slab)
+{
+  char *s;
+  void *p;
+
+  LOCK(slab);
+  if (NULL != slab->free) {
+    p = slab->free;
+    slab->free = *(void **) p;
+  } else {
+    if (slab->fresh == slab->end) {
+      s = (char *) malloc(RPN_SLAB_SIZE);
+      if (NULL == s) {
+	UNLOCK(slab);
+	return NULL;
+      }
+      *(void **) s = slab->slabs;
+      slab->slabs = s;
+      slab->nslabs++;
+      slab->fresh = s + slab->size;
+      slab->end = s + (RPN_SLAB_SIZE / slab->size) * slab->size;
+    }
+    p = slab->fresh;
+    slab->fresh += slab->size;
+  }
+  slab->live++;
+  UNLOCK(slab);
+
+  return p;
+}
+
+void rpn_slab_free(RPN_SLAB *slab, void *p)
+{
+  if (NULL == p) return;
+
+  LOCK(slab);
+  *(void **) p = slab->free;
+  slab->free = p;
+  slab->live--;
+  UNLOCK(slab);
+}
+
+size_t rpn_slab_bytes(RPN_SLAB *slab)
+{
+  size_t bytes;
+
+  LOCK(slab);
+  bytes = (size_t) slab->nslabs * RPN_SLAB_SIZE;
+  UNLOCK(slab);
+
+  return bytes;
+}
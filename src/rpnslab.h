@@ -0,0 +1,58 @@
+#ifndef RPNSLAB_H
+#define RPNSLAB_H
+
+#include <stddef.h>		/* size_t */
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+  A pool of same-sized objects, carved from slabs of RPN_SLAB_SIZE
+  bytes, and kept on a free list when they're freed rather than given
+  back, so a million small allocations cost a few thousand mallocs
+  and no per-object header. Thread safe where there are pthreads.
+  Slabs are only ever freed by rpn_slab_destroy().
+
+  Declare one statically with RPN_SLAB_INITIALIZER(size), or set one
+  up with rpn_slab_init().
+ */
+
+enum {RPN_SLAB_SIZE = 65536};
+
+typedef struct {
+  size_t size;			/* of an object, rounded up */
+  void *free;			/* free objects, linked through their first word */
+  void *slabs;			/* all slabs, likewise */
+  char *fresh;			/* never used objects in the newest slab */
+  char *end;			/* and the end of it */
+  long live;			/* objects handed out */
+  long nslabs;
+#if HAVE_PTHREAD_H
+  pthread_mutex_t lock;
+#endif
+} RPN_SLAB;
+
+/* room for the link, and aligned for anything, e.g., doubles */
+#define RPN_SLAB_ROUND(size) (((size) + 15) / 16 * 16)
+
+#if HAVE_PTHREAD_H
+#define RPN_SLAB_INITIALIZER(size) {RPN_SLAB_ROUND(size), NULL, NULL, NULL, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER}
+#else
+#define RPN_SLAB_INITIALIZER(size) {RPN_SLAB_ROUND(size), NULL, NULL, NULL, NULL, 0, 0}
+#endif
+
+extern void rpn_slab_init(RPN_SLAB *slab, size_t size);
+extern void rpn_slab_destroy(RPN_SLAB *slab);
+
+/*
+  An object, uninitialized, or NULL if out of memory.
+ */
+extern void *rpn_slab_alloc(RPN_SLAB *slab);
+extern void rpn_slab_free(RPN_SLAB *slab, void *p);
+
+/*
+  Bytes held in slabs, in use or not.
+ */
+extern size_t rpn_slab_bytes(RPN_SLAB *slab);
+
+#endif /* RPNSLAB_H */
@@ -0,0 +1,253 @@
+/*
+  rpnxform.c
+
+  Coordinate conversions and transforms of arrays of points, see
+  rpnxform.h. Each is done a block at a time, into arrays of the
+  block on the stack, and copied out at the end of the block, so the
+  outputs can be the inputs without the compiler having to assume
+  they might overlap somewhere else and give up on vectorizing.
+*/
+
+#include <math.h>		/* sqrt, sin, cos */
+#include <string.h>		/* memcpy */
+#include "rpncalc.h"
+#include "rpnfast.h"		/* rpn_fast_sincos_n, rpn_fast_atan2_n */
+#include "rpnxform.h"
+
+enum {BLOCK = 256};
+
+#define TODEG 57.295779513082320875
+#define TORAD 0.017453292519943295770
+
+/* the block's angles in radians, for sincos */
+static const double *radians(double *a, const double *theta, int n, int degrees)
+{
+  int t;
+
+  if (! degrees) return theta;
+  for (t = 0; t < n; t++) a[t] = theta[t] * TORAD;
+
+  return a;
+}
+
+void rpn_polar_to_xy_n(double *x, double *y, const double *r, const double *theta,
+		       int n, int degrees)
+{
+  double a[BLOCK], s[BLOCK], c[BLOCK];
+  int i, nb, t;
+
+  for (i = 0; i < n; i += nb) {
+    nb = n - i < BLOCK ? n - i : BLOCK;
+    rpn_fast_sincos_n(s, c, radians(a, theta + i, nb, degrees), nb);
+    for (t = 0; t < nb; t++) {
+      c[t] *= r[i + t];
+      s[t] *= r[i + t];
+    }
+    memcpy(x + i, c, nb * sizeof(double));
+    memcpy(y + i, s, nb * sizeof(double));
+  }
+}
+
+void rpn_xy_to_polar_n(double *r, double *theta, const double *x, const double *y,
+		       int n, int degrees)
+{
+  double rr[BLOCK], a[BLOCK];
+  double unit = degrees ? TODEG : 1.0;
+  int i, nb, t;
+
+  for (i = 0; i < n; i += nb) {
+    nb = n - i < BLOCK ? n - i : BLOCK;
+    for (t = 0; t < nb; t++) {
+      rr[t] = sqrt(x[i + t] * x[i + t] + y[i + t] * y[i + t]);
+    }
+    rpn_fast_atan2_n(a, y + i, x + i, nb);
+    for (t = 0; t < nb; t++) {
+      a[t] *= unit;
+    }
+    memcpy(r + i, rr, nb * sizeof(double));
+    memcpy(theta + i, a, nb * sizeof(double));
+  }
+}
+
+void rpn_spherical_to_xyz_n(double *x, double *y, double *z, const double *r,
+			    const double *theta, const double *phi, int n, int degrees)
+{
+  double a[BLOCK], st[BLOCK], ct[BLOCK], sp[BLOCK], cp[BLOCK];
+  int i, nb, t;
+
+  for (i = 0; i < n; i += nb) {
+    nb = n - i < BLOCK ? n - i : BLOCK;
+    rpn_fast_sincos_n(st, ct, radians(a, theta + i, nb, degrees), nb);
+    rpn_fast_sincos_n(sp, cp, radians(a, phi + i, nb, degrees), nb);
+    for (t = 0; t < nb; t++) {
+      st[t] *= r[i + t];
+      ct[t] *= r[i + t];
+      cp[t] *= st[t];
+      sp[t] *= st[t];
+    }
+    memcpy(x + i, cp, nb * sizeof(double));
+    memcpy(y + i, sp, nb * sizeof(double));
+    memcpy(z + i, ct, nb * sizeof(double));
+  }
+}
+
+void rpn_xyz_to_spherical_n(double *r, double *theta, double *phi, const double *x,
+			    const double *y, const double *z, int n, int degrees)
+{
+  double rho[BLOCK], rr[BLOCK], a[BLOCK], b[BLOCK];
+  double unit = degrees ? TODEG : 1.0;
+  int i, nb, t;
+
+  for (i = 0; i < n; i += nb) {
+    nb = n - i < BLOCK ? n - i : BLOCK;
+    for (t = 0; t < nb; t++) {
+      rho[t] = x[i + t] * x[i + t] + y[i + t] * y[i + t];
+      rr[t] = sqrt(rho[t] + z[i + t] * z[i + t]);
+      rho[t] = sqrt(rho[t]);
+    }
+    /* atan2 rather than acos(z / r), which is poor near the poles */
+    rpn_fast_atan2_n(a, rho, z + i, nb);
+    rpn_fast_atan2_n(b, y + i, x + i, nb);
+    for (t = 0; t < nb; t++) {
+      a[t] *= unit;
+      b[t] *= unit;
+    }
+    memcpy(r + i, rr, nb * sizeof(double));
+    memcpy(theta + i, a, nb * sizeof(double));
+    memcpy(phi + i, b, nb * sizeof(double));
+  }
+}
+
+void rpn_xform2_identity(RPN_XFORM2 m)
+{
+  static const RPN_XFORM2 identity = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+
+  memcpy(m, identity, sizeof(RPN_XFORM2));
+}
+
+void rpn_xform2_rotation(RPN_XFORM2 m, double angle)
+{
+  double s = sin(angle), c = cos(angle);
+
+  rpn_xform2_identity(m);
+  m[0] = c, m[1] = -s;
+  m[3] = s, m[4] = c;
+}
+
+void rpn_xform2_translation(RPN_XFORM2 m, double dx, double dy)
+{
+  rpn_xform2_identity(m);
+  m[2] = dx;
+  m[5] = dy;
+}
+
+void rpn_xform2_compose(RPN_XFORM2 m, const RPN_XFORM2 a, const RPN_XFORM2 b)
+{
+  RPN_XFORM2 ab;
+  int i, j;
+
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      ab[3 * i + j] = a[3 * i] * b[j] + a[3 * i + 1] * b[3 + j] + a[3 * i + 2] * b[6 + j];
+    }
+  }
+  memcpy(m, ab, sizeof(RPN_XFORM2));
+}
+
+void rpn_xform2_apply_n(const RPN_XFORM2 m, double *xo, double *yo,
+			const double *x, const double *y, int n)
+{
+  double u[BLOCK], v[BLOCK], w[BLOCK];
+  int affine = m[6] == 0.0 && m[7] == 0.0 && m[8] == 1.0;
+  int i, nb, t;
+
+  for (i = 0; i < n; i += nb) {
+    nb = n - i < BLOCK ? n - i : BLOCK;
+    for (t = 0; t < nb; t++) {
+      u[t] = m[0] * x[i + t] + m[1] * y[i + t] + m[2];
+      v[t] = m[3] * x[i + t] + m[4] * y[i + t] + m[5];
+    }
+    if (! affine) {
+      for (t = 0; t < nb; t++) {
+	w[t] = m[6] * x[i + t] + m[7] * y[i + t] + m[8];
+	u[t] /= w[t];
+	v[t] /= w[t];
+      }
+    }
+    memcpy(xo + i, u, nb * sizeof(double));
+    memcpy(yo + i, v, nb * sizeof(double));
+  }
+}
+
+void rpn_xform3_identity(RPN_XFORM3 m)
+{
+  static const RPN_XFORM3 identity = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+  memcpy(m, identity, sizeof(RPN_XFORM3));
+}
+
+/* Rodrigues': c I + s [k]x + (1 - c) k k', for the unit axis k */
+int rpn_xform3_rotation(RPN_XFORM3 m, double ax, double ay, double az, double angle)
+{
+  double len = sqrt(ax * ax + ay * ay + az * az);
+  double s = sin(angle), c = cos(angle), d = 1.0 - c;
+
+  if (! (len > 0.0)) return RPN_ERROR;
+  ax /= len, ay /= len, az /= len;
+  rpn_xform3_identity(m);
+  m[0] = c + d * ax * ax, m[1] = d * ax * ay - s * az, m[2] = d * ax * az + s * ay;
+  m[4] = d * ay * ax + s * az, m[5] = c + d * ay * ay, m[6] = d * ay * az - s * ax;
+  m[8] = d * az * ax - s * ay, m[9] = d * az * ay + s * ax, m[10] = c + d * az * az;
+
+  return RPN_OK;
+}
+
+void rpn_xform3_translation(RPN_XFORM3 m, double dx, double dy, double dz)
+{
+  rpn_xform3_identity(m);
+  m[3] = dx;
+  m[7] = dy;
+  m[11] = dz;
+}
+
+void rpn_xform3_compose(RPN_XFORM3 m, const RPN_XFORM3 a, const RPN_XFORM3 b)
+{
+  RPN_XFORM3 ab;
+  int i, j;
+
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 4; j++) {
+      ab[4 * i + j] = a[4 * i] * b[j] + a[4 * i + 1] * b[4 + j] +
+	a[4 * i + 2] * b[8 + j] + a[4 * i + 3] * b[12 + j];
+    }
+  }
+  memcpy(m, ab, sizeof(RPN_XFORM3));
+}
+
+void rpn_xform3_apply_n(const RPN_XFORM3 m, double *xo, double *yo, double *zo,
+			const double *x, const double *y, const double *z, int n)
+{
+  double u[BLOCK], v[BLOCK], q[BLOCK], w[BLOCK];
+  int affine = m[12] == 0.0 && m[13] == 0.0 && m[14] == 0.0 && m[15] == 1.0;
+  int i, nb, t;
+
+  for (i = 0; i < n; i += nb) {
+    nb = n - i < BLOCK ? n - i : BLOCK;
+    for (t = 0; t < nb; t++) {
+      u[t] = m[0] * x[i + t] + m[1] * y[i + t] + m[2] * z[i + t] + m[3];
+      v[t] = m[4] * x[i + t] + m[5] * y[i + t] + m[6] * z[i + t] + m[7];
+      q[t] = m[8] * x[i + t] + m[9] * y[i + t] + m[10] * z[i + t] + m[11];
+    }
+    if (! affine) {
+      for (t = 0; t < nb; t++) {
+	w[t] = m[12] * x[i + t] + m[13] * y[i + t] + m[14] * z[i + t] + m[15];
+	u[t] /= w[t];
+	v[t] /= w[t];
+	q[t] /= w[t];
+      }
+    }
+    memcpy(xo + i, u, nb * sizeof(double));
+    memcpy(yo + i, v, nb * sizeof(double));
+    memcpy(zo + i, q, nb * sizeof(double));
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef RPNXFORM_H
+#define RPNXFORM_H
+
+#include "rpncalc.h"		/* RPN_OK, RPN_ERROR */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Coordinate conversions and transforms over whole arrays of points,
+  what toxy and tort do a point at a time, for point clouds of
+  millions. Points are given a coordinate to an array, x[t], y[t] and
+  z[t] being point t, so each loop is over contiguous doubles for the
+  compiler to vectorize (at -O3, or -O2 -ftree-vectorize). Outputs
+  may be the inputs, to convert in place.
+
+  Angles are radians, or degrees if 'degrees' is true, decided once
+  for the array rather than at every point. Sines and cosines come
+  from rpn_fast_sincos_n(), both from one argument reduction, and
+  angles from rpn_fast_atan2_n(), a block at a time; see rpnfast.h
+  for their accuracy.
+
+  Polar (r, theta) is to and from (x, y), theta from the x axis.
+  Cylindrical (r, theta, z) is polar, with z as it is. Spherical
+  (r, theta, phi) is to and from (x, y, z), with theta the polar
+  angle, from the z axis, and phi the azimuth, from the x axis.
+ */
+
+extern void rpn_polar_to_xy_n(double *x, double *y, const double *r, const double *theta,
+			      int n, int degrees);
+extern void rpn_xy_to_polar_n(double *r, double *theta, const double *x, const double *y,
+			      int n, int degrees);
+extern void rpn_spherical_to_xyz_n(double *x, double *y, double *z, const double *r,
+				   const double *theta, const double *phi, int n, int degrees);
+extern void rpn_xyz_to_spherical_n(double *r, double *theta, double *phi, const double *x,
+				   const double *y, const double *z, int n, int degrees);
+
+/*
+  Homogeneous transforms, 3x3 matrices in 2D and 4x4 in 3D, in rows,
+  taking column vectors (x, y, 1) or (x, y, z, 1). The rotations are
+  counterclockwise by 'angle' radians, in 3D about the axis through
+  the origin along (ax, ay, az), which needn't be a unit vector.
+  The axis of a 3D rotation can't be 0, the one error here.
+  rpn_xform*_compose() sets m to a b, the transform that does b and
+  then a; m may be either.
+
+  Applying a transform to points divides by w, the last coordinate,
+  if the last row isn't that of an affine transform, 0 ... 0 1.
+ */
+
+typedef double RPN_XFORM2[9];
+typedef double RPN_XFORM3[16];
+
+extern void rpn_xform2_identity(RPN_XFORM2 m);
+extern void rpn_xform2_rotation(RPN_XFORM2 m, double angle);
+extern void rpn_xform2_translation(RPN_XFORM2 m, double dx, double dy);
+extern void rpn_xform2_compose(RPN_XFORM2 m, const RPN_XFORM2 a, const RPN_XFORM2 b);
+extern void rpn_xform2_apply_n(const RPN_XFORM2 m, double *xo, double *yo,
+			       const double *x, const double *y, int n);
+
+extern void rpn_xform3_identity(RPN_XFORM3 m);
+extern int rpn_xform3_rotation(RPN_XFORM3 m, double ax, double ay, double az, double angle);
+extern void rpn_xform3_translation(RPN_XFORM3 m, double dx, double dy, double dz);
+extern void rpn_xform3_compose(RPN_XFORM3 m, const RPN_XFORM3 a, const RPN_XFORM3 b);
+extern void rpn_xform3_apply_n(const RPN_XFORM3 m, double *xo, double *yo, double *zo,
+			       const double *x, const double *y, const double *z, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RPNXFORM_H */